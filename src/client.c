@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "client_internal.h"
+#include "compact_print.h"
 
 bool client_is_expired(const struct client *client)
 {
@@ -39,3 +40,23 @@ void client_set_permission(struct client *client, unsigned permission)
 {
 	client->permission = permission;
 }
+
+struct compact_dict *
+client_get_compact(const struct client *client)
+{
+	return client->compact;
+}
+
+void
+client_set_compact(struct client *client, bool enable)
+{
+	if (client->compact != NULL) {
+		compact_dict_free(client->compact);
+		client->compact = NULL;
+	}
+
+	if (enable)
+		/* start with an empty dictionary, because the client
+		   has to start over, too */
+		client->compact = compact_dict_new();
+}
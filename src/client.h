@@ -28,6 +28,7 @@
 struct client;
 struct sockaddr;
 struct player_control;
+struct compact_dict;
 
 void client_manager_init(void);
 void client_manager_deinit(void);
@@ -61,6 +62,26 @@ unsigned client_get_permission(const struct client *client);
 
 void client_set_permission(struct client *client, unsigned permission);
 
+/**
+ * Returns the string dictionary of the compact protocol mode, or NULL
+ * if the client has not enabled it with "binarymode".
+ */
+G_GNUC_PURE
+struct compact_dict *
+client_get_compact(const struct client *client);
+
+/**
+ * Enables or disables the compact protocol mode.  Enabling it always
+ * starts with an empty dictionary.
+ */
+void
+client_set_compact(struct client *client, bool enable);
+
+/**
+ * Write a block of (possibly binary) data to the client.
+ */
+void client_write(struct client *client, const char *buffer, size_t buflen);
+
 /**
  * Write a C string to the client.
  */
@@ -21,6 +21,8 @@
 #include "client_idle.h"
 #include "client_internal.h"
 #include "idle.h"
+#include "playlist.h"
+#include "playlist_print.h"
 
 #include <assert.h>
 
@@ -47,6 +49,19 @@ client_idle_notify(struct client *client)
 				      idle_names[i]);
 	}
 
+	if ((flags & IDLE_PLAYLIST & client->idle_subscriptions) &&
+	    client->idle_playlist_version != 0) {
+		/* push the queue delta, so the client doesn't need to
+		   send "plchangesposid" */
+		client_printf(client, "playlist: %lu\nplaylistlength: %i\n",
+			      playlist_get_version(&g_playlist),
+			      playlist_get_length(&g_playlist));
+		playlist_print_changes_position(client, &g_playlist,
+						client->idle_playlist_version);
+		client->idle_playlist_version =
+			playlist_get_version(&g_playlist);
+	}
+
 	client_puts(client, "OK\n");
 	g_timer_start(client->last_activity);
 }
@@ -24,6 +24,8 @@
 #include "client_message.h"
 #include "command.h"
 
+#include <stdint.h>
+
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "client"
 
@@ -61,6 +63,11 @@ struct client {
 	size_t cmd_list_size;	/* mem cmd_list consumes */
 	GQueue *deferred_send;	/* for output if client is slow */
 	size_t deferred_bytes;	/* mem deferred_send consumes */
+
+	/** the number of (uncompressed) bytes passed to
+	    client_write(); used for command statistics */
+	uint64_t output_bytes;
+
 	unsigned int num;	/* client number */
 
 	char send_buf[16384];
@@ -69,6 +76,37 @@ struct client {
 	/** is this client waiting for an "idle" response? */
 	bool idle_waiting;
 
+	/**
+	 * The string dictionary of the compact protocol mode, or NULL
+	 * if the client hasn't enabled "binarymode".
+	 */
+	struct compact_dict *compact;
+
+#ifdef ENABLE_ZLIB
+	/**
+	 * The deflate stream which compresses all output, or NULL if
+	 * the client hasn't enabled compression.
+	 */
+	struct z_stream_s *deflate;
+
+	/**
+	 * A deflate stream which has been set up by "compress"; it
+	 * becomes #deflate as soon as the current response has been
+	 * sent.
+	 */
+	struct z_stream_s *deflate_next;
+
+	/**
+	 * Flush the deflate stream after this many uncompressed
+	 * bytes, even in the middle of a response.  0 means the
+	 * stream is only flushed at the end of each response.
+	 */
+	size_t deflate_flush_size;
+
+	/** uncompressed bytes since the last flush */
+	size_t deflate_pending;
+#endif
+
 	/** idle flags pending on this client, to be sent as soon as
 	    the client enters "idle" */
 	unsigned idle_flags;
@@ -76,6 +114,13 @@ struct client {
 	/** idle flags that the client wants to receive */
 	unsigned idle_subscriptions;
 
+	/**
+	 * If non-zero, the client has enabled queue deltas with
+	 * "idleplchanges": the changes since this playlist version
+	 * are sent along with the "playlist" idle event.
+	 */
+	uint32_t idle_playlist_version;
+
 	/**
 	 * A list of channel names this client is subscribed to.
 	 */
@@ -168,6 +213,23 @@ client_write_deferred(struct client *client);
 void
 client_write_output(struct client *client);
 
+#ifdef ENABLE_ZLIB
+/**
+ * Enables deflate compression of all output to this client.  It
+ * takes effect after the current response.
+ *
+ * @param level the zlib compression level (1..9)
+ * @param flush_size see client.deflate_flush_size
+ * @return false if zlib failed to initialize
+ */
+bool
+client_enable_compression(struct client *client, int level,
+			  size_t flush_size);
+
+void
+client_deinit_compression(struct client *client);
+#endif
+
 gboolean
 client_in_event(GIOChannel *source, GIOCondition condition,
 		gpointer data);
@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "client_internal.h"
+#include "compact_print.h"
 #include "fd_util.h"
 #include "fifo_buffer.h"
 #include "resolver.h"
@@ -159,6 +160,13 @@ client_close(struct client *client)
 
 	fifo_buffer_free(client->input);
 
+	if (client->compact != NULL)
+		compact_dict_free(client->compact);
+
+#ifdef ENABLE_ZLIB
+	client_deinit_compression(client);
+#endif
+
 	g_log(G_LOG_DOMAIN, LOG_LEVEL_SECURE,
 	      "[%u] closed", client->num);
 	g_free(client);
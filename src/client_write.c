@@ -24,6 +24,10 @@
 #include <string.h>
 #include <stdio.h>
 
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
 static size_t
 client_write_deferred_buffer(struct client *client,
 			     const struct deferred_buffer *buffer)
@@ -180,15 +184,15 @@ static void client_write_direct(struct client *client,
 		g_debug("[%u] buffer created", client->num);
 }
 
-void
-client_write_output(struct client *client)
+/**
+ * Send a block of data to the client, or append it to the deferred
+ * buffer list if the socket is not ready.
+ */
+static void
+client_write_raw(struct client *client, const char *data, size_t length)
 {
-	if (client_is_expired(client) || !client->send_buf_used)
-		return;
-
 	if (!g_queue_is_empty(client->deferred_send)) {
-		client_defer_output(client, client->send_buf,
-				    client->send_buf_used);
+		client_defer_output(client, data, length);
 
 		if (client_is_expired(client))
 			return;
@@ -202,21 +206,151 @@ client_write_output(struct client *client)
 		   This should be optimized after MPD 0.14. */
 		client_write_deferred(client);
 	} else
-		client_write_direct(client, client->send_buf,
-				    client->send_buf_used);
+		client_write_direct(client, data, length);
+}
 
-	client->send_buf_used = 0;
+#ifdef ENABLE_ZLIB
+
+bool
+client_enable_compression(struct client *client, int level,
+			  size_t flush_size)
+{
+	assert(client->deflate == NULL);
+	assert(client->deflate_next == NULL);
+
+	z_stream *z = g_new0(z_stream, 1);
+	if (deflateInit(z, level) != Z_OK) {
+		g_free(z);
+		return false;
+	}
+
+	/* activated by client_write_output() after the current
+	   response has been sent uncompressed */
+	client->deflate_next = z;
+	client->deflate_flush_size = flush_size;
+	client->deflate_pending = 0;
+	return true;
+}
+
+void
+client_deinit_compression(struct client *client)
+{
+	if (client->deflate != NULL) {
+		deflateEnd(client->deflate);
+		g_free(client->deflate);
+	}
+
+	if (client->deflate_next != NULL) {
+		deflateEnd(client->deflate_next);
+		g_free(client->deflate_next);
+	}
+}
+
+/**
+ * Feed data into the client's deflate stream and send the compressed
+ * output.
+ *
+ * @param end_of_response true if this is the end of a response; the
+ * stream is flushed so the client can decode all of it
+ */
+static void
+client_write_deflate(struct client *client, const char *data, size_t length,
+		     bool end_of_response)
+{
+	z_stream *z = client->deflate;
+	int flush = Z_NO_FLUSH;
+	unsigned char buffer[4096];
+
+	client->deflate_pending += length;
+	if (end_of_response ||
+	    (client->deflate_flush_size > 0 &&
+	     client->deflate_pending >= client->deflate_flush_size)) {
+		flush = Z_SYNC_FLUSH;
+		client->deflate_pending = 0;
+	}
+
+	z->next_in = (Bytef *)data;
+	z->avail_in = length;
+
+	do {
+		z->next_out = buffer;
+		z->avail_out = sizeof(buffer);
+
+		int ret = deflate(z, flush);
+		if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			g_warning("[%u] deflate() failed: %s", client->num,
+				  z->msg != NULL ? z->msg : "unknown error");
+			client_set_expired(client);
+			return;
+		}
+
+		size_t nbytes = sizeof(buffer) - z->avail_out;
+		if (nbytes > 0)
+			client_write_raw(client, (const char *)buffer, nbytes);
+	} while (z->avail_out == 0 && !client_is_expired(client));
+
+	assert(client_is_expired(client) || z->avail_in == 0);
 }
 
+#endif
+
 /**
- * Write a block of data to the client.
+ * Send the contents of #send_buf to the client.
+ *
+ * @param end_of_response true if a response is complete; false if
+ * the buffer is only flushed because it is full
  */
-static void client_write(struct client *client, const char *buffer, size_t buflen)
+static void
+client_flush_send_buf(struct client *client, bool end_of_response)
+{
+	if (client_is_expired(client))
+		return;
+
+#ifdef ENABLE_ZLIB
+	if (client->deflate != NULL) {
+		if (client->send_buf_used > 0 ||
+		    (end_of_response && client->deflate_pending > 0))
+			client_write_deflate(client, client->send_buf,
+					     client->send_buf_used,
+					     end_of_response);
+
+		client->send_buf_used = 0;
+		return;
+	}
+#else
+	(void)end_of_response;
+#endif
+
+	if (client->send_buf_used == 0)
+		return;
+
+	client_write_raw(client, client->send_buf, client->send_buf_used);
+	client->send_buf_used = 0;
+}
+
+void
+client_write_output(struct client *client)
+{
+	client_flush_send_buf(client, true);
+
+#ifdef ENABLE_ZLIB
+	if (client->deflate_next != NULL && !client_is_expired(client)) {
+		/* the response to "compress" has been sent; all
+		   further output is compressed */
+		client->deflate = client->deflate_next;
+		client->deflate_next = NULL;
+	}
+#endif
+}
+
+void client_write(struct client *client, const char *buffer, size_t buflen)
 {
 	/* if the client is going to be closed, do nothing */
 	if (client_is_expired(client))
 		return;
 
+	client->output_bytes += buflen;
+
 	while (buflen > 0 && !client_is_expired(client)) {
 		size_t copylen;
 
@@ -232,7 +366,7 @@ static void client_write(struct client *client, const char *buffer, size_t bufle
 		client->send_buf_used += copylen;
 		buffer += copylen;
 		if (client->send_buf_used >= sizeof(client->send_buf))
-			client_write_output(client);
+			client_flush_send_buf(client, false);
 	}
 }
 
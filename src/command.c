@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "command.h"
+#include "command_stats.h"
 #include "protocol/argparser.h"
 #include "protocol/result.h"
 #include "player_control.h"
@@ -43,6 +44,7 @@
 #include "output_command.h"
 #include "output_print.h"
 #include "locate.h"
+#include "song_sort.h"
 #include "dbUtils.h"
 #include "db_error.h"
 #include "db_print.h"
@@ -61,6 +63,8 @@
 #include "mapper.h"
 #include "song.h"
 #include "song_print.h"
+#include "song_picture.h"
+#include "conf.h"
 
 #ifdef ENABLE_SQLITE
 #include "sticker.h"
@@ -703,6 +707,54 @@ handle_lsinfo(struct client *client, int argc, char *argv[])
 	return COMMAND_RETURN_OK;
 }
 
+enum {
+	/** the maximum size of one "readpicture" chunk */
+	PICTURE_CHUNK_SIZE = 8192,
+};
+
+static enum command_return
+handle_readpicture(struct client *client,
+		   G_GNUC_UNUSED int argc, char *argv[])
+{
+	unsigned offset;
+	if (!check_unsigned(client, &offset, argv[2]))
+		return COMMAND_RETURN_ERROR;
+
+	struct song *song = db_get_song(argv[1]);
+	if (song == NULL) {
+		command_error(client, ACK_ERROR_NO_EXIST, "No such song");
+		return COMMAND_RETURN_ERROR;
+	}
+
+	if (song->tag == NULL || song->tag->picture_size == 0)
+		/* no embedded picture: empty response */
+		return COMMAND_RETURN_OK;
+
+	char buffer[PICTURE_CHUNK_SIZE];
+	GError *error = NULL;
+	gssize nbytes = song_picture_read_chunk(song, offset,
+						buffer, sizeof(buffer),
+						&error);
+	if (nbytes < 0)
+		return print_error(client, error);
+
+	const size_t length = nbytes;
+
+	client_printf(client, "size: %u\n",
+		      (unsigned)song->tag->picture_size);
+
+	const char *mime = offset == 0
+		? song_picture_mime_type(buffer, length)
+		: NULL;
+	if (mime != NULL)
+		client_printf(client, "type: %s\n", mime);
+
+	client_printf(client, "binary: %u\n", (unsigned)length);
+	client_write(client, buffer, length);
+	client_puts(client, "\n");
+	return COMMAND_RETURN_OK;
+}
+
 static enum command_return
 handle_rm(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
 {
@@ -745,16 +797,99 @@ handle_plchangesposid(struct client *client, G_GNUC_UNUSED int argc, char *argv[
 	return COMMAND_RETURN_OK;
 }
 
+static bool
+is_song_window_keyword(const char *s)
+{
+	return strcmp(s, "sort") == 0 || strcmp(s, "window") == 0;
+}
+
+/**
+ * Returns the number of leading arguments which are song criteria,
+ * i.e. which precede the "sort" and "window" options.
+ */
+static int
+count_locate_criteria(int argc, char *argv[])
+{
+	if (argc > 0 && *argv[0] == '(')
+		/* a filter expression */
+		return 1;
+
+	int i = 0;
+	while (i < argc && !is_song_window_keyword(argv[i]))
+		i += 2;
+
+	return MIN(i, argc);
+}
+
+/**
+ * Parses the options "sort [-]TAG" and "window START:END".
+ */
+static bool
+parse_song_window(struct client *client, struct song_window *window,
+		  int argc, char *argv[])
+{
+	song_window_init(window);
+
+	int i = 0;
+	if (i + 1 < argc && strcmp(argv[i], "sort") == 0) {
+		const char *s = argv[i + 1];
+		window->descending = *s == '-';
+		if (window->descending)
+			++s;
+
+		window->sort = locate_parse_type(s);
+		if (window->sort < 0 || window->sort == LOCATE_TAG_ANY_TYPE) {
+			command_error(client, ACK_ERROR_ARG,
+				      "Unknown sort tag: %s", s);
+			return false;
+		}
+
+		i += 2;
+	}
+
+	if (i + 1 < argc && strcmp(argv[i], "window") == 0) {
+		if (!check_range(client, &window->start, &window->end,
+				 argv[i + 1]))
+			return false;
+
+		if (window->start > window->end) {
+			command_error(client, ACK_ERROR_ARG,
+				      "Bad window: %s", argv[i + 1]);
+			return false;
+		}
+
+		i += 2;
+	}
+
+	if (i != argc) {
+		command_error(client, ACK_ERROR_ARG, "incorrect arguments");
+		return false;
+	}
+
+	return true;
+}
+
 static enum command_return
 handle_playlistinfo(struct client *client, int argc, char *argv[])
 {
 	unsigned start = 0, end = G_MAXUINT;
 	bool ret;
 
-	if (argc == 2 && !check_range(client, &start, &end, argv[1]))
+	/* the options come in pairs; an odd number of arguments
+	   means there is a range */
+	if (argc % 2 == 0 && !check_range(client, &start, &end, argv[1]))
 		return COMMAND_RETURN_ERROR;
 
-	ret = playlist_print_info(client, &g_playlist, start, end);
+	if (argc > 2) {
+		const int n = argc % 2 == 0 ? 2 : 1;
+		struct song_window window;
+		if (!parse_song_window(client, &window, argc - n, argv + n))
+			return COMMAND_RETURN_ERROR;
+
+		ret = playlist_print_info_window(client, &g_playlist,
+						 start, end, &window);
+	} else
+		ret = playlist_print_info(client, &g_playlist, start, end);
 	if (!ret)
 		return print_playlist_result(client,
 					     PLAYLIST_RESULT_BAD_RANGE);
@@ -781,22 +916,47 @@ handle_playlistid(struct client *client, int argc, char *argv[])
 	return COMMAND_RETURN_OK;
 }
 
-static enum command_return
-handle_find(struct client *client, int argc, char *argv[])
+/**
+ * Parses song criteria (see locate_item_list_parse()) and reports
+ * errors to the client.
+ */
+static struct locate_item_list *
+parse_locate_criteria(struct client *client, char *argv[], int argc)
 {
+	GError *error = NULL;
 	struct locate_item_list *list =
-		locate_item_list_parse(argv + 1, argc - 1);
-
-	if (list == NULL || list->length == 0) {
-		if (list != NULL)
-			locate_item_list_free(list);
+		locate_item_list_parse(argv, argc, &error);
+	if (list == NULL) {
+		command_error(client, error->code, "%s", error->message);
+		g_error_free(error);
+		return NULL;
+	}
 
+	if (list->length == 0) {
+		locate_item_list_free(list);
 		command_error(client, ACK_ERROR_ARG, "incorrect arguments");
-		return COMMAND_RETURN_ERROR;
+		return NULL;
 	}
 
+	return list;
+}
+
+static enum command_return
+handle_find(struct client *client, int argc, char *argv[])
+{
+	const int n = count_locate_criteria(argc - 1, argv + 1);
+	struct song_window window;
+	if (!parse_song_window(client, &window, argc - 1 - n, argv + 1 + n))
+		return COMMAND_RETURN_ERROR;
+
+	struct locate_item_list *list =
+		parse_locate_criteria(client, argv + 1, n);
+	if (list == NULL)
+		return COMMAND_RETURN_ERROR;
+
 	GError *error = NULL;
-	enum command_return ret = findSongsIn(client, "", list, &error)
+	enum command_return ret =
+		findSongsIn(client, "", list, &window, &error)
 		? COMMAND_RETURN_OK
 		: print_error(client, error);
 
@@ -809,14 +969,9 @@ static enum command_return
 handle_findadd(struct client *client, int argc, char *argv[])
 {
     struct locate_item_list *list =
-	    locate_item_list_parse(argv + 1, argc - 1);
-    if (list == NULL || list->length == 0) {
-	    if (list != NULL)
-		    locate_item_list_free(list);
-
-	    command_error(client, ACK_ERROR_ARG, "incorrect arguments");
+	    parse_locate_criteria(client, argv + 1, argc - 1);
+    if (list == NULL)
 	    return COMMAND_RETURN_ERROR;
-    }
 
     GError *error = NULL;
     enum command_return ret =
@@ -832,19 +987,19 @@ handle_findadd(struct client *client, int argc, char *argv[])
 static enum command_return
 handle_search(struct client *client, int argc, char *argv[])
 {
-	struct locate_item_list *list =
-		locate_item_list_parse(argv + 1, argc - 1);
-
-	if (list == NULL || list->length == 0) {
-		if (list != NULL)
-			locate_item_list_free(list);
+	const int n = count_locate_criteria(argc - 1, argv + 1);
+	struct song_window window;
+	if (!parse_song_window(client, &window, argc - 1 - n, argv + 1 + n))
+		return COMMAND_RETURN_ERROR;
 
-		command_error(client, ACK_ERROR_ARG, "incorrect arguments");
+	struct locate_item_list *list =
+		parse_locate_criteria(client, argv + 1, n);
+	if (list == NULL)
 		return COMMAND_RETURN_ERROR;
-	}
 
 	GError *error = NULL;
-	enum command_return ret = searchForSongsIn(client, "", list, &error)
+	enum command_return ret =
+		searchForSongsIn(client, "", list, &window, &error)
 		? COMMAND_RETURN_OK
 		: print_error(client, error);
 
@@ -857,15 +1012,9 @@ static enum command_return
 handle_count(struct client *client, int argc, char *argv[])
 {
 	struct locate_item_list *list =
-		locate_item_list_parse(argv + 1, argc - 1);
-
-	if (list == NULL || list->length == 0) {
-		if (list != NULL)
-			locate_item_list_free(list);
-
-		command_error(client, ACK_ERROR_ARG, "incorrect arguments");
+		parse_locate_criteria(client, argv + 1, argc - 1);
+	if (list == NULL)
 		return COMMAND_RETURN_ERROR;
-	}
 
 	GError *error = NULL;
 	enum command_return ret =
@@ -882,15 +1031,9 @@ static enum command_return
 handle_playlistfind(struct client *client, int argc, char *argv[])
 {
 	struct locate_item_list *list =
-		locate_item_list_parse(argv + 1, argc - 1);
-
-	if (list == NULL || list->length == 0) {
-		if (list != NULL)
-			locate_item_list_free(list);
-
-		command_error(client, ACK_ERROR_ARG, "incorrect arguments");
+		parse_locate_criteria(client, argv + 1, argc - 1);
+	if (list == NULL)
 		return COMMAND_RETURN_ERROR;
-	}
 
 	playlist_print_find(client, &g_playlist, list);
 
@@ -903,15 +1046,9 @@ static enum command_return
 handle_playlistsearch(struct client *client, int argc, char *argv[])
 {
 	struct locate_item_list *list =
-		locate_item_list_parse(argv + 1, argc - 1);
-
-	if (list == NULL || list->length == 0) {
-		if (list != NULL)
-			locate_item_list_free(list);
-
-		command_error(client, ACK_ERROR_ARG, "incorrect arguments");
+		parse_locate_criteria(client, argv + 1, argc - 1);
+	if (list == NULL)
 		return COMMAND_RETURN_ERROR;
-	}
 
 	playlist_print_search(client, &g_playlist, list);
 
@@ -1210,8 +1347,9 @@ handle_list(struct client *client, int argc, char *argv[])
 		return COMMAND_RETURN_ERROR;
 	}
 
-	/* for compatibility with < 0.12.0 */
-	if (argc == 3) {
+	/* for compatibility with < 0.12.0 (unless the argument is a
+	   filter expression) */
+	if (argc == 3 && *argv[2] != '(') {
 		if (tagType != TAG_ALBUM) {
 			command_error(client, ACK_ERROR_ARG,
 				      "should be \"%s\" for 3 arguments",
@@ -1219,17 +1357,17 @@ handle_list(struct client *client, int argc, char *argv[])
 			return COMMAND_RETURN_ERROR;
 		}
 
-		locate_item_list_parse(argv + 1, argc - 1);
-
 		conditionals = locate_item_list_new(1);
 		conditionals->items[0].tag = TAG_ARTIST;
 		conditionals->items[0].needle = g_strdup(argv[2]);
 	} else {
+		GError *error = NULL;
 		conditionals =
-			locate_item_list_parse(argv + 2, argc - 2);
+			locate_item_list_parse(argv + 2, argc - 2, &error);
 		if (conditionals == NULL) {
-			command_error(client, ACK_ERROR_ARG,
-				      "not able to parse args");
+			command_error(client, error->code, "%s",
+				      error->message);
+			g_error_free(error);
 			return COMMAND_RETURN_ERROR;
 		}
 	}
@@ -1355,15 +1493,25 @@ handle_seekcur(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
 }
 
 static enum command_return
-handle_listallinfo(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
+handle_listallinfo(struct client *client, int argc, char *argv[])
 {
 	const char *directory = "";
 
-	if (argc == 2)
+	/* the options come in pairs; an odd number of arguments
+	   means there is a directory */
+	if (argc % 2 == 0)
 		directory = argv[1];
 
+	struct song_window window;
+	if (argc > 2) {
+		const int n = argc % 2 == 0 ? 2 : 1;
+		if (!parse_song_window(client, &window, argc - n, argv + n))
+			return COMMAND_RETURN_ERROR;
+	}
+
 	GError *error = NULL;
-	return printInfoForAllIn(client, directory, &error)
+	return printInfoForAllIn(client, directory,
+				 argc > 2 ? &window : NULL, &error)
 		? COMMAND_RETURN_OK
 		: print_error(client, error);
 }
@@ -1478,6 +1626,10 @@ static enum command_return
 handle_commands(struct client *client,
 		G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[]);
 
+static enum command_return
+handle_commandstats(struct client *client,
+		    G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[]);
+
 static enum command_return
 handle_not_commands(struct client *client,
 		    G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[]);
@@ -1603,6 +1755,65 @@ handle_idle(struct client *client,
 	return 1;
 }
 
+static enum command_return
+handle_binarymode(struct client *client,
+		  G_GNUC_UNUSED int argc, char *argv[])
+{
+	bool enable;
+	if (!check_bool(client, &enable, argv[1]))
+		return COMMAND_RETURN_ERROR;
+
+	client_set_compact(client, enable);
+	return COMMAND_RETURN_OK;
+}
+
+#ifdef ENABLE_ZLIB
+static enum command_return
+handle_compress(struct client *client, int argc, char *argv[])
+{
+	unsigned level, flush_size = 0;
+
+	if (!check_unsigned(client, &level, argv[1]))
+		return COMMAND_RETURN_ERROR;
+
+	if (level < 1 || level > 9) {
+		command_error(client, ACK_ERROR_ARG,
+			      "Compression level out of range: %s", argv[1]);
+		return COMMAND_RETURN_ERROR;
+	}
+
+	if (argc == 3 && !check_unsigned(client, &flush_size, argv[2]))
+		return COMMAND_RETURN_ERROR;
+
+	if (client->deflate != NULL || client->deflate_next != NULL) {
+		command_error(client, ACK_ERROR_EXIST,
+			      "compression is already enabled");
+		return COMMAND_RETURN_ERROR;
+	}
+
+	if (!client_enable_compression(client, level, flush_size)) {
+		command_error(client, ACK_ERROR_SYSTEM,
+			      "failed to initialize compression");
+		return COMMAND_RETURN_ERROR;
+	}
+
+	return COMMAND_RETURN_OK;
+}
+#endif
+
+static enum command_return
+handle_idleplchanges(struct client *client,
+		     G_GNUC_UNUSED int argc, char *argv[])
+{
+	uint32_t version;
+
+	if (!check_uint32(client, &version, argv[1]))
+		return COMMAND_RETURN_ERROR;
+
+	client->idle_playlist_version = version;
+	return COMMAND_RETURN_OK;
+}
+
 #ifdef ENABLE_SQLITE
 struct sticker_song_find_data {
 	struct client *client;
@@ -1619,6 +1830,116 @@ sticker_song_find_print_cb(struct song *song, const char *value,
 	sticker_print_value(data->client, data->name, value);
 }
 
+static bool
+parse_sticker_compare(struct client *client, enum sticker_compare *compare_r,
+		      const char *op, const char *value)
+{
+	if (strcmp(op, "=") == 0)
+		*compare_r = STICKER_COMPARE_EQUALS;
+	else if (strcmp(op, "<") == 0)
+		*compare_r = STICKER_COMPARE_LESS;
+	else if (strcmp(op, ">") == 0)
+		*compare_r = STICKER_COMPARE_GREATER;
+	else {
+		int dummy;
+
+		if (strcmp(op, "eq") == 0)
+			*compare_r = STICKER_COMPARE_INT_EQUALS;
+		else if (strcmp(op, "lt") == 0)
+			*compare_r = STICKER_COMPARE_INT_LESS;
+		else if (strcmp(op, "gt") == 0)
+			*compare_r = STICKER_COMPARE_INT_GREATER;
+		else {
+			command_error(client, ACK_ERROR_ARG,
+				      "bad operator: %s", op);
+			return false;
+		}
+
+		if (!check_int(client, &dummy, value))
+			return false;
+	}
+
+	return true;
+}
+
+static bool
+parse_sticker_sort(struct client *client, struct sticker_query *query,
+		   const char *s)
+{
+	query->descending = *s == '-';
+	if (query->descending)
+		++s;
+
+	if (strcmp(s, "uri") == 0)
+		query->sort = STICKER_SORT_URI;
+	else if (strcmp(s, "value") == 0)
+		query->sort = STICKER_SORT_VALUE;
+	else if (strcmp(s, "value_int") == 0)
+		query->sort = STICKER_SORT_VALUE_INT;
+	else {
+		command_error(client, ACK_ERROR_ARG,
+			      "bad sort order: %s", s);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Parses the optional arguments of "sticker find": "[OP VALUE]
+ * [sort [-]uri|value|value_int] [window START:END]".
+ */
+static bool
+parse_sticker_query(struct client *client, struct sticker_query *query,
+		    int argc, char *argv[])
+{
+	query->compare = STICKER_COMPARE_ANY;
+	query->value = NULL;
+	query->sort = STICKER_SORT_NONE;
+	query->descending = false;
+	query->start = 0;
+	query->end = G_MAXUINT;
+
+	int i = 0;
+	if (argc - i >= 2 && strcmp(argv[i], "sort") != 0 &&
+	    strcmp(argv[i], "window") != 0) {
+		if (!parse_sticker_compare(client, &query->compare,
+					   argv[i], argv[i + 1]))
+			return false;
+
+		query->value = argv[i + 1];
+		i += 2;
+	}
+
+	if (argc - i >= 2 && strcmp(argv[i], "sort") == 0) {
+		if (!parse_sticker_sort(client, query, argv[i + 1]))
+			return false;
+
+		i += 2;
+	}
+
+	if (argc - i >= 2 && strcmp(argv[i], "window") == 0) {
+		if (!check_range(client, &query->start, &query->end,
+				 argv[i + 1]))
+			return false;
+
+		if (query->start > query->end) {
+			command_error(client, ACK_ERROR_ARG,
+				      "bad window: %s", argv[i + 1]);
+			return false;
+		}
+
+		i += 2;
+	}
+
+	if (i != argc) {
+		command_error(client, ACK_ERROR_ARG, "bad request");
+		return false;
+	}
+
+	return true;
+}
+
 static enum command_return
 handle_sticker_song(struct client *client, int argc, char *argv[])
 {
@@ -1707,8 +2028,8 @@ handle_sticker_song(struct client *client, int argc, char *argv[])
 		}
 
 		return COMMAND_RETURN_OK;
-	/* find song dir key */
-	} else if (argc == 5 && strcmp(argv[1], "find") == 0) {
+	/* find song dir key [op value] [sort order] [window range] */
+	} else if (argc >= 5 && strcmp(argv[1], "find") == 0) {
 		/* "sticker find song a/directory name" */
 		struct directory *directory;
 		bool success;
@@ -1716,6 +2037,10 @@ handle_sticker_song(struct client *client, int argc, char *argv[])
 			.client = client,
 			.name = argv[4],
 		};
+		struct sticker_query query;
+
+		if (!parse_sticker_query(client, &query, argc - 5, argv + 5))
+			return COMMAND_RETURN_ERROR;
 
 		db_lock();
 		directory = db_get_directory(argv[3]);
@@ -1726,7 +2051,7 @@ handle_sticker_song(struct client *client, int argc, char *argv[])
 			return COMMAND_RETURN_ERROR;
 		}
 
-		success = sticker_song_find(directory, data.name,
+		success = sticker_song_find(directory, data.name, &query,
 					    sticker_song_find_print_cb, &data);
 		db_unlock();
 		if (!success) {
@@ -1745,7 +2070,7 @@ handle_sticker_song(struct client *client, int argc, char *argv[])
 static enum command_return
 handle_sticker(struct client *client, int argc, char *argv[])
 {
-	assert(argc >= 4);
+	assert(argc >= 2);
 
 	if (!sticker_enabled()) {
 		command_error(client, ACK_ERROR_UNKNOWN,
@@ -1753,6 +2078,18 @@ handle_sticker(struct client *client, int argc, char *argv[])
 		return COMMAND_RETURN_ERROR;
 	}
 
+	/* flush */
+	if (argc == 2 && strcmp(argv[1], "flush") == 0) {
+		sticker_flush();
+		return COMMAND_RETURN_OK;
+	}
+
+	if (argc < 4) {
+		command_error(client, ACK_ERROR_ARG,
+			      "too few arguments for \"%s\"", argv[0]);
+		return COMMAND_RETURN_ERROR;
+	}
+
 	if (strcmp(argv[2], "song") == 0)
 		return handle_sticker_song(client, argc, argv);
 	else {
@@ -1937,11 +2274,16 @@ handle_send_message(struct client *client,
 static const struct command commands[] = {
 	{ "add", PERMISSION_ADD, 1, 1, handle_add },
 	{ "addid", PERMISSION_ADD, 1, 2, handle_addid },
+	{ "binarymode", PERMISSION_READ, 1, 1, handle_binarymode },
 	{ "channels", PERMISSION_READ, 0, 0, handle_channels },
 	{ "clear", PERMISSION_CONTROL, 0, 0, handle_clear },
 	{ "clearerror", PERMISSION_CONTROL, 0, 0, handle_clearerror },
 	{ "close", PERMISSION_NONE, -1, -1, handle_close },
 	{ "commands", PERMISSION_NONE, 0, 0, handle_commands },
+	{ "commandstats", PERMISSION_ADMIN, 0, 0, handle_commandstats },
+#ifdef ENABLE_ZLIB
+	{ "compress", PERMISSION_NONE, 1, 2, handle_compress },
+#endif
 	{ "config", PERMISSION_ADMIN, 0, 0, handle_config },
 	{ "consume", PERMISSION_CONTROL, 1, 1, handle_consume },
 	{ "count", PERMISSION_READ, 2, -1, handle_count },
@@ -1955,10 +2297,11 @@ static const struct command commands[] = {
 	{ "find", PERMISSION_READ, 2, -1, handle_find },
 	{ "findadd", PERMISSION_READ, 2, -1, handle_findadd},
 	{ "idle", PERMISSION_READ, 0, -1, handle_idle },
+	{ "idleplchanges", PERMISSION_READ, 1, 1, handle_idleplchanges },
 	{ "kill", PERMISSION_ADMIN, -1, -1, handle_kill },
 	{ "list", PERMISSION_READ, 1, -1, handle_list },
 	{ "listall", PERMISSION_READ, 0, 1, handle_listall },
-	{ "listallinfo", PERMISSION_READ, 0, 1, handle_listallinfo },
+	{ "listallinfo", PERMISSION_READ, 0, 5, handle_listallinfo },
 	{ "listplaylist", PERMISSION_READ, 1, 1, handle_listplaylist },
 	{ "listplaylistinfo", PERMISSION_READ, 1, 1, handle_listplaylistinfo },
 	{ "listplaylists", PERMISSION_READ, 0, 0, handle_listplaylists },
@@ -1982,7 +2325,7 @@ static const struct command commands[] = {
 	{ "playlistdelete", PERMISSION_CONTROL, 2, 2, handle_playlistdelete },
 	{ "playlistfind", PERMISSION_READ, 2, -1, handle_playlistfind },
 	{ "playlistid", PERMISSION_READ, 0, 1, handle_playlistid },
-	{ "playlistinfo", PERMISSION_READ, 0, 1, handle_playlistinfo },
+	{ "playlistinfo", PERMISSION_READ, 0, 5, handle_playlistinfo },
 	{ "playlistmove", PERMISSION_CONTROL, 3, 3, handle_playlistmove },
 	{ "playlistsearch", PERMISSION_READ, 2, -1, handle_playlistsearch },
 	{ "plchanges", PERMISSION_READ, 1, 1, handle_plchanges },
@@ -1992,6 +2335,7 @@ static const struct command commands[] = {
 	{ "prioid", PERMISSION_CONTROL, 2, -1, handle_prioid },
 	{ "random", PERMISSION_CONTROL, 1, 1, handle_random },
 	{ "readmessages", PERMISSION_READ, 0, 0, handle_read_messages },
+	{ "readpicture", PERMISSION_READ, 2, 2, handle_readpicture },
 	{ "rename", PERMISSION_CONTROL, 2, 2, handle_rename },
 	{ "repeat", PERMISSION_CONTROL, 1, 1, handle_repeat },
 	{ "replay_gain_mode", PERMISSION_CONTROL, 1, 1,
@@ -2012,7 +2356,7 @@ static const struct command commands[] = {
 	{ "stats", PERMISSION_READ, 0, 0, handle_stats },
 	{ "status", PERMISSION_READ, 0, 0, handle_status },
 #ifdef ENABLE_SQLITE
-	{ "sticker", PERMISSION_ADMIN, 3, -1, handle_sticker },
+	{ "sticker", PERMISSION_ADMIN, 1, -1, handle_sticker },
 #endif
 	{ "stop", PERMISSION_CONTROL, 0, 0, handle_stop },
 	{ "subscribe", PERMISSION_READ, 1, 1, handle_subscribe },
@@ -2026,6 +2370,22 @@ static const struct command commands[] = {
 
 static const unsigned num_commands = sizeof(commands) / sizeof(commands[0]);
 
+/**
+ * Counters for each entry in #commands.
+ */
+static struct command_stats command_stats[G_N_ELEMENTS(commands)];
+
+/**
+ * Measures the duration of the command being executed.
+ */
+static GTimer *command_timer;
+
+/**
+ * The source id of the periodic statistics dump, or 0 if it is
+ * disabled.
+ */
+static guint command_stats_source_id;
+
 static bool
 command_available(G_GNUC_UNUSED const struct command *cmd)
 {
@@ -2073,6 +2433,70 @@ handle_not_commands(struct client *client,
 	return COMMAND_RETURN_OK;
 }
 
+static void
+print_client_stats(gpointer data, gpointer user_data)
+{
+	const struct client *client = data;
+	struct client *dest = user_data;
+
+	client_printf(dest,
+		      "client: %u\n"
+		      "deferred_bytes: %lu\n"
+		      "idle: %i\n",
+		      client->num,
+		      (unsigned long)client->deferred_bytes,
+		      client->idle_waiting);
+}
+
+static enum command_return
+handle_commandstats(struct client *client,
+		    G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
+{
+	for (unsigned i = 0; i < num_commands; ++i) {
+		const struct command_stats *stats = &command_stats[i];
+		if (stats->count == 0)
+			continue;
+
+		client_printf(client,
+			      "command: %s\n"
+			      "count: %lu\n"
+			      "time_total: %1.6f\n"
+			      "time_p50: %1.6f\n"
+			      "time_p99: %1.6f\n"
+			      "time_max: %1.6f\n"
+			      "bytes: %lu\n",
+			      commands[i].cmd, stats->count,
+			      stats->total_time,
+			      command_stats_percentile(stats, 50),
+			      command_stats_percentile(stats, 99),
+			      stats->max_time,
+			      (unsigned long)stats->bytes);
+	}
+
+	client_list_foreach(print_client_stats, client);
+
+	return COMMAND_RETURN_OK;
+}
+
+static gboolean
+command_stats_timeout(G_GNUC_UNUSED gpointer data)
+{
+	for (unsigned i = 0; i < num_commands; ++i) {
+		const struct command_stats *stats = &command_stats[i];
+		if (stats->count == 0)
+			continue;
+
+		g_message("command %s: count=%lu total=%1.3fs "
+			  "p50=%1.6fs p99=%1.6fs max=%1.6fs bytes=%lu",
+			  commands[i].cmd, stats->count, stats->total_time,
+			  command_stats_percentile(stats, 50),
+			  command_stats_percentile(stats, 99),
+			  stats->max_time, (unsigned long)stats->bytes);
+	}
+
+	return true;
+}
+
 void command_init(void)
 {
 #ifndef NDEBUG
@@ -2080,10 +2504,23 @@ void command_init(void)
 	for (unsigned i = 0; i < num_commands - 1; ++i)
 		assert(strcmp(commands[i].cmd, commands[i + 1].cmd) < 0);
 #endif
+
+	command_timer = g_timer_new();
+
+	unsigned interval =
+		config_get_unsigned(CONF_COMMAND_STATS_INTERVAL, 0);
+	if (interval > 0)
+		command_stats_source_id =
+			g_timeout_add_seconds(interval,
+					      command_stats_timeout, NULL);
 }
 
 void command_finish(void)
 {
+	if (command_stats_source_id != 0)
+		g_source_remove(command_stats_source_id);
+
+	g_timer_destroy(command_timer);
 }
 
 static const struct command *
@@ -2234,9 +2671,17 @@ command_process(struct client *client, unsigned num, char *line)
 
 	cmd = command_checked_lookup(client, client_get_permission(client),
 				     argc, argv);
-	if (cmd)
+	if (cmd) {
+		uint64_t output_bytes = client->output_bytes;
+		g_timer_start(command_timer);
+
 		ret = cmd->handler(client, argc, argv);
 
+		command_stats_add(&command_stats[cmd - commands],
+				  g_timer_elapsed(command_timer, NULL),
+				  client->output_bytes - output_bytes);
+	}
+
 	current_command = NULL;
 	command_list_num = 0;
 
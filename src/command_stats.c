@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "command_stats.h"
+
+#include <assert.h>
+
+void
+command_stats_add(struct command_stats *stats, double duration,
+		  size_t bytes)
+{
+	++stats->count;
+	stats->total_time += duration;
+	if (duration > stats->max_time)
+		stats->max_time = duration;
+	stats->bytes += bytes;
+
+	uint64_t us = duration > 0 ? (uint64_t)(duration * 1000000) : 0;
+	unsigned bucket = 0;
+	while (bucket < COMMAND_STATS_BUCKETS - 1 &&
+	       us >= ((uint64_t)1 << bucket))
+		++bucket;
+
+	++stats->histogram[bucket];
+}
+
+double
+command_stats_percentile(const struct command_stats *stats,
+			 unsigned percent)
+{
+	assert(percent > 0 && percent <= 100);
+
+	if (stats->count == 0)
+		return 0;
+
+	/* the number of samples which must be at or below the
+	   percentile (rounded up) */
+	unsigned long threshold = (stats->count * percent + 99) / 100;
+	unsigned long sum = 0;
+
+	for (unsigned i = 0; i < COMMAND_STATS_BUCKETS - 1; ++i) {
+		sum += stats->histogram[i];
+		if (sum >= threshold)
+			return ((uint64_t)1 << i) / 1000000.;
+	}
+
+	/* the last bucket is open-ended */
+	return stats->max_time;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Counters and latency histograms for protocol commands.
+ */
+
+#ifndef MPD_COMMAND_STATS_H
+#define MPD_COMMAND_STATS_H
+
+#include <glib.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+	/**
+	 * The number of latency histogram buckets.  Bucket i counts
+	 * the commands which took less than 2^i microseconds; the
+	 * last one collects all slower commands.
+	 */
+	COMMAND_STATS_BUCKETS = 28,
+};
+
+struct command_stats {
+	/** how often was this command invoked? */
+	unsigned long count;
+
+	/** the total duration of all invocations [s] */
+	double total_time;
+
+	/** the duration of the slowest invocation [s] */
+	double max_time;
+
+	/** the number of response bytes generated */
+	uint64_t bytes;
+
+	unsigned long histogram[COMMAND_STATS_BUCKETS];
+};
+
+/**
+ * Record one invocation of a command.
+ *
+ * @param duration the time it took to execute the command [s]
+ * @param bytes the number of response bytes it has generated
+ */
+void
+command_stats_add(struct command_stats *stats, double duration,
+		  size_t bytes);
+
+/**
+ * Estimates a percentile of the command durations from the
+ * histogram.  The result is the upper bound of the bucket containing
+ * the percentile, i.e. it may be up to twice the actual value.
+ *
+ * @param percent the percentile (1..100)
+ * @return the duration [s], or 0 if no command has been recorded
+ */
+G_GNUC_PURE
+double
+command_stats_percentile(const struct command_stats *stats,
+			 unsigned percent);
+
+#endif
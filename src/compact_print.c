@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "compact_print.h"
+#include "client.h"
+#include "song.h"
+#include "directory.h"
+#include "tag.h"
+#include "uri.h"
+#include "mapper.h"
+
+#include <assert.h>
+#include <string.h>
+
+struct compact_dict {
+	/**
+	 * Maps (copied) strings to their index plus one.
+	 */
+	GHashTable *table;
+
+	/** the number of strings in #table */
+	unsigned size;
+};
+
+struct compact_dict *
+compact_dict_new(void)
+{
+	struct compact_dict *dict = g_new(struct compact_dict, 1);
+	dict->table = g_hash_table_new_full(g_str_hash, g_str_equal,
+					    g_free, NULL);
+	dict->size = 0;
+	return dict;
+}
+
+void
+compact_dict_free(struct compact_dict *dict)
+{
+	g_hash_table_destroy(dict->table);
+	g_free(dict);
+}
+
+static void
+compact_append_varint(GByteArray *record, uint64_t value)
+{
+	uint8_t buffer[10];
+	unsigned length = 0;
+
+	do {
+		uint8_t byte = value & 0x7f;
+		value >>= 7;
+		if (value != 0)
+			byte |= 0x80;
+		buffer[length++] = byte;
+	} while (value != 0);
+
+	g_byte_array_append(record, buffer, length);
+}
+
+void
+compact_append_uint(GByteArray *record, uint8_t code, uint64_t value)
+{
+	g_byte_array_append(record, &code, 1);
+	compact_append_varint(record, value);
+}
+
+void
+compact_append_string(GByteArray *record, struct compact_dict *dict,
+		      uint8_t code, const char *value)
+{
+	g_byte_array_append(record, &code, 1);
+
+	if (dict != NULL) {
+		gpointer index = g_hash_table_lookup(dict->table, value);
+		if (index != NULL) {
+			compact_append_varint(record,
+					      (uint64_t)(GPOINTER_TO_UINT(index) - 1) << 1);
+			return;
+		}
+
+		if (dict->size < COMPACT_DICT_MAX)
+			/* the client adds this literal to its copy of
+			   the dictionary, too */
+			g_hash_table_insert(dict->table, g_strdup(value),
+					    GUINT_TO_POINTER(++dict->size));
+	}
+
+	size_t length = strlen(value);
+	compact_append_varint(record, ((uint64_t)length << 1) | 1);
+	g_byte_array_append(record, (const guint8 *)value, length);
+}
+
+static void
+compact_append_uri(GByteArray *record, struct compact_dict *dict,
+		   const struct song *song)
+{
+	if (song_in_database(song) && !directory_is_root(song->parent)) {
+		compact_append_string(record, dict, COMPACT_DIRECTORY,
+				      directory_get_path(song->parent));
+		compact_append_string(record, NULL, COMPACT_FILE, song->uri);
+	} else {
+		char *allocated;
+		const char *uri;
+
+		uri = allocated = uri_remove_auth(song->uri);
+		if (uri == NULL)
+			uri = song->uri;
+
+		compact_append_string(record, NULL, COMPACT_FILE,
+				      map_to_relative_path(uri));
+
+		g_free(allocated);
+	}
+}
+
+void
+compact_append_song(GByteArray *record, struct compact_dict *dict,
+		    const struct song *song)
+{
+	compact_append_uri(record, dict, song);
+
+	if (song->end_ms > 0) {
+		compact_append_uint(record, COMPACT_RANGE_START,
+				    song->start_ms);
+		compact_append_uint(record, COMPACT_RANGE_END, song->end_ms);
+	} else if (song->start_ms > 0)
+		compact_append_uint(record, COMPACT_RANGE_START,
+				    song->start_ms);
+
+	if (song->mtime > 0)
+		compact_append_uint(record, COMPACT_LAST_MODIFIED,
+				    song->mtime);
+
+	const struct tag *tag = song->tag;
+	if (tag == NULL)
+		return;
+
+	if (tag->time >= 0)
+		compact_append_uint(record, COMPACT_TIME, tag->time);
+
+	for (unsigned i = 0; i < tag->num_items; i++)
+		compact_append_string(record, dict, tag->items[i]->type,
+				      tag->items[i]->value);
+}
+
+void
+compact_send(struct client *client, GByteArray *record)
+{
+	client_printf(client, "binary: %u\n", record->len);
+	client_write(client, (const char *)record->data, record->len);
+	client_puts(client, "\n");
+
+	g_byte_array_set_size(record, 0);
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The "compact" protocol mode: song information is sent as binary
+ * length-prefixed records instead of text "key: value" lines.  This
+ * is negotiated with the "binarymode" command.
+ *
+ * Each record is sent as a text line "binary: LENGTH", followed by
+ * LENGTH bytes of payload and a newline.  The payload is a sequence
+ * of fields; each field starts with a one-byte code (a #tag_type or
+ * one of #compact_field), followed by the value.  Integer values are
+ * unsigned LEB128 varints.  String values start with a varint
+ * header: if its lowest bit is set, a literal string of (header >> 1)
+ * bytes follows; otherwise, (header >> 1) is an index into the
+ * connection's string dictionary.
+ *
+ * The dictionary is empty when "binarymode" gets enabled; each
+ * literal tag value and directory name is appended to it, until
+ * #COMPACT_DICT_MAX entries have been assigned.  File names are
+ * never added.
+ */
+
+#ifndef MPD_COMPACT_PRINT_H
+#define MPD_COMPACT_PRINT_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct client;
+struct song;
+
+enum {
+	/**
+	 * The maximum number of strings in a connection's
+	 * dictionary.
+	 */
+	COMPACT_DICT_MAX = 65536,
+};
+
+/**
+ * Field codes which are not tag types.  Tag types are encoded as
+ * their #tag_type value.
+ */
+enum compact_field {
+	/** the file name; preceded by #COMPACT_DIRECTORY for songs
+	    in a (non-root) database directory */
+	COMPACT_FILE = 0x80,
+
+	/** the directory containing the following #COMPACT_FILE */
+	COMPACT_DIRECTORY = 0x81,
+
+	/** the duration in seconds */
+	COMPACT_TIME = 0x82,
+
+	/** modification time (seconds since the epoch) */
+	COMPACT_LAST_MODIFIED = 0x83,
+
+	/** start of the song range in milliseconds */
+	COMPACT_RANGE_START = 0x84,
+
+	/** end of the song range in milliseconds */
+	COMPACT_RANGE_END = 0x85,
+
+	/** position in the queue */
+	COMPACT_POS = 0x86,
+
+	/** queue id */
+	COMPACT_ID = 0x87,
+
+	/** queue priority */
+	COMPACT_PRIO = 0x88,
+};
+
+/**
+ * A per-connection dictionary which maps strings to numbers.
+ */
+struct compact_dict;
+
+G_GNUC_MALLOC
+struct compact_dict *
+compact_dict_new(void);
+
+void
+compact_dict_free(struct compact_dict *dict);
+
+void
+compact_append_uint(GByteArray *record, uint8_t code, uint64_t value);
+
+/**
+ * Appends a string field.
+ *
+ * @param dict the dictionary which is used to look up the value and
+ * to which new values are added; NULL means the value is always sent
+ * literally (e.g. for unique values like file names)
+ */
+void
+compact_append_string(GByteArray *record, struct compact_dict *dict,
+		      uint8_t code, const char *value);
+
+/**
+ * Appends all fields describing the song (the equivalent of
+ * song_print_info()).
+ */
+void
+compact_append_song(GByteArray *record, struct compact_dict *dict,
+		    const struct song *song);
+
+/**
+ * Sends a record to the client and clears it.
+ */
+void
+compact_send(struct client *client, GByteArray *record);
+
+#endif
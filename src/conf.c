@@ -56,6 +56,9 @@ static struct config_entry config_entries[] = {
 	{ .name = CONF_FOLLOW_OUTSIDE_SYMLINKS, false, false },
 	{ .name = CONF_DB_FILE, false, false },
 	{ .name = CONF_STICKER_FILE, false, false },
+	{ .name = CONF_TAG_CACHE_FILE, false, false },
+	{ .name = CONF_PICTURE_CACHE_DIR, false, false },
+	{ .name = CONF_PICTURE_CACHE_SIZE, false, false },
 	{ .name = CONF_LOG_FILE, false, false },
 	{ .name = CONF_PID_FILE, false, false },
 	{ .name = CONF_STATE_FILE, false, false },
@@ -89,6 +92,7 @@ static struct config_entry config_entries[] = {
 	{ .name = CONF_MAX_PLAYLIST_LENGTH, false, false },
 	{ .name = CONF_MAX_COMMAND_LIST_SIZE, false, false },
 	{ .name = CONF_MAX_OUTPUT_BUFFER_SIZE, false, false },
+	{ .name = CONF_COMMAND_STATS_INTERVAL, false, false },
 	{ .name = CONF_FS_CHARSET, false, false },
 	{ .name = CONF_ID3V1_ENCODING, false, false },
 	{ .name = CONF_METADATA_TO_USE, false, false },
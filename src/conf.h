@@ -29,6 +29,9 @@
 #define CONF_FOLLOW_OUTSIDE_SYMLINKS    "follow_outside_symlinks"
 #define CONF_DB_FILE                    "db_file"
 #define CONF_STICKER_FILE               "sticker_file"
+#define CONF_TAG_CACHE_FILE             "tag_cache_file"
+#define CONF_PICTURE_CACHE_DIR          "picture_cache_directory"
+#define CONF_PICTURE_CACHE_SIZE         "picture_cache_size"
 #define CONF_LOG_FILE                   "log_file"
 #define CONF_PID_FILE                   "pid_file"
 #define CONF_STATE_FILE                 "state_file"
@@ -62,6 +65,7 @@
 #define CONF_MAX_PLAYLIST_LENGTH        "max_playlist_length"
 #define CONF_MAX_COMMAND_LIST_SIZE      "max_command_list_size"
 #define CONF_MAX_OUTPUT_BUFFER_SIZE     "max_output_buffer_size"
+#define CONF_COMMAND_STATS_INTERVAL     "command_stats_interval"
 #define CONF_FS_CHARSET                 "filesystem_charset"
 #define CONF_ID3V1_ENCODING             "id3v1_encoding"
 #define CONF_METADATA_TO_USE            "metadata_to_use"
@@ -27,6 +27,7 @@
 #include "client.h"
 #include "song.h"
 #include "song_print.h"
+#include "song_sort.h"
 #include "playlist_vector.h"
 #include "tag.h"
 #include "strset.h"
@@ -164,8 +165,73 @@ db_selection_print(struct client *client, const struct db_selection *selection,
 struct search_data {
 	struct client *client;
 	const struct locate_item_list *criteria;
+	const struct song_window *window;
+
+	/** the number of matching songs so far */
+	unsigned n;
+
+	/**
+	 * Collects the matching songs if the result shall be
+	 * sorted; NULL otherwise.
+	 */
+	GPtrArray *songs;
 };
 
+/**
+ * Handles a matching song: print it right away if it is inside the
+ * window, or remember it for sorting.
+ */
+static void
+search_data_add(struct search_data *data, struct song *song)
+{
+	if (data->songs != NULL)
+		g_ptr_array_add(data->songs, song);
+	else if (song_window_contains(data->window, data->n++))
+		song_print_info(data->client, song);
+}
+
+static void
+print_sorted_songs(struct client *client, GPtrArray *songs,
+		   const struct song_window *window)
+{
+	unsigned *indexes =
+		song_sort_indexes((struct song *const*)songs->pdata,
+				  songs->len, window->sort,
+				  window->descending);
+
+	const unsigned end = MIN(window->end, songs->len);
+	for (unsigned i = window->start; i < end; ++i)
+		song_print_info(client,
+				g_ptr_array_index(songs, indexes[i]));
+
+	g_free(indexes);
+}
+
+/**
+ * Walks the database, and prints the songs accepted by the visitor
+ * (which calls search_data_add()) according to the window.
+ */
+static bool
+search_walk(const char *name, const struct db_visitor *visitor,
+	    struct search_data *data, GError **error_r)
+{
+	data->n = 0;
+	data->songs = song_window_is_sorted(data->window)
+		? g_ptr_array_new()
+		: NULL;
+
+	bool success = db_walk(name, visitor, data, error_r);
+
+	if (data->songs != NULL) {
+		if (success)
+			print_sorted_songs(data->client, data->songs,
+					   data->window);
+		g_ptr_array_free(data->songs, true);
+	}
+
+	return success;
+}
+
 static bool
 search_visitor_song(struct song *song, void *_data,
 		    G_GNUC_UNUSED GError **error_r)
@@ -173,7 +239,7 @@ search_visitor_song(struct song *song, void *_data,
 	struct search_data *data = _data;
 
 	if (locate_song_search(song, data->criteria))
-		song_print_info(data->client, song);
+		search_data_add(data, song);
 
 	return true;
 }
@@ -185,6 +251,7 @@ static const struct db_visitor search_visitor = {
 bool
 searchForSongsIn(struct client *client, const char *name,
 		 const struct locate_item_list *criteria,
+		 const struct song_window *window,
 		 GError **error_r)
 {
 	struct locate_item_list *new_list
@@ -193,8 +260,9 @@ searchForSongsIn(struct client *client, const char *name,
 
 	data.client = client;
 	data.criteria = new_list;
+	data.window = window;
 
-	bool success = db_walk(name, &search_visitor, &data, error_r);
+	bool success = search_walk(name, &search_visitor, &data, error_r);
 
 	locate_item_list_free(new_list);
 
@@ -208,7 +276,7 @@ find_visitor_song(struct song *song, void *_data,
 	struct search_data *data = _data;
 
 	if (locate_song_match(song, data->criteria))
-		song_print_info(data->client, song);
+		search_data_add(data, song);
 
 	return true;
 }
@@ -220,16 +288,30 @@ static const struct db_visitor find_visitor = {
 bool
 findSongsIn(struct client *client, const char *name,
 	    const struct locate_item_list *criteria,
+	    const struct song_window *window,
 	    GError **error_r)
 {
 	struct search_data data;
 
 	data.client = client;
 	data.criteria = criteria;
+	data.window = window;
 
-	return db_walk(name, &find_visitor, &data, error_r);
+	return search_walk(name, &find_visitor, &data, error_r);
 }
 
+static bool
+all_visitor_song(struct song *song, void *data,
+		 G_GNUC_UNUSED GError **error_r)
+{
+	search_data_add(data, song);
+	return true;
+}
+
+static const struct db_visitor all_visitor = {
+	.song = all_visitor_song,
+};
+
 static void printSearchStats(struct client *client, SearchStats *stats)
 {
 	client_printf(client, "songs: %i\n", stats->numberOfSongs);
@@ -282,8 +364,21 @@ printAllIn(struct client *client, const char *uri_utf8, GError **error_r)
 
 bool
 printInfoForAllIn(struct client *client, const char *uri_utf8,
+		  const struct song_window *window,
 		  GError **error_r)
 {
+	if (window != NULL) {
+		/* only songs can be sorted and windowed; directories
+		   and playlists are omitted */
+		struct search_data data;
+
+		data.client = client;
+		data.criteria = NULL;
+		data.window = window;
+
+		return search_walk(uri_utf8, &all_visitor, &data, error_r);
+	}
+
 	struct db_selection selection;
 	db_selection_init(&selection, uri_utf8, true);
 	return db_selection_print(client, &selection, true, error_r);
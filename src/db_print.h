@@ -29,6 +29,7 @@ struct client;
 struct locate_item_list;
 struct db_selection;
 struct db_visitor;
+struct song_window;
 
 gcc_nonnull(1,2)
 bool
@@ -39,21 +40,28 @@ gcc_nonnull(1,2)
 bool
 printAllIn(struct client *client, const char *uri_utf8, GError **error_r);
 
+/**
+ * @param window if not NULL, print only the songs (no directories
+ * and playlists), sorted and windowed
+ */
 gcc_nonnull(1,2)
 bool
 printInfoForAllIn(struct client *client, const char *uri_utf8,
+		  const struct song_window *window,
 		  GError **error_r);
 
-gcc_nonnull(1,2,3)
+gcc_nonnull(1,2,3,4)
 bool
 searchForSongsIn(struct client *client, const char *name,
 		 const struct locate_item_list *criteria,
+		 const struct song_window *window,
 		 GError **error_r);
 
-gcc_nonnull(1,2,3)
+gcc_nonnull(1,2,3,4)
 bool
 findSongsIn(struct client *client, const char *name,
 	    const struct locate_item_list *criteria,
+	    const struct song_window *window,
 	    GError **error_r);
 
 gcc_nonnull(1,2,3)
@@ -44,7 +44,17 @@
 #define DB_TAG_PREFIX "tag: "
 
 enum {
-	DB_FORMAT = 1,
+	/**
+	 * Format 2 added the "Picture" song attribute, which older
+	 * versions reject as an unknown line.
+	 */
+	DB_FORMAT = 2,
+
+	/**
+	 * The oldest format which can still be loaded.  Format 1
+	 * files just lack the "Picture" lines.
+	 */
+	DB_FORMAT_MIN = 1,
 };
 
 G_GNUC_CONST
@@ -152,7 +162,7 @@ db_load_internal(FILE *fp, struct directory *music_root, GError **error)
 		}
 	}
 
-	if (format != DB_FORMAT) {
+	if (format < DB_FORMAT_MIN || format > DB_FORMAT) {
 		g_set_error(error, db_quark(), 0,
 			    "Database format mismatch, "
 			    "discarding database file");
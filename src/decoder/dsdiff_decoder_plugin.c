@@ -326,14 +326,21 @@ dsdiff_decode_chunk(struct decoder *decoder, struct input_stream *is,
 			now_size = now_frames * frame_size;
 		}
 
-		size_t nbytes = decoder_read(decoder, is, buffer, now_size);
+		size_t nbytes;
+		const void *data = decoder_read_direct(decoder, is, now_size,
+						       &nbytes);
+		if (data == NULL) {
+			nbytes = decoder_read(decoder, is, buffer, now_size);
+			data = buffer;
+		}
+
 		if (nbytes != now_size)
 			return false;
 
 		chunk_size -= nbytes;
 
 		enum decoder_command cmd =
-			decoder_data(decoder, is, buffer, nbytes, 0);
+			decoder_data(decoder, is, data, nbytes, 0);
 		switch (cmd) {
 		case DECODE_COMMAND_NONE:
 			break;
@@ -63,16 +63,24 @@ pcm_stream_decode(struct decoder *decoder, struct input_stream *is)
 
 	do {
 		char buffer[4096];
-
-		size_t nbytes = decoder_read(decoder, is,
-					     buffer, sizeof(buffer));
+		size_t nbytes;
+
+		/* avoid copying if the input stream supports it */
+		const void *data = decoder_read_direct(decoder, is,
+						       sizeof(buffer),
+						       &nbytes);
+		if (data == NULL) {
+			nbytes = decoder_read(decoder, is,
+					      buffer, sizeof(buffer));
+			data = buffer;
+		}
 
 		if (nbytes == 0 && input_stream_lock_eof(is))
 			break;
 
 		cmd = nbytes > 0
 			? decoder_data(decoder, is,
-				       buffer, nbytes, 0)
+				       data, nbytes, 0)
 			: decoder_get_command(decoder);
 		if (cmd == DECODE_COMMAND_SEEK) {
 			goffset offset = (goffset)(time_to_size *
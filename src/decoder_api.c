@@ -300,6 +300,33 @@ size_t decoder_read(struct decoder *decoder,
 	return nbytes;
 }
 
+const void *
+decoder_read_direct(struct decoder *decoder, struct input_stream *is,
+		    size_t length, size_t *length_r)
+{
+	const void *data;
+
+	assert(decoder == NULL ||
+	       decoder->dc->state == DECODE_STATE_START ||
+	       decoder->dc->state == DECODE_STATE_DECODE);
+	assert(is != NULL);
+	assert(length_r != NULL);
+
+	if (length == 0)
+		return NULL;
+
+	input_stream_lock(is);
+
+	data = decoder_check_cancel_read(decoder) ||
+		!input_stream_available(is)
+		? NULL
+		: input_stream_read_direct(is, length, length_r);
+
+	input_stream_unlock(is);
+
+	return data;
+}
+
 void
 decoder_timestamp(struct decoder *decoder, double t)
 {
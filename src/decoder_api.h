@@ -105,6 +105,24 @@ size_t
 decoder_read(struct decoder *decoder, struct input_stream *is,
 	     void *buffer, size_t length);
 
+/**
+ * Zero-copy variant of decoder_read(): returns a pointer into the
+ * input stream (e.g. a memory mapped file) instead of copying to a
+ * caller-supplied buffer.  The data must not be modified, and it
+ * remains valid until the stream is closed.
+ *
+ * If this returns NULL, the caller should fall back to
+ * decoder_read(), which also deals with end of file, I/O errors and
+ * decoder commands.
+ *
+ * @param length the maximum number of bytes to read
+ * @param length_r the number of bytes at the returned pointer
+ * @return a pointer to the data, or NULL
+ */
+const void *
+decoder_read_direct(struct decoder *decoder, struct input_stream *is,
+		    size_t length, size_t *length_r);
+
 /**
  * Sets the time stamp for the next data chunk [seconds].  The MPD
  * core automatically counts it up, and a decoder plugin only needs to
@@ -30,12 +30,84 @@
 
 #include <FLAC/stream_encoder.h>
 
+#if defined(FLAC_API_VERSION_CURRENT) && FLAC_API_VERSION_CURRENT > 7
+/* the parallel mode needs FLAC__stream_encoder_init_stream() */
+#define FLAC_ENCODER_THREADS
+#endif
+
+enum {
+	/**
+	 * The number of FLAC blocks in one #flac_job.
+	 */
+	FLAC_JOB_BLOCKS = 16,
+
+	/**
+	 * The maximum number of jobs per worker thread which may be
+	 * in flight before flac_encoder_write() blocks.
+	 */
+	FLAC_JOBS_PER_THREAD = 2,
+};
+
+/**
+ * A chunk of PCM data which is encoded independently by one of the
+ * worker threads.
+ */
+struct flac_job {
+	/**
+	 * The sample number of the first frame of this job within
+	 * the whole stream.
+	 */
+	uint64_t position;
+
+	/**
+	 * The position of the next FLAC frame emitted by the worker.
+	 */
+	uint64_t next_position;
+
+	/**
+	 * Interleaved samples in libFLAC's 32 bit format.
+	 */
+	int32_t *samples;
+
+	unsigned num_frames;
+
+	/**
+	 * The encoded FLAC frames, renumbered to #position.  Filled
+	 * by the worker thread.
+	 */
+	GByteArray *output;
+
+	/**
+	 * Set by the worker thread when #output is complete.
+	 */
+	bool done;
+
+	/**
+	 * Set by the worker thread if libFLAC has failed.
+	 */
+	bool error;
+};
+
+struct flac_worker {
+	struct flac_encoder *encoder;
+
+	FLAC__StreamEncoder *fse;
+
+	GThread *thread;
+};
+
 struct flac_encoder {
 	struct encoder encoder;
 
 	struct audio_format audio_format;
 	unsigned compression;
 
+	/**
+	 * The number of worker threads from the "threads" setting.
+	 * If this is 1, then libFLAC runs in the caller's thread.
+	 */
+	unsigned threads;
+
 	FLAC__StreamEncoder *fse;
 
 	struct pcm_buffer expand_buffer;
@@ -45,6 +117,59 @@ struct flac_encoder {
 	 * picked up with flac_encoder_read().
 	 */
 	struct fifo_buffer *output_buffer;
+
+	/* the following attributes are only used when #threads is
+	   greater than 1 */
+
+	/**
+	 * The number of frames in one #flac_job.  This is a multiple
+	 * of libFLAC's block size.
+	 */
+	unsigned job_frames;
+
+	/**
+	 * The sample size passed to flac_encoder_setup() by the
+	 * worker threads.
+	 */
+	unsigned bits_per_sample;
+
+	struct flac_worker *workers;
+
+	/**
+	 * Protects #queue, #pending, #quit and the "done" flags of
+	 * all jobs.
+	 */
+	GMutex *mutex;
+
+	/**
+	 * Signalled when a job is submitted, when a worker has
+	 * finished a job, and when the workers shall quit.
+	 */
+	GCond *cond;
+
+	/**
+	 * Jobs waiting for a worker thread.
+	 */
+	GQueue *queue;
+
+	/**
+	 * All submitted jobs which have not been collected yet, in
+	 * stream order.
+	 */
+	GQueue *pending;
+
+	/**
+	 * The job which is currently being filled by
+	 * flac_encoder_write().
+	 */
+	struct flac_job *current;
+
+	/**
+	 * The sample number of the first frame of #current.
+	 */
+	uint64_t position;
+
+	bool quit;
 };
 
 extern const struct encoder_plugin flac_encoder_plugin;
@@ -58,11 +183,28 @@ flac_encoder_quark(void)
 
 static bool
 flac_encoder_configure(struct flac_encoder *encoder,
-		const struct config_param *param, G_GNUC_UNUSED GError **error)
+		const struct config_param *param, GError **error)
 {
 	encoder->compression = config_get_block_unsigned(param,
 						"compression", 5);
 
+	encoder->threads = config_get_block_unsigned(param, "threads", 1);
+	if (encoder->threads == 0 || encoder->threads > 64) {
+		g_set_error(error, flac_encoder_quark(), 0,
+			    "Invalid number of threads at line %i",
+			    param->line);
+		return false;
+	}
+
+#ifndef FLAC_ENCODER_THREADS
+	if (encoder->threads > 1) {
+		g_set_error(error, flac_encoder_quark(), 0,
+			    "The \"threads\" setting requires libFLAC 1.1.3 "
+			    "or newer (line %i)", param->line);
+		return false;
+	}
+#endif
+
 	return true;
 }
 
@@ -95,12 +237,12 @@ flac_encoder_finish(struct encoder *_encoder)
 }
 
 static bool
-flac_encoder_setup(struct flac_encoder *encoder, unsigned bits_per_sample,
-		   GError **error)
+flac_encoder_setup(struct flac_encoder *encoder, FLAC__StreamEncoder *fse,
+		   unsigned bits_per_sample, GError **error)
 {
 #if !defined(FLAC_API_VERSION_CURRENT) || FLAC_API_VERSION_CURRENT <= 7
 #else
-	if ( !FLAC__stream_encoder_set_compression_level(encoder->fse,
+	if ( !FLAC__stream_encoder_set_compression_level(fse,
 					encoder->compression)) {
 		g_set_error(error, flac_encoder_quark(), 0,
 			    "error setting flac compression to %d",
@@ -108,21 +250,21 @@ flac_encoder_setup(struct flac_encoder *encoder, unsigned bits_per_sample,
 		return false;
 	}
 #endif
-	if ( !FLAC__stream_encoder_set_channels(encoder->fse,
+	if ( !FLAC__stream_encoder_set_channels(fse,
 					encoder->audio_format.channels)) {
 		g_set_error(error, flac_encoder_quark(), 0,
 			    "error setting flac channels num to %d",
 			    encoder->audio_format.channels);
 		return false;
 	}
-	if ( !FLAC__stream_encoder_set_bits_per_sample(encoder->fse,
+	if ( !FLAC__stream_encoder_set_bits_per_sample(fse,
 							bits_per_sample)) {
 		g_set_error(error, flac_encoder_quark(), 0,
 			    "error setting flac bit format to %d",
 			    bits_per_sample);
 		return false;
 	}
-	if ( !FLAC__stream_encoder_set_sample_rate(encoder->fse,
+	if ( !FLAC__stream_encoder_set_sample_rate(fse,
 					encoder->audio_format.sample_rate)) {
 		g_set_error(error, flac_encoder_quark(), 0,
 			    "error setting flac sample rate to %d",
@@ -151,11 +293,517 @@ flac_write_callback(G_GNUC_UNUSED const FLAC__StreamEncoder *fse,
 	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
 }
 
+#ifdef FLAC_ENCODER_THREADS
+
+static uint8_t
+flac_crc8(const uint8_t *p, size_t length)
+{
+	uint8_t crc = 0;
+
+	while (length-- > 0) {
+		crc ^= *p++;
+		for (unsigned i = 0; i < 8; ++i)
+			crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+
+	return crc;
+}
+
+static uint16_t
+flac_crc16(const uint8_t *p, size_t length)
+{
+	uint16_t crc = 0;
+
+	while (length-- > 0) {
+		crc ^= *p++ << 8;
+		for (unsigned i = 0; i < 8; ++i)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1;
+	}
+
+	return crc;
+}
+
+/**
+ * Determines the length of the UTF-8 like coded frame/sample number
+ * in a FLAC frame header from its first byte.  Returns 0 if the byte
+ * is malformed.
+ */
+static unsigned
+flac_utf8_length(uint8_t first)
+{
+	if ((first & 0x80) == 0)
+		return 1;
+
+	unsigned n = 0;
+	while (n < 8 && (first & (0x80 >> n)) != 0)
+		++n;
+
+	return n >= 2 && n <= 7 ? n : 0;
+}
+
+static unsigned
+flac_utf8_encode(uint8_t *dest, uint64_t value)
+{
+	unsigned n;
+
+	if (value < 0x80) {
+		dest[0] = value;
+		return 1;
+	} else if (value < 0x800)
+		n = 2;
+	else if (value < 0x10000)
+		n = 3;
+	else if (value < 0x200000)
+		n = 4;
+	else if (value < 0x4000000)
+		n = 5;
+	else if (value < 0x80000000)
+		n = 6;
+	else
+		n = 7;
+
+	for (unsigned i = n - 1; i > 0; --i) {
+		dest[i] = 0x80 | (value & 0x3f);
+		value >>= 6;
+	}
+
+	dest[0] = ((0xff00 >> n) & 0xff) | value;
+	return n;
+}
+
+/**
+ * Appends a FLAC frame emitted by libFLAC to the #GByteArray,
+ * converting it to a "variable block size" frame which begins at the
+ * specified sample number.  The CRCs are recalculated.
+ *
+ * @return false if the frame is malformed
+ */
+static bool
+flac_frame_renumber(GByteArray *dest, const FLAC__byte *src, size_t length,
+		    uint64_t position)
+{
+	if (length < 6 || src[0] != 0xff || (src[1] & 0xfe) != 0xf8)
+		return false;
+
+	const unsigned number_length = flac_utf8_length(src[4]);
+	if (number_length == 0)
+		return false;
+
+	/* the block size and the sample rate may be stored after
+	   the number, depending on their codes */
+	const unsigned block_size_code = src[2] >> 4;
+	const unsigned sample_rate_code = src[2] & 0xf;
+	unsigned extra = 0;
+
+	if (block_size_code == 6)
+		extra += 1;
+	else if (block_size_code == 7)
+		extra += 2;
+
+	if (sample_rate_code == 12)
+		extra += 1;
+	else if (sample_rate_code == 13 || sample_rate_code == 14)
+		extra += 2;
+
+	const size_t old_header_length = 4 + number_length + extra + 1;
+	if (length < old_header_length + 2)
+		return false;
+
+	uint8_t header[4 + 7 + 4 + 1];
+	memcpy(header, src, 4);
+	header[1] |= 0x01; /* blocking strategy: variable */
+
+	size_t header_length = 4 + flac_utf8_encode(header + 4, position);
+	memcpy(header + header_length, src + 4 + number_length, extra);
+	header_length += extra;
+	header[header_length] = flac_crc8(header, header_length);
+	++header_length;
+
+	const guint start = dest->len;
+	g_byte_array_append(dest, header, header_length);
+	g_byte_array_append(dest, src + old_header_length,
+			    length - old_header_length - 2);
+
+	const uint16_t crc = flac_crc16(dest->data + start, dest->len - start);
+	const uint8_t footer[2] = { crc >> 8, crc };
+	g_byte_array_append(dest, footer, sizeof(footer));
+	return true;
+}
+
+static struct flac_job *
+flac_job_new(unsigned num_frames, unsigned channels)
+{
+	struct flac_job *job = g_new(struct flac_job, 1);
+
+	job->samples = g_new(int32_t, num_frames * channels);
+	job->num_frames = 0;
+	job->output = g_byte_array_new();
+	job->done = false;
+	job->error = false;
+
+	return job;
+}
+
+static void
+flac_job_free(struct flac_job *job)
+{
+	g_free(job->samples);
+	g_byte_array_free(job->output, true);
+	g_free(job);
+}
+
+static FLAC__StreamEncoderWriteStatus
+flac_job_write_callback(G_GNUC_UNUSED const FLAC__StreamEncoder *fse,
+			const FLAC__byte data[], size_t bytes,
+			unsigned samples,
+			G_GNUC_UNUSED unsigned current_frame,
+			void *client_data)
+{
+	struct flac_job *job = client_data;
+
+	if (samples == 0)
+		/* metadata: the stream header has already been
+		   generated by flac_encoder_open_threads() */
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+
+	if (!flac_frame_renumber(job->output, data, bytes,
+				 job->next_position))
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+
+	job->next_position += samples;
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+/**
+ * Encodes one job as a separate libFLAC stream.  Runs in a worker
+ * thread.
+ */
+static bool
+flac_job_encode(struct flac_worker *worker, struct flac_job *job)
+{
+	struct flac_encoder *encoder = worker->encoder;
+	FLAC__StreamEncoder *fse = worker->fse;
+
+	job->next_position = job->position;
+
+	/* FLAC__stream_encoder_finish() has reset all settings to
+	   libFLAC's defaults, so they must be applied again for each
+	   job */
+	if (!flac_encoder_setup(encoder, fse, encoder->bits_per_sample,
+				NULL))
+		return false;
+
+	/* the stream header is not updated, so the checksum would be
+	   wasted CPU time */
+	FLAC__stream_encoder_set_do_md5(fse, false);
+
+	if (FLAC__stream_encoder_init_stream(fse, flac_job_write_callback,
+					     NULL, NULL, NULL, job) !=
+	    FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+		return false;
+
+	bool success = FLAC__stream_encoder_process_interleaved(fse,
+								job->samples,
+								job->num_frames);
+
+	/* this encodes the last (possibly short) block, and allows
+	   reinitializing the encoder for the next job */
+	return FLAC__stream_encoder_finish(fse) && success;
+}
+
+static gpointer
+flac_worker_task(gpointer data)
+{
+	struct flac_worker *worker = data;
+	struct flac_encoder *encoder = worker->encoder;
+
+	g_mutex_lock(encoder->mutex);
+
+	while (!encoder->quit) {
+		struct flac_job *job = g_queue_pop_head(encoder->queue);
+		if (job == NULL) {
+			g_cond_wait(encoder->cond, encoder->mutex);
+			continue;
+		}
+
+		g_mutex_unlock(encoder->mutex);
+		bool success = flac_job_encode(worker, job);
+		g_mutex_lock(encoder->mutex);
+
+		job->error = !success;
+		job->done = true;
+		g_cond_broadcast(encoder->cond);
+	}
+
+	g_mutex_unlock(encoder->mutex);
+	return NULL;
+}
+
+/**
+ * Moves the output of all finished jobs at the head of #pending to
+ * #output_buffer, in stream order.  A failed job stays in #pending,
+ * so the error is reported again on the next call.  Caller must
+ * hold the mutex.
+ */
+static bool
+flac_encoder_collect(struct flac_encoder *encoder, GError **error)
+{
+	struct flac_job *job;
+
+	while ((job = g_queue_peek_head(encoder->pending)) != NULL &&
+	       job->done) {
+		if (job->error) {
+			g_set_error(error, flac_encoder_quark(), 0,
+				    "flac encoder process failed");
+			return false;
+		}
+
+		g_queue_pop_head(encoder->pending);
+		growing_fifo_append(&encoder->output_buffer,
+				    job->output->data, job->output->len);
+		flac_job_free(job);
+	}
+
+	return true;
+}
+
+/**
+ * Passes #current to the worker threads.  Blocks while too many jobs
+ * are in flight.
+ */
+static bool
+flac_encoder_submit(struct flac_encoder *encoder, GError **error)
+{
+	struct flac_job *job = encoder->current;
+	bool success;
+
+	encoder->current = NULL;
+	job->position = encoder->position;
+	encoder->position += job->num_frames;
+
+	g_mutex_lock(encoder->mutex);
+
+	g_queue_push_tail(encoder->queue, job);
+	g_queue_push_tail(encoder->pending, job);
+	g_cond_broadcast(encoder->cond);
+
+	while ((success = flac_encoder_collect(encoder, error)) &&
+	       g_queue_get_length(encoder->pending) >
+	       encoder->threads * FLAC_JOBS_PER_THREAD)
+		g_cond_wait(encoder->cond, encoder->mutex);
+
+	g_mutex_unlock(encoder->mutex);
+
+	return success;
+}
+
+/**
+ * Submits the partial #current job, and waits until all jobs have
+ * been collected.
+ */
+static bool
+flac_encoder_drain(struct flac_encoder *encoder, GError **error)
+{
+	bool success;
+
+	if (encoder->current != NULL && encoder->current->num_frames > 0 &&
+	    !flac_encoder_submit(encoder, error))
+		return false;
+
+	g_mutex_lock(encoder->mutex);
+
+	while ((success = flac_encoder_collect(encoder, error)) &&
+	       !g_queue_is_empty(encoder->pending))
+		g_cond_wait(encoder->cond, encoder->mutex);
+
+	g_mutex_unlock(encoder->mutex);
+
+	return success;
+}
+
+static bool
+flac_encoder_write_jobs(struct flac_encoder *encoder,
+			const int32_t *buffer, unsigned num_frames,
+			GError **error)
+{
+	const unsigned channels = encoder->audio_format.channels;
+
+	while (num_frames > 0) {
+		if (encoder->current == NULL)
+			encoder->current = flac_job_new(encoder->job_frames,
+							channels);
+
+		struct flac_job *job = encoder->current;
+		unsigned n = encoder->job_frames - job->num_frames;
+		if (n > num_frames)
+			n = num_frames;
+
+		memcpy(job->samples + job->num_frames * channels, buffer,
+		       n * channels * sizeof(*buffer));
+		job->num_frames += n;
+		buffer += n * channels;
+		num_frames -= n;
+
+		if (job->num_frames == encoder->job_frames &&
+		    !flac_encoder_submit(encoder, error))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Stops all worker threads and frees all jobs.
+ */
+static void
+flac_encoder_stop_workers(struct flac_encoder *encoder)
+{
+	g_mutex_lock(encoder->mutex);
+	encoder->quit = true;
+	g_cond_broadcast(encoder->cond);
+	g_mutex_unlock(encoder->mutex);
+
+	for (unsigned i = 0; i < encoder->threads; ++i) {
+		struct flac_worker *worker = &encoder->workers[i];
+
+		if (worker->thread != NULL)
+			g_thread_join(worker->thread);
+
+		if (worker->fse != NULL)
+			FLAC__stream_encoder_delete(worker->fse);
+	}
+
+	g_free(encoder->workers);
+	encoder->workers = NULL;
+
+	/* all jobs in #queue are also in #pending */
+	struct flac_job *job;
+	while ((job = g_queue_pop_head(encoder->pending)) != NULL)
+		flac_job_free(job);
+
+	if (encoder->current != NULL)
+		flac_job_free(encoder->current);
+
+	g_queue_free(encoder->queue);
+	g_queue_free(encoder->pending);
+	g_cond_free(encoder->cond);
+	g_mutex_free(encoder->mutex);
+}
+
+static FLAC__StreamEncoderWriteStatus
+flac_header_write_callback(G_GNUC_UNUSED const FLAC__StreamEncoder *fse,
+			   const FLAC__byte data[], size_t bytes,
+			   G_GNUC_UNUSED unsigned samples,
+			   G_GNUC_UNUSED unsigned current_frame,
+			   void *client_data)
+{
+	GByteArray *header = client_data;
+
+	g_byte_array_append(header, data, bytes);
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+/**
+ * Generates the stream header with #fse and appends it to
+ * #output_buffer.
+ */
+static bool
+flac_encoder_write_header(struct flac_encoder *encoder, GError **error)
+{
+	GByteArray *header = g_byte_array_new();
+	FLAC__StreamEncoderInitStatus init_status;
+
+	init_status = FLAC__stream_encoder_init_stream(encoder->fse,
+						       flac_header_write_callback,
+						       NULL, NULL, NULL,
+						       header);
+	if (init_status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+		g_set_error(error, flac_encoder_quark(), 0,
+			    "failed to initialize encoder: %s\n",
+			    FLAC__StreamEncoderInitStatusString[init_status]);
+		g_byte_array_free(header, true);
+		return false;
+	}
+
+	(void)FLAC__stream_encoder_finish(encoder->fse);
+
+	/* the last block of each job may be short, therefore the
+	   STREAMINFO block must not announce a fixed block size: set
+	   its "minimum block size" field to the smallest legal
+	   value */
+	if (header->len >= 10 && memcmp(header->data, "fLaC", 4) == 0) {
+		header->data[8] = 0;
+		header->data[9] = 16;
+	}
+
+	growing_fifo_append(&encoder->output_buffer,
+			    header->data, header->len);
+	g_byte_array_free(header, true);
+	return true;
+}
+
+/**
+ * Sets up the parallel mode: each worker thread owns a libFLAC
+ * encoder and encodes whole jobs as independent streams; their
+ * frames are renumbered to form one "variable block size" stream.
+ */
+static bool
+flac_encoder_open_threads(struct flac_encoder *encoder,
+			  unsigned bits_per_sample, GError **error)
+{
+	/* query the configured block size now, because
+	   flac_encoder_write_header() calls
+	   FLAC__stream_encoder_finish(), which resets it */
+	encoder->job_frames = FLAC__stream_encoder_get_blocksize(encoder->fse)
+		* FLAC_JOB_BLOCKS;
+	encoder->bits_per_sample = bits_per_sample;
+
+	if (!flac_encoder_write_header(encoder, error))
+		return false;
+
+	encoder->mutex = g_mutex_new();
+	encoder->cond = g_cond_new();
+	encoder->queue = g_queue_new();
+	encoder->pending = g_queue_new();
+	encoder->current = NULL;
+	encoder->position = 0;
+	encoder->quit = false;
+
+	encoder->workers = g_new0(struct flac_worker, encoder->threads);
+
+	for (unsigned i = 0; i < encoder->threads; ++i) {
+		struct flac_worker *worker = &encoder->workers[i];
+
+		worker->encoder = encoder;
+
+		worker->fse = FLAC__stream_encoder_new();
+		if (worker->fse == NULL) {
+			g_set_error(error, flac_encoder_quark(), 0,
+				    "flac_new() failed");
+			return false;
+		}
+
+		worker->thread = g_thread_create(flac_worker_task, worker,
+						 true, error);
+		if (worker->thread == NULL)
+			return false;
+	}
+
+	return true;
+}
+
+#endif /* FLAC_ENCODER_THREADS */
+
 static void
 flac_encoder_close(struct encoder *_encoder)
 {
 	struct flac_encoder *encoder = (struct flac_encoder *)_encoder;
 
+#ifdef FLAC_ENCODER_THREADS
+	if (encoder->workers != NULL)
+		flac_encoder_stop_workers(encoder);
+#endif
+
 	FLAC__stream_encoder_delete(encoder->fse);
 
 	pcm_buffer_deinit(&encoder->expand_buffer);
@@ -198,7 +846,8 @@ flac_encoder_open(struct encoder *_encoder, struct audio_format *audio_format,
 		return false;
 	}
 
-	if (!flac_encoder_setup(encoder, bits_per_sample, error)) {
+	if (!flac_encoder_setup(encoder, encoder->fse, bits_per_sample,
+				error)) {
 		FLAC__stream_encoder_delete(encoder->fse);
 		return false;
 	}
@@ -206,6 +855,7 @@ flac_encoder_open(struct encoder *_encoder, struct audio_format *audio_format,
 	pcm_buffer_init(&encoder->expand_buffer);
 
 	encoder->output_buffer = growing_fifo_new();
+	encoder->workers = NULL;
 
 	/* this immediately outputs data through callback */
 
@@ -227,6 +877,16 @@ flac_encoder_open(struct encoder *_encoder, struct audio_format *audio_format,
 		}
 	}
 #else
+	if (encoder->threads > 1) {
+		if (!flac_encoder_open_threads(encoder, bits_per_sample,
+					       error)) {
+			flac_encoder_close(_encoder);
+			return false;
+		}
+
+		return true;
+	}
+
 	{
 		FLAC__StreamEncoderInitStatus init_status;
 
@@ -249,10 +909,17 @@ flac_encoder_open(struct encoder *_encoder, struct audio_format *audio_format,
 
 
 static bool
-flac_encoder_flush(struct encoder *_encoder, G_GNUC_UNUSED GError **error)
+flac_encoder_flush(struct encoder *_encoder, GError **error)
 {
 	struct flac_encoder *encoder = (struct flac_encoder *)_encoder;
 
+#ifdef FLAC_ENCODER_THREADS
+	if (encoder->threads > 1)
+		/* unlike libFLAC's finish(), this doesn't end the
+		   stream; it may be continued with more jobs */
+		return flac_encoder_drain(encoder, error);
+#endif
+
 	(void) FLAC__stream_encoder_finish(encoder->fse);
 	return true;
 }
@@ -313,6 +980,12 @@ flac_encoder_write(struct encoder *_encoder,
 
 	/* feed samples to encoder */
 
+#ifdef FLAC_ENCODER_THREADS
+	if (encoder->threads > 1)
+		return flac_encoder_write_jobs(encoder, buffer, num_frames,
+					       error);
+#endif
+
 	if (!FLAC__stream_encoder_process_interleaved(encoder->fse, buffer,
 							num_frames)) {
 		g_set_error(error, flac_encoder_quark(), 0,
@@ -328,6 +1001,16 @@ flac_encoder_read(struct encoder *_encoder, void *dest, size_t length)
 {
 	struct flac_encoder *encoder = (struct flac_encoder *)_encoder;
 
+#ifdef FLAC_ENCODER_THREADS
+	if (encoder->threads > 1) {
+		/* errors are reported by the next write() or flush()
+		   call */
+		g_mutex_lock(encoder->mutex);
+		flac_encoder_collect(encoder, NULL);
+		g_mutex_unlock(encoder->mutex);
+	}
+#endif
+
 	size_t max_length;
 	const char *src = fifo_buffer_read(encoder->output_buffer,
 					   &max_length);
@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "encoder_api.h"
+#include "encoder_plugin.h"
+#include "tag.h"
+#include "audio_format.h"
+
+#include <opus.h>
+#include <ogg/ogg.h>
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "opus_encoder"
+
+enum {
+	/**
+	 * Opus always operates at 48 kHz internally, and the Ogg
+	 * granule position is always counted at this rate.
+	 */
+	OPUS_SAMPLE_RATE = 48000,
+
+	/**
+	 * The largest frame size: 60 ms.
+	 */
+	OPUS_MAX_FRAME_SIZE = OPUS_SAMPLE_RATE * 60 / 1000,
+
+	/**
+	 * The recommended maximum packet size.
+	 */
+	OPUS_MAX_PACKET_SIZE = 4000,
+};
+
+struct opus_encoder {
+	/** the base class */
+	struct encoder encoder;
+
+	/* configuration */
+
+	/**
+	 * The bit rate in kbit/s, or #OPUS_AUTO or #OPUS_BITRATE_MAX.
+	 */
+	opus_int32 bitrate;
+	int complexity;
+	int signal;
+
+	/**
+	 * The number of frames per Opus packet.
+	 */
+	unsigned frame_size;
+
+	/* runtime information */
+
+	struct audio_format audio_format;
+
+	size_t frame_bytes;
+
+	OpusEncoder *enc;
+
+	/**
+	 * The number of frames at the beginning of the stream which
+	 * the decoder must skip (the encoder's look-ahead).
+	 */
+	opus_int32 lookahead;
+
+	/**
+	 * PCM data which does not fill a whole Opus frame yet.
+	 */
+	int16_t buffer[OPUS_MAX_FRAME_SIZE * 2];
+
+	/**
+	 * The number of frames in #buffer.
+	 */
+	unsigned buffer_frames;
+
+	ogg_stream_state os;
+
+	ogg_int64_t granulepos;
+
+	ogg_int64_t packetno;
+
+	/**
+	 * Header pages which have been generated, but not yet
+	 * returned by opus_encoder_read().  They are flushed
+	 * immediately, because the Ogg Opus specification requires
+	 * both headers to be on pages of their own.  Also holds the
+	 * rest of a page which did not fit into the caller's buffer.
+	 */
+	GByteArray *pending;
+
+	bool flush;
+};
+
+extern const struct encoder_plugin opus_encoder_plugin;
+
+static inline GQuark
+opus_encoder_quark(void)
+{
+	return g_quark_from_static_string("opus_encoder");
+}
+
+static bool
+opus_encoder_configure(struct opus_encoder *encoder,
+		       const struct config_param *param, GError **error_r)
+{
+	const char *value = config_get_block_string(param, "bitrate", "auto");
+	if (strcmp(value, "auto") == 0)
+		encoder->bitrate = OPUS_AUTO;
+	else if (strcmp(value, "max") == 0)
+		encoder->bitrate = OPUS_BITRATE_MAX;
+	else {
+		char *endptr;
+		encoder->bitrate = strtoul(value, &endptr, 10);
+		if (endptr == value || *endptr != 0 ||
+		    encoder->bitrate < 1 || encoder->bitrate > 512) {
+			g_set_error(error_r, opus_encoder_quark(), 0,
+				    "Invalid bit rate at line %i",
+				    param->line);
+			return false;
+		}
+	}
+
+	encoder->complexity = config_get_block_unsigned(param, "complexity",
+							10);
+	if (encoder->complexity > 10) {
+		g_set_error(error_r, opus_encoder_quark(), 0,
+			    "Invalid complexity at line %i", param->line);
+		return false;
+	}
+
+	value = config_get_block_string(param, "signal", "auto");
+	if (strcmp(value, "auto") == 0)
+		encoder->signal = OPUS_AUTO;
+	else if (strcmp(value, "voice") == 0)
+		encoder->signal = OPUS_SIGNAL_VOICE;
+	else if (strcmp(value, "music") == 0)
+		encoder->signal = OPUS_SIGNAL_MUSIC;
+	else {
+		g_set_error(error_r, opus_encoder_quark(), 0,
+			    "Invalid signal at line %i", param->line);
+		return false;
+	}
+
+	/* the frame size in milliseconds; shorter frames reduce the
+	   latency, longer frames improve the quality at low bit
+	   rates */
+	value = config_get_block_string(param, "frame_size", "20");
+	double frame_ms = g_ascii_strtod(value, NULL);
+	if (frame_ms == 2.5 || frame_ms == 5 || frame_ms == 10 ||
+	    frame_ms == 20 || frame_ms == 40 || frame_ms == 60)
+		encoder->frame_size = OPUS_SAMPLE_RATE * frame_ms / 1000;
+	else {
+		g_set_error(error_r, opus_encoder_quark(), 0,
+			    "Invalid frame size (must be one of 2.5, 5, 10, "
+			    "20, 40, 60) at line %i", param->line);
+		return false;
+	}
+
+	return true;
+}
+
+static struct encoder *
+opus_encoder_init(const struct config_param *param, GError **error)
+{
+	struct opus_encoder *encoder;
+
+	encoder = g_new(struct opus_encoder, 1);
+	encoder_struct_init(&encoder->encoder, &opus_encoder_plugin);
+
+	/* load configuration from "param" */
+	if (!opus_encoder_configure(encoder, param, error)) {
+		/* configuration has failed, roll back and return error */
+		g_free(encoder);
+		return NULL;
+	}
+
+	return &encoder->encoder;
+}
+
+static void
+opus_encoder_finish(struct encoder *_encoder)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	/* the real libopus/libogg cleanup was already performed by
+	   opus_encoder_close(), so no real work here */
+	g_free(encoder);
+}
+
+static void
+opus_encoder_packetin(struct opus_encoder *encoder,
+		      unsigned char *data, long length,
+		      bool bos, bool eos)
+{
+	ogg_packet packet;
+	packet.packet = data;
+	packet.bytes = length;
+	packet.b_o_s = bos;
+	packet.e_o_s = eos;
+	packet.granulepos = encoder->granulepos;
+	packet.packetno = encoder->packetno++;
+
+	ogg_stream_packetin(&encoder->os, &packet);
+}
+
+/**
+ * Flush all packets in the ogg_stream_state to #pending.
+ */
+static void
+opus_encoder_flush_pending(struct opus_encoder *encoder)
+{
+	ogg_page page;
+	while (ogg_stream_flush(&encoder->os, &page) != 0) {
+		g_byte_array_append(encoder->pending,
+				    page.header, page.header_len);
+		g_byte_array_append(encoder->pending,
+				    page.body, page.body_len);
+	}
+}
+
+static void
+write_le16(unsigned char *p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+static void
+write_le32(unsigned char *p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+/**
+ * Submits the "OpusHead" and "OpusTags" packets, which begin a new
+ * logical stream.
+ */
+static void
+opus_encoder_headerout(struct opus_encoder *encoder, const struct tag *tag)
+{
+	/* OpusHead */
+
+	unsigned char head[19];
+	memcpy(head, "OpusHead", 8);
+	head[8] = 1; /* version */
+	head[9] = encoder->audio_format.channels;
+	write_le16(head + 10, encoder->lookahead);
+	write_le32(head + 12, encoder->audio_format.sample_rate);
+	write_le16(head + 16, 0); /* output gain */
+	head[18] = 0; /* channel mapping family */
+
+	encoder->granulepos = 0;
+	encoder->packetno = 0;
+	opus_encoder_packetin(encoder, head, sizeof(head), true, false);
+	opus_encoder_flush_pending(encoder);
+
+	/* OpusTags */
+
+	const char *vendor = opus_get_version_string();
+	const size_t vendor_length = strlen(vendor);
+
+	GByteArray *tags = g_byte_array_new();
+	unsigned char buffer[4];
+
+	g_byte_array_append(tags, (const guint8 *)"OpusTags", 8);
+	write_le32(buffer, vendor_length);
+	g_byte_array_append(tags, buffer, 4);
+	g_byte_array_append(tags, (const guint8 *)vendor, vendor_length);
+
+	write_le32(buffer, tag != NULL ? tag->num_items : 0);
+	g_byte_array_append(tags, buffer, 4);
+
+	if (tag != NULL) {
+		for (unsigned i = 0; i < tag->num_items; i++) {
+			const struct tag_item *item = tag->items[i];
+			char *comment =
+				g_strconcat(tag_item_names[item->type], "=",
+					    item->value, NULL);
+			const size_t length = strlen(comment);
+
+			/* the field names are case insensitive, but
+			   upper case is customary */
+			for (char *p = comment; *p != '='; ++p)
+				*p = g_ascii_toupper(*p);
+
+			write_le32(buffer, length);
+			g_byte_array_append(tags, buffer, 4);
+			g_byte_array_append(tags, (const guint8 *)comment,
+					    length);
+			g_free(comment);
+		}
+	}
+
+	opus_encoder_packetin(encoder, tags->data, tags->len, false, false);
+	g_byte_array_free(tags, true);
+	opus_encoder_flush_pending(encoder);
+
+	/* the granule position of the audio packets includes the
+	   pre-skip */
+	encoder->granulepos = encoder->lookahead;
+}
+
+static bool
+opus_encoder_open(struct encoder *_encoder,
+		  struct audio_format *audio_format,
+		  GError **error_r)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	/* libopus supports only 48 kHz (and a few lower rates, which
+	   we don't use); MPD converts the input */
+	audio_format->sample_rate = OPUS_SAMPLE_RATE;
+	audio_format->format = SAMPLE_FORMAT_S16;
+	if (audio_format->channels > 2)
+		audio_format->channels = 2;
+
+	encoder->audio_format = *audio_format;
+	encoder->frame_bytes = audio_format_frame_size(audio_format);
+
+	int error;
+	encoder->enc = opus_encoder_create(audio_format->sample_rate,
+					   audio_format->channels,
+					   OPUS_APPLICATION_AUDIO,
+					   &error);
+	if (encoder->enc == NULL) {
+		g_set_error_literal(error_r, opus_encoder_quark(), error,
+				    opus_strerror(error));
+		return false;
+	}
+
+	opus_encoder_ctl(encoder->enc,
+			 OPUS_SET_BITRATE(encoder->bitrate > 0
+					  ? encoder->bitrate * 1000
+					  : encoder->bitrate));
+	opus_encoder_ctl(encoder->enc,
+			 OPUS_SET_COMPLEXITY(encoder->complexity));
+	opus_encoder_ctl(encoder->enc, OPUS_SET_SIGNAL(encoder->signal));
+	opus_encoder_ctl(encoder->enc,
+			 OPUS_GET_LOOKAHEAD(&encoder->lookahead));
+
+	encoder->buffer_frames = 0;
+	encoder->flush = false;
+	encoder->pending = g_byte_array_new();
+
+	ogg_stream_init(&encoder->os, g_random_int());
+	opus_encoder_headerout(encoder, NULL);
+
+	return true;
+}
+
+static void
+opus_encoder_close(struct encoder *_encoder)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	ogg_stream_clear(&encoder->os);
+	opus_encoder_destroy(encoder->enc);
+	g_byte_array_free(encoder->pending, true);
+}
+
+/**
+ * Encodes the full #buffer into one Opus packet.
+ */
+static bool
+opus_encoder_do_encode(struct opus_encoder *encoder, bool eos,
+		       GError **error_r)
+{
+	assert(encoder->buffer_frames == encoder->frame_size);
+
+	unsigned char packet[OPUS_MAX_PACKET_SIZE];
+	opus_int32 result = opus_encode(encoder->enc, encoder->buffer,
+					encoder->frame_size,
+					packet, sizeof(packet));
+	if (result < 0) {
+		g_set_error_literal(error_r, opus_encoder_quark(), result,
+				    "Opus encoder error");
+		return false;
+	}
+
+	encoder->granulepos += encoder->frame_size;
+	opus_encoder_packetin(encoder, packet, result, false, eos);
+
+	encoder->buffer_frames = 0;
+	return true;
+}
+
+static bool
+opus_encoder_flush(struct encoder *_encoder, G_GNUC_UNUSED GError **error)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	encoder->flush = true;
+	return true;
+}
+
+static bool
+opus_encoder_pre_tag(struct encoder *_encoder, GError **error_r)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	/* pad the last frame with silence, and end the stream */
+
+	memset(encoder->buffer + encoder->buffer_frames *
+	       encoder->audio_format.channels, 0,
+	       (encoder->frame_size - encoder->buffer_frames) *
+	       encoder->frame_bytes);
+	encoder->buffer_frames = encoder->frame_size;
+
+	if (!opus_encoder_do_encode(encoder, true, error_r))
+		return false;
+
+	/* move the rest of this stream out of the ogg_stream_state,
+	   before opus_encoder_tag() starts a new one; and start the
+	   next stream with a clean encoder state */
+	opus_encoder_flush_pending(encoder);
+	opus_encoder_ctl(encoder->enc, OPUS_RESET_STATE);
+	return true;
+}
+
+static bool
+opus_encoder_tag(struct encoder *_encoder, const struct tag *tag,
+		 G_GNUC_UNUSED GError **error)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	/* begin a new logical stream with new headers */
+
+	ogg_stream_reset_serialno(&encoder->os, g_random_int());
+	opus_encoder_headerout(encoder, tag);
+
+	return true;
+}
+
+static bool
+opus_encoder_write(struct encoder *_encoder,
+		   const void *_data, size_t length,
+		   GError **error_r)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+	const char *data = _data;
+
+	assert(length % encoder->frame_bytes == 0);
+
+	while (length > 0) {
+		unsigned n = encoder->frame_size - encoder->buffer_frames;
+		if (n > length / encoder->frame_bytes)
+			n = length / encoder->frame_bytes;
+
+		memcpy(encoder->buffer + encoder->buffer_frames *
+		       encoder->audio_format.channels,
+		       data, n * encoder->frame_bytes);
+		encoder->buffer_frames += n;
+		data += n * encoder->frame_bytes;
+		length -= n * encoder->frame_bytes;
+
+		if (encoder->buffer_frames == encoder->frame_size &&
+		    !opus_encoder_do_encode(encoder, false, error_r))
+			return false;
+	}
+
+	return true;
+}
+
+static size_t
+opus_encoder_read(struct encoder *_encoder, void *_dest, size_t length)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+	ogg_page page;
+	int ret;
+	unsigned char *dest = _dest;
+	size_t nbytes;
+
+	if (encoder->pending->len > 0) {
+		nbytes = encoder->pending->len;
+		if (nbytes > length)
+			nbytes = length;
+
+		memcpy(dest, encoder->pending->data, nbytes);
+		g_byte_array_remove_range(encoder->pending, 0, nbytes);
+		return nbytes;
+	}
+
+	ret = ogg_stream_pageout(&encoder->os, &page);
+	if (ret == 0 && encoder->flush) {
+		encoder->flush = false;
+		ret = ogg_stream_flush(&encoder->os, &page);
+	}
+
+	if (ret == 0)
+		return 0;
+
+	assert(page.header_len > 0 || page.body_len > 0);
+
+	nbytes = (size_t)page.header_len + (size_t)page.body_len;
+	if (nbytes > length) {
+		/* the page doesn't fit: keep the rest for the next
+		   call */
+		g_byte_array_append(encoder->pending, page.header,
+				    page.header_len);
+		g_byte_array_append(encoder->pending, page.body,
+				    page.body_len);
+
+		memcpy(dest, encoder->pending->data, length);
+		g_byte_array_remove_range(encoder->pending, 0, length);
+		return length;
+	}
+
+	memcpy(dest, page.header, page.header_len);
+	memcpy(dest + page.header_len, page.body, page.body_len);
+
+	return nbytes;
+}
+
+static const char *
+opus_encoder_get_mime_type(G_GNUC_UNUSED struct encoder *_encoder)
+{
+	return "audio/ogg";
+}
+
+const struct encoder_plugin opus_encoder_plugin = {
+	.name = "opus",
+	.init = opus_encoder_init,
+	.finish = opus_encoder_finish,
+	.open = opus_encoder_open,
+	.close = opus_encoder_close,
+	.flush = opus_encoder_flush,
+	.pre_tag = opus_encoder_pre_tag,
+	.tag = opus_encoder_tag,
+	.write = opus_encoder_write,
+	.read = opus_encoder_read,
+	.get_mime_type = opus_encoder_get_mime_type,
+};
@@ -0,0 +1,549 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "encoder_thread.h"
+#include "encoder_api.h"
+#include "audio_format.h"
+#include "fifo_buffer.h"
+#include "page.h"
+
+#include <assert.h>
+#include <string.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "encoder_thread"
+
+struct thread_encoder {
+	struct encoder encoder;
+
+	/**
+	 * A copy of #thread_encoder_plugin, with the optional tag
+	 * methods removed if the wrapped encoder doesn't implement
+	 * them.  Outputs check encoder.plugin->tag to decide whether
+	 * to use encoder tags.
+	 */
+	struct encoder_plugin plugin;
+
+	/**
+	 * The wrapped encoder.  While the worker thread is running,
+	 * it may only be used by the thread which has set #busy, or
+	 * with #mutex locked and #busy cleared.
+	 */
+	struct encoder *inner;
+
+	/**
+	 * The configured length of the PCM queue in milliseconds.
+	 */
+	unsigned queue_time;
+
+	/**
+	 * The size of one PCM frame.  The wrapped encoder is fed
+	 * whole frames only.
+	 */
+	size_t frame_size;
+
+	GThread *thread;
+
+	/**
+	 * This mutex protects all attributes below.
+	 */
+	GMutex *mutex;
+
+	/**
+	 * Signalled by the worker thread when it has consumed input
+	 * or finished a chunk, and by the output thread when there is
+	 * new input or #quit was set.
+	 */
+	GCond *cond;
+
+	/**
+	 * The PCM queue, filled by encoder_write().
+	 */
+	struct fifo_buffer *input;
+
+	/**
+	 * A queue of #page objects with encoded data, which are
+	 * returned by encoder_read().
+	 */
+	GQueue *output;
+
+	/**
+	 * The number of bytes of the first #output page which were
+	 * already returned by encoder_read().
+	 */
+	size_t output_position;
+
+	/**
+	 * True while the worker thread uses #inner without holding
+	 * the mutex.
+	 */
+	bool busy;
+
+	/**
+	 * True if encoder_thread_flush_async() has requested a flush,
+	 * which the worker thread performs after having encoded
+	 * #flush_remaining more bytes of input.
+	 */
+	bool flush_pending;
+
+	/**
+	 * The number of bytes in #input which were queued before the
+	 * pending flush request.  Only valid if #flush_pending is
+	 * set.
+	 */
+	size_t flush_remaining;
+
+	/**
+	 * True if the worker thread shall exit.
+	 */
+	bool quit;
+
+	/**
+	 * An error which occurred in the worker thread.  It is
+	 * reported by the next encoder_write() call.
+	 */
+	GError *error;
+};
+
+static void
+thread_encoder_unref_page(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	struct page *page = data;
+
+	page_unref(page);
+}
+
+/**
+ * Reads all available data from the wrapped encoder, and appends it
+ * to the specified queue.
+ */
+static void
+thread_encoder_read_inner(struct encoder *inner, GQueue *queue)
+{
+	char buffer[32768];
+	size_t nbytes;
+
+	while ((nbytes = encoder_read(inner, buffer, sizeof(buffer))) > 0)
+		g_queue_push_tail(queue, page_new_copy(buffer, nbytes));
+}
+
+static gpointer
+thread_encoder_task(gpointer data)
+{
+	struct thread_encoder *te = data;
+	char buffer[8192];
+	const size_t max_length = sizeof(buffer) -
+		sizeof(buffer) % te->frame_size;
+
+	g_mutex_lock(te->mutex);
+
+	while (!te->quit) {
+		const void *src = NULL;
+		size_t length = 0;
+		bool flush = false;
+
+		if (te->error != NULL) {
+			/* wait for the output thread to pick up the
+			   error */
+		} else if (te->flush_pending && te->flush_remaining == 0) {
+			flush = true;
+			te->flush_pending = false;
+		} else {
+			src = fifo_buffer_read(te->input, &length);
+
+			if (te->flush_pending &&
+			    length > te->flush_remaining)
+				length = te->flush_remaining;
+
+			if (length > max_length)
+				length = max_length;
+
+			/* the output thread may be in the middle of
+			   appending a frame */
+			length -= length % te->frame_size;
+		}
+
+		if (!flush && length == 0) {
+			g_cond_wait(te->cond, te->mutex);
+			continue;
+		}
+
+		if (!flush) {
+			memcpy(buffer, src, length);
+			fifo_buffer_consume(te->input, length);
+			if (te->flush_pending)
+				te->flush_remaining -= length;
+
+			/* wake up encoder_write(), which may be
+			   waiting for free space */
+			g_cond_broadcast(te->cond);
+		}
+
+		te->busy = true;
+		g_mutex_unlock(te->mutex);
+
+		/* encode without holding the lock */
+
+		GError *error = NULL;
+		GQueue *pages = g_queue_new();
+		bool success = flush
+			? encoder_flush(te->inner, &error)
+			: encoder_write(te->inner, buffer, length, &error);
+		if (success)
+			thread_encoder_read_inner(te->inner, pages);
+
+		g_mutex_lock(te->mutex);
+
+		struct page *page;
+		while ((page = g_queue_pop_head(pages)) != NULL)
+			g_queue_push_tail(te->output, page);
+		g_queue_free(pages);
+
+		if (error != NULL)
+			te->error = error;
+
+		te->busy = false;
+		g_cond_broadcast(te->cond);
+	}
+
+	g_mutex_unlock(te->mutex);
+	return NULL;
+}
+
+/**
+ * Waits until the worker thread has encoded all queued PCM data.
+ * After that, the caller may use the wrapped encoder as long as it
+ * holds the mutex.  The caller must hold the mutex.
+ */
+static void
+thread_encoder_drain(struct thread_encoder *te)
+{
+	while ((te->busy || te->flush_pending ||
+		!fifo_buffer_is_empty(te->input)) &&
+	       te->error == NULL)
+		g_cond_wait(te->cond, te->mutex);
+}
+
+/**
+ * Returns the error which occurred in the worker thread, if any.  The
+ * caller must hold the mutex.
+ *
+ * @return false if an error has occurred
+ */
+static bool
+thread_encoder_check_error(struct thread_encoder *te, GError **error_r)
+{
+	if (te->error == NULL)
+		return true;
+
+	g_propagate_error(error_r, te->error);
+	te->error = NULL;
+	return false;
+}
+
+static void
+thread_encoder_finish(struct encoder *_encoder)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+
+	assert(te->thread == NULL);
+
+	encoder_finish(te->inner);
+	g_cond_free(te->cond);
+	g_mutex_free(te->mutex);
+	g_free(te);
+}
+
+static bool
+thread_encoder_open(struct encoder *_encoder,
+		    struct audio_format *audio_format,
+		    GError **error_r)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+
+	assert(te->thread == NULL);
+
+	if (!encoder_open(te->inner, audio_format, error_r))
+		return false;
+
+	te->frame_size = audio_format_frame_size(audio_format);
+
+	size_t queue_size = audio_format_time_to_size(audio_format) *
+		te->queue_time / 1000;
+	if (queue_size < 8192)
+		queue_size = 8192;
+
+	te->input = fifo_buffer_new(queue_size);
+	te->output = g_queue_new();
+	te->output_position = 0;
+	te->busy = false;
+	te->flush_pending = false;
+	te->quit = false;
+	te->error = NULL;
+
+	/* the stream header is available right after opening the
+	   encoder */
+	thread_encoder_read_inner(te->inner, te->output);
+
+	te->thread = g_thread_create(thread_encoder_task, te, true, error_r);
+	if (te->thread == NULL) {
+		g_queue_foreach(te->output, thread_encoder_unref_page, NULL);
+		g_queue_free(te->output);
+		fifo_buffer_free(te->input);
+		encoder_close(te->inner);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+thread_encoder_close(struct encoder *_encoder)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+
+	assert(te->thread != NULL);
+
+	g_mutex_lock(te->mutex);
+	te->quit = true;
+	g_cond_broadcast(te->cond);
+	g_mutex_unlock(te->mutex);
+
+	g_thread_join(te->thread);
+	te->thread = NULL;
+
+	encoder_close(te->inner);
+
+	if (te->error != NULL)
+		g_error_free(te->error);
+
+	g_queue_foreach(te->output, thread_encoder_unref_page, NULL);
+	g_queue_free(te->output);
+	fifo_buffer_free(te->input);
+}
+
+static bool
+thread_encoder_flush(struct encoder *_encoder, GError **error_r)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+
+	g_mutex_lock(te->mutex);
+	thread_encoder_drain(te);
+
+	bool success = thread_encoder_check_error(te, error_r) &&
+		encoder_flush(te->inner, error_r);
+	if (success)
+		thread_encoder_read_inner(te->inner, te->output);
+
+	g_mutex_unlock(te->mutex);
+	return success;
+}
+
+static bool
+thread_encoder_flush_async(struct thread_encoder *te, GError **error_r)
+{
+	g_mutex_lock(te->mutex);
+
+	bool success = thread_encoder_check_error(te, error_r);
+	if (success && !te->flush_pending) {
+		size_t length;
+		if (fifo_buffer_read(te->input, &length) == NULL)
+			length = 0;
+
+		te->flush_pending = true;
+		te->flush_remaining = length;
+		g_cond_broadcast(te->cond);
+	}
+
+	g_mutex_unlock(te->mutex);
+	return success;
+}
+
+static bool
+thread_encoder_pre_tag(struct encoder *_encoder, GError **error_r)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+
+	g_mutex_lock(te->mutex);
+	thread_encoder_drain(te);
+
+	bool success = thread_encoder_check_error(te, error_r) &&
+		encoder_pre_tag(te->inner, error_r);
+	if (success)
+		thread_encoder_read_inner(te->inner, te->output);
+
+	g_mutex_unlock(te->mutex);
+	return success;
+}
+
+static bool
+thread_encoder_tag(struct encoder *_encoder, const struct tag *tag,
+		   GError **error_r)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+
+	g_mutex_lock(te->mutex);
+	thread_encoder_drain(te);
+
+	bool success = thread_encoder_check_error(te, error_r) &&
+		encoder_tag(te->inner, tag, error_r);
+	if (success)
+		thread_encoder_read_inner(te->inner, te->output);
+
+	g_mutex_unlock(te->mutex);
+	return success;
+}
+
+static bool
+thread_encoder_write(struct encoder *_encoder,
+		     const void *data, size_t length,
+		     GError **error_r)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+	const char *src = data;
+
+	g_mutex_lock(te->mutex);
+
+	while (length > 0) {
+		if (!thread_encoder_check_error(te, error_r)) {
+			g_mutex_unlock(te->mutex);
+			return false;
+		}
+
+		size_t max_length;
+		char *dest = fifo_buffer_write(te->input, &max_length);
+		if (dest == NULL) {
+			/* the queue is full: the encoder can't keep
+			   up */
+			g_cond_wait(te->cond, te->mutex);
+			continue;
+		}
+
+		if (max_length > length)
+			max_length = length;
+
+		memcpy(dest, src, max_length);
+		fifo_buffer_append(te->input, max_length);
+		src += max_length;
+		length -= max_length;
+
+		g_cond_broadcast(te->cond);
+	}
+
+	g_mutex_unlock(te->mutex);
+	return true;
+}
+
+static size_t
+thread_encoder_read(struct encoder *_encoder, void *_dest, size_t length)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+	char *dest = _dest;
+	size_t nbytes = 0;
+
+	g_mutex_lock(te->mutex);
+
+	struct page *page;
+	while (nbytes < length &&
+	       (page = g_queue_peek_head(te->output)) != NULL) {
+		size_t n = page->size - te->output_position;
+		if (n > length - nbytes)
+			n = length - nbytes;
+
+		memcpy(dest + nbytes, page->data + te->output_position, n);
+		nbytes += n;
+		te->output_position += n;
+
+		if (te->output_position == page->size) {
+			g_queue_pop_head(te->output);
+			page_unref(page);
+			te->output_position = 0;
+		}
+	}
+
+	g_mutex_unlock(te->mutex);
+	return nbytes;
+}
+
+static const char *
+thread_encoder_get_mime_type(struct encoder *_encoder)
+{
+	struct thread_encoder *te = (struct thread_encoder *)_encoder;
+
+	return encoder_get_mime_type(te->inner);
+}
+
+/**
+ * This plugin is not registered in the encoder list; it is only
+ * instantiated by encoder_thread_wrap().
+ */
+static const struct encoder_plugin thread_encoder_plugin = {
+	.name = "thread",
+	.finish = thread_encoder_finish,
+	.open = thread_encoder_open,
+	.close = thread_encoder_close,
+	.flush = thread_encoder_flush,
+	.pre_tag = thread_encoder_pre_tag,
+	.tag = thread_encoder_tag,
+	.write = thread_encoder_write,
+	.read = thread_encoder_read,
+	.get_mime_type = thread_encoder_get_mime_type,
+};
+
+struct encoder *
+encoder_thread_wrap(struct encoder *encoder,
+		    const struct config_param *param)
+{
+	assert(encoder != NULL);
+
+	if (!config_get_block_bool(param, "encoder_thread", false))
+		return encoder;
+
+	struct thread_encoder *te = g_new(struct thread_encoder, 1);
+
+	te->plugin = thread_encoder_plugin;
+	te->plugin.name = encoder->plugin->name;
+	if (encoder->plugin->pre_tag == NULL)
+		te->plugin.pre_tag = NULL;
+	if (encoder->plugin->tag == NULL)
+		te->plugin.tag = NULL;
+
+	encoder_struct_init(&te->encoder, &te->plugin);
+	te->inner = encoder;
+	te->queue_time = config_get_block_unsigned(param,
+						   "encoder_queue_time",
+						   2000);
+	te->thread = NULL;
+	te->mutex = g_mutex_new();
+	te->cond = g_cond_new();
+
+	return &te->encoder;
+}
+
+bool
+encoder_thread_flush_async(struct encoder *encoder, GError **error_r)
+{
+	if (encoder->plugin->flush != thread_encoder_flush)
+		/* not wrapped */
+		return encoder_flush(encoder, error_r);
+
+	return thread_encoder_flush_async((struct thread_encoder *)encoder,
+					  error_r);
+}
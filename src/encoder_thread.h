@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Runs an encoder in a separate thread, so a slow encoder does not
+ * block the output thread.
+ */
+
+#ifndef MPD_ENCODER_THREAD_H
+#define MPD_ENCODER_THREAD_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+
+struct encoder;
+struct config_param;
+
+/**
+ * Wraps the specified encoder in a new encoder object which runs it
+ * in a worker thread, if enabled with the "encoder_thread" setting in
+ * the configuration block.  PCM data passed to encoder_write() is
+ * copied to a queue which holds "encoder_queue_time" milliseconds;
+ * encoder_write() blocks only if this queue is full.  encoder_read()
+ * returns the data which the worker thread has encoded so far.
+ *
+ * @param encoder the encoder object, whose ownership is passed to the
+ * returned object
+ * @param param the output's configuration block
+ * @return the new encoder object, or the given one if the worker
+ * thread is disabled
+ */
+struct encoder *
+encoder_thread_wrap(struct encoder *encoder,
+		    const struct config_param *param);
+
+/**
+ * Like encoder_flush(), but if the encoder has been wrapped by
+ * encoder_thread_wrap(), this does not wait: the flush is performed
+ * by the worker thread after it has encoded the PCM data queued so
+ * far, and its output is returned by a later encoder_read() call.
+ * Errors from the worker thread are reported by this function or by
+ * the next encoder_write() call.
+ */
+bool
+encoder_thread_flush_async(struct encoder *encoder, GError **error_r);
+
+#endif
@@ -0,0 +1,741 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "input/curl_cache.h"
+#include "fd_util.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "curl_cache"
+
+/**
+ * A byte range [start, end) which is present in the data file.
+ */
+struct curl_cache_range {
+	goffset start, end;
+};
+
+struct curl_cache_entry {
+	char *url;
+
+	/**
+	 * The file name without directory and suffix, derived from
+	 * a hash of the URL.  This is the key in #cache.entries.
+	 */
+	char *name;
+
+	/**
+	 * The path of the data file (".data") and of the index
+	 * record (".meta").
+	 */
+	char *data_path, *meta_path;
+
+	/**
+	 * The size of the resource, or -1 if unknown.
+	 */
+	goffset size;
+
+	/**
+	 * The MIME type of the resource, or NULL if unknown.
+	 */
+	char *mime;
+
+	/**
+	 * A sorted array of #curl_cache_range objects which neither
+	 * overlap nor touch each other.
+	 */
+	GArray *ranges;
+
+	/**
+	 * The sum of all #ranges.
+	 */
+	goffset stored;
+
+	/**
+	 * The last time this entry was used; for the LRU eviction.
+	 */
+	time_t atime;
+
+	unsigned refcount;
+
+	/**
+	 * The data file, or -1 if it is not open.  It is open only
+	 * while the entry is in use.
+	 */
+	int fd;
+
+	/**
+	 * Does the index record need to be saved?
+	 */
+	bool dirty;
+};
+
+static struct {
+	/**
+	 * Protects everything in this struct and all entries.
+	 */
+	GMutex *mutex;
+
+	char *directory;
+
+	guint64 max_size;
+
+	/**
+	 * The sum of all curl_cache_entry.stored values.
+	 */
+	guint64 total;
+
+	/**
+	 * Maps curl_cache_entry.name to #curl_cache_entry.  NULL if
+	 * the cache is disabled.
+	 */
+	GHashTable *entries;
+} cache;
+
+static inline GQuark
+curl_cache_quark(void)
+{
+	return g_quark_from_static_string("curl_cache");
+}
+
+/**
+ * Calculates the file name for a URL: a 64 bit FNV-1a hash in
+ * hexadecimal notation.
+ */
+static char *
+curl_cache_name(const char *url)
+{
+	guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+
+	for (const unsigned char *p = (const unsigned char *)url;
+	     *p != 0; ++p) {
+		hash ^= *p;
+		hash *= G_GUINT64_CONSTANT(1099511628211);
+	}
+
+	return g_strdup_printf("%016" G_GINT64_MODIFIER "x", hash);
+}
+
+static struct curl_cache_entry *
+curl_cache_entry_new(const char *name, const char *url)
+{
+	struct curl_cache_entry *entry = g_new(struct curl_cache_entry, 1);
+	char *path = g_build_filename(cache.directory, name, NULL);
+
+	entry->url = g_strdup(url);
+	entry->name = g_strdup(name);
+	entry->data_path = g_strconcat(path, ".data", NULL);
+	entry->meta_path = g_strconcat(path, ".meta", NULL);
+	entry->size = -1;
+	entry->mime = NULL;
+	entry->ranges = g_array_new(false, false,
+				    sizeof(struct curl_cache_range));
+	entry->stored = 0;
+	entry->atime = time(NULL);
+	entry->refcount = 0;
+	entry->fd = -1;
+	entry->dirty = false;
+
+	g_free(path);
+	return entry;
+}
+
+static void
+curl_cache_entry_free(struct curl_cache_entry *entry)
+{
+	assert(entry->refcount == 0);
+
+	if (entry->fd >= 0)
+		close(entry->fd);
+
+	g_free(entry->url);
+	g_free(entry->name);
+	g_free(entry->data_path);
+	g_free(entry->meta_path);
+	g_free(entry->mime);
+	g_array_free(entry->ranges, true);
+	g_free(entry);
+}
+
+static inline struct curl_cache_range *
+curl_cache_entry_range(struct curl_cache_entry *entry, guint i)
+{
+	return &g_array_index(entry->ranges, struct curl_cache_range, i);
+}
+
+/**
+ * Discards all cached data of this entry.
+ */
+static void
+curl_cache_entry_clear(struct curl_cache_entry *entry)
+{
+	cache.total -= entry->stored;
+	entry->stored = 0;
+	g_array_set_size(entry->ranges, 0);
+	entry->dirty = true;
+
+	if (entry->fd >= 0) {
+		if (ftruncate(entry->fd, 0) < 0)
+			g_warning("Failed to truncate %s: %s",
+				  entry->data_path, g_strerror(errno));
+	} else
+		unlink(entry->data_path);
+}
+
+/**
+ * Adds the range [start, end) to the entry, merging it with
+ * overlapping and adjacent ranges.
+ */
+static void
+curl_cache_entry_add_range(struct curl_cache_entry *entry,
+			   goffset start, goffset end)
+{
+	assert(start < end);
+
+	guint i = 0, n = entry->ranges->len;
+
+	/* skip all ranges which end before the new one */
+	while (i < n && curl_cache_entry_range(entry, i)->end < start)
+		++i;
+
+	/* merge all ranges which overlap or touch the new one */
+	struct curl_cache_range merged = { start, end };
+	guint j = i;
+	while (j < n && curl_cache_entry_range(entry, j)->start <= end) {
+		const struct curl_cache_range *r =
+			curl_cache_entry_range(entry, j);
+
+		if (r->start < merged.start)
+			merged.start = r->start;
+		if (r->end > merged.end)
+			merged.end = r->end;
+
+		entry->stored -= r->end - r->start;
+		cache.total -= r->end - r->start;
+		++j;
+	}
+
+	if (j > i)
+		g_array_remove_range(entry->ranges, i, j - i);
+	g_array_insert_val(entry->ranges, i, merged);
+
+	entry->stored += merged.end - merged.start;
+	cache.total += merged.end - merged.start;
+	entry->dirty = true;
+}
+
+/**
+ * Returns the number of bytes which are cached contiguously,
+ * beginning at the specified offset.
+ */
+static goffset
+curl_cache_entry_contiguous(struct curl_cache_entry *entry, goffset offset)
+{
+	for (guint i = 0; i < entry->ranges->len; ++i) {
+		const struct curl_cache_range *r =
+			curl_cache_entry_range(entry, i);
+
+		if (offset < r->start)
+			break;
+
+		if (offset < r->end)
+			return r->end - offset;
+	}
+
+	return 0;
+}
+
+static bool
+curl_cache_entry_open(struct curl_cache_entry *entry)
+{
+	if (entry->fd >= 0)
+		return true;
+
+	entry->fd = open_cloexec(entry->data_path, O_RDWR|O_CREAT|O_BINARY,
+				 0666);
+	if (entry->fd < 0) {
+		g_warning("Failed to open %s: %s",
+			  entry->data_path, g_strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static void
+curl_cache_entry_save(struct curl_cache_entry *entry)
+{
+	char *tmp_path = g_strconcat(entry->meta_path, ".tmp", NULL);
+	FILE *file = fopen(tmp_path, "w");
+	if (file == NULL) {
+		g_warning("Failed to create %s: %s",
+			  tmp_path, g_strerror(errno));
+		g_free(tmp_path);
+		return;
+	}
+
+	fprintf(file, "url %s\n", entry->url);
+	fprintf(file, "size %" G_GINT64_FORMAT "\n", (gint64)entry->size);
+	if (entry->mime != NULL)
+		fprintf(file, "mime %s\n", entry->mime);
+
+	for (guint i = 0; i < entry->ranges->len; ++i) {
+		const struct curl_cache_range *r =
+			curl_cache_entry_range(entry, i);
+		fprintf(file, "range %" G_GINT64_FORMAT " %" G_GINT64_FORMAT
+			"\n", (gint64)r->start, (gint64)r->end);
+	}
+
+	if (fclose(file) != 0 || rename(tmp_path, entry->meta_path) < 0) {
+		g_warning("Failed to save %s: %s",
+			  entry->meta_path, g_strerror(errno));
+		unlink(tmp_path);
+	} else
+		entry->dirty = false;
+
+	g_free(tmp_path);
+}
+
+/**
+ * Deletes the entry from the cache and from the disk.
+ */
+static void
+curl_cache_entry_delete(struct curl_cache_entry *entry)
+{
+	assert(entry->refcount == 0);
+
+	g_hash_table_remove(cache.entries, entry->name);
+	cache.total -= entry->stored;
+
+	unlink(entry->meta_path);
+	unlink(entry->data_path);
+
+	curl_cache_entry_free(entry);
+}
+
+static void
+curl_cache_find_lru(G_GNUC_UNUSED gpointer key, gpointer value,
+		    gpointer user_data)
+{
+	struct curl_cache_entry *entry = value;
+	struct curl_cache_entry **lru_r = user_data;
+
+	if (entry->refcount == 0 &&
+	    (*lru_r == NULL || entry->atime < (*lru_r)->atime))
+		*lru_r = entry;
+}
+
+/**
+ * Deletes the least recently used entries until the cache is below
+ * its size limit.  Entries which are in use are not deleted.
+ */
+static void
+curl_cache_evict(void)
+{
+	while (cache.total > cache.max_size) {
+		struct curl_cache_entry *lru = NULL;
+		g_hash_table_foreach(cache.entries, curl_cache_find_lru, &lru);
+		if (lru == NULL)
+			break;
+
+		g_debug("evicting %s", lru->url);
+		curl_cache_entry_delete(lru);
+	}
+}
+
+/**
+ * Parses an index record.  On success, the new entry is added to
+ * the cache.
+ */
+static bool
+curl_cache_load_entry(const char *name, const char *meta_path)
+{
+	char *contents;
+	if (!g_file_get_contents(meta_path, &contents, NULL, NULL))
+		return false;
+
+	struct curl_cache_entry *entry = NULL;
+	char **lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	for (char **p = lines; *p != NULL; ++p) {
+		const char *line = *p;
+
+		if (g_str_has_prefix(line, "url ")) {
+			if (entry != NULL)
+				break;
+
+			entry = curl_cache_entry_new(name, line + 4);
+		} else if (entry == NULL) {
+			break;
+		} else if (g_str_has_prefix(line, "size ")) {
+			entry->size = g_ascii_strtoll(line + 5, NULL, 10);
+		} else if (g_str_has_prefix(line, "mime ")) {
+			g_free(entry->mime);
+			entry->mime = g_strdup(line + 5);
+		} else if (g_str_has_prefix(line, "range ")) {
+			char *endptr;
+			goffset start = g_ascii_strtoll(line + 6, &endptr, 10);
+			goffset end = g_ascii_strtoll(endptr, NULL, 10);
+			if (start >= 0 && start < end)
+				curl_cache_entry_add_range(entry, start, end);
+		}
+	}
+
+	g_strfreev(lines);
+
+	if (entry == NULL)
+		return false;
+
+	/* the record must belong to this file, and the data file
+	   must contain all recorded ranges */
+	char *expected_name = curl_cache_name(entry->url);
+	bool valid = strcmp(expected_name, name) == 0;
+	g_free(expected_name);
+
+	struct stat st;
+	if (valid && entry->stored > 0 &&
+	    (stat(entry->data_path, &st) < 0 ||
+	     st.st_size < curl_cache_entry_range(entry, entry->ranges->len - 1)->end))
+		valid = false;
+
+	if (!valid) {
+		cache.total -= entry->stored;
+		curl_cache_entry_free(entry);
+		return false;
+	}
+
+	if (stat(meta_path, &st) == 0)
+		entry->atime = st.st_mtime;
+
+	g_hash_table_insert(cache.entries, entry->name, entry);
+	return true;
+}
+
+/**
+ * Loads all index records, and deletes stale files.
+ */
+static bool
+curl_cache_load(GError **error_r)
+{
+	GError *error = NULL;
+	GDir *dir = g_dir_open(cache.directory, 0, &error);
+	if (dir == NULL) {
+		g_propagate_error(error_r, error);
+		return false;
+	}
+
+	GSList *stale = NULL;
+	const char *filename;
+	while ((filename = g_dir_read_name(dir)) != NULL) {
+		if (!g_str_has_suffix(filename, ".meta"))
+			continue;
+
+		char *name = g_strndup(filename, strlen(filename) - 5);
+		char *path = g_build_filename(cache.directory, filename, NULL);
+		if (!curl_cache_load_entry(name, path))
+			stale = g_slist_prepend(stale, path);
+		else
+			g_free(path);
+		g_free(name);
+	}
+
+	/* delete data files without a valid index record, and
+	   leftovers of interrupted saves */
+	g_dir_rewind(dir);
+	while ((filename = g_dir_read_name(dir)) != NULL) {
+		if (g_str_has_suffix(filename, ".tmp")) {
+			stale = g_slist_prepend(stale,
+						g_build_filename(cache.directory,
+								 filename,
+								 NULL));
+		} else if (g_str_has_suffix(filename, ".data")) {
+			char *name = g_strndup(filename, strlen(filename) - 5);
+			if (g_hash_table_lookup(cache.entries, name) == NULL)
+				stale = g_slist_prepend(stale,
+							g_build_filename(cache.directory,
+									 filename,
+									 NULL));
+			g_free(name);
+		}
+	}
+
+	g_dir_close(dir);
+
+	for (GSList *i = stale; i != NULL; i = g_slist_next(i)) {
+		unlink(i->data);
+		g_free(i->data);
+	}
+
+	g_slist_free(stale);
+	return true;
+}
+
+bool
+curl_cache_init(const char *directory, guint64 max_size, GError **error_r)
+{
+	assert(directory != NULL);
+	assert(cache.entries == NULL);
+
+	if (g_mkdir_with_parents(directory, 0777) < 0) {
+		g_set_error(error_r, curl_cache_quark(), errno,
+			    "Failed to create %s: %s",
+			    directory, g_strerror(errno));
+		return false;
+	}
+
+	cache.directory = g_strdup(directory);
+	cache.max_size = max_size;
+	cache.total = 0;
+	cache.entries = g_hash_table_new(g_str_hash, g_str_equal);
+
+	if (!curl_cache_load(error_r)) {
+		g_hash_table_destroy(cache.entries);
+		cache.entries = NULL;
+		g_free(cache.directory);
+		return false;
+	}
+
+	cache.mutex = g_mutex_new();
+
+	curl_cache_evict();
+	return true;
+}
+
+static void
+curl_cache_free_entry(G_GNUC_UNUSED gpointer key, gpointer value,
+		      G_GNUC_UNUSED gpointer user_data)
+{
+	struct curl_cache_entry *entry = value;
+
+	if (entry->dirty)
+		curl_cache_entry_save(entry);
+
+	curl_cache_entry_free(entry);
+}
+
+void
+curl_cache_finish(void)
+{
+	if (cache.entries == NULL)
+		return;
+
+	g_hash_table_foreach(cache.entries, curl_cache_free_entry, NULL);
+	g_hash_table_destroy(cache.entries);
+	cache.entries = NULL;
+
+	g_mutex_free(cache.mutex);
+	g_free(cache.directory);
+}
+
+struct curl_cache_entry *
+curl_cache_acquire(const char *url)
+{
+	if (cache.entries == NULL)
+		return NULL;
+
+	char *name = curl_cache_name(url);
+
+	g_mutex_lock(cache.mutex);
+
+	struct curl_cache_entry *entry =
+		g_hash_table_lookup(cache.entries, name);
+	if (entry == NULL) {
+		entry = curl_cache_entry_new(name, url);
+		g_hash_table_insert(cache.entries, entry->name, entry);
+	} else if (strcmp(entry->url, url) != 0) {
+		/* hash collision: don't cache this URL */
+		entry = NULL;
+	}
+
+	if (entry != NULL) {
+		++entry->refcount;
+		entry->atime = time(NULL);
+	}
+
+	g_mutex_unlock(cache.mutex);
+
+	g_free(name);
+	return entry;
+}
+
+void
+curl_cache_release(struct curl_cache_entry *entry)
+{
+	assert(entry != NULL);
+	assert(entry->refcount > 0);
+
+	g_mutex_lock(cache.mutex);
+
+	if (--entry->refcount == 0) {
+		if (entry->fd >= 0) {
+			close(entry->fd);
+			entry->fd = -1;
+		}
+
+		if (entry->stored == 0)
+			curl_cache_entry_delete(entry);
+		else {
+			if (entry->dirty)
+				curl_cache_entry_save(entry);
+
+			curl_cache_evict();
+		}
+	}
+
+	g_mutex_unlock(cache.mutex);
+}
+
+bool
+curl_cache_get_info(struct curl_cache_entry *entry,
+		    goffset *size_r, char **mime_r)
+{
+	g_mutex_lock(cache.mutex);
+
+	bool known = entry->size >= 0;
+	if (known) {
+		*size_r = entry->size;
+		*mime_r = g_strdup(entry->mime);
+	}
+
+	g_mutex_unlock(cache.mutex);
+	return known;
+}
+
+void
+curl_cache_set_info(struct curl_cache_entry *entry,
+		    goffset size, const char *mime)
+{
+	g_mutex_lock(cache.mutex);
+
+	if (entry->size != size ||
+	    (entry->mime == NULL) != (mime == NULL) ||
+	    (mime != NULL && strcmp(entry->mime, mime) != 0)) {
+		if (entry->stored > 0) {
+			/* the resource has changed on the server */
+			g_debug("discarding outdated %s", entry->url);
+			curl_cache_entry_clear(entry);
+		}
+
+		entry->size = size;
+		g_free(entry->mime);
+		entry->mime = g_strdup(mime);
+		entry->dirty = true;
+	}
+
+	g_mutex_unlock(cache.mutex);
+}
+
+bool
+curl_cache_contains(struct curl_cache_entry *entry, goffset offset)
+{
+	g_mutex_lock(cache.mutex);
+	bool result = curl_cache_entry_contiguous(entry, offset) > 0;
+	g_mutex_unlock(cache.mutex);
+
+	return result;
+}
+
+size_t
+curl_cache_read(struct curl_cache_entry *entry, goffset offset,
+		void *dest, size_t length)
+{
+	ssize_t nbytes = 0;
+
+	g_mutex_lock(cache.mutex);
+
+	goffset available = curl_cache_entry_contiguous(entry, offset);
+	if (available > 0 && curl_cache_entry_open(entry)) {
+		if ((goffset)length > available)
+			length = (size_t)available;
+
+		if (lseek(entry->fd, (off_t)offset, SEEK_SET) < 0 ||
+		    (nbytes = read(entry->fd, dest, length)) < 0) {
+			g_warning("Failed to read %s: %s",
+				  entry->data_path, g_strerror(errno));
+			nbytes = 0;
+		}
+
+		entry->atime = time(NULL);
+	}
+
+	g_mutex_unlock(cache.mutex);
+
+	return (size_t)nbytes;
+}
+
+void
+curl_cache_write(struct curl_cache_entry *entry, goffset offset,
+		 const void *src, size_t length)
+{
+	assert(length > 0);
+
+	g_mutex_lock(cache.mutex);
+
+	if (!curl_cache_entry_open(entry)) {
+		g_mutex_unlock(cache.mutex);
+		return;
+	}
+
+	if (lseek(entry->fd, (off_t)offset, SEEK_SET) < 0) {
+		g_warning("Failed to seek %s: %s",
+			  entry->data_path, g_strerror(errno));
+		g_mutex_unlock(cache.mutex);
+		return;
+	}
+
+	const char *p = src;
+	size_t remaining = length;
+	while (remaining > 0) {
+		ssize_t nbytes = write(entry->fd, p, remaining);
+		if (nbytes <= 0) {
+			g_warning("Failed to write %s: %s",
+				  entry->data_path, g_strerror(errno));
+			break;
+		}
+
+		p += nbytes;
+		remaining -= nbytes;
+	}
+
+	if (remaining < length)
+		curl_cache_entry_add_range(entry, offset,
+					   offset + (goffset)(length - remaining));
+
+	if (cache.total > cache.max_size)
+		curl_cache_evict();
+
+	g_mutex_unlock(cache.mutex);
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_CURL_CACHE_H
+#define MPD_CURL_CACHE_H
+
+#include "input_stream.h" /* for goffset */
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * An optional on-disk cache for resources downloaded by the "curl"
+ * input plugin.  Each URL is stored in a sparse file; the ranges
+ * which have been downloaded are tracked, so a stream can be served
+ * from the cache and only the holes need to be requested from the
+ * server.  The least recently used entries are deleted when the
+ * cache exceeds its configured size.
+ *
+ * All functions are thread-safe.
+ */
+struct curl_cache_entry;
+
+/**
+ * Enables the cache and loads the index from the specified
+ * directory.
+ *
+ * @param max_size the maximum size of all cached data in bytes
+ */
+bool
+curl_cache_init(const char *directory, guint64 max_size, GError **error_r);
+
+/**
+ * Saves the index and disables the cache.  Must not be called while
+ * entries are in use.
+ */
+void
+curl_cache_finish(void);
+
+/**
+ * Obtains the cache entry for a URL, and creates it if it does not
+ * exist yet.  The entry will not be deleted until
+ * curl_cache_release() is called.
+ *
+ * @return the entry, or NULL if the cache is disabled
+ */
+struct curl_cache_entry *
+curl_cache_acquire(const char *url);
+
+/**
+ * Releases an entry obtained by curl_cache_acquire().  Its index
+ * record is saved to disk.
+ */
+void
+curl_cache_release(struct curl_cache_entry *entry);
+
+/**
+ * Obtains the resource attributes recorded with
+ * curl_cache_set_info().
+ *
+ * @param mime_r returns the MIME type (to be freed with g_free()),
+ * or NULL if unknown
+ * @return false if the attributes are not known
+ */
+bool
+curl_cache_get_info(struct curl_cache_entry *entry,
+		    goffset *size_r, char **mime_r);
+
+/**
+ * Records the size and the MIME type of the resource.  If they
+ * differ from the recorded ones, the resource has changed on the
+ * server, and all cached data is discarded.
+ */
+void
+curl_cache_set_info(struct curl_cache_entry *entry,
+		    goffset size, const char *mime);
+
+/**
+ * Is the byte at the specified offset in the cache?
+ */
+bool
+curl_cache_contains(struct curl_cache_entry *entry, goffset offset);
+
+/**
+ * Reads data from the cache.  Stops at the first byte which is not
+ * cached.
+ *
+ * @return the number of bytes read; 0 if the byte at #offset is not
+ * cached or on I/O error
+ */
+size_t
+curl_cache_read(struct curl_cache_entry *entry, goffset offset,
+		void *dest, size_t length);
+
+/**
+ * Stores data in the cache.  I/O errors are logged and ignored.
+ */
+void
+curl_cache_write(struct curl_cache_entry *entry, goffset offset,
+		 const void *src, size_t length);
+
+#endif
@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "input/curl_input_plugin.h"
+#include "input/curl_cache.h"
 #include "input_internal.h"
 #include "input_plugin.h"
 #include "conf.h"
@@ -26,15 +27,9 @@
 #include "icy_metadata.h"
 #include "io_thread.h"
 #include "glib_compat.h"
+#include "glib_socket.h"
 
 #include <assert.h>
-
-#if defined(WIN32)
-	#include <winsock2.h>
-#else
-	#include <sys/select.h>
-#endif
-
 #include <string.h>
 #include <errno.h>
 
@@ -45,30 +40,39 @@
 #define G_LOG_DOMAIN "input_curl"
 
 /**
- * Do not buffer more than this number of bytes.  It should be a
- * reasonable limit that doesn't make low-end machines suffer too
- * much, but doesn't cause stuttering on high-latency lines.
+ * Do not buffer more than this number of bytes by default.  It
+ * should be a reasonable limit that doesn't make low-end machines
+ * suffer too much, but doesn't cause stuttering on high-latency
+ * lines.
  */
-static const size_t CURL_MAX_BUFFERED = 512 * 1024;
+static const size_t CURL_DEFAULT_BUFFER_SIZE = 512 * 1024;
 
 /**
- * Resume the stream at this number of bytes after it has been paused.
+ * The smallest allowed "buffer_size" setting.
  */
-static const size_t CURL_RESUME_AT = 384 * 1024;
+static const size_t CURL_MIN_BUFFER_SIZE = 64 * 1024;
 
 /**
- * Buffers created by input_curl_writefunction().
+ * The number of idle connections which the multi handle keeps open
+ * for HTTP keep-alive.
  */
-struct buffer {
-	/** size of the payload */
-	size_t size;
+static const long CURL_MAX_CONNECTS = 8;
 
-	/** how much has been consumed yet? */
-	size_t consumed;
+/**
+ * The size of the receive buffer of each stream.
+ */
+static size_t curl_buffer_size;
 
-	/** the payload */
-	unsigned char data[sizeof(long)];
-};
+/**
+ * The low-water mark: a paused stream is resumed when its buffer
+ * has been drained below this number of bytes.
+ */
+static size_t curl_resume_at;
+
+/**
+ * The libcurl version we're running with, see curl_version_info().
+ */
+static unsigned curl_version_num;
 
 struct input_curl {
 	struct input_stream base;
@@ -81,28 +85,25 @@ struct input_curl {
 	/** the curl handles */
 	CURL *easy;
 
-	/** the GMainLoop source used to poll all CURL file
-	    descriptors */
-	GSource *source;
-
-	/** the source id of #source */
-	guint source_id;
+	/**
+	 * The receive buffer: a ring of #curl_buffer_size bytes,
+	 * which input_curl_writefunction() appends to, and
+	 * input_curl_read() reads from.  Protected by the mutex.
+	 */
+	unsigned char *buffer;
 
-	/** a linked list of all registered GPollFD objects */
-	GSList *fds;
+	/** the position of the first unread byte in #buffer */
+	size_t buffer_head;
 
-	/** list of buffers, where input_curl_writefunction() appends
-	    to, and input_curl_read() reads from them */
-	GQueue *buffers;
+	/** the number of unread bytes in #buffer */
+	size_t buffer_fill;
 
-#if LIBCURL_VERSION_NUM >= 0x071200
 	/**
 	 * Is the connection currently paused?  That happens when the
-	 * buffer was getting too large.  It will be unpaused when the
-	 * buffer is below the threshold again.
+	 * buffer is full.  It will be unpaused when the buffer is
+	 * below #curl_resume_at again.
 	 */
 	bool paused;
-#endif
 
 	/** error message provided by libcurl */
 	char error[CURL_ERROR_SIZE];
@@ -118,6 +119,39 @@ struct input_curl {
 	struct tag *tag;
 
 	GError *postponed_error;
+
+	/**
+	 * The disk cache entry for this URL, or NULL if the cache is
+	 * disabled.
+	 */
+	struct curl_cache_entry *cache;
+
+	/**
+	 * Is this stream currently served from #cache instead of
+	 * the network?  There is no HTTP request while this is set.
+	 */
+	bool from_cache;
+
+	/**
+	 * Is the data received from the server stored in #cache?
+	 * This is cleared for responses which can't be cached
+	 * (unknown size, not seekable, icy-metadata), and for range
+	 * requests which the server did not honour.  Only accessed
+	 * in the I/O thread while a request is running.
+	 */
+	bool cache_write;
+
+	/**
+	 * Has the first chunk of the current response been received,
+	 * i.e. have all response headers been seen?
+	 */
+	bool response_started;
+
+	/**
+	 * The stream offset of the next byte received from the
+	 * server.
+	 */
+	goffset write_offset;
 };
 
 /** libcurl should accept "ICY 200 OK" */
@@ -127,6 +161,19 @@ static struct curl_slist *http_200_aliases;
 static const char *proxy, *proxy_user, *proxy_password;
 static unsigned proxy_port;
 
+/**
+ * A socket which libcurl has asked us to watch.  It is attached to
+ * the socket with curl_multi_assign().
+ */
+struct curl_socket {
+	curl_socket_t fd;
+
+	GIOChannel *channel;
+
+	/** the I/O watch on #channel, or NULL */
+	GSource *source;
+};
+
 static struct {
 	CURLM *multi;
 
@@ -137,32 +184,10 @@ static struct {
 	GSList *requests;
 
 	/**
-	 * The GMainLoop source used to poll all CURL file
-	 * descriptors.
-	 */
-	GSource *source;
-
-	/**
-	 * The source id of #source.
-	 */
-	guint source_id;
-
-	GSList *fds;
-
-#if LIBCURL_VERSION_NUM >= 0x070f04
-	/**
-	 * Did CURL give us a timeout?  If yes, then we need to call
-	 * curl_multi_perform(), even if there was no event on any
-	 * file descriptor.
+	 * The timer requested by libcurl with
+	 * CURLMOPT_TIMERFUNCTION, or NULL.
 	 */
-	bool timeout;
-
-	/**
-	 * The absolute time stamp when the timeout expires.  This is
-	 * used in the GSource method check().
-	 */
-	GTimeVal absolute_timeout;
-#endif
+	GSource *timeout_source;
 } curl;
 
 static inline GQuark
@@ -190,117 +215,6 @@ input_curl_find_request(CURL *easy)
 	return NULL;
 }
 
-#if LIBCURL_VERSION_NUM >= 0x071200
-
-static gpointer
-input_curl_resume(gpointer data)
-{
-	assert(io_thread_inside());
-
-	struct input_curl *c = data;
-
-	if (c->paused) {
-		c->paused = false;
-		curl_easy_pause(c->easy, CURLPAUSE_CONT);
-	}
-
-	return NULL;
-}
-
-#endif
-
-/**
- * Calculates the GLib event bit mask for one file descriptor,
- * obtained from three #fd_set objects filled by curl_multi_fdset().
- */
-static gushort
-input_curl_fd_events(int fd, fd_set *rfds, fd_set *wfds, fd_set *efds)
-{
-	gushort events = 0;
-
-	if (FD_ISSET(fd, rfds)) {
-		events |= G_IO_IN | G_IO_HUP | G_IO_ERR;
-		FD_CLR(fd, rfds);
-	}
-
-	if (FD_ISSET(fd, wfds)) {
-		events |= G_IO_OUT | G_IO_ERR;
-		FD_CLR(fd, wfds);
-	}
-
-	if (FD_ISSET(fd, efds)) {
-		events |= G_IO_HUP | G_IO_ERR;
-		FD_CLR(fd, efds);
-	}
-
-	return events;
-}
-
-/**
- * Updates all registered GPollFD objects, unregisters old ones,
- * registers new ones.
- *
- * Runs in the I/O thread.  No lock needed.
- */
-static void
-curl_update_fds(void)
-{
-	assert(io_thread_inside());
-
-	fd_set rfds, wfds, efds;
-
-	FD_ZERO(&rfds);
-	FD_ZERO(&wfds);
-	FD_ZERO(&efds);
-
-	int max_fd;
-	CURLMcode mcode = curl_multi_fdset(curl.multi, &rfds, &wfds,
-					   &efds, &max_fd);
-	if (mcode != CURLM_OK) {
-		g_warning("curl_multi_fdset() failed: %s\n",
-			  curl_multi_strerror(mcode));
-		return;
-	}
-
-	GSList *fds = curl.fds;
-	curl.fds = NULL;
-
-	while (fds != NULL) {
-		GPollFD *poll_fd = fds->data;
-		gushort events = input_curl_fd_events(poll_fd->fd, &rfds,
-						      &wfds, &efds);
-
-		assert(poll_fd->events != 0);
-
-		fds = g_slist_remove(fds, poll_fd);
-
-		if (events != poll_fd->events)
-			g_source_remove_poll(curl.source, poll_fd);
-
-		if (events != 0) {
-			if (events != poll_fd->events) {
-				poll_fd->events = events;
-				g_source_add_poll(curl.source, poll_fd);
-			}
-
-			curl.fds = g_slist_prepend(curl.fds, poll_fd);
-		} else {
-			g_free(poll_fd);
-		}
-	}
-
-	for (int fd = 0; fd <= max_fd; ++fd) {
-		gushort events = input_curl_fd_events(fd, &rfds, &wfds, &efds);
-		if (events != 0) {
-			GPollFD *poll_fd = g_new(GPollFD, 1);
-			poll_fd->fd = fd;
-			poll_fd->events = events;
-			g_source_add_poll(curl.source, poll_fd);
-			curl.fds = g_slist_prepend(curl.fds, poll_fd);
-		}
-	}
-}
-
 /**
  * Runs in the I/O thread.  No lock needed.
  */
@@ -322,8 +236,6 @@ input_curl_easy_add(struct input_curl *c, GError **error_r)
 		return false;
 	}
 
-	curl_update_fds();
-
 	return true;
 }
 
@@ -379,8 +291,10 @@ input_curl_easy_free(struct input_curl *c)
 	curl.requests = g_slist_remove(curl.requests, c);
 
 	curl_multi_remove_handle(curl.multi, c->easy);
+
 	curl_easy_cleanup(c->easy);
 	c->easy = NULL;
+	c->paused = false;
 
 	curl_slist_free_all(c->request_headers);
 	c->request_headers = NULL;
@@ -395,7 +309,6 @@ input_curl_easy_free_callback(gpointer data)
 	struct input_curl *c = data;
 
 	input_curl_easy_free(c);
-	curl_update_fds();
 
 	return NULL;
 }
@@ -532,107 +445,202 @@ input_curl_perform(void)
 	return true;
 }
 
+/**
+ * Let CURL handle an event on the specified socket, or expired
+ * timers if it is CURL_SOCKET_TIMEOUT.
+ *
+ * Runs in the I/O thread.  The caller must not hold locks.
+ */
+static bool
+input_curl_socket_action(curl_socket_t fd, int ev_bitmask)
+{
+	assert(io_thread_inside());
+
+	CURLMcode mcode;
+
+	do {
+		int running_handles;
+		mcode = curl_multi_socket_action(curl.multi, fd, ev_bitmask,
+						 &running_handles);
+	} while (mcode == CURLM_CALL_MULTI_PERFORM);
+
+	if (mcode != CURLM_OK) {
+		GError *error = g_error_new(curl_quark(), mcode,
+					    "curl_multi_socket_action() failed: %s",
+					    curl_multi_strerror(mcode));
+		input_curl_abort_all_requests(error);
+		return false;
+	}
+
+	return true;
+}
+
+static gpointer
+input_curl_resume(gpointer data)
+{
+	assert(io_thread_inside());
+
+	struct input_curl *c = data;
+
+	if (c->paused) {
+		c->paused = false;
+		curl_easy_pause(c->easy, CURLPAUSE_CONT);
+
+		if (curl_version_num < 0x072000 && input_curl_perform())
+			/* libcurl older than 7.32.0 does not update
+			   its sockets after curl_easy_pause(); force
+			   libcurl to do it now */
+			input_curl_info_read();
+	}
+
+	return NULL;
+}
+
 /*
- * GSource methods
+ * multi socket callbacks
  *
  */
 
 /**
- * The GSource prepare() method implementation.
+ * Called by the main loop when an event occurs on a socket.
  */
 static gboolean
-input_curl_source_prepare(G_GNUC_UNUSED GSource *source, gint *timeout_r)
+input_curl_socket_event(G_GNUC_UNUSED GIOChannel *channel,
+			GIOCondition condition, gpointer data)
 {
-	curl_update_fds();
-
-#if LIBCURL_VERSION_NUM >= 0x070f04
-	curl.timeout = false;
-
-	long timeout2;
-	CURLMcode mcode = curl_multi_timeout(curl.multi, &timeout2);
-	if (mcode == CURLM_OK) {
-		if (timeout2 >= 0) {
-			g_source_get_current_time(source,
-						  &curl.absolute_timeout);
-			g_time_val_add(&curl.absolute_timeout,
-				       timeout2 * 1000);
-		}
+	const struct curl_socket *s = data;
+
+	int ev_bitmask = 0;
+	if (condition & G_IO_IN)
+		ev_bitmask |= CURL_CSELECT_IN;
+	if (condition & G_IO_OUT)
+		ev_bitmask |= CURL_CSELECT_OUT;
+	if (condition & (G_IO_ERR|G_IO_HUP))
+		ev_bitmask |= CURL_CSELECT_ERR;
+
+	/* note that "s" may be freed by curl_multi_socket_action() */
+	if (input_curl_socket_action(s->fd, ev_bitmask))
+		input_curl_info_read();
+
+	return true;
+}
+
+static void
+curl_socket_unschedule(struct curl_socket *s)
+{
+	if (s->source == NULL)
+		return;
 
-		if (timeout2 >= 0 && timeout2 < 10)
-			/* CURL 7.21.1 likes to report "timeout=0",
-			   which means we're running in a busy loop.
-			   Quite a bad idea to waste so much CPU.
-			   Let's use a lower limit of 10ms. */
-			timeout2 = 10;
+	g_source_destroy(s->source);
+	g_source_unref(s->source);
+	s->source = NULL;
+}
 
-		*timeout_r = timeout2;
+static void
+curl_socket_schedule(struct curl_socket *s, int what)
+{
+	GIOCondition condition = 0;
+	if (what & CURL_POLL_IN)
+		condition |= G_IO_IN|G_IO_ERR|G_IO_HUP;
+	if (what & CURL_POLL_OUT)
+		condition |= G_IO_OUT|G_IO_ERR;
 
-		curl.timeout = timeout2 >= 0;
-	} else
-		g_warning("curl_multi_timeout() failed: %s\n",
-			  curl_multi_strerror(mcode));
-#else
-	(void)timeout_r;
-#endif
+	curl_socket_unschedule(s);
 
-	return false;
+	if (condition == 0)
+		return;
+
+	s->source = g_io_create_watch(s->channel, condition);
+	g_source_set_callback(s->source, (GSourceFunc)input_curl_socket_event,
+			      s, NULL);
+	g_source_attach(s->source, io_thread_context());
 }
 
 /**
- * The GSource check() method implementation.
+ * The CURLMOPT_SOCKETFUNCTION callback: libcurl tells us which
+ * events it is interested in on a socket.
+ *
+ * Runs in the I/O thread.  No lock needed.
  */
-static gboolean
-input_curl_source_check(G_GNUC_UNUSED GSource *source)
+static int
+input_curl_socket_function(G_GNUC_UNUSED CURL *easy, curl_socket_t fd,
+			   int what, G_GNUC_UNUSED void *userp,
+			   void *socketp)
 {
-#if LIBCURL_VERSION_NUM >= 0x070f04
-	if (curl.timeout) {
-		/* when a timeout has expired, we need to call
-		   curl_multi_perform(), even if there was no file
-		   descriptor event */
-
-		GTimeVal now;
-		g_source_get_current_time(source, &now);
-		if (now.tv_sec > curl.absolute_timeout.tv_sec ||
-		    (now.tv_sec == curl.absolute_timeout.tv_sec &&
-		     now.tv_usec >= curl.absolute_timeout.tv_usec))
-			return true;
+	assert(io_thread_inside());
+
+	struct curl_socket *s = socketp;
+
+	if (what == CURL_POLL_REMOVE) {
+		if (s != NULL) {
+			curl_socket_unschedule(s);
+			g_io_channel_unref(s->channel);
+			g_free(s);
+		}
+
+		return 0;
 	}
-#endif
 
-	for (GSList *i = curl.fds; i != NULL; i = i->next) {
-		GPollFD *poll_fd = i->data;
-		if (poll_fd->revents != 0)
-			return true;
+	if (s == NULL) {
+		s = g_new(struct curl_socket, 1);
+		s->fd = fd;
+		s->channel = g_io_channel_new_socket(fd);
+		s->source = NULL;
+
+		curl_multi_assign(curl.multi, fd, s);
 	}
 
-	return false;
+	curl_socket_schedule(s, what);
+	return 0;
 }
 
-/**
- * The GSource dispatch() method implementation.  The callback isn't
- * used, because we're handling all events directly.
- */
 static gboolean
-input_curl_source_dispatch(G_GNUC_UNUSED GSource *source,
-			   G_GNUC_UNUSED GSourceFunc callback,
-			   G_GNUC_UNUSED gpointer user_data)
+input_curl_timeout(G_GNUC_UNUSED gpointer data)
 {
-	if (input_curl_perform())
+	assert(curl.timeout_source != NULL);
+
+	g_source_unref(curl.timeout_source);
+	curl.timeout_source = NULL;
+
+	if (input_curl_socket_action(CURL_SOCKET_TIMEOUT, 0))
 		input_curl_info_read();
 
-	return true;
+	return false;
 }
 
 /**
- * The vtable for our GSource implementation.  Unfortunately, we
- * cannot declare it "const", because g_source_new() takes a non-const
- * pointer, for whatever reason.
+ * The CURLMOPT_TIMERFUNCTION callback: libcurl wants to be called
+ * again after the specified number of milliseconds, or not at all
+ * if it is negative.
+ *
+ * Runs in the I/O thread.  No lock needed.
  */
-static GSourceFuncs curl_source_funcs = {
-	.prepare = input_curl_source_prepare,
-	.check = input_curl_source_check,
-	.dispatch = input_curl_source_dispatch,
-};
+static int
+input_curl_timer_function(G_GNUC_UNUSED CURLM *multi, long timeout_ms,
+			  G_GNUC_UNUSED void *userp)
+{
+	assert(io_thread_inside());
+
+	if (curl.timeout_source != NULL) {
+		g_source_destroy(curl.timeout_source);
+		g_source_unref(curl.timeout_source);
+		curl.timeout_source = NULL;
+	}
+
+	if (timeout_ms < 0)
+		return 0;
+
+	if (timeout_ms < 10)
+		/* CURL 7.21.1 likes to report "timeout=0", which
+		   means we're running in a busy loop.  Quite a bad
+		   idea to waste so much CPU.  Let's use a lower limit
+		   of 10ms. */
+		timeout_ms = 10;
+
+	curl.timeout_source = io_thread_timeout_add(timeout_ms,
+						    input_curl_timeout, NULL);
+	return 0;
+}
 
 /*
  * input_plugin methods
@@ -668,6 +676,39 @@ input_curl_init(const struct config_param *param,
 						   "");
 	}
 
+	curl_buffer_size = (size_t)
+		config_get_block_unsigned(param, "buffer_size",
+					  CURL_DEFAULT_BUFFER_SIZE / 1024) * 1024;
+	if (curl_buffer_size < CURL_MIN_BUFFER_SIZE) {
+		g_set_error(error_r, curl_quark(), 0,
+			    "buffer_size must be at least %u KiB",
+			    (unsigned)(CURL_MIN_BUFFER_SIZE / 1024));
+		return false;
+	}
+
+	curl_resume_at = (size_t)
+		config_get_block_unsigned(param, "resume_at",
+					  curl_buffer_size * 3 / 4 / 1024) * 1024;
+	if (curl_resume_at + CURL_MAX_WRITE_SIZE > curl_buffer_size) {
+		/* libcurl must be able to deliver at least one
+		   chunk after the transfer has been resumed */
+		g_set_error(error_r, curl_quark(), 0,
+			    "resume_at must be at least %u KiB less than "
+			    "buffer_size",
+			    (unsigned)(CURL_MAX_WRITE_SIZE / 1024));
+		return false;
+	}
+
+	const char *cache_directory =
+		config_get_block_string(param, "cache_directory", NULL);
+	if (cache_directory != NULL) {
+		unsigned cache_size =
+			config_get_block_unsigned(param, "cache_size", 512);
+		if (!curl_cache_init(cache_directory,
+				     (guint64)cache_size << 20, error_r))
+			return false;
+	}
+
 	curl.multi = curl_multi_init();
 	if (curl.multi == NULL) {
 		g_set_error(error_r, curl_quark(), 0,
@@ -675,16 +716,34 @@ input_curl_init(const struct config_param *param,
 		return false;
 	}
 
-	curl.source = g_source_new(&curl_source_funcs, sizeof(*curl.source));
-	curl.source_id = g_source_attach(curl.source, io_thread_context());
+	curl_multi_setopt(curl.multi, CURLMOPT_SOCKETFUNCTION,
+			  input_curl_socket_function);
+	curl_multi_setopt(curl.multi, CURLMOPT_TIMERFUNCTION,
+			  input_curl_timer_function);
+
+	/* finished requests leave their connections in the multi
+	   handle's connection cache, to be reused by the next request
+	   to the same server */
+	curl_multi_setopt(curl.multi, CURLMOPT_MAXCONNECTS,
+			  CURL_MAX_CONNECTS);
+
+	curl_version_num = curl_version_info(CURLVERSION_NOW)->version_num;
 
 	return true;
 }
 
 static gpointer
-curl_destroy_sources(G_GNUC_UNUSED gpointer data)
+curl_cleanup_multi(G_GNUC_UNUSED gpointer data)
 {
-	g_source_destroy(curl.source);
+	/* this may invoke the socket and timer callbacks, which must
+	   run in the I/O thread */
+	curl_multi_cleanup(curl.multi);
+
+	if (curl.timeout_source != NULL) {
+		g_source_destroy(curl.timeout_source);
+		g_source_unref(curl.timeout_source);
+		curl.timeout_source = NULL;
+	}
 
 	return NULL;
 }
@@ -694,55 +753,83 @@ input_curl_finish(void)
 {
 	assert(curl.requests == NULL);
 
-	io_thread_call(curl_destroy_sources, NULL);
-
-	curl_multi_cleanup(curl.multi);
+	io_thread_call(curl_cleanup_multi, NULL);
 
 	curl_slist_free_all(http_200_aliases);
 
+	curl_cache_finish();
+
 	curl_global_cleanup();
 }
 
-#if LIBCURL_VERSION_NUM >= 0x071200
+/**
+ * Appends data to the receive buffer.  The caller must lock the
+ * mutex, and must make sure that there is enough room.
+ */
+static void
+curl_buffer_append(struct input_curl *c, const void *src, size_t length)
+{
+	assert(length <= curl_buffer_size - c->buffer_fill);
+
+	size_t tail = c->buffer_head + c->buffer_fill;
+	if (tail >= curl_buffer_size)
+		tail -= curl_buffer_size;
+
+	size_t first = curl_buffer_size - tail;
+	if (first > length)
+		first = length;
+
+	memcpy(c->buffer + tail, src, first);
+	memcpy(c->buffer, (const unsigned char *)src + first, length - first);
+
+	c->buffer_fill += length;
+}
 
 /**
- * Determine the total sizes of all buffers, including portions that
- * have already been consumed.
+ * Returns a pointer to the first unread byte of the receive buffer,
+ * and the number of unread bytes which follow it contiguously.
  *
  * The caller must lock the mutex.
  */
-G_GNUC_PURE
-static size_t
-curl_total_buffer_size(const struct input_curl *c)
+static const unsigned char *
+curl_buffer_read(const struct input_curl *c, size_t *length_r)
 {
-	size_t total = 0;
+	size_t length = curl_buffer_size - c->buffer_head;
+	if (length > c->buffer_fill)
+		length = c->buffer_fill;
 
-	for (GList *i = g_queue_peek_head_link(c->buffers);
-	     i != NULL; i = g_list_next(i)) {
-		struct buffer *buffer = i->data;
-		total += buffer->size;
-	}
-
-	return total;
+	*length_r = length;
+	return c->buffer + c->buffer_head;
 }
 
-#endif
-
+/**
+ * Mark a part of the receive buffer as consumed.
+ *
+ * The caller must lock the mutex.
+ */
 static void
-buffer_free_callback(gpointer data, G_GNUC_UNUSED gpointer user_data)
+curl_buffer_consume(struct input_curl *c, size_t length)
 {
-	struct buffer *buffer = data;
-
-	assert(buffer->consumed <= buffer->size);
-
-	g_free(buffer);
+	assert(length <= c->buffer_fill);
+
+	c->buffer_fill -= length;
+
+	if (c->buffer_fill == 0) {
+		/* rewind, so the next read is likely to be
+		   contiguous */
+		c->buffer_head = 0;
+	} else {
+		c->buffer_head += length;
+		if (c->buffer_head >= curl_buffer_size)
+			c->buffer_head -= curl_buffer_size;
+	}
 }
 
 static void
 input_curl_flush_buffers(struct input_curl *c)
 {
-	g_queue_foreach(c->buffers, buffer_free_callback, NULL);
-	g_queue_clear(c->buffers);
+	c->buffer_head = 0;
+	c->buffer_fill = 0;
 }
 
 /**
@@ -756,9 +843,11 @@ input_curl_free(struct input_curl *c)
 	g_free(c->meta_name);
 
 	input_curl_easy_free_indirect(c);
-	input_curl_flush_buffers(c);
 
-	g_queue_free(c->buffers);
+	g_free(c->buffer);
+
+	if (c->cache != NULL)
+		curl_cache_release(c->cache);
 
 	if (c->postponed_error != NULL)
 		g_error_free(c->postponed_error);
@@ -795,7 +884,7 @@ input_curl_tag(struct input_stream *is)
 static bool
 fill_buffer(struct input_curl *c, GError **error_r)
 {
-	while (c->easy != NULL && g_queue_is_empty(c->buffers))
+	while (c->easy != NULL && c->buffer_fill == 0)
 		g_cond_wait(c->base.cond, c->base.mutex);
 
 	if (c->postponed_error != NULL) {
@@ -804,79 +893,51 @@ fill_buffer(struct input_curl *c, GError **error_r)
 		return false;
 	}
 
-	return !g_queue_is_empty(c->buffers);
-}
-
-/**
- * Mark a part of the buffer object as consumed.
- */
-static struct buffer *
-consume_buffer(struct buffer *buffer, size_t length)
-{
-	assert(buffer != NULL);
-	assert(buffer->consumed < buffer->size);
-
-	buffer->consumed += length;
-	if (buffer->consumed < buffer->size)
-		return buffer;
-
-	assert(buffer->consumed == buffer->size);
-
-	g_free(buffer);
-
-	return NULL;
+	return c->buffer_fill > 0;
 }
 
 static size_t
-read_from_buffer(struct icy_metadata *icy_metadata, GQueue *buffers,
-		 void *dest0, size_t length)
+read_from_buffer(struct input_curl *c, void *dest0, size_t length)
 {
-	struct buffer *buffer = g_queue_pop_head(buffers);
+	size_t available;
+	const unsigned char *src = curl_buffer_read(c, &available);
 	uint8_t *dest = dest0;
 	size_t nbytes = 0;
 
-	assert(buffer->size > 0);
-	assert(buffer->consumed < buffer->size);
+	assert(available > 0);
 
-	if (length > buffer->size - buffer->consumed)
-		length = buffer->size - buffer->consumed;
+	if (length > available)
+		length = available;
 
 	while (true) {
 		size_t chunk;
 
-		chunk = icy_data(icy_metadata, length);
+		chunk = icy_data(&c->icy_metadata, length);
 		if (chunk > 0) {
-			memcpy(dest, buffer->data + buffer->consumed,
-			       chunk);
-			buffer = consume_buffer(buffer, chunk);
+			memcpy(dest, src, chunk);
+			curl_buffer_consume(c, chunk);
 
+			src += chunk;
 			nbytes += chunk;
 			dest += chunk;
 			length -= chunk;
 
 			if (length == 0)
 				break;
-
-			assert(buffer != NULL);
 		}
 
-		chunk = icy_meta(icy_metadata, buffer->data + buffer->consumed,
-				 length);
+		chunk = icy_meta(&c->icy_metadata, src, length);
 		if (chunk > 0) {
-			buffer = consume_buffer(buffer, chunk);
+			curl_buffer_consume(c, chunk);
 
+			src += chunk;
 			length -= chunk;
 
 			if (length == 0)
 				break;
-
-			assert(buffer != NULL);
 		}
 	}
 
-	if (buffer != NULL)
-		g_queue_push_head(buffers, buffer);
-
 	return nbytes;
 }
 
@@ -902,10 +963,14 @@ input_curl_available(struct input_stream *is)
 {
 	struct input_curl *c = (struct input_curl *)is;
 
-	return c->postponed_error != NULL || c->easy == NULL ||
-		!g_queue_is_empty(c->buffers);
+	return c->from_cache ||
+		c->postponed_error != NULL || c->easy == NULL ||
+		c->buffer_fill > 0;
 }
 
+static bool
+input_curl_restart(struct input_curl *c, GError **error_r);
+
 static size_t
 input_curl_read(struct input_stream *is, void *ptr, size_t size,
 		GError **error_r)
@@ -915,6 +980,21 @@ input_curl_read(struct input_stream *is, void *ptr, size_t size,
 	size_t nbytes = 0;
 	char *dest = ptr;
 
+	if (c->from_cache) {
+		nbytes = curl_cache_read(c->cache, is->offset, ptr, size);
+		if (nbytes > 0) {
+			is->offset += (goffset)nbytes;
+			return nbytes;
+		}
+
+		if (is->offset >= is->size)
+			return 0;
+
+		/* reached a hole in the cache: download the rest */
+		if (!input_curl_restart(c, error_r))
+			return 0;
+	}
+
 	do {
 		/* fill the buffer */
 
@@ -924,9 +1004,8 @@ input_curl_read(struct input_stream *is, void *ptr, size_t size,
 
 		/* send buffer contents */
 
-		while (size > 0 && !g_queue_is_empty(c->buffers)) {
-			size_t copy = read_from_buffer(&c->icy_metadata, c->buffers,
-						       dest + nbytes, size);
+		while (size > 0 && c->buffer_fill > 0) {
+			size_t copy = read_from_buffer(c, dest + nbytes, size);
 
 			nbytes += copy;
 			size -= copy;
@@ -938,13 +1017,11 @@ input_curl_read(struct input_stream *is, void *ptr, size_t size,
 
 	is->offset += (goffset)nbytes;
 
-#if LIBCURL_VERSION_NUM >= 0x071200
-	if (c->paused && curl_total_buffer_size(c) < CURL_RESUME_AT) {
+	if (c->paused && c->buffer_fill < curl_resume_at) {
 		g_mutex_unlock(c->base.mutex);
 		io_thread_call(input_curl_resume, c);
 		g_mutex_lock(c->base.mutex);
 	}
-#endif
 
 	return nbytes;
 }
@@ -962,7 +1039,10 @@ input_curl_eof(G_GNUC_UNUSED struct input_stream *is)
 {
 	struct input_curl *c = (struct input_curl *)is;
 
-	return c->easy == NULL && g_queue_is_empty(c->buffers);
+	if (c->from_cache)
+		return is->offset >= is->size;
+
+	return c->easy == NULL && c->buffer_fill == 0;
 }
 
 /** called by curl when new data is available */
@@ -1009,6 +1089,15 @@ input_curl_headerfunction(void *ptr, size_t size, size_t nmemb, void *stream)
 		buffer[end - value] = 0;
 
 		c->base.size = c->base.offset + g_ascii_strtoull(buffer, NULL, 10);
+	} else if (g_ascii_strcasecmp(name, "content-range") == 0) {
+		/* "bytes START-END/TOTAL": store the data in the
+		   cache only if the server has honoured the range
+		   request */
+		if (end - value > 6 &&
+		    g_ascii_strncasecmp(value, "bytes ", 6) == 0)
+			c->cache_write = c->cache != NULL &&
+				(goffset)g_ascii_strtoull(value + 6, NULL, 10)
+				== c->write_offset;
 	} else if (g_ascii_strcasecmp(name, "content-type") == 0) {
 		g_free(c->base.mime);
 		c->base.mime = g_strndup(value, end - value);
@@ -1054,7 +1143,6 @@ static size_t
 input_curl_writefunction(void *ptr, size_t size, size_t nmemb, void *stream)
 {
 	struct input_curl *c = (struct input_curl *)stream;
-	struct buffer *buffer;
 
 	size *= nmemb;
 	if (size == 0)
@@ -1062,25 +1150,41 @@ input_curl_writefunction(void *ptr, size_t size, size_t nmemb, void *stream)
 
 	g_mutex_lock(c->base.mutex);
 
-#if LIBCURL_VERSION_NUM >= 0x071200
-	if (curl_total_buffer_size(c) + size >= CURL_MAX_BUFFERED) {
+	if (size > curl_buffer_size - c->buffer_fill) {
+		/* the buffer is full; input_curl_read() resumes the
+		   transfer when it has been drained below the
+		   low-water mark */
 		c->paused = true;
 		g_mutex_unlock(c->base.mutex);
 		return CURL_WRITEFUNC_PAUSE;
 	}
-#endif
-
-	buffer = g_malloc(sizeof(*buffer) - sizeof(buffer->data) + size);
-	buffer->size = size;
-	buffer->consumed = 0;
-	memcpy(buffer->data, ptr, size);
 
-	g_queue_push_tail(c->buffers, buffer);
+	curl_buffer_append(c, ptr, size);
 	c->base.ready = true;
 
 	g_cond_broadcast(c->base.cond);
 	g_mutex_unlock(c->base.mutex);
 
+	if (!c->response_started) {
+		/* all response headers have been received now */
+		c->response_started = true;
+
+		if (c->cache_write) {
+			if (c->base.size >= 0 && c->base.seekable &&
+			    !icy_defined(&c->icy_metadata))
+				curl_cache_set_info(c->cache, c->base.size,
+						    c->base.mime);
+			else
+				c->cache_write = false;
+		}
+	}
+
+	/* this is done without holding the mutex, because disk I/O
+	   may be slow */
+	if (c->cache_write)
+		curl_cache_write(c->cache, c->write_offset, ptr, size);
+	c->write_offset += size;
+
 	return size;
 }
 
@@ -1143,12 +1247,67 @@ input_curl_easy_init(struct input_curl *c, GError **error_r)
 	return true;
 }
 
+/**
+ * Closes the current connection (if any), and sends a new HTTP
+ * request beginning at the current offset.
+ *
+ * The caller must lock the mutex.
+ */
+static bool
+input_curl_restart(struct input_curl *c, GError **error_r)
+{
+	struct input_stream *is = &c->base;
+
+	g_mutex_unlock(c->base.mutex);
+
+	input_curl_easy_free_indirect(c);
+	input_curl_flush_buffers(c);
+
+	if (!input_curl_easy_init(c, error_r)) {
+		g_mutex_lock(c->base.mutex);
+		return false;
+	}
+
+	/* send the "Range" header */
+
+	if (is->offset > 0) {
+		c->range = g_strdup_printf("%lld-", (long long)is->offset);
+		curl_easy_setopt(c->easy, CURLOPT_RANGE, c->range);
+	}
+
+	/* store the response in the cache only after the
+	   "Content-Range" response header has confirmed the offset */
+	c->from_cache = false;
+	c->cache_write = c->cache != NULL && is->offset == 0;
+	c->response_started = false;
+	c->write_offset = is->offset;
+
+	c->base.ready = false;
+
+	if (!input_curl_easy_add_indirect(c, error_r)) {
+		g_mutex_lock(c->base.mutex);
+		return false;
+	}
+
+	g_mutex_lock(c->base.mutex);
+
+	while (!c->base.ready)
+		g_cond_wait(c->base.cond, c->base.mutex);
+
+	if (c->postponed_error != NULL) {
+		g_propagate_error(error_r, c->postponed_error);
+		c->postponed_error = NULL;
+		return false;
+	}
+
+	return true;
+}
+
 static bool
 input_curl_seek(struct input_stream *is, goffset offset, int whence,
 		GError **error_r)
 {
 	struct input_curl *c = (struct input_curl *)is;
-	bool ret;
 
 	assert(is->ready);
 
@@ -1186,69 +1345,51 @@ input_curl_seek(struct input_stream *is, goffset offset, int whence,
 
 	/* check if we can fast-forward the buffer */
 
-	while (offset > is->offset && !g_queue_is_empty(c->buffers)) {
-		struct buffer *buffer;
-		size_t length;
-
-		buffer = (struct buffer *)g_queue_pop_head(c->buffers);
-
-		length = buffer->size - buffer->consumed;
+	if (offset > is->offset && c->buffer_fill > 0) {
+		size_t length = c->buffer_fill;
 		if (offset - is->offset < (goffset)length)
 			length = offset - is->offset;
 
-		buffer = consume_buffer(buffer, length);
-		if (buffer != NULL)
-			g_queue_push_head(c->buffers, buffer);
-
+		curl_buffer_consume(c, length);
 		is->offset += length;
 	}
 
 	if (offset == is->offset)
 		return true;
 
-	/* close the old connection and open a new one */
+	if (c->cache != NULL && is->size >= 0 &&
+	    (offset == is->size || curl_cache_contains(c->cache, offset))) {
+		/* serve this from the disk cache, and don't bother the
+		   server until we reach a hole */
 
-	g_mutex_unlock(c->base.mutex);
+		g_mutex_unlock(c->base.mutex);
+		input_curl_easy_free_indirect(c);
+		input_curl_flush_buffers(c);
+		g_mutex_lock(c->base.mutex);
 
-	input_curl_easy_free_indirect(c);
-	input_curl_flush_buffers(c);
+		is->offset = offset;
+		c->from_cache = true;
+		return true;
+	}
+
+	/* close the old connection and open a new one */
 
 	is->offset = offset;
 	if (is->offset == is->size) {
 		/* seek to EOF: simulate empty result; avoid
 		   triggering a "416 Requested Range Not Satisfiable"
 		   response */
-		return true;
-	}
-
-	ret = input_curl_easy_init(c, error_r);
-	if (!ret)
-		return false;
-
-	/* send the "Range" header */
-
-	if (is->offset > 0) {
-		c->range = g_strdup_printf("%lld-", (long long)is->offset);
-		curl_easy_setopt(c->easy, CURLOPT_RANGE, c->range);
-	}
 
-	c->base.ready = false;
-
-	if (!input_curl_easy_add_indirect(c, error_r))
-		return false;
-
-	g_mutex_lock(c->base.mutex);
-
-	while (!c->base.ready)
-		g_cond_wait(c->base.cond, c->base.mutex);
+		g_mutex_unlock(c->base.mutex);
+		input_curl_easy_free_indirect(c);
+		input_curl_flush_buffers(c);
+		g_mutex_lock(c->base.mutex);
 
-	if (c->postponed_error != NULL) {
-		g_propagate_error(error_r, c->postponed_error);
-		c->postponed_error = NULL;
-		return false;
+		c->from_cache = false;
+		return true;
 	}
 
-	return true;
+	return input_curl_restart(c, error_r);
 }
 
 static struct input_stream *
@@ -1268,16 +1409,40 @@ input_curl_open(const char *url, GMutex *mutex, GCond *cond,
 			  mutex, cond);
 
 	c->url = g_strdup(url);
-	c->buffers = g_queue_new();
+	c->buffer = g_malloc(curl_buffer_size);
+	c->buffer_head = c->buffer_fill = 0;
 
 	icy_clear(&c->icy_metadata);
 	c->tag = NULL;
 
 	c->postponed_error = NULL;
 
-#if LIBCURL_VERSION_NUM >= 0x071200
 	c->paused = false;
-#endif
+
+	c->cache = curl_cache_acquire(url);
+	if (c->cache != NULL) {
+		goffset size;
+		char *mime;
+
+		if (curl_cache_get_info(c->cache, &size, &mime)) {
+			if (curl_cache_contains(c->cache, 0)) {
+				/* start playing from the cache, without
+				   any HTTP request */
+				c->base.size = size;
+				c->base.mime = mime;
+				c->base.seekable = true;
+				c->base.ready = true;
+				c->from_cache = true;
+				return &c->base;
+			}
+
+			g_free(mime);
+		}
+	}
+
+	c->cache_write = c->cache != NULL;
+	c->response_started = false;
+	c->write_offset = 0;
 
 	if (!input_curl_easy_init(c, error_r)) {
 		input_curl_free(c);
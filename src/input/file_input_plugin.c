@@ -22,10 +22,18 @@
 #include "input_internal.h"
 #include "input_plugin.h"
 #include "fd_util.h"
+#include "fifo_buffer.h"
+#include "conf.h"
 #include "open.h"
 
+#include <assert.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <stdint.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <errno.h>
 #include <string.h>
 #include <glib.h>
@@ -33,18 +41,244 @@
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "input_file"
 
+enum {
+	/**
+	 * The read-ahead thread is started after this many bytes
+	 * have been read sequentially.  This avoids speculative I/O
+	 * for callers which only look at the file header, such as
+	 * the database update.
+	 */
+	FILE_READAHEAD_THRESHOLD = 64 * 1024,
+
+	/**
+	 * The maximum size of one read() call in the read-ahead
+	 * thread.
+	 */
+	FILE_READAHEAD_CHUNK = 128 * 1024,
+};
+
 struct file_input_stream {
 	struct input_stream base;
 
 	int fd;
+
+	/**
+	 * The whole file mapped into memory, or NULL if the file is
+	 * read with read().  When set, the read-ahead buffer is not
+	 * used.
+	 */
+	const unsigned char *map;
+
+	/**
+	 * The number of bytes read synchronously since the stream
+	 * was opened or last seeked.
+	 */
+	goffset direct_bytes;
+
+	/**
+	 * The read-ahead buffer; NULL until the read-ahead thread
+	 * has been started.  The following attributes are protected
+	 * by input_stream.mutex.
+	 */
+	struct fifo_buffer *buffer;
+
+	GThread *thread;
+
+	/**
+	 * Wakes up the read-ahead thread after data has been
+	 * consumed, after a seek and on close.
+	 */
+	GCond *wake;
+
+	/**
+	 * The file offset of the end of the data in #buffer.
+	 */
+	goffset fill_offset;
+
+	/**
+	 * Incremented by each seek which discards the buffer; the
+	 * read-ahead thread discards data which was read for an
+	 * older generation.
+	 */
+	unsigned generation;
+
+	/**
+	 * True while the read-ahead thread fills the buffer; it
+	 * pauses when the buffer is full, until half of it has been
+	 * consumed.
+	 */
+	bool filling;
+
+	/**
+	 * True when the read-ahead thread has reached the end of the
+	 * file.
+	 */
+	bool eof;
+
+	bool quit;
+
+	/**
+	 * An error which has occurred in the read-ahead thread.
+	 */
+	GError *error;
 };
 
+/**
+ * The size of the read-ahead window in bytes; 0 disables read-ahead.
+ */
+static size_t file_readahead_size;
+
+/**
+ * Map files into memory instead of reading them?
+ */
+static bool file_mmap;
+
 static inline GQuark
 file_quark(void)
 {
 	return g_quark_from_static_string("file");
 }
 
+static bool
+input_file_init(const struct config_param *param,
+		G_GNUC_UNUSED GError **error_r)
+{
+	file_readahead_size = config_get_block_unsigned(param,
+							"readahead_size",
+							1024) * 1024;
+	if (file_readahead_size > 0 &&
+	    file_readahead_size < 2 * FILE_READAHEAD_CHUNK)
+		file_readahead_size = 2 * FILE_READAHEAD_CHUNK;
+
+	file_mmap = config_get_block_bool(param, "mmap", false);
+
+	return true;
+}
+
+static gpointer
+input_file_readahead_task(gpointer data)
+{
+	struct file_input_stream *fis = data;
+	struct input_stream *is = &fis->base;
+	unsigned generation = fis->generation - 1;
+
+	g_mutex_lock(is->mutex);
+
+	while (!fis->quit) {
+		size_t available = fifo_buffer_available(fis->buffer);
+		if (available <= file_readahead_size / 2)
+			fis->filling = true;
+		else if (available == file_readahead_size)
+			fis->filling = false;
+
+		if (!fis->filling || fis->eof || fis->error != NULL) {
+			g_cond_wait(fis->wake, is->mutex);
+			continue;
+		}
+
+		size_t max_length;
+		void *dest = fifo_buffer_write(fis->buffer, &max_length);
+		assert(dest != NULL);
+		if (max_length > FILE_READAHEAD_CHUNK)
+			max_length = FILE_READAHEAD_CHUNK;
+
+		const goffset offset = fis->fill_offset;
+		const bool seek = generation != fis->generation;
+		generation = fis->generation;
+
+		/* the consumer never writes to the free part of the
+		   buffer, and a seek which clears the buffer changes
+		   the generation; therefore it is safe to read into
+		   the buffer without holding the mutex */
+		g_mutex_unlock(is->mutex);
+
+		ssize_t nbytes;
+		if (seek && lseek(fis->fd, (off_t)offset, SEEK_SET) < 0)
+			nbytes = -1;
+		else
+			nbytes = read(fis->fd, dest, max_length);
+		const int e = errno;
+
+		g_mutex_lock(is->mutex);
+
+		if (generation != fis->generation)
+			/* the stream has been seeked meanwhile: discard
+			   this data */
+			continue;
+
+		if (nbytes < 0) {
+			g_set_error(&fis->error, file_quark(), e,
+				    "Failed to read: %s", g_strerror(e));
+		} else if (nbytes == 0)
+			fis->eof = true;
+		else {
+			fifo_buffer_append(fis->buffer, nbytes);
+			fis->fill_offset += nbytes;
+		}
+
+		g_cond_broadcast(is->cond);
+	}
+
+	g_mutex_unlock(is->mutex);
+	return NULL;
+}
+
+/**
+ * Starts the read-ahead thread at the current offset.  On failure,
+ * the stream continues with synchronous reads.
+ */
+static void
+input_file_readahead_start(struct file_input_stream *fis)
+{
+	GError *error = NULL;
+
+	fis->buffer = fifo_buffer_new(file_readahead_size);
+	fis->wake = g_cond_new();
+	fis->fill_offset = fis->base.offset;
+	fis->generation = 0;
+	fis->filling = true;
+	fis->eof = false;
+	fis->quit = false;
+	fis->error = NULL;
+
+	fis->thread = g_thread_create(input_file_readahead_task, fis,
+				      true, &error);
+	if (fis->thread == NULL) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+
+		g_cond_free(fis->wake);
+		fifo_buffer_free(fis->buffer);
+		fis->buffer = NULL;
+	}
+}
+
+#ifdef HAVE_MMAP
+
+/**
+ * Attempts to map the whole file into memory.  Returns NULL on
+ * failure; the caller falls back to read().
+ */
+static const unsigned char *
+input_file_map(int fd, goffset size)
+{
+	if (size <= 0 || (guint64)size > SIZE_MAX / 4)
+		/* empty, or too large for the address space */
+		return NULL;
+
+	void *map = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+#ifdef HAVE_MADVISE
+	madvise(map, (size_t)size, MADV_SEQUENTIAL);
+#endif
+
+	return map;
+}
+
+#endif
+
 static struct input_stream *
 input_file_open(const char *filename,
 		GMutex *mutex, GCond *cond,
@@ -82,11 +316,20 @@ input_file_open(const char *filename,
 		return NULL;
 	}
 
+	fis = g_new(struct file_input_stream, 1);
+
+	fis->map = NULL;
+#ifdef HAVE_MMAP
+	if (file_mmap)
+		fis->map = input_file_map(fd, st.st_size);
+#endif
+
 #ifdef POSIX_FADV_SEQUENTIAL
-	posix_fadvise(fd, (off_t)0, st.st_size, POSIX_FADV_SEQUENTIAL);
+	if (fis->map == NULL)
+		posix_fadvise(fd, (off_t)0, st.st_size,
+			      POSIX_FADV_SEQUENTIAL);
 #endif
 
-	fis = g_new(struct file_input_stream, 1);
 	input_stream_init(&fis->base, &input_plugin_file, filename,
 			  mutex, cond);
 
@@ -95,16 +338,108 @@ input_file_open(const char *filename,
 	fis->base.ready = true;
 
 	fis->fd = fd;
+	fis->direct_bytes = 0;
+	fis->buffer = NULL;
 
 	return &fis->base;
 }
 
+/**
+ * Converts a relative offset to an absolute one.
+ *
+ * @return the absolute offset, or -1 on error
+ */
+static goffset
+input_file_absolute_offset(const struct input_stream *is, goffset offset,
+			   int whence)
+{
+	switch (whence) {
+	case SEEK_SET:
+		break;
+
+	case SEEK_CUR:
+		offset += is->offset;
+		break;
+
+	case SEEK_END:
+		offset += is->size;
+		break;
+
+	default:
+		return -1;
+	}
+
+	return offset >= 0 ? offset : -1;
+}
+
+static bool
+input_file_seek_map(struct file_input_stream *fis, goffset offset,
+		    int whence, GError **error_r)
+{
+	struct input_stream *is = &fis->base;
+
+	offset = input_file_absolute_offset(is, offset, whence);
+	if (offset < 0 || offset > is->size) {
+		g_set_error(error_r, file_quark(), EINVAL,
+			    "Failed to seek: %s", g_strerror(EINVAL));
+		return false;
+	}
+
+	is->offset = offset;
+	return true;
+}
+
+/**
+ * Seeks within the read-ahead buffer, or discards it.
+ */
+static bool
+input_file_seek_buffer(struct file_input_stream *fis, goffset offset,
+		       int whence, GError **error_r)
+{
+	struct input_stream *is = &fis->base;
+
+	offset = input_file_absolute_offset(is, offset, whence);
+	if (offset < 0) {
+		g_set_error(error_r, file_quark(), EINVAL,
+			    "Failed to seek: %s", g_strerror(EINVAL));
+		return false;
+	}
+
+	if (offset >= is->offset && offset <= fis->fill_offset) {
+		/* the new offset is already in the buffer: skip
+		   data */
+		fifo_buffer_consume(fis->buffer, offset - is->offset);
+	} else {
+		fifo_buffer_clear(fis->buffer);
+		fis->fill_offset = offset;
+		++fis->generation;
+		fis->eof = false;
+
+		if (fis->error != NULL) {
+			g_error_free(fis->error);
+			fis->error = NULL;
+		}
+	}
+
+	is->offset = offset;
+	g_cond_signal(fis->wake);
+	return true;
+}
+
 static bool
 input_file_seek(struct input_stream *is, goffset offset, int whence,
 		GError **error_r)
 {
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 
+	if (fis->map != NULL)
+		return input_file_seek_map(fis, offset, whence, error_r);
+
+	if (fis->buffer != NULL)
+		return input_file_seek_buffer(fis, offset, whence, error_r);
+
+	fis->direct_bytes = 0;
+
 	offset = (goffset)lseek(fis->fd, (off_t)offset, whence);
 	if (offset < 0) {
 		g_set_error(error_r, file_quark(), errno,
@@ -116,6 +451,64 @@ input_file_seek(struct input_stream *is, goffset offset, int whence,
 	return true;
 }
 
+/**
+ * Reads from the read-ahead buffer, waits for the read-ahead thread
+ * if it is empty.
+ */
+static size_t
+input_file_read_buffer(struct file_input_stream *fis, void *ptr, size_t size,
+		       GError **error_r)
+{
+	struct input_stream *is = &fis->base;
+
+	while (true) {
+		size_t length;
+		const void *src = fifo_buffer_read(fis->buffer, &length);
+		if (src != NULL) {
+			if (length > size)
+				length = size;
+
+			memcpy(ptr, src, length);
+			fifo_buffer_consume(fis->buffer, length);
+			is->offset += length;
+
+			if (fifo_buffer_available(fis->buffer) <=
+			    file_readahead_size / 2)
+				g_cond_signal(fis->wake);
+
+			return length;
+		}
+
+		if (fis->error != NULL) {
+			g_propagate_error(error_r, g_error_copy(fis->error));
+			return 0;
+		}
+
+		if (fis->eof)
+			return 0;
+
+		g_cond_wait(is->cond, is->mutex);
+	}
+}
+
+static const void *
+input_file_read_direct(struct input_stream *is, size_t size,
+		       size_t *length_r)
+{
+	struct file_input_stream *fis = (struct file_input_stream *)is;
+
+	if (fis->map == NULL || is->offset >= is->size)
+		return NULL;
+
+	if ((goffset)size > is->size - is->offset)
+		size = (size_t)(is->size - is->offset);
+
+	const void *data = fis->map + is->offset;
+	is->offset += size;
+	*length_r = size;
+	return data;
+}
+
 static size_t
 input_file_read(struct input_stream *is, void *ptr, size_t size,
 		GError **error_r)
@@ -123,6 +516,19 @@ input_file_read(struct input_stream *is, void *ptr, size_t size,
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 	ssize_t nbytes;
 
+	if (fis->map != NULL) {
+		size_t length;
+		const void *data = input_file_read_direct(is, size, &length);
+		if (data == NULL)
+			return 0;
+
+		memcpy(ptr, data, length);
+		return length;
+	}
+
+	if (fis->buffer != NULL)
+		return input_file_read_buffer(fis, ptr, size, error_r);
+
 	nbytes = read(fis->fd, ptr, size);
 	if (nbytes < 0) {
 		g_set_error(error_r, file_quark(), errno,
@@ -131,6 +537,15 @@ input_file_read(struct input_stream *is, void *ptr, size_t size,
 	}
 
 	is->offset += nbytes;
+
+	/* the read-ahead thread signals the consumer through
+	   input_stream.cond, so it can't be used without one */
+	fis->direct_bytes += nbytes;
+	if (fis->direct_bytes >= FILE_READAHEAD_THRESHOLD &&
+	    file_readahead_size > 0 && is->cond != NULL &&
+	    is->offset < is->size)
+		input_file_readahead_start(fis);
+
 	return (size_t)nbytes;
 }
 
@@ -139,11 +554,40 @@ input_file_close(struct input_stream *is)
 {
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 
+	if (fis->buffer != NULL) {
+		g_mutex_lock(is->mutex);
+		fis->quit = true;
+		g_cond_signal(fis->wake);
+		g_mutex_unlock(is->mutex);
+
+		g_thread_join(fis->thread);
+
+		g_cond_free(fis->wake);
+		fifo_buffer_free(fis->buffer);
+		if (fis->error != NULL)
+			g_error_free(fis->error);
+	}
+
+#ifdef HAVE_MMAP
+	if (fis->map != NULL)
+		munmap((void *)fis->map, (size_t)is->size);
+#endif
+
 	close(fis->fd);
 	input_stream_deinit(&fis->base);
 	g_free(fis);
 }
 
+static bool
+input_file_available(struct input_stream *is)
+{
+	struct file_input_stream *fis = (struct file_input_stream *)is;
+
+	return fis->buffer == NULL ||
+		!fifo_buffer_is_empty(fis->buffer) ||
+		fis->eof || fis->error != NULL;
+}
+
 static bool
 input_file_eof(struct input_stream *is)
 {
@@ -152,9 +596,12 @@ input_file_eof(struct input_stream *is)
 
 const struct input_plugin input_plugin_file = {
 	.name = "file",
+	.init = input_file_init,
 	.open = input_file_open,
 	.close = input_file_close,
+	.available = input_file_available,
 	.read = input_file_read,
+	.read_direct = input_file_read_direct,
 	.eof = input_file_eof,
 	.seek = input_file_seek,
 };
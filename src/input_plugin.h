@@ -81,6 +81,20 @@ struct input_plugin {
 
 	size_t (*read)(struct input_stream *is, void *ptr, size_t size,
 		       GError **error_r);
+
+	/**
+	 * Optional zero-copy variant of read(): returns a pointer to
+	 * the data at the current offset and advances the offset.
+	 * The pointer remains valid until the stream is closed.
+	 *
+	 * @param length_r the number of bytes at the returned
+	 * pointer, at most #size
+	 * @return NULL if no data is available this way (e.g. end of
+	 * file, or this stream can't do it); the caller should then
+	 * fall back to read()
+	 */
+	const void *(*read_direct)(struct input_stream *is, size_t size,
+				   size_t *length_r);
 	bool (*eof)(struct input_stream *is);
 	bool (*seek)(struct input_stream *is, goffset offset, int whence,
 		     GError **error_r);
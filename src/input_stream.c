@@ -202,6 +202,20 @@ input_stream_read(struct input_stream *is, void *ptr, size_t size,
 	return is->plugin->read(is, ptr, size, error_r);
 }
 
+const void *
+input_stream_read_direct(struct input_stream *is, size_t size,
+			 size_t *length_r)
+{
+	assert(is != NULL);
+	assert(size > 0);
+	assert(length_r != NULL);
+
+	if (is->plugin->read_direct == NULL)
+		return NULL;
+
+	return is->plugin->read_direct(is, size, length_r);
+}
+
 size_t
 input_stream_lock_read(struct input_stream *is, void *ptr, size_t size,
 		       GError **error_r)
@@ -259,6 +259,25 @@ size_t
 input_stream_read(struct input_stream *is, void *ptr, size_t size,
 		  GError **error_r);
 
+/**
+ * Zero-copy variant of input_stream_read(): returns a pointer to the
+ * data at the current offset, and advances the offset.  The pointer
+ * remains valid until the stream is closed.  Not all plugins support
+ * this; if NULL is returned, the caller should fall back to
+ * input_stream_read().
+ *
+ * The caller must lock the mutex.
+ *
+ * @param is the input_stream object
+ * @param size the maximum number of bytes to read
+ * @param length_r the number of bytes at the returned pointer
+ * @return a pointer to the data, or NULL
+ */
+gcc_nonnull(1, 3)
+const void *
+input_stream_read_direct(struct input_stream *is, size_t size,
+			 size_t *length_r);
+
 /**
  * Wrapper for input_stream_tag() which locks and unlocks the
  * mutex; the caller must not be holding it already.
@@ -19,10 +19,19 @@
 
 #include "config.h"
 #include "locate.h"
+#include "song_filter.h"
+#include "ack.h"
 #include "path.h"
 #include "tag.h"
 #include "song.h"
 
+#ifdef ENABLE_SQLITE
+#include "sticker.h"
+#include "song_sticker.h"
+#include "database.h"
+#include "db_lock.h"
+#endif
+
 #include <glib.h>
 
 #include <stdlib.h>
@@ -30,6 +39,7 @@
 #define LOCATE_TAG_FILE_KEY     "file"
 #define LOCATE_TAG_FILE_KEY_OLD "filename"
 #define LOCATE_TAG_ANY_KEY      "any"
+#define LOCATE_TAG_STICKER_PREFIX "sticker:"
 
 int
 locate_parse_type(const char *str)
@@ -50,10 +60,47 @@ locate_parse_type(const char *str)
 	return -1;
 }
 
+#ifdef ENABLE_SQLITE
+
+GHashTable *
+locate_load_stickers(const char *name)
+{
+	if (*name == 0 || !sticker_enabled())
+		return NULL;
+
+	db_lock();
+	struct directory *root = db_get_root();
+	GHashTable *stickers = root != NULL
+		? sticker_song_find_table(root, name)
+		: NULL;
+	db_unlock();
+
+	return stickers;
+}
+
+#endif
+
 static bool
 locate_item_init(struct locate_item *item,
 		 const char *type_string, const char *needle)
 {
+	if (g_str_has_prefix(type_string, LOCATE_TAG_STICKER_PREFIX)) {
+#ifdef ENABLE_SQLITE
+		const char *name = type_string +
+			sizeof(LOCATE_TAG_STICKER_PREFIX) - 1;
+
+		item->stickers = locate_load_stickers(name);
+		if (item->stickers == NULL)
+			return false;
+
+		item->tag = LOCATE_TAG_STICKER_TYPE;
+		item->needle = g_strdup(needle);
+		return true;
+#else
+		return false;
+#endif
+	}
+
 	item->tag = locate_parse_type(type_string);
 
 	if (item->tag < 0)
@@ -67,8 +114,13 @@ locate_item_init(struct locate_item *item,
 void
 locate_item_list_free(struct locate_item_list *list)
 {
-	for (unsigned i = 0; i < list->length; ++i)
+	for (unsigned i = 0; i < list->length; ++i) {
 		g_free(list->items[i].needle);
+		if (list->items[i].stickers != NULL)
+			g_hash_table_unref(list->items[i].stickers);
+		if (list->items[i].filter != NULL)
+			song_filter_unref(list->items[i].filter);
+	}
 
 	g_free(list);
 }
@@ -86,12 +138,28 @@ locate_item_list_new(unsigned length)
 }
 
 struct locate_item_list *
-locate_item_list_parse(char *argv[], int argc)
+locate_item_list_parse(char *argv[], int argc, GError **error_r)
 {
 	struct locate_item_list *list;
 
-	if (argc % 2 != 0)
+	if (argc == 1 && *argv[0] == '(') {
+		struct song_filter *filter =
+			song_filter_parse(argv[0], error_r);
+		if (filter == NULL)
+			return NULL;
+
+		list = locate_item_list_new(1);
+		list->items[0].tag = LOCATE_TAG_FILTER_TYPE;
+		list->items[0].needle = g_strdup(argv[0]);
+		list->items[0].filter = filter;
+		return list;
+	}
+
+	if (argc % 2 != 0) {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "incorrect arguments");
 		return NULL;
+	}
 
 	list = locate_item_list_new(argc / 2);
 
@@ -99,6 +167,8 @@ locate_item_list_parse(char *argv[], int argc)
 		if (!locate_item_init(&list->items[i], argv[i * 2],
 				      argv[i * 2 + 1])) {
 			locate_item_list_free(list);
+			g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+				    "incorrect arguments");
 			return NULL;
 		}
 	}
@@ -115,6 +185,12 @@ locate_item_list_casefold(const struct locate_item_list *list)
 		new_list->items[i].needle =
 			g_utf8_casefold(list->items[i].needle, -1);
 		new_list->items[i].tag = list->items[i].tag;
+		if (list->items[i].stickers != NULL)
+			new_list->items[i].stickers =
+				g_hash_table_ref(list->items[i].stickers);
+		if (list->items[i].filter != NULL)
+			new_list->items[i].filter =
+				song_filter_ref(list->items[i].filter);
 	}
 
 	return new_list;
@@ -124,9 +200,38 @@ void
 locate_item_free(struct locate_item *item)
 {
 	g_free(item->needle);
+	if (item->stickers != NULL)
+		g_hash_table_unref(item->stickers);
+	if (item->filter != NULL)
+		song_filter_unref(item->filter);
 	g_free(item);
 }
 
+/**
+ * Checks the song's sticker value.  Songs without this sticker
+ * match only the empty string, just like songs without a certain
+ * tag.
+ *
+ * @param search true for a case insensitive substring search (the
+ * needle has been casefolded already), false for an exact match
+ */
+static bool
+locate_sticker(const struct song *song, const struct locate_item *item,
+	       bool search)
+{
+	const char *value = g_hash_table_lookup(item->stickers, song);
+	if (value == NULL)
+		return *item->needle == 0;
+
+	if (!search)
+		return strcmp(value, item->needle) == 0;
+
+	char *folded = g_utf8_casefold(value, -1);
+	bool ret = strstr(folded, item->needle) != NULL;
+	g_free(folded);
+	return ret;
+}
+
 static bool
 locate_tag_search(const struct song *song, enum tag_type type, const char *str)
 {
@@ -182,10 +287,18 @@ bool
 locate_song_search(const struct song *song,
 		   const struct locate_item_list *criteria)
 {
-	for (unsigned i = 0; i < criteria->length; i++)
-		if (!locate_tag_search(song, criteria->items[i].tag,
-				       criteria->items[i].needle))
+	for (unsigned i = 0; i < criteria->length; i++) {
+		if (criteria->items[i].tag == LOCATE_TAG_STICKER_TYPE) {
+			if (!locate_sticker(song, &criteria->items[i], true))
+				return false;
+		} else if (criteria->items[i].tag == LOCATE_TAG_FILTER_TYPE) {
+			if (!song_filter_match(criteria->items[i].filter,
+					       song, true))
+				return false;
+		} else if (!locate_tag_search(song, criteria->items[i].tag,
+					      criteria->items[i].needle))
 			return false;
+	}
 
 	return true;
 }
@@ -239,10 +352,18 @@ bool
 locate_song_match(const struct song *song,
 		  const struct locate_item_list *criteria)
 {
-	for (unsigned i = 0; i < criteria->length; i++)
-		if (!locate_tag_match(song, criteria->items[i].tag,
-				      criteria->items[i].needle))
+	for (unsigned i = 0; i < criteria->length; i++) {
+		if (criteria->items[i].tag == LOCATE_TAG_STICKER_TYPE) {
+			if (!locate_sticker(song, &criteria->items[i], false))
+				return false;
+		} else if (criteria->items[i].tag == LOCATE_TAG_FILTER_TYPE) {
+			if (!song_filter_match(criteria->items[i].filter,
+					       song, false))
+				return false;
+		} else if (!locate_tag_match(song, criteria->items[i].tag,
+					     criteria->items[i].needle))
 			return false;
+	}
 
 	return true;
 }
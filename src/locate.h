@@ -22,19 +22,38 @@
 
 #include "gcc.h"
 
+#include <glib.h>
+
 #include <stdint.h>
 #include <stdbool.h>
 
 #define LOCATE_TAG_FILE_TYPE	TAG_NUM_OF_ITEM_TYPES+10
 #define LOCATE_TAG_ANY_TYPE     TAG_NUM_OF_ITEM_TYPES+20
+#define LOCATE_TAG_STICKER_TYPE TAG_NUM_OF_ITEM_TYPES+30
+#define LOCATE_TAG_FILTER_TYPE  TAG_NUM_OF_ITEM_TYPES+40
 
 struct song;
+struct song_filter;
 
 /* struct used for search, find, list queries */
 struct locate_item {
 	int8_t tag;
 	/* what we are looking for */
 	char *needle;
+
+	/**
+	 * For #LOCATE_TAG_STICKER_TYPE: maps struct song pointers to
+	 * the values of the sticker specified in the query.  It is
+	 * loaded from the sticker database when the query is parsed,
+	 * and is shared by all copies of this item.
+	 */
+	GHashTable *stickers;
+
+	/**
+	 * For #LOCATE_TAG_FILTER_TYPE: the compiled filter
+	 * expression; #needle is its source text.
+	 */
+	struct song_filter *filter;
 };
 
 /**
@@ -58,10 +77,14 @@ locate_parse_type(const char *str);
 struct locate_item_list *
 locate_item_list_new(unsigned length);
 
-/* return number of items or -1 on error */
-gcc_nonnull(1)
+/**
+ * Parses criteria from command arguments: either (TYPE, WHAT) pairs,
+ * or a single filter expression (see song_filter_parse()).
+ *
+ * @return a new list, or NULL on error
+ */
 struct locate_item_list *
-locate_item_list_parse(char *argv[], int argc);
+locate_item_list_parse(char *argv[], int argc, GError **error_r);
 
 /**
  * Duplicate the struct locate_item_list object and convert all
@@ -89,4 +112,17 @@ bool
 locate_song_match(const struct song *song,
 		   const struct locate_item_list *criteria);
 
+/**
+ * Loads the values of the specified sticker of all songs into a hash
+ * table, see sticker_song_find_table().  The keys are song pointers;
+ * they remain valid until the main thread allows the update thread
+ * to delete songs, i.e. at least until the current command has
+ * finished.
+ *
+ * @return the hash table, or NULL if the sticker database is
+ * disabled or on error
+ */
+GHashTable *
+locate_load_stickers(const char *name);
+
 #endif
@@ -29,6 +29,7 @@
 #include "stored_playlist.h"
 #include "database.h"
 #include "update.h"
+#include "song_picture.h"
 #include "player_thread.h"
 #include "listen.h"
 #include "cmdline.h"
@@ -202,6 +203,26 @@ glue_sticker_init(void)
 #endif
 }
 
+/**
+ * Configure and initialize the cache of embedded pictures.
+ */
+static void
+glue_picture_init(void)
+{
+	GError *error = NULL;
+	char *directory = config_dup_path(CONF_PICTURE_CACHE_DIR, &error);
+	if (directory == NULL && error != NULL)
+		MPD_ERROR("%s", error->message);
+
+	const unsigned max_size =
+		config_get_positive(CONF_PICTURE_CACHE_SIZE, 64);
+	if (!song_picture_global_init(directory, (guint64)max_size << 20,
+				      &error))
+		MPD_ERROR("%s", error->message);
+
+	g_free(directory);
+}
+
 static bool
 glue_state_file_init(GError **error_r)
 {
@@ -414,6 +435,7 @@ int mpd_main(int argc, char *argv[])
 	create_db = !glue_db_init_and_load();
 
 	glue_sticker_init();
+	glue_picture_init();
 
 	command_init();
 	initialize_decoder_and_player();
@@ -512,6 +534,8 @@ int mpd_main(int argc, char *argv[])
 	sticker_global_finish();
 #endif
 
+	song_picture_global_finish();
+
 	g_cond_free(main_cond);
 	event_pipe_deinit();
 
@@ -0,0 +1,985 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * An output plugin which encodes the stream at several bitrates,
+ * cuts it into segments and serves them with HTTP Live Streaming
+ * playlists.
+ */
+
+#include "config.h"
+#include "hls_output_plugin.h"
+#include "output_api.h"
+#include "encoder_plugin.h"
+#include "encoder_list.h"
+#include "encoder_thread.h"
+#include "page.h"
+#include "timer.h"
+#include "fd_util.h"
+#include "server_socket.h"
+#include "glib_socket.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "hls_output"
+
+enum {
+	/**
+	 * The maximum number of renditions (bitrates).
+	 */
+	HLS_MAX_RENDITIONS = 8,
+
+	/**
+	 * The maximum number of segments kept per rendition.
+	 */
+	HLS_MAX_SEGMENTS = 64,
+};
+
+struct hls_segment {
+	/** the media sequence number */
+	unsigned sequence;
+
+	/** the duration in seconds */
+	double duration;
+
+	/** the encoded data */
+	struct page *data;
+};
+
+/**
+ * One encoding of the stream.
+ */
+struct hls_rendition {
+	/** the configured bitrate in kbit/s */
+	unsigned bitrate;
+
+	/**
+	 * The configuration block passed to the encoder plugin,
+	 * containing the bitrate.
+	 */
+	struct config_param *param;
+
+	struct encoder *encoder;
+
+	/**
+	 * The encoded data of the segment which is being recorded.
+	 * Only used by the output thread.
+	 */
+	GByteArray *pending;
+
+	/**
+	 * The encoder header, which is prepended to every segment
+	 * (e.g. the Ogg header pages).
+	 */
+	struct page *header;
+
+	/**
+	 * A ring of the most recent segments; the oldest one is at
+	 * index (sequence % num_segments).  Protected by
+	 * hls_output.mutex.
+	 */
+	struct hls_segment segments[HLS_MAX_SEGMENTS];
+};
+
+struct hls_output {
+	struct audio_output base;
+
+	struct hls_rendition renditions[HLS_MAX_RENDITIONS];
+	unsigned num_renditions;
+
+	/** the configured segment duration in seconds */
+	unsigned segment_time;
+
+	/** the number of segments listed in the playlists */
+	unsigned num_segments;
+
+	/** the MIME type produced by the encoder */
+	const char *content_type;
+
+	/** the file name suffix of segments */
+	const char *suffix;
+
+	struct server_socket *server_socket;
+
+	/**
+	 * This mutex protects the segments, the client list and
+	 * #next_sequence.
+	 */
+	GMutex *mutex;
+
+	/** synchronizes this output with the wallclock */
+	struct timer *timer;
+
+	/** the number of PCM bytes per second */
+	double time_to_size;
+
+	/** the number of PCM bytes of one segment */
+	size_t segment_size;
+
+	/** the number of PCM bytes in the current segment */
+	size_t segment_fill;
+
+	/** the sequence number of the next segment */
+	unsigned next_sequence;
+
+	/** all connected HTTP clients */
+	GList *clients;
+
+	/** a buffer for encoder_read() */
+	char buffer[32768];
+};
+
+struct hls_client {
+	struct hls_output *hls;
+
+	GIOChannel *channel;
+
+	guint source_id;
+
+	/** the HTTP request being received */
+	char request[2048];
+	size_t request_length;
+
+	/** the response header */
+	GString *header;
+
+	/** the response body (may be NULL) */
+	struct page *body;
+
+	/** the number of bytes of the response which were sent */
+	size_t position;
+};
+
+/**
+ * The quark used for GError.domain.
+ */
+static inline GQuark
+hls_output_quark(void)
+{
+	return g_quark_from_static_string("hls_output");
+}
+
+static const char *
+hls_suffix_for_mime_type(const char *mime_type)
+{
+	if (mime_type == NULL)
+		return "dat";
+	else if (strcmp(mime_type, "audio/mpeg") == 0)
+		return "mp3";
+	else if (strcmp(mime_type, "audio/aac") == 0)
+		return "aac";
+	else if (strcmp(mime_type, "audio/ogg") == 0 ||
+		 strcmp(mime_type, "application/x-ogg") == 0)
+		return "ogg";
+	else
+		return "dat";
+}
+
+/*
+ * HTTP server
+ *
+ */
+
+static void
+hls_client_free(struct hls_client *client)
+{
+	g_source_remove(client->source_id);
+	g_io_channel_unref(client->channel);
+
+	if (client->header != NULL)
+		g_string_free(client->header, true);
+	if (client->body != NULL)
+		page_unref(client->body);
+
+	g_free(client);
+}
+
+/**
+ * Frees the client and removes it from the client list.  The caller
+ * must hold the mutex.
+ */
+static void
+hls_client_close(struct hls_client *client)
+{
+	struct hls_output *hls = client->hls;
+
+	hls->clients = g_list_remove(hls->clients, client);
+	hls_client_free(client);
+}
+
+static void
+hls_client_respond(struct hls_client *client, const char *status,
+		   const char *content_type, const char *cache_control,
+		   struct page *body)
+{
+	client->header = g_string_new(NULL);
+	g_string_append_printf(client->header,
+			       "HTTP/1.1 %s\r\n"
+			       "Content-Type: %s\r\n"
+			       "Content-Length: %lu\r\n"
+			       "Cache-Control: %s\r\n"
+			       "Connection: close\r\n"
+			       "\r\n",
+			       status, content_type,
+			       body != NULL ? (unsigned long)body->size : 0ul,
+			       cache_control);
+	client->body = body;
+	client->position = 0;
+}
+
+static void
+hls_client_not_found(struct hls_client *client)
+{
+	hls_client_respond(client, "404 Not Found", "text/plain",
+			   "no-cache", NULL);
+}
+
+static struct page *
+page_new_string(GString *s)
+{
+	struct page *page = page_new_copy(s->str, s->len);
+	g_string_free(s, true);
+	return page;
+}
+
+/**
+ * Generates the master playlist which lists all renditions.
+ */
+static struct page *
+hls_master_playlist(const struct hls_output *hls)
+{
+	GString *s = g_string_new("#EXTM3U\n");
+
+	for (unsigned i = 0; i < hls->num_renditions; ++i)
+		g_string_append_printf(s,
+				       "#EXT-X-STREAM-INF:BANDWIDTH=%u\n"
+				       "%u/index.m3u8\n",
+				       hls->renditions[i].bitrate * 1000, i);
+
+	return page_new_string(s);
+}
+
+/**
+ * Generates the media playlist of one rendition.  The caller must
+ * hold the mutex.
+ */
+static struct page *
+hls_media_playlist(const struct hls_output *hls,
+		   const struct hls_rendition *rendition)
+{
+	unsigned first = hls->next_sequence > hls->num_segments
+		? hls->next_sequence - hls->num_segments
+		: 0;
+
+	GString *s = g_string_new(NULL);
+	g_string_append_printf(s,
+			       "#EXTM3U\n"
+			       "#EXT-X-VERSION:3\n"
+			       "#EXT-X-TARGETDURATION:%u\n"
+			       "#EXT-X-MEDIA-SEQUENCE:%u\n",
+			       hls->segment_time + 1, first);
+
+	for (unsigned i = first; i < hls->next_sequence; ++i) {
+		const struct hls_segment *segment =
+			&rendition->segments[i % hls->num_segments];
+		if (segment->data == NULL || segment->sequence != i)
+			continue;
+
+		g_string_append_printf(s, "#EXTINF:%.3f,\n%u.%s\n",
+				       segment->duration, i, hls->suffix);
+	}
+
+	return page_new_string(s);
+}
+
+/**
+ * Looks up a segment.  The caller must hold the mutex.
+ *
+ * @return the segment data (with a new reference), or NULL
+ */
+static struct page *
+hls_find_segment(const struct hls_output *hls,
+		 const struct hls_rendition *rendition, unsigned sequence)
+{
+	if (sequence >= hls->next_sequence ||
+	    sequence + hls->num_segments < hls->next_sequence)
+		return NULL;
+
+	const struct hls_segment *segment =
+		&rendition->segments[sequence % hls->num_segments];
+	if (segment->data == NULL || segment->sequence != sequence)
+		return NULL;
+
+	page_ref(segment->data);
+	return segment->data;
+}
+
+/**
+ * Handles a request for the specified path.  The caller must hold
+ * the mutex.
+ */
+static void
+hls_client_handle_request(struct hls_client *client, const char *path)
+{
+	const struct hls_output *hls = client->hls;
+
+	if (strcmp(path, "/") == 0 || strcmp(path, "/index.m3u8") == 0) {
+		hls_client_respond(client, "200 OK",
+				   "application/vnd.apple.mpegurl",
+				   "no-cache", hls_master_playlist(hls));
+		return;
+	}
+
+	char *endptr;
+	unsigned i = strtoul(path + 1, &endptr, 10);
+	if (endptr == path + 1 || *endptr != '/' ||
+	    i >= hls->num_renditions) {
+		hls_client_not_found(client);
+		return;
+	}
+
+	const struct hls_rendition *rendition = &hls->renditions[i];
+	path = endptr + 1;
+
+	if (strcmp(path, "index.m3u8") == 0) {
+		hls_client_respond(client, "200 OK",
+				   "application/vnd.apple.mpegurl",
+				   "no-cache",
+				   hls_media_playlist(hls, rendition));
+		return;
+	}
+
+	unsigned sequence = strtoul(path, &endptr, 10);
+	struct page *page;
+	if (endptr == path || *endptr != '.' ||
+	    strcmp(endptr + 1, hls->suffix) != 0 ||
+	    (page = hls_find_segment(hls, rendition, sequence)) == NULL) {
+		hls_client_not_found(client);
+		return;
+	}
+
+	/* segments never change, so they may be cached */
+	char cache_control[32];
+	g_snprintf(cache_control, sizeof(cache_control), "max-age=%u",
+		   hls->segment_time * hls->num_segments);
+
+	hls_client_respond(client, "200 OK", hls->content_type,
+			   cache_control, page);
+}
+
+static gboolean
+hls_client_out_event(GIOChannel *source, GIOCondition condition,
+		     gpointer data);
+
+/**
+ * Parses the request line, and switches to sending the response.
+ *
+ * @return false if the request is malformed
+ */
+static bool
+hls_client_received(struct hls_client *client)
+{
+	if (strstr(client->request, "\r\n\r\n") == NULL &&
+	    strstr(client->request, "\n\n") == NULL)
+		/* request is not complete yet */
+		return true;
+
+	if (strncmp(client->request, "GET /", 5) != 0)
+		return false;
+
+	char *path = client->request + 4;
+	char *end = path + strcspn(path, " ?\r\n");
+	*end = 0;
+
+	hls_client_handle_request(client, path);
+
+	g_source_remove(client->source_id);
+	client->source_id = g_io_add_watch(client->channel,
+					   G_IO_OUT|G_IO_ERR|G_IO_HUP,
+					   hls_client_out_event, client);
+	return true;
+}
+
+static gboolean
+hls_client_in_event(G_GNUC_UNUSED GIOChannel *source,
+		    GIOCondition condition, gpointer data)
+{
+	struct hls_client *client = data;
+	struct hls_output *hls = client->hls;
+
+	g_mutex_lock(hls->mutex);
+
+	if (condition != G_IO_IN) {
+		hls_client_close(client);
+		g_mutex_unlock(hls->mutex);
+		return false;
+	}
+
+	gsize nbytes;
+	GIOStatus status =
+		g_io_channel_read_chars(client->channel,
+					client->request + client->request_length,
+					sizeof(client->request) - 1 -
+					client->request_length,
+					&nbytes, NULL);
+	if (status == G_IO_STATUS_AGAIN) {
+		g_mutex_unlock(hls->mutex);
+		return true;
+	}
+
+	if (status != G_IO_STATUS_NORMAL) {
+		hls_client_close(client);
+		g_mutex_unlock(hls->mutex);
+		return false;
+	}
+
+	client->request_length += nbytes;
+	client->request[client->request_length] = 0;
+
+	guint old_source_id = client->source_id;
+	if (!hls_client_received(client) ||
+	    (client->header == NULL &&
+	     client->request_length >= sizeof(client->request) - 1)) {
+		g_warning("malformed request from client");
+		hls_client_close(client);
+		g_mutex_unlock(hls->mutex);
+		return false;
+	}
+
+	/* if hls_client_received() has registered the output event,
+	   this input event source has already been removed */
+	bool ret = client->source_id == old_source_id;
+	g_mutex_unlock(hls->mutex);
+	return ret;
+}
+
+static gboolean
+hls_client_out_event(G_GNUC_UNUSED GIOChannel *source,
+		     GIOCondition condition, gpointer data)
+{
+	struct hls_client *client = data;
+	struct hls_output *hls = client->hls;
+
+	g_mutex_lock(hls->mutex);
+
+	if (condition != G_IO_OUT) {
+		hls_client_close(client);
+		g_mutex_unlock(hls->mutex);
+		return false;
+	}
+
+	const char *p;
+	size_t length;
+	if (client->position < client->header->len) {
+		p = client->header->str + client->position;
+		length = client->header->len - client->position;
+	} else {
+		size_t position = client->position - client->header->len;
+		assert(client->body != NULL);
+		assert(position < client->body->size);
+
+		p = (const char *)client->body->data + position;
+		length = client->body->size - position;
+	}
+
+	gsize nbytes;
+	GIOStatus status = g_io_channel_write_chars(client->channel, p, length,
+						    &nbytes, NULL);
+	if (status == G_IO_STATUS_AGAIN) {
+		g_mutex_unlock(hls->mutex);
+		return true;
+	}
+
+	if (status != G_IO_STATUS_NORMAL) {
+		hls_client_close(client);
+		g_mutex_unlock(hls->mutex);
+		return false;
+	}
+
+	client->position += nbytes;
+
+	size_t total = client->header->len +
+		(client->body != NULL ? client->body->size : 0);
+	if (client->position >= total) {
+		/* the response is complete */
+		hls_client_close(client);
+		g_mutex_unlock(hls->mutex);
+		return false;
+	}
+
+	g_mutex_unlock(hls->mutex);
+	return true;
+}
+
+static void
+hls_listen_in_event(int fd, G_GNUC_UNUSED const struct sockaddr *address,
+		    G_GNUC_UNUSED size_t address_length,
+		    G_GNUC_UNUSED int uid, void *ctx)
+{
+	struct hls_output *hls = ctx;
+
+	if (fd < 0) {
+		if (errno != EINTR)
+			g_warning("accept() failed: %s", g_strerror(errno));
+		return;
+	}
+
+	struct hls_client *client = g_new(struct hls_client, 1);
+	client->hls = hls;
+	client->channel = g_io_channel_new_socket(fd);
+	g_io_channel_set_close_on_unref(client->channel, true);
+	g_io_channel_set_encoding(client->channel, NULL, NULL);
+	g_io_channel_set_buffered(client->channel, false);
+	client->request_length = 0;
+	client->header = NULL;
+	client->body = NULL;
+	client->position = 0;
+
+	g_mutex_lock(hls->mutex);
+	client->source_id = g_io_add_watch(client->channel,
+					   G_IO_IN|G_IO_ERR|G_IO_HUP,
+					   hls_client_in_event, client);
+	hls->clients = g_list_prepend(hls->clients, client);
+	g_mutex_unlock(hls->mutex);
+}
+
+/*
+ * segmenter
+ *
+ */
+
+/**
+ * Reads all available data from the rendition's encoder into the
+ * pending segment.
+ */
+static void
+hls_rendition_read(struct hls_output *hls, struct hls_rendition *rendition)
+{
+	size_t nbytes;
+
+	while ((nbytes = encoder_read(rendition->encoder, hls->buffer,
+				      sizeof(hls->buffer))) > 0)
+		g_byte_array_append(rendition->pending,
+				    (const guint8 *)hls->buffer, nbytes);
+}
+
+static void
+hls_rendition_clear_segments(struct hls_rendition *rendition)
+{
+	for (unsigned i = 0; i < HLS_MAX_SEGMENTS; ++i) {
+		if (rendition->segments[i].data != NULL) {
+			page_unref(rendition->segments[i].data);
+			rendition->segments[i].data = NULL;
+		}
+	}
+}
+
+/**
+ * Finishes the current segment of all renditions at the same PCM
+ * position, so segments with the same sequence number are aligned.
+ */
+static void
+hls_output_cut(struct hls_output *hls)
+{
+	double duration = hls->segment_fill / hls->time_to_size;
+
+	for (unsigned i = 0; i < hls->num_renditions; ++i) {
+		struct hls_rendition *rendition = &hls->renditions[i];
+
+		if (encoder_flush(rendition->encoder, NULL))
+			hls_rendition_read(hls, rendition);
+	}
+
+	g_mutex_lock(hls->mutex);
+
+	const unsigned sequence = hls->next_sequence++;
+
+	for (unsigned i = 0; i < hls->num_renditions; ++i) {
+		struct hls_rendition *rendition = &hls->renditions[i];
+		struct hls_segment *segment =
+			&rendition->segments[sequence % hls->num_segments];
+
+		if (segment->data != NULL)
+			page_unref(segment->data);
+
+		struct page *data = page_new_copy(rendition->pending->data,
+						  rendition->pending->len);
+		if (rendition->header != NULL) {
+			segment->data = page_new_concat(rendition->header,
+							data);
+			page_unref(data);
+		} else
+			segment->data = data;
+
+		segment->sequence = sequence;
+		segment->duration = duration;
+
+		g_byte_array_set_size(rendition->pending, 0);
+	}
+
+	g_mutex_unlock(hls->mutex);
+
+	hls->segment_fill = 0;
+}
+
+/*
+ * audio_output methods
+ *
+ */
+
+static void
+hls_output_free_renditions(struct hls_output *hls)
+{
+	for (unsigned i = 0; i < hls->num_renditions; ++i) {
+		struct hls_rendition *rendition = &hls->renditions[i];
+
+		encoder_finish(rendition->encoder);
+		config_param_free(rendition->param);
+	}
+}
+
+static bool
+hls_output_configure_renditions(struct hls_output *hls,
+				const struct config_param *param,
+				GError **error_r)
+{
+	const char *encoder_name =
+		config_get_block_string(param, "encoder", "lame");
+	const struct encoder_plugin *encoder_plugin =
+		encoder_plugin_get(encoder_name);
+	if (encoder_plugin == NULL) {
+		g_set_error(error_r, hls_output_quark(), 0,
+			    "No such encoder: %s", encoder_name);
+		return false;
+	}
+
+	const char *bitrates = config_get_block_string(param, "bitrates",
+						       NULL);
+	if (bitrates == NULL) {
+		g_set_error(error_r, hls_output_quark(), 0,
+			    "'bitrates' not configured");
+		return false;
+	}
+
+	hls->num_renditions = 0;
+
+	bool success = true;
+	char **list = g_strsplit(bitrates, ",", 0);
+	for (char **p = list; success && *p != NULL; ++p) {
+		char *endptr;
+		unsigned bitrate = strtoul(g_strstrip(*p), &endptr, 10);
+		if (endptr == *p || *endptr != 0 || bitrate == 0) {
+			g_set_error(error_r, hls_output_quark(), 0,
+				    "Invalid bitrate: %s", *p);
+			success = false;
+			break;
+		}
+
+		if (hls->num_renditions >= HLS_MAX_RENDITIONS) {
+			g_set_error(error_r, hls_output_quark(), 0,
+				    "Too many bitrates");
+			success = false;
+			break;
+		}
+
+		struct hls_rendition *rendition =
+			&hls->renditions[hls->num_renditions];
+		rendition->bitrate = bitrate;
+
+		/* each encoder gets its own configuration block
+		   which only specifies the bitrate */
+		rendition->param = config_new_param(NULL, param->line);
+		config_add_block_param(rendition->param, "bitrate", *p,
+				       param->line);
+
+		rendition->encoder = encoder_init(encoder_plugin,
+						  rendition->param, error_r);
+		if (rendition->encoder == NULL) {
+			config_param_free(rendition->param);
+			success = false;
+			break;
+		}
+
+		rendition->encoder =
+			encoder_thread_wrap(rendition->encoder, param);
+		memset(rendition->segments, 0, sizeof(rendition->segments));
+		++hls->num_renditions;
+	}
+
+	g_strfreev(list);
+
+	if (!success) {
+		hls_output_free_renditions(hls);
+		return false;
+	}
+
+	if (hls->num_renditions == 0) {
+		g_set_error(error_r, hls_output_quark(), 0,
+			    "No bitrates configured");
+		return false;
+	}
+
+	return true;
+}
+
+static struct audio_output *
+hls_output_init(const struct config_param *param, GError **error_r)
+{
+	struct hls_output *hls = g_new(struct hls_output, 1);
+	if (!ao_base_init(&hls->base, &hls_output_plugin, param, error_r)) {
+		g_free(hls);
+		return NULL;
+	}
+
+	hls->segment_time = config_get_block_unsigned(param, "segment_time",
+						      4);
+	hls->num_segments = config_get_block_unsigned(param, "segments", 6);
+	if (hls->segment_time == 0 || hls->num_segments < 2 ||
+	    hls->num_segments > HLS_MAX_SEGMENTS) {
+		g_set_error(error_r, hls_output_quark(), 0,
+			    "Invalid segment configuration");
+		ao_base_finish(&hls->base);
+		g_free(hls);
+		return NULL;
+	}
+
+	if (!hls_output_configure_renditions(hls, param, error_r)) {
+		ao_base_finish(&hls->base);
+		g_free(hls);
+		return NULL;
+	}
+
+	hls->content_type =
+		encoder_get_mime_type(hls->renditions[0].encoder);
+	if (hls->content_type == NULL)
+		hls->content_type = "application/octet-stream";
+	hls->suffix = hls_suffix_for_mime_type(hls->content_type);
+
+	/* set up the HTTP server */
+
+	unsigned port = config_get_block_unsigned(param, "port", 8001);
+	const char *bind_to_address =
+		config_get_block_string(param, "bind_to_address", NULL);
+
+	hls->server_socket = server_socket_new(hls_listen_in_event, hls);
+	bool success = bind_to_address != NULL &&
+		strcmp(bind_to_address, "any") != 0
+		? server_socket_add_host(hls->server_socket, bind_to_address,
+					 port, error_r)
+		: server_socket_add_port(hls->server_socket, port, error_r);
+	if (!success) {
+		server_socket_free(hls->server_socket);
+		hls_output_free_renditions(hls);
+		ao_base_finish(&hls->base);
+		g_free(hls);
+		return NULL;
+	}
+
+	hls->mutex = g_mutex_new();
+	hls->clients = NULL;
+	hls->next_sequence = 0;
+
+	return &hls->base;
+}
+
+static void
+hls_output_finish(struct audio_output *ao)
+{
+	struct hls_output *hls = (struct hls_output *)ao;
+
+	assert(hls->clients == NULL);
+
+	for (unsigned i = 0; i < hls->num_renditions; ++i)
+		hls_rendition_clear_segments(&hls->renditions[i]);
+
+	hls_output_free_renditions(hls);
+	server_socket_free(hls->server_socket);
+	g_mutex_free(hls->mutex);
+	ao_base_finish(&hls->base);
+	g_free(hls);
+}
+
+static bool
+hls_output_enable(struct audio_output *ao, GError **error_r)
+{
+	struct hls_output *hls = (struct hls_output *)ao;
+
+	g_mutex_lock(hls->mutex);
+	bool success = server_socket_open(hls->server_socket, error_r);
+	g_mutex_unlock(hls->mutex);
+
+	return success;
+}
+
+static void
+hls_client_free_callback(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	struct hls_client *client = data;
+
+	hls_client_free(client);
+}
+
+static void
+hls_output_disable(struct audio_output *ao)
+{
+	struct hls_output *hls = (struct hls_output *)ao;
+
+	g_mutex_lock(hls->mutex);
+	server_socket_close(hls->server_socket);
+
+	g_list_foreach(hls->clients, hls_client_free_callback, NULL);
+	g_list_free(hls->clients);
+	hls->clients = NULL;
+	g_mutex_unlock(hls->mutex);
+}
+
+static bool
+hls_output_open(struct audio_output *ao, struct audio_format *audio_format,
+		GError **error_r)
+{
+	struct hls_output *hls = (struct hls_output *)ao;
+
+	for (unsigned i = 0; i < hls->num_renditions; ++i) {
+		struct hls_rendition *rendition = &hls->renditions[i];
+
+		/* all encoders must agree on the input format; the
+		   first one may adjust it */
+		if (!encoder_open(rendition->encoder, audio_format,
+				  error_r)) {
+			while (i-- > 0) {
+				encoder_close(hls->renditions[i].encoder);
+				g_byte_array_free(hls->renditions[i].pending,
+						  true);
+				if (hls->renditions[i].header != NULL)
+					page_unref(hls->renditions[i].header);
+			}
+
+			return false;
+		}
+
+		rendition->pending = g_byte_array_new();
+
+		/* remember the header, which is needed at the start
+		   of each segment */
+		hls_rendition_read(hls, rendition);
+		rendition->header = rendition->pending->len > 0
+			? page_new_copy(rendition->pending->data,
+					rendition->pending->len)
+			: NULL;
+		g_byte_array_set_size(rendition->pending, 0);
+	}
+
+	hls->time_to_size = audio_format_time_to_size(audio_format);
+	hls->segment_size = hls->time_to_size * hls->segment_time;
+	hls->segment_fill = 0;
+	hls->timer = timer_new(audio_format);
+
+	return true;
+}
+
+static void
+hls_output_close(struct audio_output *ao)
+{
+	struct hls_output *hls = (struct hls_output *)ao;
+
+	timer_free(hls->timer);
+
+	g_mutex_lock(hls->mutex);
+
+	for (unsigned i = 0; i < hls->num_renditions; ++i) {
+		struct hls_rendition *rendition = &hls->renditions[i];
+
+		encoder_close(rendition->encoder);
+		g_byte_array_free(rendition->pending, true);
+		if (rendition->header != NULL)
+			page_unref(rendition->header);
+
+		/* the old segments may have a different audio
+		   format; drop them */
+		hls_rendition_clear_segments(rendition);
+	}
+
+	g_mutex_unlock(hls->mutex);
+}
+
+static unsigned
+hls_output_delay(struct audio_output *ao)
+{
+	struct hls_output *hls = (struct hls_output *)ao;
+
+	return hls->timer->started
+		? timer_delay(hls->timer)
+		: 0;
+}
+
+static size_t
+hls_output_play(struct audio_output *ao, const void *chunk, size_t size,
+		GError **error_r)
+{
+	struct hls_output *hls = (struct hls_output *)ao;
+
+	/* don't cross the segment boundary */
+	if (size > hls->segment_size - hls->segment_fill)
+		size = hls->segment_size - hls->segment_fill;
+
+	for (unsigned i = 0; i < hls->num_renditions; ++i) {
+		struct hls_rendition *rendition = &hls->renditions[i];
+
+		if (!encoder_write(rendition->encoder, chunk, size, error_r))
+			return 0;
+
+		hls_rendition_read(hls, rendition);
+	}
+
+	hls->segment_fill += size;
+	if (hls->segment_fill >= hls->segment_size)
+		hls_output_cut(hls);
+
+	if (!hls->timer->started)
+		timer_start(hls->timer);
+	timer_add(hls->timer, size);
+
+	return size;
+}
+
+static bool
+hls_output_pause(struct audio_output *ao)
+{
+	/* keep producing segments, so clients don't stall */
+	static const char silence[1020];
+	return hls_output_play(ao, silence, sizeof(silence), NULL) > 0;
+}
+
+const struct audio_output_plugin hls_output_plugin = {
+	.name = "hls",
+	.init = hls_output_init,
+	.finish = hls_output_finish,
+	.enable = hls_output_enable,
+	.disable = hls_output_disable,
+	.open = hls_output_open,
+	.close = hls_output_close,
+	.delay = hls_output_delay,
+	.play = hls_output_play,
+	.pause = hls_output_pause,
+};
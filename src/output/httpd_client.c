@@ -29,6 +29,16 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+
+#ifdef WIN32
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "httpd_output"
@@ -78,14 +88,17 @@ struct httpd_client {
 	} state;
 
 	/**
-	 * A queue of #page objects to be sent to the client.
+	 * The #page which is currently being sent to the client.  The
+	 * client holds a reference to it, so it survives being
+	 * evicted from the ring.
 	 */
-	GQueue *pages;
+	struct page *current_page;
 
 	/**
-	 * The #page which is currently being sent to the client.
+	 * The sequence number of the ring page which will be sent
+	 * after #current_page.
 	 */
-	struct page *current_page;
+	uint64_t next_page;
 
 	/**
 	 * The amount of bytes which were already sent from
@@ -138,14 +151,6 @@ struct httpd_client {
 	guint metadata_fill;
 };
 
-static void
-httpd_client_unref_page(gpointer data, G_GNUC_UNUSED gpointer user_data)
-{
-	struct page *page = data;
-
-	page_unref(page);
-}
-
 void
 httpd_client_free(struct httpd_client *client)
 {
@@ -157,9 +162,6 @@ httpd_client_free(struct httpd_client *client)
 
 		if (client->current_page != NULL)
 			page_unref(client->current_page);
-
-		g_queue_foreach(client->pages, httpd_client_unref_page, NULL);
-		g_queue_free(client->pages);
 	} else
 		fifo_buffer_free(client->input);
 
@@ -194,8 +196,8 @@ httpd_client_begin_response(struct httpd_client *client)
 
 	client->state = RESPONSE;
 	client->write_source_id = 0;
-	client->pages = g_queue_new();
 	client->current_page = NULL;
+	client->next_page = httpd_output_burst_start(client->httpd);
 
 	httpd_output_send_header(client->httpd, client);
 }
@@ -517,35 +519,14 @@ httpd_client_new(struct httpd_output *httpd, int fd, bool metadata_supported)
 	return client;
 }
 
-static void
-httpd_client_add_page_size(gpointer data, gpointer user_data)
-{
-	struct page *page = data;
-	size_t *size = user_data;
-
-	*size += page->size;
-}
-
-size_t
-httpd_client_queue_size(const struct httpd_client *client)
-{
-	size_t size = 0;
-
-	if (client->state != RESPONSE)
-		return 0;
-
-	g_queue_foreach(client->pages, httpd_client_add_page_size, &size);
-	return size;
-}
-
 void
 httpd_client_cancel(struct httpd_client *client)
 {
 	if (client->state != RESPONSE)
 		return;
 
-	g_queue_foreach(client->pages, httpd_client_unref_page, NULL);
-	g_queue_clear(client->pages);
+	/* finish the current page, and then wait for new ones */
+	client->next_page = client->httpd->ring_head;
 
 	if (client->write_source_id != 0 && client->current_page == NULL) {
 		g_source_remove(client->write_source_id);
@@ -553,59 +534,149 @@ httpd_client_cancel(struct httpd_client *client)
 	}
 }
 
-static GIOStatus
-write_page_to_channel(GIOChannel *channel,
-		      const struct page *page, size_t position,
-		      gsize *bytes_written_r, GError **error)
+/**
+ * Loads the next page from the ring into httpd_client.current_page.
+ *
+ * @return false if there is no page to be sent
+ */
+static bool
+httpd_client_next_page(struct httpd_client *client)
 {
-	assert(channel != NULL);
-	assert(page != NULL);
-	assert(position < page->size);
-
-	return g_io_channel_write_chars(channel,
-					(const gchar*)page->data + position,
-					page->size - position,
-					bytes_written_r, error);
+	const struct httpd_output *httpd = client->httpd;
+
+	assert(client->current_page == NULL);
+
+	if (client->next_page < httpd->ring_tail) {
+		/* the pages have been evicted from the ring before
+		   this client was able to send them */
+		g_debug("client is too slow, skipping %u pages",
+			(unsigned)(httpd->ring_head - client->next_page));
+		client->next_page = httpd->ring_head;
+		return false;
+	}
+
+	struct page *page = httpd_output_get_page(httpd, client->next_page);
+	if (page == NULL)
+		return false;
+
+	page_ref(page);
+	client->current_page = page;
+	client->current_position = 0;
+	++client->next_page;
+	return true;
 }
 
-static GIOStatus
-write_n_bytes_to_channel(GIOChannel *channel, const struct page *page,
-			 size_t position, gint n,
-			 gsize *bytes_written_r, GError **error)
+/**
+ * Marks the specified number of bytes as sent, moving on to the
+ * following ring pages as necessary.
+ */
+static void
+httpd_client_consume(struct httpd_client *client, size_t nbytes)
 {
-	GIOStatus status;
+	assert(client->current_page != NULL);
+
+	while (true) {
+		size_t remaining = client->current_page->size -
+			client->current_position;
+		if (nbytes < remaining) {
+			client->current_position += nbytes;
+			return;
+		}
 
-	assert(channel != NULL);
-	assert(page != NULL);
-	assert(position < page->size);
+		nbytes -= remaining;
+		page_unref(client->current_page);
+		client->current_page = NULL;
 
-	if (n == -1) {
-		status =  write_page_to_channel (channel, page, position,
-						 bytes_written_r, error);
-	} else {
-		status = g_io_channel_write_chars(channel,
-						  (const gchar*)page->data + position,
-						  n, bytes_written_r, error);
+		if (nbytes == 0 || !httpd_client_next_page(client)) {
+			assert(nbytes == 0);
+			return;
+		}
 	}
-
-	return status;
 }
 
-static gint
-bytes_left_till_metadata (struct httpd_client *client)
+/**
+ * Writes a vector of buffers to the client socket.
+ */
+static GIOStatus
+httpd_client_write(struct httpd_client *client,
+		   const struct iovec *iov, unsigned n,
+		   gsize *bytes_written_r, GError **error_r)
 {
-	assert(client != NULL);
+	assert(n > 0);
+
+#ifdef WIN32
+	/* no writev() on Windows: write only the first buffer */
+	(void)n;
+	return g_io_channel_write_chars(client->channel, iov[0].iov_base,
+					iov[0].iov_len, bytes_written_r,
+					error_r);
+#else
+	ssize_t nbytes = writev(g_io_channel_unix_get_fd(client->channel),
+				iov, n);
+	if (nbytes >= 0) {
+		*bytes_written_r = nbytes;
+		return G_IO_STATUS_NORMAL;
+	}
 
-	if (client->metadata_requested &&
-	    client->current_page->size - client->current_position
-	    > client->metaint - client->metadata_fill)
-		return client->metaint - client->metadata_fill;
+	*bytes_written_r = 0;
+
+	switch (errno) {
+	case EAGAIN:
+	case EINTR:
+		return G_IO_STATUS_AGAIN;
 
-	return -1;
+	case EPIPE:
+	case ECONNRESET:
+		return G_IO_STATUS_EOF;
+
+	default:
+		g_set_error_literal(error_r, g_io_channel_error_quark(),
+				    g_io_channel_error_from_errno(errno),
+				    g_strerror(errno));
+		return G_IO_STATUS_ERROR;
+	}
+#endif
+}
+
+/**
+ * Fills the vector with the data which is ready to be sent: the rest
+ * of the current page and the following ring pages, up to the next
+ * Icy-Metadata block.
+ *
+ * @return the number of vector elements
+ */
+static unsigned
+httpd_client_fill_iovec(const struct httpd_client *client,
+			struct iovec *iov, unsigned max_iov)
+{
+	size_t max_bytes = client->metadata_requested
+		? client->metaint - client->metadata_fill
+		: (size_t)-1;
+
+	const struct page *page = client->current_page;
+	size_t position = client->current_position;
+	uint64_t next_page = client->next_page;
+	unsigned n = 0;
+
+	while (page != NULL && n < max_iov && max_bytes > 0) {
+		size_t length = page->size - position;
+		if (length > max_bytes)
+			length = max_bytes;
+
+		iov[n].iov_base = (void *)(page->data + position);
+		iov[n].iov_len = length;
+		++n;
+		max_bytes -= length;
+
+		page = httpd_output_get_page(client->httpd, next_page++);
+		position = 0;
+	}
+
+	return n;
 }
 
 static gboolean
-httpd_client_out_event(GIOChannel *source,
+httpd_client_out_event(G_GNUC_UNUSED GIOChannel *source,
 		       G_GNUC_UNUSED GIOCondition condition, gpointer data)
 {
 	struct httpd_client *client = data;
@@ -613,7 +684,6 @@ httpd_client_out_event(GIOChannel *source,
 	GError *error = NULL;
 	GIOStatus status;
 	gsize bytes_written;
-	gint bytes_to_write;
 
 	g_mutex_lock(httpd->mutex);
 
@@ -627,72 +697,61 @@ httpd_client_out_event(GIOChannel *source,
 		return false;
 	}
 
-	if (client->current_page == NULL) {
-		client->current_page = g_queue_pop_head(client->pages);
-		client->current_position = 0;
-	}
-
-	bytes_to_write = bytes_left_till_metadata(client);
+	if (client->current_page == NULL &&
+	    !httpd_client_next_page(client)) {
+		/* all pages are sent: remove the event source */
+		client->write_source_id = 0;
 
-	if (bytes_to_write == 0) {
-		gint metadata_to_write;
+		g_mutex_unlock(httpd->mutex);
+		return false;
+	}
 
-		metadata_to_write = client->metadata_current_position;
+	if (client->metadata_requested &&
+	    client->metadata_fill >= client->metaint) {
+		/* an Icy-Metadata block is due: either the new
+		   metadata or a single zero byte */
+		static const unsigned char empty_metadata = 0;
+		struct iovec iov;
 
 		if (!client->metadata_sent) {
-			status = write_page_to_channel(source,
-						       client->metadata,
-						       metadata_to_write,
-						       &bytes_written, &error);
+			iov.iov_base = client->metadata->data +
+				client->metadata_current_position;
+			iov.iov_len = client->metadata->size -
+				client->metadata_current_position;
+		} else {
+			iov.iov_base = (void *)&empty_metadata;
+			iov.iov_len = 1;
+		}
 
+		status = httpd_client_write(client, &iov, 1,
+					    &bytes_written, &error);
+		if (status == G_IO_STATUS_NORMAL) {
 			client->metadata_current_position += bytes_written;
 
-			if (client->metadata->size
-			    - client->metadata_current_position == 0) {
+			if (bytes_written == iov.iov_len) {
 				client->metadata_fill = 0;
 				client->metadata_current_position = 0;
 				client->metadata_sent = true;
 			}
-		} else {
-			struct page *empty_meta;
-			guchar empty_data = 0;
-
-			empty_meta = page_new_copy(&empty_data, 1);
-
-			status = write_page_to_channel(source,
-						       empty_meta,
-						       metadata_to_write,
-						       &bytes_written, &error);
 
-			client->metadata_current_position += bytes_written;
-
-			if (empty_meta->size
-			    - client->metadata_current_position == 0) {
-				client->metadata_fill = 0;
-				client->metadata_current_position = 0;
-			}
+			g_mutex_unlock(httpd->mutex);
+			return true;
 		}
-
-		bytes_written = 0;
 	} else {
-		status = write_n_bytes_to_channel(source, client->current_page,
-						  client->current_position, bytes_to_write,
-						  &bytes_written, &error);
-	}
+		struct iovec iov[16];
+		unsigned n = httpd_client_fill_iovec(client, iov,
+						     G_N_ELEMENTS(iov));
 
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-		client->current_position += bytes_written;
-		assert(client->current_position <= client->current_page->size);
+		status = httpd_client_write(client, iov, n,
+					    &bytes_written, &error);
+		if (status == G_IO_STATUS_NORMAL) {
+			if (client->metadata_requested)
+				client->metadata_fill += bytes_written;
 
-		if (client->metadata_requested)
-			client->metadata_fill += bytes_written;
+			httpd_client_consume(client, bytes_written);
 
-		if (client->current_position >= client->current_page->size) {
-			page_unref(client->current_page);
-			client->current_page = NULL;
-
-			if (g_queue_is_empty(client->pages)) {
+			if (client->current_page == NULL &&
+			    !httpd_client_next_page(client)) {
 				/* all pages are sent: remove the
 				   event source */
 				client->write_source_id = 0;
@@ -700,10 +759,16 @@ httpd_client_out_event(GIOChannel *source,
 				g_mutex_unlock(httpd->mutex);
 				return false;
 			}
+
+			g_mutex_unlock(httpd->mutex);
+			return true;
 		}
+	}
 
-		g_mutex_unlock(httpd->mutex);
-		return true;
+	switch (status) {
+	case G_IO_STATUS_NORMAL:
+		/* handled above */
+		break;
 
 	case G_IO_STATUS_AGAIN:
 		g_mutex_unlock(httpd->mutex);
@@ -740,8 +805,21 @@ httpd_client_send(struct httpd_client *client, struct page *page)
 		/* the client is still writing the HTTP request */
 		return;
 
+	assert(client->current_page == NULL);
+
 	page_ref(page);
-	g_queue_push_tail(client->pages, page);
+	client->current_page = page;
+	client->current_position = 0;
+
+	httpd_client_wake(client);
+}
+
+void
+httpd_client_wake(struct httpd_client *client)
+{
+	if (client->state != RESPONSE)
+		/* the client is still writing the HTTP request */
+		return;
 
 	if (client->write_source_id == 0)
 		client->write_source_id =
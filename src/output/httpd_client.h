@@ -45,22 +45,24 @@ void
 httpd_client_free(struct httpd_client *client);
 
 /**
- * Returns the total size of this client's page queue.
+ * Discards all pages which have not been sent yet.  The client
+ * continues with the next page added to the ring.
  */
-size_t
-httpd_client_queue_size(const struct httpd_client *client);
+void
+httpd_client_cancel(struct httpd_client *client);
 
 /**
- * Clears the page queue.
+ * Sends a page to the client before the pages in the ring.  This is
+ * used for the encoder header.
  */
 void
-httpd_client_cancel(struct httpd_client *client);
+httpd_client_send(struct httpd_client *client, struct page *page);
 
 /**
- * Appends a page to the client's queue.
+ * Notifies the client that new pages have been added to the ring.
  */
 void
-httpd_client_send(struct httpd_client *client, struct page *page);
+httpd_client_wake(struct httpd_client *client);
 
 /**
  * Sends the passed metadata.
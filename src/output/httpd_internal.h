@@ -31,9 +31,24 @@
 #include <glib.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct httpd_client;
 
+enum {
+	/**
+	 * The maximum number of pages in the httpd_output.ring.
+	 */
+	HTTPD_RING_PAGES = 1024,
+
+	/**
+	 * The maximum number of bytes in the httpd_output.ring.  A
+	 * client which falls behind more than this skips to the most
+	 * recent page.
+	 */
+	HTTPD_RING_BYTES = 256 * 1024,
+};
+
 struct httpd_output {
 	struct audio_output base;
 
@@ -107,6 +122,48 @@ struct httpd_output {
 	 */
 	GList *clients;
 
+	/**
+	 * The most recent encoded pages, shared by all clients.  Each
+	 * client remembers the sequence number of the next page it
+	 * has to send; the page with sequence number n is stored in
+	 * ring[n % HTTPD_RING_PAGES].
+	 */
+	struct page *ring[HTTPD_RING_PAGES];
+
+	/**
+	 * The sequence number of the oldest page in #ring.
+	 */
+	uint64_t ring_tail;
+
+	/**
+	 * The sequence number of the next page to be added to #ring.
+	 */
+	uint64_t ring_head;
+
+	/**
+	 * The total size of all pages in #ring.
+	 */
+	size_t ring_size;
+
+	/**
+	 * The maximum total size of the pages in #ring.  This is at
+	 * least #HTTPD_RING_BYTES, and at least #burst_size.
+	 */
+	size_t ring_max_size;
+
+	/**
+	 * The sequence number of the first page after the current
+	 * #header.  New clients must not receive older pages, because
+	 * they belong to a different stream.
+	 */
+	uint64_t stream_start;
+
+	/**
+	 * The configured number of bytes of recent pages which are
+	 * sent to new clients right after the #header.
+	 */
+	size_t burst_size;
+
 	/**
 	 * A temporary buffer for the httpd_output_read_page()
 	 * function.
@@ -127,6 +184,28 @@ void
 httpd_output_remove_client(struct httpd_output *httpd,
 			   struct httpd_client *client);
 
+/**
+ * Returns the page with the specified sequence number from the
+ * ring, or NULL if it is not (or not anymore) available.  This does
+ * not add a reference.  The caller must hold the mutex.
+ */
+static inline struct page *
+httpd_output_get_page(const struct httpd_output *httpd, uint64_t seq)
+{
+	if (seq < httpd->ring_tail || seq >= httpd->ring_head)
+		return NULL;
+
+	return httpd->ring[seq % HTTPD_RING_PAGES];
+}
+
+/**
+ * Determines the sequence number of the first ring page which is
+ * sent to a new client, according to httpd_output.burst_size.  The
+ * caller must hold the mutex.
+ */
+uint64_t
+httpd_output_burst_start(const struct httpd_output *httpd);
+
 /**
  * Sends the encoder header to the client.  This is called right after
  * the response headers have been sent.
@@ -24,6 +24,7 @@
 #include "output_api.h"
 #include "encoder_plugin.h"
 #include "encoder_list.h"
+#include "encoder_thread.h"
 #include "resolver.h"
 #include "page.h"
 #include "icy_server.h"
@@ -115,6 +116,11 @@ httpd_output_init(const struct config_param *param,
 
 	httpd->clients_max = config_get_block_unsigned(param,"max_clients", 0);
 
+	httpd->burst_size = config_get_block_unsigned(param, "burst_size", 0);
+	httpd->ring_max_size = httpd->burst_size > HTTPD_RING_BYTES
+		? httpd->burst_size
+		: HTTPD_RING_BYTES;
+
 	/* set up bind_to_address */
 
 	httpd->server_socket = server_socket_new(httpd_listen_in_event, httpd);
@@ -145,6 +151,8 @@ httpd_output_init(const struct config_param *param,
 		return NULL;
 	}
 
+	httpd->encoder = encoder_thread_wrap(httpd->encoder, param);
+
 	/* determine content type */
 	httpd->content_type = encoder_get_mime_type(httpd->encoder);
 	if (httpd->content_type == NULL) {
@@ -246,35 +254,43 @@ httpd_listen_in_event(int fd, const struct sockaddr *address,
 /**
  * Reads data from the encoder (as much as available) and returns it
  * as a new #page object.
+ *
+ * The encoder is always drained completely, because it may return a
+ * frame or an Ogg page in several pieces; this way, each #page
+ * begins at an encoder frame or Ogg page boundary, which is where
+ * httpd_output_burst_start() lets new clients begin.
  */
 static struct page *
 httpd_output_read_page(struct httpd_output *httpd)
 {
-	size_t size = 0, nbytes;
+	GByteArray *data = NULL;
+	size_t nbytes;
 
 	if (httpd->unflushed_input >= 65536) {
 		/* we have fed a lot of input into the encoder, but it
 		   didn't give anything back yet - flush now to avoid
-		   buffer underruns */
-		encoder_flush(httpd->encoder, NULL);
+		   buffer underruns; don't wait for the encoder
+		   thread, it may still be busy with queued input */
+		encoder_thread_flush_async(httpd->encoder, NULL);
 		httpd->unflushed_input = 0;
 	}
 
-	do {
-		nbytes = encoder_read(httpd->encoder, httpd->buffer + size,
-				      sizeof(httpd->buffer) - size);
-		if (nbytes == 0)
-			break;
-
+	while ((nbytes = encoder_read(httpd->encoder, httpd->buffer,
+				      sizeof(httpd->buffer))) > 0) {
 		httpd->unflushed_input = 0;
 
-		size += nbytes;
-	} while (size < sizeof(httpd->buffer));
+		if (data == NULL)
+			data = g_byte_array_new();
+		g_byte_array_append(data, (const guint8 *)httpd->buffer,
+				    nbytes);
+	}
 
-	if (size == 0)
+	if (data == NULL)
 		return NULL;
 
-	return page_new_copy(httpd->buffer, size);
+	struct page *page = page_new_copy(data->data, data->len);
+	g_byte_array_free(data, true);
+	return page;
 }
 
 static bool
@@ -335,6 +351,9 @@ httpd_output_open(struct audio_output *ao, struct audio_format *audio_format,
 
 	httpd->clients = NULL;
 	httpd->clients_cnt = 0;
+	httpd->ring_tail = httpd->ring_head = 0;
+	httpd->ring_size = 0;
+	httpd->stream_start = 0;
 	httpd->timer = timer_new(audio_format);
 
 	httpd->open = true;
@@ -365,6 +384,9 @@ httpd_output_close(struct audio_output *ao)
 	g_list_foreach(httpd->clients, httpd_client_delete, NULL);
 	g_list_free(httpd->clients);
 
+	for (uint64_t i = httpd->ring_tail; i < httpd->ring_head; ++i)
+		page_unref(httpd->ring[i % HTTPD_RING_PAGES]);
+
 	if (httpd->header != NULL)
 		page_unref(httpd->header);
 
@@ -384,6 +406,30 @@ httpd_output_remove_client(struct httpd_output *httpd,
 	httpd->clients_cnt--;
 }
 
+uint64_t
+httpd_output_burst_start(const struct httpd_output *httpd)
+{
+	uint64_t first = httpd->ring_tail > httpd->stream_start
+		? httpd->ring_tail
+		: httpd->stream_start;
+	uint64_t seq = httpd->ring_head;
+	size_t size = 0;
+
+	/* go back page by page: each page begins at an encoder frame
+	   or Ogg page boundary, see httpd_output_read_page() */
+	while (seq > first) {
+		const struct page *page =
+			httpd->ring[(seq - 1) % HTTPD_RING_PAGES];
+		if (size + page->size > httpd->burst_size)
+			break;
+
+		size += page->size;
+		--seq;
+	}
+
+	return seq;
+}
+
 void
 httpd_output_send_header(struct httpd_output *httpd,
 			 struct httpd_client *client)
@@ -402,24 +448,47 @@ httpd_output_delay(struct audio_output *ao)
 		: 0;
 }
 
+/**
+ * Removes the oldest page from the ring.  Clients which have not sent
+ * it yet will notice that and skip to the most recent page.
+ */
 static void
-httpd_client_check_queue(gpointer data, G_GNUC_UNUSED gpointer user_data)
+httpd_output_ring_shift(struct httpd_output *httpd)
 {
-	struct httpd_client *client = data;
+	assert(httpd->ring_tail < httpd->ring_head);
 
-	if (httpd_client_queue_size(client) > 256 * 1024) {
-		g_debug("client is too slow, flushing its queue");
-		httpd_client_cancel(client);
-	}
+	struct page *page = httpd->ring[httpd->ring_tail % HTTPD_RING_PAGES];
+	++httpd->ring_tail;
+
+	assert(httpd->ring_size >= page->size);
+	httpd->ring_size -= page->size;
+	page_unref(page);
 }
 
+/**
+ * Appends a page to the ring, evicting old pages if it is full.  The
+ * caller must hold the mutex.
+ */
 static void
-httpd_client_send_page(gpointer data, gpointer user_data)
+httpd_output_ring_push(struct httpd_output *httpd, struct page *page)
+{
+	while (httpd->ring_head - httpd->ring_tail >= HTTPD_RING_PAGES ||
+	       (httpd->ring_tail < httpd->ring_head &&
+		httpd->ring_size + page->size > httpd->ring_max_size))
+		httpd_output_ring_shift(httpd);
+
+	page_ref(page);
+	httpd->ring[httpd->ring_head % HTTPD_RING_PAGES] = page;
+	++httpd->ring_head;
+	httpd->ring_size += page->size;
+}
+
+static void
+httpd_client_wake_callback(gpointer data, G_GNUC_UNUSED gpointer user_data)
 {
 	struct httpd_client *client = data;
-	struct page *page = user_data;
 
-	httpd_client_send(client, page);
+	httpd_client_wake(client);
 }
 
 /**
@@ -431,7 +500,8 @@ httpd_output_broadcast_page(struct httpd_output *httpd, struct page *page)
 	assert(page != NULL);
 
 	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_send_page, page);
+	httpd_output_ring_push(httpd, page);
+	g_list_foreach(httpd->clients, httpd_client_wake_callback, NULL);
 	g_mutex_unlock(httpd->mutex);
 }
 
@@ -443,10 +513,6 @@ httpd_output_encoder_to_clients(struct httpd_output *httpd)
 {
 	struct page *page;
 
-	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_check_queue, NULL);
-	g_mutex_unlock(httpd->mutex);
-
 	while ((page = httpd_output_read_page(httpd)) != NULL) {
 		httpd_output_broadcast_page(httpd, page);
 		page_unref(page);
@@ -552,10 +618,18 @@ httpd_output_tag(struct audio_output *ao, const struct tag *tag)
 
 		page = httpd_output_read_page(httpd);
 		if (page != NULL) {
+			g_mutex_lock(httpd->mutex);
+
 			if (httpd->header != NULL)
 				page_unref(httpd->header);
 			httpd->header = page;
-			httpd_output_broadcast_page(httpd, page);
+
+			httpd_output_ring_push(httpd, page);
+			httpd->stream_start = httpd->ring_head;
+
+			g_list_foreach(httpd->clients,
+				       httpd_client_wake_callback, NULL);
+			g_mutex_unlock(httpd->mutex);
 		}
 	} else {
 		/* use Icy-Metadata */
@@ -590,6 +664,11 @@ httpd_output_cancel(struct audio_output *ao)
 	struct httpd_output *httpd = (struct httpd_output *)ao;
 
 	g_mutex_lock(httpd->mutex);
+
+	/* the pending pages are obsolete */
+	while (httpd->ring_tail < httpd->ring_head)
+		httpd_output_ring_shift(httpd);
+
 	g_list_foreach(httpd->clients, httpd_client_cancel_callback, NULL);
 	g_mutex_unlock(httpd->mutex);
 }
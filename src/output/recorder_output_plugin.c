@@ -22,6 +22,7 @@
 #include "output_api.h"
 #include "encoder_plugin.h"
 #include "encoder_list.h"
+#include "encoder_thread.h"
 #include "fd_util.h"
 #include "open.h"
 
@@ -103,6 +104,8 @@ recorder_output_init(const struct config_param *param, GError **error_r)
 	if (recorder->encoder == NULL)
 		goto failure;
 
+	recorder->encoder = encoder_thread_wrap(recorder->encoder, param);
+
 	return &recorder->base;
 
 failure:
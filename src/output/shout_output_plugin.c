@@ -22,6 +22,7 @@
 #include "output_api.h"
 #include "encoder_plugin.h"
 #include "encoder_list.h"
+#include "encoder_thread.h"
 #include "mpd_error.h"
 
 #include <shout/shout.h>
@@ -223,6 +224,8 @@ my_shout_init_driver(const struct config_param *param,
 	if (sd->encoder == NULL)
 		goto failure;
 
+	sd->encoder = encoder_thread_wrap(sd->encoder, param);
+
 	if (strcmp(encoding, "mp3") == 0 || strcmp(encoding, "lame") == 0)
 		shout_format = SHOUT_FORMAT_MP3;
 	else
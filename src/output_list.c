@@ -24,6 +24,7 @@
 #include "output/ao_output_plugin.h"
 #include "output/ffado_output_plugin.h"
 #include "output/fifo_output_plugin.h"
+#include "output/hls_output_plugin.h"
 #include "output/httpd_output_plugin.h"
 #include "output/jack_output_plugin.h"
 #include "output/mvp_output_plugin.h"
@@ -87,6 +88,9 @@ const struct audio_output_plugin *audio_output_plugins[] = {
 #ifdef ENABLE_HTTPD_OUTPUT
 	&httpd_output_plugin,
 #endif
+#ifdef ENABLE_HLS_OUTPUT
+	&hls_output_plugin,
+#endif
 #ifdef ENABLE_RECORDER_OUTPUT
 	&recorder_output_plugin,
 #endif
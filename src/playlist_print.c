@@ -58,6 +58,24 @@ playlist_print_info(struct client *client, const struct playlist *playlist,
 	return true;
 }
 
+bool
+playlist_print_info_window(struct client *client,
+			   const struct playlist *playlist,
+			   unsigned start, unsigned end,
+			   const struct song_window *window)
+{
+	const struct queue *queue = &playlist->queue;
+
+	if (end > queue_length(queue))
+		end = queue_length(queue);
+
+	if (start > end)
+		return false;
+
+	queue_print_info_window(client, queue, start, end, window);
+	return true;
+}
+
 bool
 playlist_print_id(struct client *client, const struct playlist *playlist,
 		  unsigned id)
@@ -27,6 +27,7 @@
 struct client;
 struct playlist;
 struct locate_item_list;
+struct song_window;
 
 /**
  * Sends the whole playlist to the client, song URIs only.
@@ -44,6 +45,16 @@ bool
 playlist_print_info(struct client *client, const struct playlist *playlist,
 		    unsigned start, unsigned end);
 
+/**
+ * Like playlist_print_info(), but sorts the range and sends only the
+ * specified window of it (see struct song_window).
+ */
+bool
+playlist_print_info_window(struct client *client,
+			   const struct playlist *playlist,
+			   unsigned start, unsigned end,
+			   const struct song_window *window);
+
 /**
  * Sends the song with the specified id to the client.
  *
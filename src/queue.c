@@ -41,6 +41,168 @@ queue_generate_id(const struct queue *queue)
 	return cur;
 }
 
+/**
+ * Adds an item to the URI index.
+ */
+static void
+queue_uri_index_add(struct queue *queue, const struct song *song,
+		    unsigned id)
+{
+	char *uri = song_get_uri(song);
+	GSList *ids = g_hash_table_lookup(queue->uri_index, uri);
+
+	/* if the URI is already known, g_hash_table_insert() keeps
+	   the old key and frees the new one */
+	g_hash_table_insert(queue->uri_index, uri,
+			    g_slist_prepend(ids, GUINT_TO_POINTER(id)));
+}
+
+/**
+ * Removes an item from the URI index.
+ */
+static void
+queue_uri_index_remove(struct queue *queue, const struct song *song,
+		       unsigned id)
+{
+	char *uri = song_get_uri(song);
+	GSList *ids = g_hash_table_lookup(queue->uri_index, uri);
+	assert(g_slist_find(ids, GUINT_TO_POINTER(id)) != NULL);
+
+	ids = g_slist_remove(ids, GUINT_TO_POINTER(id));
+	if (ids != NULL)
+		g_hash_table_insert(queue->uri_index, uri, ids);
+	else {
+		g_hash_table_remove(queue->uri_index, uri);
+		g_free(uri);
+	}
+}
+
+static void
+queue_uri_index_free_value(G_GNUC_UNUSED gpointer key, gpointer value,
+			   G_GNUC_UNUSED gpointer user_data)
+{
+	g_slist_free(value);
+}
+
+/**
+ * Records that the items in the specified position range have been
+ * modified in the current version.
+ */
+static void
+queue_history_add(struct queue *queue, unsigned start, unsigned end)
+{
+	assert(start <= end);
+
+	if (start == end)
+		return;
+
+	if (queue->history_length > 0) {
+		struct queue_change *last =
+			&queue->history[(queue->history_head +
+					 queue->history_length - 1) %
+					QUEUE_HISTORY_LENGTH];
+		if (last->version == queue->version) {
+			/* same version: extend the existing record */
+			if (start < last->start)
+				last->start = start;
+			if (end > last->end)
+				last->end = end;
+			return;
+		}
+	}
+
+	if (queue->history_length == QUEUE_HISTORY_LENGTH) {
+		/* the ring is full: drop the oldest record */
+		const struct queue_change *oldest =
+			&queue->history[queue->history_head];
+		if (oldest->version >= queue->history_version)
+			queue->history_version = oldest->version + 1;
+
+		queue->history_head = (queue->history_head + 1) %
+			QUEUE_HISTORY_LENGTH;
+		--queue->history_length;
+	}
+
+	queue->history[(queue->history_head + queue->history_length) %
+		       QUEUE_HISTORY_LENGTH] = (struct queue_change){
+		.version = queue->version,
+		.start = start,
+		.end = end,
+	};
+	++queue->history_length;
+}
+
+/**
+ * Discards all change records.
+ *
+ * @param version the new value for queue.history_version
+ */
+static void
+queue_history_clear(struct queue *queue, uint32_t version)
+{
+	queue->history_head = 0;
+	queue->history_length = 0;
+	queue->history_version = version;
+}
+
+static int
+queue_change_compare_start(const void *av, const void *bv)
+{
+	const struct queue_change *a = av, *b = bv;
+
+	if (a->start < b->start)
+		return -1;
+	else if (a->start > b->start)
+		return 1;
+	else
+		return 0;
+}
+
+int
+queue_get_changes(const struct queue *queue, uint32_t version,
+		  struct queue_change *ranges)
+{
+	if (version > queue->version || version < queue->history_version)
+		return -1;
+
+	unsigned n = 0;
+	for (unsigned i = 0; i < queue->history_length; ++i) {
+		const struct queue_change *change =
+			&queue->history[(queue->history_head + i) %
+					QUEUE_HISTORY_LENGTH];
+		if (change->version < version)
+			continue;
+
+		/* items at the end may have been deleted meanwhile */
+		unsigned end = change->end < queue->length
+			? change->end
+			: queue->length;
+		if (change->start >= end)
+			continue;
+
+		ranges[n++] = (struct queue_change){
+			.version = change->version,
+			.start = change->start,
+			.end = end,
+		};
+	}
+
+	/* sort by start position and merge overlapping ranges */
+
+	qsort(ranges, n, sizeof(ranges[0]), queue_change_compare_start);
+
+	unsigned m = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		if (m > 0 && ranges[i].start <= ranges[m - 1].end) {
+			if (ranges[i].end > ranges[m - 1].end)
+				ranges[m - 1].end = ranges[i].end;
+		} else
+			ranges[m++] = ranges[i];
+	}
+
+	return m;
+}
+
 int
 queue_next_order(const struct queue *queue, unsigned order)
 {
@@ -70,6 +232,11 @@ queue_increment_version(struct queue *queue)
 			queue->items[i].version = 0;
 
 		queue->version = 1;
+
+		/* the history cannot represent the items reset to
+		   version 0; disable it until the queue gets
+		   cleared */
+		queue_history_clear(queue, G_MAXUINT32);
 	}
 }
 
@@ -82,6 +249,7 @@ queue_modify(struct queue *queue, unsigned order)
 
 	position = queue->order[order];
 	queue->items[position].version = queue->version;
+	queue_history_add(queue, position, position + 1);
 
 	queue_increment_version(queue);
 }
@@ -92,6 +260,7 @@ queue_modify_all(struct queue *queue)
 	for (unsigned i = 0; i < queue->length; i++)
 		queue->items[i].version = queue->version;
 
+	queue_history_add(queue, 0, queue->length);
 	queue_increment_version(queue);
 }
 
@@ -111,6 +280,8 @@ queue_append(struct queue *queue, struct song *song)
 
 	queue->order[queue->length] = queue->length;
 	queue->id_to_position[id] = queue->length;
+	queue_uri_index_add(queue, song, id);
+	queue_history_add(queue, queue->length, queue->length + 1);
 
 	++queue->length;
 
@@ -133,6 +304,11 @@ queue_swap(struct queue *queue, unsigned position1, unsigned position2)
 
 	queue->id_to_position[id1] = position2;
 	queue->id_to_position[id2] = position1;
+
+	if (position1 < position2)
+		queue_history_add(queue, position1, position2 + 1);
+	else
+		queue_history_add(queue, position2, position1 + 1);
 }
 
 static void
@@ -166,6 +342,11 @@ queue_move(struct queue *queue, unsigned from, unsigned to)
 	queue->items[to] = item;
 	queue->items[to].version = queue->version;
 
+	if (from < to)
+		queue_history_add(queue, from, to + 1);
+	else
+		queue_history_add(queue, to, from + 1);
+
 	/* now deal with order */
 
 	if (queue->random) {
@@ -207,6 +388,11 @@ queue_move_range(struct queue *queue, unsigned start, unsigned end, unsigned to)
 		queue->items[to + i - start].version = queue->version;
 	}
 
+	if (to > start)
+		queue_history_add(queue, start, to + end - start);
+	else
+		queue_history_add(queue, to, end);
+
 	if (queue->random) {
 		// Update the positions in the queue.
 		// Note that the ranges for these cases are the same as the ranges of
@@ -256,10 +442,12 @@ queue_delete(struct queue *queue, unsigned position)
 	assert(position < queue->length);
 
 	song = queue_get(queue, position);
+	id = queue_position_to_id(queue, position);
+
+	queue_uri_index_remove(queue, song, id);
 	if (!song_in_database(song))
 		song_free(song);
 
-	id = queue_position_to_id(queue, position);
 	order = queue_position_to_order(queue, position);
 
 	--queue->length;
@@ -273,6 +461,8 @@ queue_delete(struct queue *queue, unsigned position)
 	for (unsigned i = position; i < queue->length; i++)
 		queue_move_song_to(queue, i + 1, i);
 
+	queue_history_add(queue, position, queue->length);
+
 	/* delete the entry from the order array */
 
 	for (unsigned i = order; i < queue->length; i++)
@@ -297,7 +487,15 @@ queue_clear(struct queue *queue)
 		queue->id_to_position[item->id] = -1;
 	}
 
+	g_hash_table_foreach(queue->uri_index, queue_uri_index_free_value,
+			     NULL);
+	g_hash_table_remove_all(queue->uri_index);
+
 	queue->length = 0;
+
+	/* no item survives, so all future changes will be
+	   recorded */
+	queue_history_clear(queue, 0);
 }
 
 void
@@ -310,6 +508,7 @@ queue_init(struct queue *queue, unsigned max_length)
 	queue->random = false;
 	queue->single = false;
 	queue->consume = false;
+	queue_history_clear(queue, 0);
 
 	queue->items = g_new(struct queue_item, max_length);
 	queue->order = g_malloc(sizeof(queue->order[0]) *
@@ -320,6 +519,9 @@ queue_init(struct queue *queue, unsigned max_length)
 	for (unsigned i = 0; i < max_length * QUEUE_HASH_MULT; ++i)
 		queue->id_to_position[i] = -1;
 
+	queue->uri_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+						 g_free, NULL);
+
 	queue->rand = g_rand_new();
 }
 
@@ -331,6 +533,7 @@ queue_finish(struct queue *queue)
 	g_free(queue->items);
 	g_free(queue->order);
 	g_free(queue->id_to_position);
+	g_hash_table_destroy(queue->uri_index);
 
 	g_rand_free(queue->rand);
 }
@@ -528,6 +731,7 @@ queue_set_priority(struct queue *queue, unsigned position, uint8_t priority,
 
 	item->version = queue->version;
 	item->priority = priority;
+	queue_history_add(queue, position, position + 1);
 
 	if (!queue->random)
 		/* don't reorder if not in random mode */
@@ -32,6 +32,29 @@ enum {
 	 * number space
 	 */
 	QUEUE_HASH_MULT = 4,
+
+	/**
+	 * The number of change records kept in the queue's history
+	 * ring.
+	 */
+	QUEUE_HISTORY_LENGTH = 64,
+};
+
+/**
+ * A range of positions which was modified in one queue version.
+ */
+struct queue_change {
+	/**
+	 * The queue version which was current when the items were
+	 * modified, i.e. the value written to queue_item.version.
+	 */
+	uint32_t version;
+
+	/** the first modified position */
+	unsigned start;
+
+	/** the position after the last modified one */
+	unsigned end;
 };
 
 /**
@@ -84,6 +107,14 @@ struct queue {
 	/** map song ids to positions */
 	int *id_to_position;
 
+	/**
+	 * Maps song URIs to a GSList of the ids of all items with
+	 * that URI.  Item ids do not change when songs are moved, so
+	 * only queue_append(), queue_delete() and queue_clear() need
+	 * to update it.
+	 */
+	GHashTable *uri_index;
+
 	/** repeat playback when the end of the queue has been
 	    reached? */
 	bool repeat;
@@ -99,6 +130,27 @@ struct queue {
 
 	/** random number generator for shuffle and random mode */
 	GRand *rand;
+
+	/**
+	 * A ring buffer of recent modifications.  This allows
+	 * queue_get_changes() to find the modified items without
+	 * scanning the whole queue.  There is at most one record per
+	 * version; further modifications within the same version
+	 * extend that record.
+	 */
+	struct queue_change history[QUEUE_HISTORY_LENGTH];
+
+	/** the index of the oldest record in #history */
+	unsigned history_head;
+
+	/** the number of valid records in #history */
+	unsigned history_length;
+
+	/**
+	 * All modifications since this version are recorded in
+	 * #history.  Older records have been dropped from the ring.
+	 */
+	uint32_t history_version;
 };
 
 static inline unsigned
@@ -217,6 +269,17 @@ queue_get_order(const struct queue *queue, unsigned order)
 	return queue_get(queue, queue_order_to_position(queue, order));
 }
 
+/**
+ * Returns the ids of all items with the specified song URI, in no
+ * particular order.  The list is owned by the queue and becomes
+ * invalid when the next song is added or removed.
+ */
+static inline const GSList *
+queue_lookup_uri(const struct queue *queue, const char *uri)
+{
+	return g_hash_table_lookup(queue->uri_index, uri);
+}
+
 /**
  * Is the song at the specified position newer than the specified
  * version?
@@ -232,6 +295,21 @@ queue_song_newer(const struct queue *queue, unsigned position,
 		queue->items[position].version == 0;
 }
 
+/**
+ * Determines which positions have been modified since the specified
+ * version, using the queue's change history.  The ranges are sorted
+ * and do not overlap; they may include items which have not been
+ * modified, so the caller must still check queue_song_newer().
+ *
+ * @param ranges an array of at least #QUEUE_HISTORY_LENGTH elements
+ * which receives the position ranges
+ * @return the number of ranges, or -1 if the history does not go
+ * back far enough (the caller must scan the whole queue then)
+ */
+int
+queue_get_changes(const struct queue *queue, uint32_t version,
+		  struct queue_change *ranges);
+
 /**
  * Initialize a queue object.
  */
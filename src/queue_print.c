@@ -22,9 +22,14 @@
 #include "queue.h"
 #include "song.h"
 #include "song_print.h"
+#include "song_sort.h"
 #include "locate.h"
+#include "tag.h"
 #include "client.h"
 #include "mapper.h"
+#include "compact_print.h"
+
+#include <stdlib.h>
 
 /**
  * Send detailed information about a range of songs in the queue to a
@@ -38,6 +43,24 @@ static void
 queue_print_song_info(struct client *client, const struct queue *queue,
 		      unsigned position)
 {
+	struct compact_dict *dict = client_get_compact(client);
+	if (dict != NULL) {
+		GByteArray *record = g_byte_array_new();
+		compact_append_song(record, dict, queue_get(queue, position));
+		compact_append_uint(record, COMPACT_POS, position);
+		compact_append_uint(record, COMPACT_ID,
+				    queue_position_to_id(queue, position));
+
+		uint8_t priority =
+			queue_get_priority_at_position(queue, position);
+		if (priority != 0)
+			compact_append_uint(record, COMPACT_PRIO, priority);
+
+		compact_send(client, record);
+		g_byte_array_free(record, true);
+		return;
+	}
+
 	song_print_info(client, queue_get(queue, position));
 	client_printf(client, "Pos: %u\nId: %u\n",
 		      position, queue_position_to_id(queue, position));
@@ -58,6 +81,39 @@ queue_print_info(struct client *client, const struct queue *queue,
 		queue_print_song_info(client, queue, i);
 }
 
+void
+queue_print_info_window(struct client *client, const struct queue *queue,
+			unsigned start, unsigned end,
+			const struct song_window *window)
+{
+	assert(start <= end);
+	assert(end <= queue_length(queue));
+
+	if (!song_window_is_sorted(window)) {
+		if (window->start >= end - start)
+			return;
+
+		queue_print_info(client, queue, start + window->start,
+				 start + MIN(window->end, end - start));
+		return;
+	}
+
+	const unsigned n = end - start;
+	struct song **songs = g_new(struct song *, n);
+	for (unsigned i = 0; i < n; ++i)
+		songs[i] = queue_get(queue, start + i);
+
+	unsigned *indexes = song_sort_indexes(songs, n, window->sort,
+					      window->descending);
+	g_free(songs);
+
+	const unsigned window_end = MIN(window->end, n);
+	for (unsigned i = window->start; i < window_end; ++i)
+		queue_print_song_info(client, queue, start + indexes[i]);
+
+	g_free(indexes);
+}
+
 void
 queue_print_uris(struct client *client, const struct queue *queue,
 		 unsigned start, unsigned end)
@@ -71,24 +127,53 @@ queue_print_uris(struct client *client, const struct queue *queue,
 	}
 }
 
+static void
+queue_print_song_position(struct client *client, const struct queue *queue,
+			  unsigned position)
+{
+	client_printf(client, "cpos: %i\nId: %i\n",
+		      position, queue_position_to_id(queue, position));
+}
+
+/**
+ * Invoke a callback for each song which is newer than the specified
+ * version.  Consults the queue's change history first, and falls back
+ * to scanning the whole queue if the history doesn't reach back far
+ * enough.
+ */
+static void
+queue_print_changes(struct client *client, const struct queue *queue,
+		    uint32_t version,
+		    void (*print)(struct client *client,
+				  const struct queue *queue,
+				  unsigned position))
+{
+	struct queue_change ranges[QUEUE_HISTORY_LENGTH];
+	int n = queue_get_changes(queue, version, ranges);
+	if (n < 0) {
+		ranges[0].start = 0;
+		ranges[0].end = queue_length(queue);
+		n = 1;
+	}
+
+	for (int r = 0; r < n; ++r)
+		for (unsigned i = ranges[r].start; i < ranges[r].end; ++i)
+			if (queue_song_newer(queue, i, version))
+				print(client, queue, i);
+}
+
 void
 queue_print_changes_info(struct client *client, const struct queue *queue,
 			 uint32_t version)
 {
-	for (unsigned i = 0; i < queue_length(queue); i++) {
-		if (queue_song_newer(queue, i, version))
-			queue_print_song_info(client, queue, i);
-	}
+	queue_print_changes(client, queue, version, queue_print_song_info);
 }
 
 void
 queue_print_changes_position(struct client *client, const struct queue *queue,
 			     uint32_t version)
 {
-	for (unsigned i = 0; i < queue_length(queue); i++)
-		if (queue_song_newer(queue, i, version))
-			client_printf(client, "cpos: %i\nId: %i\n",
-				      i, queue_position_to_id(queue, i));
+	queue_print_changes(client, queue, version, queue_print_song_position);
 }
 
 void
@@ -109,10 +194,64 @@ queue_search(struct client *client, const struct queue *queue,
 	locate_item_list_free(new_list);
 }
 
+static int
+compare_position(const void *av, const void *bv)
+{
+	const unsigned *a = av, *b = bv;
+
+	if (*a < *b)
+		return -1;
+	else if (*a > *b)
+		return 1;
+	else
+		return 0;
+}
+
+/**
+ * Implementation of queue_find() for criteria which include the
+ * exact song URI: only the items found in the queue's URI index are
+ * checked.
+ */
+static void
+queue_find_uri(struct client *client, const struct queue *queue,
+	       const struct locate_item_list *criteria, const char *uri)
+{
+	const GSList *ids = queue_lookup_uri(queue, uri);
+	unsigned n = g_slist_length((GSList *)ids);
+	if (n == 0)
+		return;
+
+	unsigned *positions = g_new(unsigned, n);
+	unsigned i = 0;
+	for (const GSList *j = ids; j != NULL; j = j->next)
+		positions[i++] = queue_id_to_position(queue,
+						      GPOINTER_TO_UINT(j->data));
+
+	/* print the results in queue order, like the full scan */
+	qsort(positions, n, sizeof(positions[0]), compare_position);
+
+	for (i = 0; i < n; ++i) {
+		const struct song *song = queue_get(queue, positions[i]);
+
+		if (locate_song_match(song, criteria))
+			queue_print_song_info(client, queue, positions[i]);
+	}
+
+	g_free(positions);
+}
+
 void
 queue_find(struct client *client, const struct queue *queue,
 	   const struct locate_item_list *criteria)
 {
+	for (unsigned i = 0; i < criteria->length; ++i) {
+		if (criteria->items[i].tag == LOCATE_TAG_FILE_TYPE) {
+			queue_find_uri(client, queue, criteria,
+				       criteria->items[i].needle);
+			return;
+		}
+	}
+
 	for (unsigned i = 0; i < queue_length(queue); i++) {
 		const struct song *song = queue_get(queue, i);
 
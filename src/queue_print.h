@@ -30,11 +30,21 @@
 struct client;
 struct queue;
 struct locate_item_list;
+struct song_window;
 
 void
 queue_print_info(struct client *client, const struct queue *queue,
 		 unsigned start, unsigned end);
 
+/**
+ * Like queue_print_info(), but sorts the range and prints only the
+ * specified window of it.
+ */
+void
+queue_print_info_window(struct client *client, const struct queue *queue,
+			unsigned start, unsigned end,
+			const struct song_window *window);
+
 void
 queue_print_uris(struct client *client, const struct queue *queue,
 		 unsigned start, unsigned end);
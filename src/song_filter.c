@@ -0,0 +1,655 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "song_filter.h"
+#include "locate.h"
+#include "song.h"
+#include "tag.h"
+#include "ack.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define SONG_FILTER_STICKER_PREFIX "sticker:"
+
+enum song_filter_type {
+	SONG_FILTER_AND,
+	SONG_FILTER_OR,
+	SONG_FILTER_NOT,
+	SONG_FILTER_LEAF,
+};
+
+struct song_filter {
+	enum song_filter_type type;
+
+	/** the reference counter; only used in the root node */
+	unsigned ref;
+
+	/** the next operand of the parent AND/OR node */
+	struct song_filter *next;
+
+	/** the operands of AND/OR, or the one operand of NOT */
+	struct song_filter *children;
+
+	/* the remaining attributes are used only by SONG_FILTER_LEAF */
+
+	/**
+	 * Obtains the value(s) of #tag from the song and passes them
+	 * to #match_value.  Chosen by the parser, so the tag type is
+	 * not checked again for every song.
+	 */
+	bool (*match_song)(const struct song_filter *filter,
+			   const struct song *song, bool fold_case);
+
+	/**
+	 * Compares one value according to the operator.
+	 */
+	bool (*match_value)(const struct song_filter *filter,
+			    const char *value, bool fold_case);
+
+	/** a tag type, #LOCATE_TAG_FILE_TYPE or #LOCATE_TAG_ANY_TYPE */
+	int tag;
+
+	/** invert the result ("!=" and "!~")? */
+	bool negated;
+
+	char *value;
+
+	/** #value converted with g_utf8_casefold() */
+	char *folded;
+
+	size_t value_length, folded_length;
+
+#if GLIB_CHECK_VERSION(2,14,0)
+	GRegex *regex, *regex_folded;
+#endif
+
+	/** see locate_load_stickers() */
+	GHashTable *stickers;
+};
+
+static struct song_filter *
+song_filter_new(enum song_filter_type type)
+{
+	struct song_filter *filter = g_new0(struct song_filter, 1);
+	filter->type = type;
+	return filter;
+}
+
+static void
+song_filter_free(struct song_filter *filter)
+{
+	while (filter->children != NULL) {
+		struct song_filter *child = filter->children;
+		filter->children = child->next;
+		song_filter_free(child);
+	}
+
+	g_free(filter->value);
+	g_free(filter->folded);
+
+#if GLIB_CHECK_VERSION(2,14,0)
+	if (filter->regex != NULL)
+		g_regex_unref(filter->regex);
+	if (filter->regex_folded != NULL)
+		g_regex_unref(filter->regex_folded);
+#endif
+
+	if (filter->stickers != NULL)
+		g_hash_table_unref(filter->stickers);
+
+	g_free(filter);
+}
+
+struct song_filter *
+song_filter_ref(struct song_filter *filter)
+{
+	assert(filter->ref > 0);
+
+	++filter->ref;
+	return filter;
+}
+
+void
+song_filter_unref(struct song_filter *filter)
+{
+	assert(filter->ref > 0);
+
+	if (--filter->ref == 0)
+		song_filter_free(filter);
+}
+
+/*
+ * value matchers
+ *
+ */
+
+static bool
+match_equals(const struct song_filter *filter, const char *value,
+	     bool fold_case)
+{
+	if (!fold_case)
+		return strcmp(value, filter->value) == 0;
+
+	char *folded = g_utf8_casefold(value, -1);
+	bool result = strcmp(folded, filter->folded) == 0;
+	g_free(folded);
+	return result;
+}
+
+static bool
+match_contains(const struct song_filter *filter, const char *value,
+	       bool fold_case)
+{
+	if (!fold_case)
+		return strstr(value, filter->value) != NULL;
+
+	char *folded = g_utf8_casefold(value, -1);
+	bool result = strstr(folded, filter->folded) != NULL;
+	g_free(folded);
+	return result;
+}
+
+static bool
+match_starts_with(const struct song_filter *filter, const char *value,
+		  bool fold_case)
+{
+	if (!fold_case)
+		return strncmp(value, filter->value,
+			       filter->value_length) == 0;
+
+	char *folded = g_utf8_casefold(value, -1);
+	bool result = strncmp(folded, filter->folded,
+			      filter->folded_length) == 0;
+	g_free(folded);
+	return result;
+}
+
+#if GLIB_CHECK_VERSION(2,14,0)
+static bool
+match_regex(const struct song_filter *filter, const char *value,
+	    bool fold_case)
+{
+	return g_regex_match(fold_case ? filter->regex_folded : filter->regex,
+			     value, 0, NULL);
+}
+#endif
+
+/*
+ * song matchers
+ *
+ */
+
+static bool
+match_song_uri(const struct song_filter *filter, const struct song *song,
+	       bool fold_case)
+{
+	char *uri = song_get_uri(song);
+	bool result = filter->match_value(filter, uri, fold_case);
+	g_free(uri);
+	return result;
+}
+
+static bool
+match_song_tag(const struct song_filter *filter, const struct song *song,
+	       bool fold_case)
+{
+	bool found = false;
+
+	if (song->tag != NULL) {
+		for (unsigned i = 0; i < song->tag->num_items; ++i) {
+			const struct tag_item *item = song->tag->items[i];
+			if ((int)item->type != filter->tag)
+				continue;
+
+			if (filter->match_value(filter, item->value,
+						fold_case))
+				return true;
+
+			found = true;
+		}
+	}
+
+	/* a missing tag is treated like an empty value */
+	return !found && filter->match_value(filter, "", fold_case);
+}
+
+static bool
+match_song_any(const struct song_filter *filter, const struct song *song,
+	       bool fold_case)
+{
+	if (match_song_uri(filter, song, fold_case))
+		return true;
+
+	if (song->tag != NULL)
+		for (unsigned i = 0; i < song->tag->num_items; ++i)
+			if (filter->match_value(filter,
+						song->tag->items[i]->value,
+						fold_case))
+				return true;
+
+	return false;
+}
+
+static bool
+match_song_sticker(const struct song_filter *filter, const struct song *song,
+		   bool fold_case)
+{
+	const char *value = g_hash_table_lookup(filter->stickers, song);
+	if (value == NULL)
+		value = "";
+
+	return filter->match_value(filter, value, fold_case);
+}
+
+bool
+song_filter_match(const struct song_filter *filter, const struct song *song,
+		  bool fold_case)
+{
+	const struct song_filter *i;
+
+	switch (filter->type) {
+	case SONG_FILTER_AND:
+		for (i = filter->children; i != NULL; i = i->next)
+			if (!song_filter_match(i, song, fold_case))
+				return false;
+		return true;
+
+	case SONG_FILTER_OR:
+		for (i = filter->children; i != NULL; i = i->next)
+			if (song_filter_match(i, song, fold_case))
+				return true;
+		return false;
+
+	case SONG_FILTER_NOT:
+		return !song_filter_match(filter->children, song, fold_case);
+
+	case SONG_FILTER_LEAF:
+		return filter->match_song(filter, song, fold_case) !=
+			filter->negated;
+	}
+
+	assert(false);
+	return false;
+}
+
+/*
+ * parser
+ *
+ */
+
+static const char *
+skip_spaces(const char *p)
+{
+	while (g_ascii_isspace(*p))
+		++p;
+	return p;
+}
+
+static bool
+is_word_char(char ch)
+{
+	return g_ascii_isalnum(ch) || ch == '_' || ch == '-' ||
+		ch == ':' || ch == '.';
+}
+
+/**
+ * Reads a word (a tag name, an operator or "AND"/"OR").  Returns a
+ * newly allocated string, or NULL if there is no word at this
+ * position.
+ */
+static char *
+parse_word(const char **pp)
+{
+	const char *p = *pp, *start = p;
+
+	if ((*p == '=' || *p == '!') && (p[1] == '=' || p[1] == '~'))
+		p += 2;
+	else
+		while (is_word_char(*p))
+			++p;
+
+	if (p == start)
+		return NULL;
+
+	*pp = p;
+	return g_strndup(start, p - start);
+}
+
+/**
+ * Reads a quoted string.  Returns a newly allocated string, or NULL
+ * on error.
+ */
+static char *
+parse_quoted(const char **pp, GError **error_r)
+{
+	const char *p = *pp;
+	const char quote = *p++;
+
+	if (quote != '\'' && quote != '"') {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "Quoted value expected");
+		return NULL;
+	}
+
+	GString *value = g_string_new(NULL);
+
+	while (*p != quote) {
+		if (*p == '\\' && p[1] != 0)
+			++p;
+
+		if (*p == 0) {
+			g_string_free(value, true);
+			g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+				    "Closing quote not found");
+			return NULL;
+		}
+
+		g_string_append_c(value, *p++);
+	}
+
+	*pp = p + 1;
+	return g_string_free(value, false);
+}
+
+static bool
+expect_close(const char **pp, GError **error_r)
+{
+	const char *p = skip_spaces(*pp);
+	if (*p != ')') {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "')' expected");
+		return false;
+	}
+
+	*pp = p + 1;
+	return true;
+}
+
+#if GLIB_CHECK_VERSION(2,14,0)
+/**
+ * Compiles a regular expression.  A GRegex error is converted to an
+ * #ACK_ERROR_ARG, because the client has to see it as a bad
+ * argument.
+ */
+static GRegex *
+song_filter_compile_regex(const char *pattern, GRegexCompileFlags flags,
+			  GError **error_r)
+{
+	GError *error = NULL;
+	GRegex *regex = g_regex_new(pattern, G_REGEX_OPTIMIZE|flags, 0,
+				    &error);
+	if (regex == NULL) {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "Invalid regular expression: %s", error->message);
+		g_error_free(error);
+	}
+
+	return regex;
+}
+#endif
+
+/**
+ * Chooses the matchers for the tag and the operator.
+ */
+static bool
+song_filter_compile_leaf(struct song_filter *filter,
+			 const char *tag, const char *op,
+			 GError **error_r)
+{
+	if (g_str_has_prefix(tag, SONG_FILTER_STICKER_PREFIX)) {
+		filter->tag = LOCATE_TAG_STICKER_TYPE;
+		filter->match_song = match_song_sticker;
+
+#ifdef ENABLE_SQLITE
+		const char *name = tag +
+			sizeof(SONG_FILTER_STICKER_PREFIX) - 1;
+		filter->stickers = locate_load_stickers(name);
+#endif
+		if (filter->stickers == NULL) {
+			g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+				    "Sticker database not available");
+			return false;
+		}
+	} else {
+		filter->tag = locate_parse_type(tag);
+		if (filter->tag < 0) {
+			g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+				    "Unknown tag: %s", tag);
+			return false;
+		}
+
+		filter->match_song = filter->tag == LOCATE_TAG_FILE_TYPE
+			? match_song_uri
+			: (filter->tag == LOCATE_TAG_ANY_TYPE
+			   ? match_song_any
+			   : match_song_tag);
+	}
+
+	filter->negated = op[0] == '!';
+
+	if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0)
+		filter->match_value = match_equals;
+	else if (strcmp(op, "contains") == 0)
+		filter->match_value = match_contains;
+	else if (strcmp(op, "starts_with") == 0)
+		filter->match_value = match_starts_with;
+	else if (strcmp(op, "=~") == 0 || strcmp(op, "!~") == 0) {
+#if GLIB_CHECK_VERSION(2,14,0)
+		filter->regex = song_filter_compile_regex(filter->value, 0,
+							  error_r);
+		if (filter->regex == NULL)
+			return false;
+
+		filter->regex_folded =
+			song_filter_compile_regex(filter->value,
+						  G_REGEX_CASELESS, error_r);
+		if (filter->regex_folded == NULL)
+			return false;
+
+		filter->match_value = match_regex;
+#else
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "Regular expressions not supported");
+		return false;
+#endif
+	} else {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "Unknown operator: %s", op);
+		return false;
+	}
+
+	return true;
+}
+
+static struct song_filter *
+song_filter_parse_expression(const char **pp, GError **error_r);
+
+/**
+ * Parses the remainder of an AND/OR expression, after the first
+ * operand.
+ */
+static struct song_filter *
+song_filter_parse_list(const char **pp, struct song_filter *first,
+		       GError **error_r)
+{
+	const char *p = skip_spaces(*pp);
+	char *op = parse_word(&p);
+	enum song_filter_type type;
+
+	if (op != NULL && strcmp(op, "AND") == 0)
+		type = SONG_FILTER_AND;
+	else if (op != NULL && strcmp(op, "OR") == 0)
+		type = SONG_FILTER_OR;
+	else {
+		g_free(op);
+		song_filter_free(first);
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "'AND' or 'OR' expected");
+		return NULL;
+	}
+
+	struct song_filter *filter = song_filter_new(type);
+	struct song_filter **tail = &filter->children;
+	*tail = first;
+	tail = &first->next;
+
+	while (true) {
+		struct song_filter *child =
+			song_filter_parse_expression(&p, error_r);
+		if (child == NULL)
+			break;
+
+		*tail = child;
+		tail = &child->next;
+
+		p = skip_spaces(p);
+		if (*p == ')') {
+			g_free(op);
+			*pp = p + 1;
+			return filter;
+		}
+
+		char *op2 = parse_word(&p);
+		bool same = op2 != NULL && strcmp(op, op2) == 0;
+		g_free(op2);
+		if (!same) {
+			g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+				    "'%s' or ')' expected; use parentheses"
+				    " to combine AND and OR", op);
+			break;
+		}
+	}
+
+	g_free(op);
+	song_filter_free(filter);
+	return NULL;
+}
+
+static struct song_filter *
+song_filter_parse_expression(const char **pp, GError **error_r)
+{
+	const char *p = skip_spaces(*pp);
+	struct song_filter *filter;
+
+	if (*p != '(') {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "'(' expected");
+		return NULL;
+	}
+
+	p = skip_spaces(p + 1);
+
+	if (*p == '(') {
+		filter = song_filter_parse_expression(&p, error_r);
+		if (filter == NULL)
+			return NULL;
+
+		const char *q = skip_spaces(p);
+		if (*q == ')') {
+			/* redundant parentheses */
+			*pp = q + 1;
+			return filter;
+		}
+
+		filter = song_filter_parse_list(&p, filter, error_r);
+		if (filter != NULL)
+			*pp = p;
+		return filter;
+	}
+
+	if (*p == '!') {
+		++p;
+
+		struct song_filter *child =
+			song_filter_parse_expression(&p, error_r);
+		if (child == NULL)
+			return NULL;
+
+		filter = song_filter_new(SONG_FILTER_NOT);
+		filter->children = child;
+	} else {
+		char *tag = parse_word(&p);
+		if (tag == NULL) {
+			g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+				    "Tag name expected");
+			return NULL;
+		}
+
+		p = skip_spaces(p);
+		char *op = parse_word(&p);
+		if (op == NULL) {
+			g_free(tag);
+			g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+				    "Operator expected");
+			return NULL;
+		}
+
+		p = skip_spaces(p);
+		char *value = parse_quoted(&p, error_r);
+		if (value == NULL) {
+			g_free(tag);
+			g_free(op);
+			return NULL;
+		}
+
+		filter = song_filter_new(SONG_FILTER_LEAF);
+		filter->value = value;
+		filter->value_length = strlen(value);
+		filter->folded = g_utf8_casefold(value, -1);
+		filter->folded_length = strlen(filter->folded);
+
+		bool success = song_filter_compile_leaf(filter, tag, op,
+							error_r);
+		g_free(tag);
+		g_free(op);
+		if (!success) {
+			song_filter_free(filter);
+			return NULL;
+		}
+	}
+
+	if (!expect_close(&p, error_r)) {
+		song_filter_free(filter);
+		return NULL;
+	}
+
+	*pp = p;
+	return filter;
+}
+
+struct song_filter *
+song_filter_parse(const char *s, GError **error_r)
+{
+	struct song_filter *filter = song_filter_parse_expression(&s, error_r);
+	if (filter == NULL)
+		return NULL;
+
+	s = skip_spaces(s);
+	if (*s != 0) {
+		song_filter_free(filter);
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "Unparsed garbage after expression");
+		return NULL;
+	}
+
+	filter->ref = 1;
+	return filter;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Filter expressions for song queries, e.g.:
+ *
+ *   ((artist == 'Miles Davis') AND (!(album starts_with 'Live')))
+ *
+ * An expression is compiled once into a tree of matchers, which is
+ * then evaluated for each song.
+ */
+
+#ifndef MPD_SONG_FILTER_H
+#define MPD_SONG_FILTER_H
+
+#include "gcc.h"
+
+#include <glib.h>
+
+#include <stdbool.h>
+
+struct song;
+struct song_filter;
+
+/**
+ * Parses and compiles a filter expression.  The grammar is:
+ *
+ *   EXPR := "(" TAG OP 'VALUE' ")"
+ *         | "(" "!" EXPR ")"
+ *         | "(" EXPR "AND" EXPR ... ")"
+ *         | "(" EXPR "OR" EXPR ... ")"
+ *
+ * TAG is a tag name, "file", "any" or "sticker:NAME".  OP is one of
+ * "==", "!=", "contains", "starts_with", "=~" and "!~" (regular
+ * expression).  VALUE is quoted with single or double quotes; a
+ * backslash escapes the following character.
+ *
+ * @return the filter (reference count 1), or NULL on error
+ */
+gcc_nonnull(1)
+struct song_filter *
+song_filter_parse(const char *s, GError **error_r);
+
+gcc_nonnull(1)
+struct song_filter *
+song_filter_ref(struct song_filter *filter);
+
+gcc_nonnull(1)
+void
+song_filter_unref(struct song_filter *filter);
+
+/**
+ * Does the song match the filter?
+ *
+ * @param fold_case compare strings case insensitively (for the
+ * "search" commands)
+ */
+gcc_nonnull(1,2)
+bool
+song_filter_match(const struct song_filter *filter, const struct song *song,
+		  bool fold_case);
+
+#endif
@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h" /* must be first for large file support */
+#include "song_picture.h"
+#include "song.h"
+#include "tag.h"
+#include "mapper.h"
+#include "ack.h"
+#include "fd_util.h"
+#include "open.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "song_picture"
+
+/** the file name suffix of cached pictures */
+#define PICTURE_SUFFIX ".img"
+
+struct picture_cache_entry {
+	/** the file name within the cache directory */
+	char *name;
+
+	guint64 size;
+
+	/**
+	 * The last time this entry was used; for the LRU eviction.
+	 * It is initialized with the file's modification time when
+	 * the cache is loaded.
+	 */
+	time_t atime;
+};
+
+static struct {
+	char *directory;
+
+	guint64 max_size;
+
+	/**
+	 * The sum of all picture_cache_entry.size values.
+	 */
+	guint64 total;
+
+	/**
+	 * Maps picture_cache_entry.name to #picture_cache_entry.
+	 * NULL if the cache is disabled.
+	 */
+	GHashTable *entries;
+} cache;
+
+static inline GQuark
+song_picture_quark(void)
+{
+	return g_quark_from_static_string("song_picture");
+}
+
+/**
+ * Calculates the cache file name for the picture of a song: a 64 bit
+ * FNV-1a hash of its URI, modification time and picture position.
+ * If the song file is modified, its old picture will not be found
+ * anymore, and will eventually be evicted.
+ */
+static char *
+picture_cache_name(const struct song *song)
+{
+	char *uri = song_get_uri(song);
+	char *key = g_strdup_printf("%s\n%ld\n%" G_GUINT64_FORMAT "\n%u",
+				    uri, (long)song->mtime,
+				    (guint64)song->tag->picture_offset,
+				    (unsigned)song->tag->picture_size);
+	g_free(uri);
+
+	guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+	for (const unsigned char *p = (const unsigned char *)key;
+	     *p != 0; ++p) {
+		hash ^= *p;
+		hash *= G_GUINT64_CONSTANT(1099511628211);
+	}
+
+	g_free(key);
+
+	return g_strdup_printf("%016" G_GINT64_MODIFIER "x" PICTURE_SUFFIX,
+			       hash);
+}
+
+static struct picture_cache_entry *
+picture_cache_entry_new(const char *name, guint64 size, time_t atime)
+{
+	struct picture_cache_entry *entry =
+		g_new(struct picture_cache_entry, 1);
+
+	entry->name = g_strdup(name);
+	entry->size = size;
+	entry->atime = atime;
+
+	g_hash_table_insert(cache.entries, entry->name, entry);
+	cache.total += size;
+	return entry;
+}
+
+static void
+picture_cache_entry_free(struct picture_cache_entry *entry)
+{
+	g_free(entry->name);
+	g_free(entry);
+}
+
+static void
+picture_cache_entry_delete(struct picture_cache_entry *entry)
+{
+	char *path = g_build_filename(cache.directory, entry->name, NULL);
+	unlink(path);
+	g_free(path);
+
+	g_hash_table_remove(cache.entries, entry->name);
+	cache.total -= entry->size;
+	picture_cache_entry_free(entry);
+}
+
+struct picture_cache_lru {
+	const struct picture_cache_entry *keep;
+
+	struct picture_cache_entry *lru;
+};
+
+static void
+picture_cache_find_lru(G_GNUC_UNUSED gpointer key, gpointer value,
+		       gpointer user_data)
+{
+	struct picture_cache_entry *entry = value;
+	struct picture_cache_lru *data = user_data;
+
+	if (entry != data->keep &&
+	    (data->lru == NULL || entry->atime < data->lru->atime))
+		data->lru = entry;
+}
+
+/**
+ * Deletes the least recently used pictures until the cache is below
+ * its size limit.
+ *
+ * @param keep an entry which must not be deleted, or NULL
+ */
+static void
+picture_cache_evict(const struct picture_cache_entry *keep)
+{
+	while (cache.total > cache.max_size) {
+		struct picture_cache_lru data = {
+			.keep = keep,
+			.lru = NULL,
+		};
+
+		g_hash_table_foreach(cache.entries, picture_cache_find_lru,
+				     &data);
+		if (data.lru == NULL)
+			break;
+
+		g_debug("evicting %s", data.lru->name);
+		picture_cache_entry_delete(data.lru);
+	}
+}
+
+/**
+ * Adds all pictures in the cache directory to the index, and deletes
+ * leftovers of interrupted writes.
+ */
+static bool
+picture_cache_load(GError **error_r)
+{
+	GError *error = NULL;
+	GDir *dir = g_dir_open(cache.directory, 0, &error);
+	if (dir == NULL) {
+		g_propagate_error(error_r, error);
+		return false;
+	}
+
+	const char *filename;
+	while ((filename = g_dir_read_name(dir)) != NULL) {
+		char *path = g_build_filename(cache.directory, filename, NULL);
+		struct stat st;
+
+		if (g_str_has_suffix(filename, ".tmp"))
+			unlink(path);
+		else if (g_str_has_suffix(filename, PICTURE_SUFFIX) &&
+			 stat(path, &st) == 0 && S_ISREG(st.st_mode))
+			picture_cache_entry_new(filename, st.st_size,
+						st.st_mtime);
+
+		g_free(path);
+	}
+
+	g_dir_close(dir);
+	return true;
+}
+
+bool
+song_picture_global_init(const char *directory, guint64 max_size,
+			 GError **error_r)
+{
+	assert(cache.entries == NULL);
+
+	if (directory == NULL)
+		/* the cache is disabled */
+		return true;
+
+	if (g_mkdir_with_parents(directory, 0777) < 0) {
+		g_set_error(error_r, song_picture_quark(), errno,
+			    "Failed to create %s: %s",
+			    directory, g_strerror(errno));
+		return false;
+	}
+
+	cache.directory = g_strdup(directory);
+	cache.max_size = max_size;
+	cache.total = 0;
+	cache.entries = g_hash_table_new(g_str_hash, g_str_equal);
+
+	if (!picture_cache_load(error_r)) {
+		song_picture_global_finish();
+		return false;
+	}
+
+	picture_cache_evict(NULL);
+	return true;
+}
+
+static void
+picture_cache_free_entry(G_GNUC_UNUSED gpointer key, gpointer value,
+			 G_GNUC_UNUSED gpointer user_data)
+{
+	picture_cache_entry_free(value);
+}
+
+void
+song_picture_global_finish(void)
+{
+	if (cache.entries == NULL)
+		return;
+
+	g_hash_table_foreach(cache.entries, picture_cache_free_entry, NULL);
+	g_hash_table_destroy(cache.entries);
+	cache.entries = NULL;
+
+	g_free(cache.directory);
+	cache.directory = NULL;
+}
+
+static bool
+picture_read_fd(int fd, goffset offset, void *buffer, size_t length)
+{
+	if (lseek(fd, (off_t)offset, SEEK_SET) != (off_t)offset)
+		return false;
+
+	uint8_t *p = buffer;
+	while (length > 0) {
+		ssize_t nbytes = read(fd, p, length);
+		if (nbytes <= 0) {
+			if (nbytes == 0)
+				/* the file is shorter than expected */
+				errno = EINVAL;
+			return false;
+		}
+
+		p += nbytes;
+		length -= nbytes;
+	}
+
+	return true;
+}
+
+static bool
+picture_read_file(const char *path_fs, goffset offset,
+		  void *buffer, size_t length, GError **error_r)
+{
+	int fd = open_cloexec(path_fs, O_RDONLY|O_BINARY, 0);
+	if (fd < 0 || !picture_read_fd(fd, offset, buffer, length)) {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_SYSTEM,
+			    "Failed to read picture: %s", g_strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	close(fd);
+	return true;
+}
+
+/**
+ * Maps the song to its file, and verifies that it has not been
+ * modified since the database update recorded the picture position.
+ */
+static char *
+song_picture_open(const struct song *song, GError **error_r)
+{
+	char *path_fs = map_song_fs(song);
+	if (path_fs == NULL) {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_NO_EXIST,
+			    "No such file");
+		return NULL;
+	}
+
+	struct stat st;
+	if (stat(path_fs, &st) < 0) {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_NO_EXIST,
+			    "No such file");
+		g_free(path_fs);
+		return NULL;
+	}
+
+	if (st.st_mtime != song->mtime) {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_NO_EXIST,
+			    "File has been modified, update the database");
+		g_free(path_fs);
+		return NULL;
+	}
+
+	return path_fs;
+}
+
+static bool
+picture_cache_write(const char *path, const void *data, size_t length)
+{
+	char *tmp = g_strconcat(path, ".tmp", NULL);
+	FILE *file = fopen(tmp, "wb");
+	if (file == NULL) {
+		g_warning("Failed to create %s: %s", tmp, g_strerror(errno));
+		g_free(tmp);
+		return false;
+	}
+
+	bool success = fwrite(data, 1, length, file) == length;
+	success = fclose(file) == 0 && success;
+	if (success)
+		success = rename(tmp, path) == 0;
+
+	if (!success) {
+		g_warning("Failed to write %s: %s", path, g_strerror(errno));
+		unlink(tmp);
+	}
+
+	g_free(tmp);
+	return success;
+}
+
+/**
+ * Copies the picture from the song file to the cache.
+ *
+ * @return the new entry, or NULL if the picture could not be cached
+ */
+static struct picture_cache_entry *
+picture_cache_store(const struct song *song, const char *name,
+		    GError **error_r)
+{
+	const size_t size = song->tag->picture_size;
+	if (size > cache.max_size)
+		return NULL;
+
+	char *path_fs = song_picture_open(song, error_r);
+	if (path_fs == NULL)
+		return NULL;
+
+	void *data = g_try_malloc(size);
+	if (data == NULL) {
+		g_free(path_fs);
+		return NULL;
+	}
+
+	bool success = picture_read_file(path_fs,
+					 song->tag->picture_offset,
+					 data, size, error_r);
+	g_free(path_fs);
+
+	/* cache it even if the image format is unknown;
+	   song_picture_open() has verified that the file has not
+	   been modified since the offsets were recorded */
+	if (success) {
+		char *path = g_build_filename(cache.directory, name, NULL);
+		success = picture_cache_write(path, data, size);
+		g_free(path);
+	}
+
+	g_free(data);
+
+	if (!success)
+		return NULL;
+
+	struct picture_cache_entry *entry =
+		picture_cache_entry_new(name, size, time(NULL));
+	picture_cache_evict(entry);
+	return entry;
+}
+
+bool
+song_picture_read(const struct song *song, size_t offset,
+		  void *buffer, size_t length, GError **error_r)
+{
+	assert(song->tag != NULL);
+	assert(song->tag->picture_size > 0);
+	assert(offset + length <= song->tag->picture_size);
+
+	if (cache.entries != NULL) {
+		char *name = picture_cache_name(song);
+		struct picture_cache_entry *entry =
+			g_hash_table_lookup(cache.entries, name);
+
+		GError *error = NULL;
+		if (entry == NULL)
+			entry = picture_cache_store(song, name, &error);
+		g_free(name);
+
+		if (error != NULL) {
+			g_propagate_error(error_r, error);
+			return false;
+		}
+
+		if (entry != NULL) {
+			entry->atime = time(NULL);
+
+			char *path = g_build_filename(cache.directory,
+						      entry->name, NULL);
+			bool success = picture_read_file(path, offset,
+							 buffer, length,
+							 error_r);
+			g_free(path);
+			return success;
+		}
+	}
+
+	/* no cache: read the chunk from the song file */
+
+	char *path_fs = song_picture_open(song, error_r);
+	if (path_fs == NULL)
+		return false;
+
+	bool success = picture_read_file(path_fs,
+					 song->tag->picture_offset + offset,
+					 buffer, length, error_r);
+	g_free(path_fs);
+	return success;
+}
+
+gssize
+song_picture_read_chunk(const struct song *song, size_t offset,
+			void *buffer, size_t size, GError **error_r)
+{
+	if (song->tag == NULL || song->tag->picture_size == 0)
+		return 0;
+
+	const size_t picture_size = song->tag->picture_size;
+	if (offset > picture_size) {
+		g_set_error(error_r, ack_quark(), ACK_ERROR_ARG,
+			    "Offset too large");
+		return -1;
+	}
+
+	const size_t length = MIN(picture_size - offset, size);
+	if (length > 0 &&
+	    !song_picture_read(song, offset, buffer, length, error_r))
+		return -1;
+
+	return length;
+}
+
+const char *
+song_picture_mime_type(const void *data, size_t length)
+{
+	const unsigned char *p = data;
+
+	if (length >= 3 && memcmp(p, "\xff\xd8\xff", 3) == 0)
+		return "image/jpeg";
+
+	if (length >= 8 && memcmp(p, "\x89PNG\r\n\x1a\n", 8) == 0)
+		return "image/png";
+
+	if (length >= 4 && memcmp(p, "GIF8", 4) == 0)
+		return "image/gif";
+
+	if (length >= 12 && memcmp(p, "RIFF", 4) == 0 &&
+	    memcmp(p + 8, "WEBP", 4) == 0)
+		return "image/webp";
+
+	if (length >= 2 && memcmp(p, "BM", 2) == 0)
+		return "image/bmp";
+
+	return NULL;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_SONG_PICTURE_H
+#define MPD_SONG_PICTURE_H
+
+#include "check.h"
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct song;
+
+/**
+ * Enables the on-disk cache of extracted pictures, and loads its
+ * index from the directory.
+ *
+ * This library is not thread-safe; all functions must be called from
+ * the main thread.
+ *
+ * @param directory the cache directory, or NULL to disable the
+ * cache
+ * @param max_size the maximum size of all cached pictures in bytes
+ */
+bool
+song_picture_global_init(const char *directory, guint64 max_size,
+			 GError **error_r);
+
+void
+song_picture_global_finish(void);
+
+/**
+ * Reads a chunk of the picture (cover art) embedded in a song file.
+ * Its position has been recorded in the song's tag by the database
+ * update.  If the cache is enabled, the whole picture is copied to
+ * it on the first request, and all chunks are read from there.
+ *
+ * @param offset the position within the picture
+ * @param length the number of bytes to read; the chunk must not
+ * exceed the end of the picture
+ */
+bool
+song_picture_read(const struct song *song, size_t offset,
+		  void *buffer, size_t length, GError **error_r);
+
+/**
+ * Reads the next chunk of the picture for the "readpicture" command.
+ *
+ * @param offset the position within the picture; it may be equal to
+ * the picture size (end of picture)
+ * @param size the size of the buffer
+ * @return the number of bytes read, 0 at the end of the picture or
+ * if the song has no picture, or -1 on error
+ */
+gssize
+song_picture_read_chunk(const struct song *song, size_t offset,
+			void *buffer, size_t size, GError **error_r);
+
+/**
+ * Guesses the MIME type of an image from its first bytes.
+ *
+ * @return the MIME type, or NULL if unknown
+ */
+G_GNUC_PURE
+const char *
+song_picture_mime_type(const void *data, size_t length);
+
+#endif
@@ -25,6 +25,7 @@
 #include "client.h"
 #include "uri.h"
 #include "mapper.h"
+#include "compact_print.h"
 
 void
 song_print_uri(struct client *client, struct song *song)
@@ -50,6 +51,15 @@ song_print_uri(struct client *client, struct song *song)
 void
 song_print_info(struct client *client, struct song *song)
 {
+	struct compact_dict *dict = client_get_compact(client);
+	if (dict != NULL) {
+		GByteArray *record = g_byte_array_new();
+		compact_append_song(record, dict, song);
+		compact_send(client, record);
+		g_byte_array_free(record, true);
+		return;
+	}
+
 	song_print_uri(client, song);
 
 	if (song->end_ms > 0)
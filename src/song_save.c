@@ -107,6 +107,16 @@ song_load(FILE *fp, struct directory *parent, const char *uri,
 			}
 
 			song->tag->has_playlist = strcmp(value, "yes") == 0;
+		} else if (strcmp(line, "Picture") == 0) {
+			if (!song->tag) {
+				song->tag = tag_new();
+				tag_begin_add(song->tag);
+			}
+
+			char *endptr;
+			song->tag->picture_offset =
+				g_ascii_strtoull(value, &endptr, 10);
+			song->tag->picture_size = strtoul(endptr, NULL, 10);
 		} else if (strcmp(line, SONG_MTIME) == 0) {
 			song->mtime = atoi(value);
 		} else if (strcmp(line, "Range") == 0) {
@@ -127,7 +137,7 @@ song_load(FILE *fp, struct directory *parent, const char *uri,
 	}
 
 	if (song->tag != NULL)
-		tag_end_add(song->tag);
+		song->tag = tag_compact(song->tag);
 
 	return song;
 }
@@ -20,6 +20,7 @@
 #include "config.h"
 #include "song_sort.h"
 #include "song.h"
+#include "locate.h"
 #include "util/list.h"
 #include "util/list_sort.h"
 #include "tag.h"
@@ -28,6 +29,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 static const char *
 tag_get_value_checked(const struct tag *tag, enum tag_type type)
@@ -119,3 +121,99 @@ song_list_sort(struct list_head *songs)
 {
 	list_sort(NULL, songs, song_cmp);
 }
+
+struct song_sort_entry {
+	unsigned index;
+
+	/** the collation key, or NULL if the tag is missing */
+	char *key;
+
+	/** the numeric value, for numeric tags */
+	long number;
+};
+
+struct song_sort_context {
+	bool numeric;
+	bool descending;
+};
+
+static int
+song_sort_entry_cmp(gconstpointer _a, gconstpointer _b, gpointer user_data)
+{
+	const struct song_sort_entry *a = _a, *b = _b;
+	const struct song_sort_context *ctx = user_data;
+	int ret;
+
+	if (ctx->numeric)
+		ret = a->number < b->number ? -1 : a->number > b->number;
+	else if (a->key == NULL)
+		ret = b->key == NULL ? 0 : -1;
+	else if (b->key == NULL)
+		ret = 1;
+	else
+		ret = strcmp(a->key, b->key);
+
+	if (ctx->descending)
+		ret = -ret;
+
+	/* stable sort */
+	if (ret == 0)
+		ret = a->index < b->index ? -1 : a->index > b->index;
+
+	return ret;
+}
+
+unsigned *
+song_sort_indexes(struct song *const*songs, unsigned n, int tag,
+		  bool descending)
+{
+	struct song_sort_context ctx = {
+		.numeric = tag == TAG_TRACK || tag == TAG_DISC,
+		.descending = descending,
+	};
+
+	assert(tag >= 0);
+
+	struct song_sort_entry *entries = g_new(struct song_sort_entry, n);
+
+	for (unsigned i = 0; i < n; ++i) {
+		const struct song *song = songs[i];
+		struct song_sort_entry *entry = &entries[i];
+
+		entry->index = i;
+		entry->key = NULL;
+		entry->number = 0;
+
+		if (tag == LOCATE_TAG_FILE_TYPE) {
+			char *uri = song_get_uri(song);
+			entry->key = g_utf8_collate_key(uri, -1);
+			g_free(uri);
+			continue;
+		}
+
+		const char *value = tag_get_value_checked(song->tag, tag);
+		if (value == NULL)
+			continue;
+
+		if (ctx.numeric) {
+			/* same as compare_number_string(): missing
+			   and invalid numbers sort first */
+			entry->number = strtol(value, NULL, 10);
+			if (entry->number < 0)
+				entry->number = 0;
+		} else
+			entry->key = g_utf8_collate_key(value, -1);
+	}
+
+	g_qsort_with_data(entries, n, sizeof(entries[0]),
+			  song_sort_entry_cmp, &ctx);
+
+	unsigned *indexes = g_new(unsigned, n);
+	for (unsigned i = 0; i < n; ++i) {
+		indexes[i] = entries[i].index;
+		g_free(entries[i].key);
+	}
+
+	g_free(entries);
+	return indexes;
+}
@@ -20,9 +20,70 @@
 #ifndef MPD_SONG_SORT_H
 #define MPD_SONG_SORT_H
 
+#include <glib.h>
+
+#include <stdbool.h>
+
 struct list_head;
+struct song;
+
+/**
+ * Sort order and window of a song list sent to the client.
+ */
+struct song_window {
+	/**
+	 * The tag type to sort by, #LOCATE_TAG_FILE_TYPE to sort by
+	 * URI, or -1 to keep the natural order.
+	 */
+	int sort;
+
+	bool descending;
+
+	/**
+	 * Send only this range of the (sorted) list.  #end may be
+	 * G_MAXUINT for "no limit".
+	 */
+	unsigned start, end;
+};
+
+static inline void
+song_window_init(struct song_window *window)
+{
+	window->sort = -1;
+	window->descending = false;
+	window->start = 0;
+	window->end = G_MAXUINT;
+}
+
+static inline bool
+song_window_is_sorted(const struct song_window *window)
+{
+	return window->sort >= 0;
+}
+
+static inline bool
+song_window_contains(const struct song_window *window, unsigned i)
+{
+	return i >= window->start && i < window->end;
+}
 
 void
 song_list_sort(struct list_head *songs);
 
+/**
+ * Sorts an array of songs by a tag.  The collation key of each song
+ * is calculated only once; numeric tags (track, disc) are compared
+ * as numbers.  Songs which compare equal keep their relative order.
+ *
+ * @param songs the songs; the array itself is not modified
+ * @param n the number of songs
+ * @param tag a tag type or #LOCATE_TAG_FILE_TYPE
+ * @param descending sort in reverse order
+ * @return an array of n indexes into #songs in sorted order, to be
+ * freed with g_free()
+ */
+unsigned *
+song_sort_indexes(struct song *const*songs, unsigned n, int tag,
+		  bool descending);
+
 #endif
@@ -136,6 +136,7 @@ sticker_song_find_cb(const char *uri, const char *value, gpointer user_data)
 
 bool
 sticker_song_find(struct directory *directory, const char *name,
+		  const struct sticker_query *query,
 		  void (*func)(struct song *song, const char *value,
 			       gpointer user_data),
 		  gpointer user_data)
@@ -159,9 +160,34 @@ sticker_song_find(struct directory *directory, const char *name,
 
 	data.base_uri_length = strlen(data.base_uri);
 
-	success = sticker_find("song", data.base_uri, name,
+	success = sticker_find("song", data.base_uri, name, query,
 			       sticker_song_find_cb, &data);
 	g_free(allocated);
 
 	return success;
 }
+
+static void
+sticker_song_find_table_cb(struct song *song, const char *value,
+			   gpointer user_data)
+{
+	GHashTable *table = user_data;
+
+	g_hash_table_insert(table, song, g_strdup(value));
+}
+
+GHashTable *
+sticker_song_find_table(struct directory *directory, const char *name)
+{
+	GHashTable *table = g_hash_table_new_full(g_direct_hash,
+						  g_direct_equal,
+						  NULL, g_free);
+
+	if (!sticker_song_find(directory, name, NULL,
+			       sticker_song_find_table_cb, table)) {
+		g_hash_table_unref(table);
+		return NULL;
+	}
+
+	return table;
+}
@@ -26,6 +26,7 @@
 struct song;
 struct directory;
 struct sticker;
+struct sticker_query;
 
 /**
  * Returns one value from a song's sticker record.  The caller must
@@ -72,13 +73,29 @@ sticker_song_get(const struct song *song);
  *
  * @param directory the base directory to search in
  * @param name the name of the sticker
+ * @param query filter, sort order and window (see sticker_find()),
+ * or NULL
  * @return true on success (even if no sticker was found), false on
  * failure
  */
 bool
 sticker_song_find(struct directory *directory, const char *name,
+		  const struct sticker_query *query,
 		  void (*func)(struct song *song, const char *value,
 			       gpointer user_data),
 		  gpointer user_data);
 
+/**
+ * Loads the values of the specified sticker of all songs below the
+ * specified directory into a new hash table, which maps struct song
+ * pointers to values.
+ *
+ * Caller must lock the #db_mutex.
+ *
+ * @return the hash table (to be freed with g_hash_table_unref()), or
+ * NULL on failure
+ */
+GHashTable *
+sticker_song_find_table(struct directory *directory, const char *name);
+
 #endif
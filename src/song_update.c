@@ -27,6 +27,8 @@
 #include "tag_ape.h"
 #include "tag_id3.h"
 #include "tag.h"
+#include "tag_cache.h"
+#include "tag_quick.h"
 #include "tag_handler.h"
 #include "input_stream.h"
 
@@ -111,6 +113,13 @@ song_file_update(struct song *song)
 
 	song->mtime = st.st_mtime;
 
+	struct tag_cache_key cache_key;
+	song->tag = tag_cache_lookup(path_fs, &st, &cache_key);
+	if (song->tag != NULL) {
+		g_free(path_fs);
+		return true;
+	}
+
 	GMutex *mutex = NULL;
 	GCond *cond;
 #if !GCC_CHECK_VERSION(4, 2)
@@ -119,7 +128,17 @@ song_file_update(struct song *song)
 	cond = NULL;
 #endif
 
-	do {
+	/* try the lightweight header parsers first, they don't need
+	   to open a decoder */
+	song->tag = tag_new();
+	if (tag_quick_scan(path_fs, &full_tag_handler, song->tag))
+		plugin = NULL;
+	else {
+		tag_free(song->tag);
+		song->tag = NULL;
+	}
+
+	while (plugin != NULL) {
 		/* load file tag */
 		song->tag = tag_new();
 		if (decoder_plugin_scan_file(plugin, path_fs,
@@ -156,7 +175,7 @@ song_file_update(struct song *song)
 		}
 
 		plugin = decoder_plugin_from_suffix(suffix, plugin);
-	} while (plugin != NULL);
+	}
 
 	if (is != NULL)
 		input_stream_close(is);
@@ -169,6 +188,11 @@ song_file_update(struct song *song)
 	if (song->tag != NULL && tag_is_empty(song->tag))
 		tag_scan_fallback(path_fs, &full_tag_handler, song->tag);
 
+	if (song->tag != NULL) {
+		song->tag = tag_compact(song->tag);
+		tag_cache_store(&cache_key, song->tag);
+	}
+
 	g_free(path_fs);
 	return song->tag != NULL;
 }
@@ -24,6 +24,7 @@
 #include <glib.h>
 #include <sqlite3.h>
 #include <assert.h>
+#include <string.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "sticker"
@@ -43,7 +44,6 @@ enum sticker_sql {
 	STICKER_SQL_INSERT,
 	STICKER_SQL_DELETE,
 	STICKER_SQL_DELETE_VALUE,
-	STICKER_SQL_FIND,
 };
 
 static const char *const sticker_sql[] = {
@@ -59,8 +59,6 @@ static const char *const sticker_sql[] = {
 	"DELETE FROM sticker WHERE type=? AND uri=?",
 	[STICKER_SQL_DELETE_VALUE] =
 	"DELETE FROM sticker WHERE type=? AND uri=? AND name=?",
-	[STICKER_SQL_FIND] =
-	"SELECT uri,value FROM sticker WHERE type=? AND uri LIKE (? || '%') AND name=?",
 };
 
 static const char sticker_sql_create[] =
@@ -72,71 +70,229 @@ static const char sticker_sql_create[] =
 	");"
 	"CREATE UNIQUE INDEX IF NOT EXISTS"
 	" sticker_value ON sticker(type, uri, name);"
+	"CREATE INDEX IF NOT EXISTS"
+	" sticker_name_value ON sticker(type, name, value);"
 	"";
 
+/**
+ * Commit at most this number of operations in one transaction.
+ */
+static const unsigned STICKER_BATCH_MAX = 1024;
+
+/**
+ * After the first operation has been queued, wait this long for more
+ * before committing the transaction.
+ */
+static const unsigned STICKER_BATCH_DELAY_MS = 100;
+
+/**
+ * Block the caller when more operations than this are waiting to be
+ * committed.
+ */
+static const unsigned STICKER_QUEUE_MAX = 16 * 1024;
+
+/**
+ * Modifications are not written to the database right away.  They
+ * are queued, and the writer thread commits them in batches.  Until
+ * then, the readers apply pending operations to the values they load
+ * from the database.
+ */
+struct sticker_op {
+	enum {
+		STICKER_OP_STORE,
+		STICKER_OP_DELETE,
+		STICKER_OP_DELETE_VALUE,
+	} op;
+
+	char *type, *uri;
+
+	/** the sticker name; NULL for #STICKER_OP_DELETE */
+	char *name;
+
+	/** the new value; only for #STICKER_OP_STORE */
+	char *value;
+};
+
+/**
+ * The database connection of the main thread.  It is only used for
+ * reading.
+ */
 static sqlite3 *sticker_db;
 static sqlite3_stmt *sticker_stmt[G_N_ELEMENTS(sticker_sql)];
 
+static struct {
+	/** the database connection of the writer thread */
+	sqlite3 *db;
+	sqlite3_stmt *stmt[G_N_ELEMENTS(sticker_sql)];
+
+	GThread *thread;
+
+	/**
+	 * Protects the two queues and the flags.  The main thread
+	 * holds it while it reads from the database and applies the
+	 * pending operations, so it doesn't miss a batch which is
+	 * committed in between.
+	 */
+	GMutex *mutex;
+
+	/**
+	 * Wakes up the writer thread: operations have been queued,
+	 * or #flush or #quit has been set.
+	 */
+	GCond *cond;
+
+	/**
+	 * Signalled by the writer thread after each batch.
+	 */
+	GCond *done_cond;
+
+	/**
+	 * Operations which have not been picked up by the writer
+	 * thread yet.
+	 */
+	GQueue *queue;
+
+	/**
+	 * Operations which are being committed right now.  Only the
+	 * writer thread modifies this queue, and it does so with
+	 * #mutex locked.
+	 */
+	GQueue *committing;
+
+	/** commit right away, don't wait for more operations */
+	bool flush;
+
+	/** commit all queued operations, and exit */
+	bool quit;
+} sticker_writer;
+
 static GQuark
 sticker_quark(void)
 {
 	return g_quark_from_static_string("sticker");
 }
 
-static sqlite3_stmt *
-sticker_prepare(const char *sql, GError **error_r)
+/**
+ * Opens a connection to the sticker database, and prepares all
+ * statements.
+ */
+static sqlite3 *
+sticker_open(const char *path, sqlite3_stmt **stmt, GError **error_r)
 {
+	sqlite3 *db;
 	int ret;
-	sqlite3_stmt *stmt;
 
-	ret = sqlite3_prepare_v2(sticker_db, sql, -1, &stmt, NULL);
+	ret = sqlite3_open(path, &db);
 	if (ret != SQLITE_OK) {
 		g_set_error(error_r, sticker_quark(), ret,
-			    "sqlite3_prepare_v2() failed: %s",
-			    sqlite3_errmsg(sticker_db));
+			    "Failed to open sqlite database '%s': %s",
+			    path, sqlite3_errmsg(db));
+		sqlite3_close(db);
 		return NULL;
 	}
 
-	return stmt;
+	/* the writer thread may hold a lock for a moment */
+	sqlite3_busy_timeout(db, 5000);
+
+	/* create the table and index */
+
+	ret = sqlite3_exec(db, sticker_sql_create, NULL, NULL, NULL);
+	if (ret != SQLITE_OK) {
+		g_set_error(error_r, sticker_quark(), ret,
+			    "Failed to create sticker table: %s",
+			    sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return NULL;
+	}
+
+	/* prepare the statements we're going to use */
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(sticker_sql); ++i) {
+		assert(sticker_sql[i] != NULL);
+
+		ret = sqlite3_prepare_v2(db, sticker_sql[i], -1,
+					 &stmt[i], NULL);
+		if (ret != SQLITE_OK) {
+			g_set_error(error_r, sticker_quark(), ret,
+				    "sqlite3_prepare_v2() failed: %s",
+				    sqlite3_errmsg(db));
+
+			while (i > 0)
+				sqlite3_finalize(stmt[--i]);
+			sqlite3_close(db);
+			return NULL;
+		}
+	}
+
+	return db;
+}
+
+static void
+sticker_close(sqlite3 *db, sqlite3_stmt **stmt)
+{
+	for (unsigned i = 0; i < G_N_ELEMENTS(sticker_sql); ++i) {
+		assert(stmt[i] != NULL);
+
+		sqlite3_finalize(stmt[i]);
+	}
+
+	sqlite3_close(db);
 }
 
+static gpointer
+sticker_writer_thread(gpointer data);
+
 bool
 sticker_global_init(const char *path, GError **error_r)
 {
-	int ret;
-
 	if (path == NULL)
 		/* not configured */
 		return true;
 
 	/* open/create the sqlite database */
 
-	ret = sqlite3_open(path, &sticker_db);
-	if (ret != SQLITE_OK) {
-		g_set_error(error_r, sticker_quark(), ret,
-			    "Failed to open sqlite database '%s': %s",
-			    path, sqlite3_errmsg(sticker_db));
+	sticker_db = sticker_open(path, sticker_stmt, error_r);
+	if (sticker_db == NULL)
 		return false;
-	}
 
-	/* create the table and index */
+#if SQLITE_VERSION_NUMBER >= 3007000
+	/* with write-ahead logging, the main thread can read while
+	   the writer thread commits, and a commit needs only one
+	   fsync */
+	if (sqlite3_exec(sticker_db, "PRAGMA journal_mode=WAL",
+			 NULL, NULL, NULL) != SQLITE_OK)
+		g_debug("Failed to enable write-ahead logging: %s",
+			sqlite3_errmsg(sticker_db));
+#endif
 
-	ret = sqlite3_exec(sticker_db, sticker_sql_create, NULL, NULL, NULL);
-	if (ret != SQLITE_OK) {
-		g_set_error(error_r, sticker_quark(), ret,
-			    "Failed to create sticker table: %s",
-			    sqlite3_errmsg(sticker_db));
+	sticker_writer.db = sticker_open(path, sticker_writer.stmt, error_r);
+	if (sticker_writer.db == NULL) {
+		sticker_close(sticker_db, sticker_stmt);
+		sticker_db = NULL;
 		return false;
 	}
 
-	/* prepare the statements we're going to use */
-
-	for (unsigned i = 0; i < G_N_ELEMENTS(sticker_sql); ++i) {
-		assert(sticker_sql[i] != NULL);
+#if SQLITE_VERSION_NUMBER >= 3007000
+	/* in WAL mode, this is still safe against corruption */
+	sqlite3_exec(sticker_writer.db, "PRAGMA synchronous=NORMAL",
+		     NULL, NULL, NULL);
+#endif
 
-		sticker_stmt[i] = sticker_prepare(sticker_sql[i], error_r);
-		if (sticker_stmt[i] == NULL)
-			return false;
+	sticker_writer.mutex = g_mutex_new();
+	sticker_writer.cond = g_cond_new();
+	sticker_writer.done_cond = g_cond_new();
+	sticker_writer.queue = g_queue_new();
+	sticker_writer.committing = g_queue_new();
+	sticker_writer.flush = false;
+	sticker_writer.quit = false;
+
+	sticker_writer.thread = g_thread_create(sticker_writer_thread, NULL,
+						true, error_r);
+	if (sticker_writer.thread == NULL) {
+		sticker_close(sticker_writer.db, sticker_writer.stmt);
+		sticker_close(sticker_db, sticker_stmt);
+		sticker_db = NULL;
+		return false;
 	}
 
 	return true;
@@ -149,13 +305,26 @@ sticker_global_finish(void)
 		/* not configured */
 		return;
 
-	for (unsigned i = 0; i < G_N_ELEMENTS(sticker_stmt); ++i) {
-		assert(sticker_stmt[i] != NULL);
+	/* let the writer thread commit the remaining operations */
 
-		sqlite3_finalize(sticker_stmt[i]);
-	}
+	g_mutex_lock(sticker_writer.mutex);
+	sticker_writer.quit = true;
+	g_cond_signal(sticker_writer.cond);
+	g_mutex_unlock(sticker_writer.mutex);
+
+	g_thread_join(sticker_writer.thread);
+
+	assert(g_queue_is_empty(sticker_writer.queue));
+	assert(g_queue_is_empty(sticker_writer.committing));
 
-	sqlite3_close(sticker_db);
+	g_queue_free(sticker_writer.queue);
+	g_queue_free(sticker_writer.committing);
+	g_cond_free(sticker_writer.done_cond);
+	g_cond_free(sticker_writer.cond);
+	g_mutex_free(sticker_writer.mutex);
+
+	sticker_close(sticker_writer.db, sticker_writer.stmt);
+	sticker_close(sticker_db, sticker_stmt);
 }
 
 bool
@@ -164,21 +333,13 @@ sticker_enabled(void)
 	return sticker_db != NULL;
 }
 
-char *
-sticker_load_value(const char *type, const char *uri, const char *name)
+static char *
+sticker_load_value_db(const char *type, const char *uri, const char *name)
 {
 	sqlite3_stmt *const stmt = sticker_stmt[STICKER_SQL_GET];
 	int ret;
 	char *value;
 
-	assert(sticker_enabled());
-	assert(type != NULL);
-	assert(uri != NULL);
-	assert(name != NULL);
-
-	if (*name == 0)
-		return NULL;
-
 	sqlite3_reset(stmt);
 
 	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
@@ -283,7 +444,7 @@ static bool
 sticker_update_value(const char *type, const char *uri,
 		     const char *name, const char *value)
 {
-	sqlite3_stmt *const stmt = sticker_stmt[STICKER_SQL_UPDATE];
+	sqlite3_stmt *const stmt = sticker_writer.stmt[STICKER_SQL_UPDATE];
 	int ret;
 
 	assert(type != NULL);
@@ -292,35 +453,33 @@ sticker_update_value(const char *type, const char *uri,
 	assert(*name != 0);
 	assert(value != NULL);
 
-	assert(sticker_enabled());
-
 	sqlite3_reset(stmt);
 
 	ret = sqlite3_bind_text(stmt, 1, value, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 2, type, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 3, uri, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 4, name, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
@@ -330,16 +489,15 @@ sticker_update_value(const char *type, const char *uri,
 
 	if (ret != SQLITE_DONE) {
 		g_warning("sqlite3_step() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
-	ret = sqlite3_changes(sticker_db);
+	ret = sqlite3_changes(sticker_writer.db);
 
 	sqlite3_reset(stmt);
 	sqlite3_clear_bindings(stmt);
 
-	idle_add(IDLE_STICKER);
 	return ret > 0;
 }
 
@@ -347,7 +505,7 @@ static bool
 sticker_insert_value(const char *type, const char *uri,
 		     const char *name, const char *value)
 {
-	sqlite3_stmt *const stmt = sticker_stmt[STICKER_SQL_INSERT];
+	sqlite3_stmt *const stmt = sticker_writer.stmt[STICKER_SQL_INSERT];
 	int ret;
 
 	assert(type != NULL);
@@ -356,35 +514,33 @@ sticker_insert_value(const char *type, const char *uri,
 	assert(*name != 0);
 	assert(value != NULL);
 
-	assert(sticker_enabled());
-
 	sqlite3_reset(stmt);
 
 	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 2, uri, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 3, name, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 4, value, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
@@ -394,42 +550,30 @@ sticker_insert_value(const char *type, const char *uri,
 
 	if (ret != SQLITE_DONE) {
 		g_warning("sqlite3_step() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	sqlite3_reset(stmt);
 	sqlite3_clear_bindings(stmt);
 
-
-	idle_add(IDLE_STICKER);
 	return true;
 }
 
-bool
-sticker_store_value(const char *type, const char *uri,
-		    const char *name, const char *value)
+static bool
+sticker_store_value_db(const char *type, const char *uri,
+		       const char *name, const char *value)
 {
-	assert(sticker_enabled());
-	assert(type != NULL);
-	assert(uri != NULL);
-	assert(name != NULL);
-	assert(value != NULL);
-
-	if (*name == 0)
-		return false;
-
 	return sticker_update_value(type, uri, name, value) ||
 		sticker_insert_value(type, uri, name, value);
 }
 
-bool
-sticker_delete(const char *type, const char *uri)
+static bool
+sticker_delete_db(const char *type, const char *uri)
 {
-	sqlite3_stmt *const stmt = sticker_stmt[STICKER_SQL_DELETE];
+	sqlite3_stmt *const stmt = sticker_writer.stmt[STICKER_SQL_DELETE];
 	int ret;
 
-	assert(sticker_enabled());
 	assert(type != NULL);
 	assert(uri != NULL);
 
@@ -438,14 +582,14 @@ sticker_delete(const char *type, const char *uri)
 	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 2, uri, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
@@ -455,24 +599,22 @@ sticker_delete(const char *type, const char *uri)
 
 	if (ret != SQLITE_DONE) {
 		g_warning("sqlite3_step() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	sqlite3_reset(stmt);
 	sqlite3_clear_bindings(stmt);
 
-	idle_add(IDLE_STICKER);
 	return true;
 }
 
-bool
-sticker_delete_value(const char *type, const char *uri, const char *name)
+static bool
+sticker_delete_value_db(const char *type, const char *uri, const char *name)
 {
-	sqlite3_stmt *const stmt = sticker_stmt[STICKER_SQL_DELETE_VALUE];
+	sqlite3_stmt *const stmt = sticker_writer.stmt[STICKER_SQL_DELETE_VALUE];
 	int ret;
 
-	assert(sticker_enabled());
 	assert(type != NULL);
 	assert(uri != NULL);
 
@@ -481,21 +623,21 @@ sticker_delete_value(const char *type, const char *uri, const char *name)
 	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 2, uri, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
 	ret = sqlite3_bind_text(stmt, 3, name, -1, NULL);
 	if (ret != SQLITE_OK) {
 		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
@@ -505,19 +647,336 @@ sticker_delete_value(const char *type, const char *uri, const char *name)
 
 	if (ret != SQLITE_DONE) {
 		g_warning("sqlite3_step() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+			  sqlite3_errmsg(sticker_writer.db));
 		return false;
 	}
 
-	ret = sqlite3_changes(sticker_db);
+	ret = sqlite3_changes(sticker_writer.db);
 
 	sqlite3_reset(stmt);
 	sqlite3_clear_bindings(stmt);
 
-	idle_add(IDLE_STICKER);
 	return ret > 0;
 }
 
+static void
+sticker_op_free(struct sticker_op *op)
+{
+	g_free(op->type);
+	g_free(op->uri);
+	g_free(op->name);
+	g_free(op->value);
+	g_free(op);
+}
+
+static void
+sticker_op_free_callback(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	sticker_op_free(data);
+}
+
+static bool
+sticker_exec(const char *sql)
+{
+	int ret = sqlite3_exec(sticker_writer.db, sql, NULL, NULL, NULL);
+	if (ret != SQLITE_OK) {
+		g_warning("\"%s\" failed: %s",
+			  sql, sqlite3_errmsg(sticker_writer.db));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Executes a batch of operations in one transaction.
+ *
+ * Runs in the writer thread.  The mutex is not locked.
+ */
+static void
+sticker_commit(GQueue *ops)
+{
+	bool transaction = sticker_exec("BEGIN");
+
+	for (GList *i = g_queue_peek_head_link(ops); i != NULL;
+	     i = g_list_next(i)) {
+		const struct sticker_op *op = i->data;
+
+		switch (op->op) {
+		case STICKER_OP_STORE:
+			sticker_store_value_db(op->type, op->uri,
+					       op->name, op->value);
+			break;
+
+		case STICKER_OP_DELETE:
+			sticker_delete_db(op->type, op->uri);
+			break;
+
+		case STICKER_OP_DELETE_VALUE:
+			sticker_delete_value_db(op->type, op->uri, op->name);
+			break;
+		}
+	}
+
+	if (transaction && !sticker_exec("COMMIT"))
+		sticker_exec("ROLLBACK");
+}
+
+static gpointer
+sticker_writer_thread(G_GNUC_UNUSED gpointer data)
+{
+	g_mutex_lock(sticker_writer.mutex);
+
+	while (true) {
+		while (g_queue_is_empty(sticker_writer.queue) &&
+		       !sticker_writer.quit)
+			g_cond_wait(sticker_writer.cond, sticker_writer.mutex);
+
+		if (g_queue_is_empty(sticker_writer.queue))
+			/* quit */
+			break;
+
+		/* give the client a chance to queue more
+		   operations, to commit them all in one
+		   transaction */
+
+		GTimeVal deadline;
+		g_get_current_time(&deadline);
+		g_time_val_add(&deadline, STICKER_BATCH_DELAY_MS * 1000);
+
+		while (!sticker_writer.flush && !sticker_writer.quit &&
+		       g_queue_get_length(sticker_writer.queue) < STICKER_BATCH_MAX &&
+		       g_cond_timed_wait(sticker_writer.cond,
+					 sticker_writer.mutex, &deadline)) {}
+
+		for (unsigned i = 0; i < STICKER_BATCH_MAX &&
+			     !g_queue_is_empty(sticker_writer.queue); ++i)
+			g_queue_push_tail(sticker_writer.committing,
+					  g_queue_pop_head(sticker_writer.queue));
+
+		g_mutex_unlock(sticker_writer.mutex);
+		sticker_commit(sticker_writer.committing);
+		g_mutex_lock(sticker_writer.mutex);
+
+		/* the operations are in the database now; readers
+		   don't need to apply them anymore */
+		g_queue_foreach(sticker_writer.committing,
+				sticker_op_free_callback, NULL);
+		g_queue_clear(sticker_writer.committing);
+
+		if (g_queue_is_empty(sticker_writer.queue))
+			sticker_writer.flush = false;
+
+		g_cond_broadcast(sticker_writer.done_cond);
+	}
+
+	g_mutex_unlock(sticker_writer.mutex);
+	return NULL;
+}
+
+/**
+ * Submits an operation to the writer thread.
+ */
+static void
+sticker_submit(struct sticker_op *op)
+{
+	g_mutex_lock(sticker_writer.mutex);
+
+	while (g_queue_get_length(sticker_writer.queue) >= STICKER_QUEUE_MAX) {
+		/* the writer thread can't keep up; wait for it */
+		sticker_writer.flush = true;
+		g_cond_signal(sticker_writer.cond);
+		g_cond_wait(sticker_writer.done_cond, sticker_writer.mutex);
+	}
+
+	g_queue_push_tail(sticker_writer.queue, op);
+	g_cond_signal(sticker_writer.cond);
+	g_mutex_unlock(sticker_writer.mutex);
+
+	idle_add(IDLE_STICKER);
+}
+
+static struct sticker_op *
+sticker_op_new(int type, const char *sticker_type, const char *uri,
+	       const char *name, const char *value)
+{
+	struct sticker_op *op = g_new(struct sticker_op, 1);
+	op->op = type;
+	op->type = g_strdup(sticker_type);
+	op->uri = g_strdup(uri);
+	op->name = g_strdup(name);
+	op->value = g_strdup(value);
+	return op;
+}
+
+static bool
+sticker_op_matches(const struct sticker_op *op,
+		   const char *type, const char *uri)
+{
+	return strcmp(op->uri, uri) == 0 && strcmp(op->type, type) == 0;
+}
+
+/**
+ * Finds the last pending operation which affects the specified
+ * sticker value.
+ *
+ * The caller must lock the mutex.
+ */
+static const struct sticker_op *
+sticker_pending_find(const char *type, const char *uri, const char *name)
+{
+	const struct sticker_op *result = NULL;
+	GQueue *const queues[] = {
+		sticker_writer.committing, sticker_writer.queue,
+	};
+
+	for (unsigned q = 0; q < G_N_ELEMENTS(queues); ++q) {
+		for (GList *i = g_queue_peek_head_link(queues[q]); i != NULL;
+		     i = g_list_next(i)) {
+			const struct sticker_op *op = i->data;
+
+			if (sticker_op_matches(op, type, uri) &&
+			    (op->name == NULL || strcmp(op->name, name) == 0))
+				result = op;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * Applies all pending operations on the specified object to a hash
+ * table loaded from the database.
+ *
+ * The caller must lock the mutex.
+ */
+static void
+sticker_pending_apply(GHashTable *hash, const char *type, const char *uri)
+{
+	GQueue *const queues[] = {
+		sticker_writer.committing, sticker_writer.queue,
+	};
+
+	for (unsigned q = 0; q < G_N_ELEMENTS(queues); ++q) {
+		for (GList *i = g_queue_peek_head_link(queues[q]); i != NULL;
+		     i = g_list_next(i)) {
+			const struct sticker_op *op = i->data;
+
+			if (!sticker_op_matches(op, type, uri))
+				continue;
+
+			switch (op->op) {
+			case STICKER_OP_STORE:
+				g_hash_table_insert(hash, g_strdup(op->name),
+						    g_strdup(op->value));
+				break;
+
+			case STICKER_OP_DELETE:
+				g_hash_table_remove_all(hash);
+				break;
+
+			case STICKER_OP_DELETE_VALUE:
+				g_hash_table_remove(hash, op->name);
+				break;
+			}
+		}
+	}
+}
+
+char *
+sticker_load_value(const char *type, const char *uri, const char *name)
+{
+	assert(sticker_enabled());
+	assert(type != NULL);
+	assert(uri != NULL);
+	assert(name != NULL);
+
+	if (*name == 0)
+		return NULL;
+
+	g_mutex_lock(sticker_writer.mutex);
+
+	char *value = sticker_load_value_db(type, uri, name);
+
+	const struct sticker_op *op = sticker_pending_find(type, uri, name);
+	if (op != NULL) {
+		g_free(value);
+		value = op->op == STICKER_OP_STORE
+			? g_strdup(op->value)
+			: NULL;
+	}
+
+	g_mutex_unlock(sticker_writer.mutex);
+
+	return value;
+}
+
+bool
+sticker_store_value(const char *type, const char *uri,
+		    const char *name, const char *value)
+{
+	assert(sticker_enabled());
+	assert(type != NULL);
+	assert(uri != NULL);
+	assert(name != NULL);
+	assert(value != NULL);
+
+	if (*name == 0)
+		return false;
+
+	sticker_submit(sticker_op_new(STICKER_OP_STORE, type, uri,
+				      name, value));
+	return true;
+}
+
+bool
+sticker_delete(const char *type, const char *uri)
+{
+	assert(sticker_enabled());
+	assert(type != NULL);
+	assert(uri != NULL);
+
+	sticker_submit(sticker_op_new(STICKER_OP_DELETE, type, uri,
+				      NULL, NULL));
+	return true;
+}
+
+bool
+sticker_delete_value(const char *type, const char *uri, const char *name)
+{
+	assert(sticker_enabled());
+	assert(type != NULL);
+	assert(uri != NULL);
+	assert(name != NULL);
+
+	char *old = sticker_load_value(type, uri, name);
+	if (old == NULL)
+		return false;
+
+	g_free(old);
+
+	sticker_submit(sticker_op_new(STICKER_OP_DELETE_VALUE, type, uri,
+				      name, NULL));
+	return true;
+}
+
+void
+sticker_flush(void)
+{
+	assert(sticker_enabled());
+
+	g_mutex_lock(sticker_writer.mutex);
+
+	while (!g_queue_is_empty(sticker_writer.queue) ||
+	       !g_queue_is_empty(sticker_writer.committing)) {
+		sticker_writer.flush = true;
+		g_cond_signal(sticker_writer.cond);
+		g_cond_wait(sticker_writer.done_cond, sticker_writer.mutex);
+	}
+
+	g_mutex_unlock(sticker_writer.mutex);
+}
+
 static struct sticker *
 sticker_new(void)
 {
@@ -578,7 +1037,14 @@ sticker_load(const char *type, const char *uri)
 	struct sticker *sticker = sticker_new();
 	bool success;
 
+	g_mutex_lock(sticker_writer.mutex);
+
 	success = sticker_list_values(sticker->table, type, uri);
+	if (success)
+		sticker_pending_apply(sticker->table, type, uri);
+
+	g_mutex_unlock(sticker_writer.mutex);
+
 	if (!success) {
 		sticker_free(sticker);
 		return NULL;
@@ -593,13 +1059,156 @@ sticker_load(const char *type, const char *uri)
 	return sticker;
 }
 
+/**
+ * Returns the smallest string which is greater than all strings
+ * beginning with the specified prefix, or NULL if there is none.
+ * Together with the prefix itself, this is a range which can be
+ * looked up in the index, unlike a "LIKE" expression.
+ */
+static char *
+sticker_prefix_end(const char *prefix)
+{
+	size_t length = strlen(prefix);
+	char *end = g_strdup(prefix);
+
+	while (length > 0) {
+		unsigned char ch = end[length - 1];
+		if (ch < 0xff) {
+			end[length - 1] = ch + 1;
+			end[length] = 0;
+			return end;
+		}
+
+		--length;
+	}
+
+	g_free(end);
+	return NULL;
+}
+
+static const char *const sticker_compare_sql[] = {
+	[STICKER_COMPARE_ANY] = "",
+	[STICKER_COMPARE_EQUALS] = " AND value=?",
+	[STICKER_COMPARE_LESS] = " AND value<?",
+	[STICKER_COMPARE_GREATER] = " AND value>?",
+	[STICKER_COMPARE_INT_EQUALS] = " AND CAST(value AS INTEGER)=?",
+	[STICKER_COMPARE_INT_LESS] = " AND CAST(value AS INTEGER)<?",
+	[STICKER_COMPARE_INT_GREATER] = " AND CAST(value AS INTEGER)>?",
+};
+
+static const char *const sticker_sort_sql[] = {
+	[STICKER_SORT_NONE] = "",
+	[STICKER_SORT_URI] = " ORDER BY uri",
+	[STICKER_SORT_VALUE] = " ORDER BY value",
+	[STICKER_SORT_VALUE_INT] = " ORDER BY CAST(value AS INTEGER)",
+};
+
+static bool
+sticker_compare_is_int(enum sticker_compare compare)
+{
+	return compare == STICKER_COMPARE_INT_EQUALS ||
+		compare == STICKER_COMPARE_INT_LESS ||
+		compare == STICKER_COMPARE_INT_GREATER;
+}
+
+static bool
+sticker_query_has_window(const struct sticker_query *query)
+{
+	return query->start > 0 || query->end != G_MAXUINT;
+}
+
+/**
+ * Builds and prepares the SELECT statement for sticker_find().
+ */
+static sqlite3_stmt *
+sticker_find_prepare(const char *type, const char *base_uri,
+		     const char *name, const struct sticker_query *query)
+{
+	GString *sql = g_string_new("SELECT uri,value FROM sticker"
+				    " WHERE type=? AND name=?");
+	char *base_uri_end = NULL;
+
+	if (*base_uri != 0) {
+		g_string_append(sql, " AND uri>=?");
+
+		base_uri_end = sticker_prefix_end(base_uri);
+		if (base_uri_end != NULL)
+			g_string_append(sql, " AND uri<?");
+	}
+
+	g_string_append(sql, sticker_compare_sql[query->compare]);
+
+	g_string_append(sql, sticker_sort_sql[query->sort]);
+	if (query->sort != STICKER_SORT_NONE && query->descending)
+		g_string_append(sql, " DESC");
+
+	if (sticker_query_has_window(query))
+		g_string_append(sql, " LIMIT ? OFFSET ?");
+
+	sqlite3_stmt *stmt;
+	int ret = sqlite3_prepare_v2(sticker_db, sql->str, -1, &stmt, NULL);
+	g_string_free(sql, true);
+	if (ret != SQLITE_OK) {
+		g_warning("sqlite3_prepare_v2() failed: %s",
+			  sqlite3_errmsg(sticker_db));
+		g_free(base_uri_end);
+		return NULL;
+	}
+
+	int i = 0;
+	ret = sqlite3_bind_text(stmt, ++i, type, -1, NULL);
+	if (ret == SQLITE_OK)
+		ret = sqlite3_bind_text(stmt, ++i, name, -1, NULL);
+
+	if (ret == SQLITE_OK && *base_uri != 0)
+		ret = sqlite3_bind_text(stmt, ++i, base_uri, -1, NULL);
+
+	if (ret == SQLITE_OK && base_uri_end != NULL)
+		ret = sqlite3_bind_text(stmt, ++i, base_uri_end, -1, g_free);
+	else
+		g_free(base_uri_end);
+
+	if (ret == SQLITE_OK && query->compare != STICKER_COMPARE_ANY)
+		ret = sticker_compare_is_int(query->compare)
+			? sqlite3_bind_int64(stmt, ++i,
+					     g_ascii_strtoll(query->value,
+							     NULL, 10))
+			: sqlite3_bind_text(stmt, ++i, query->value, -1, NULL);
+
+	if (ret == SQLITE_OK && sticker_query_has_window(query)) {
+		ret = sqlite3_bind_int64(stmt, ++i,
+					 query->end == G_MAXUINT
+					 ? -1
+					 : (sqlite3_int64)(query->end -
+							   query->start));
+		if (ret == SQLITE_OK)
+			ret = sqlite3_bind_int64(stmt, ++i, query->start);
+	}
+
+	if (ret != SQLITE_OK) {
+		g_warning("sqlite3_bind() failed: %s",
+			  sqlite3_errmsg(sticker_db));
+		sqlite3_finalize(stmt);
+		return NULL;
+	}
+
+	return stmt;
+}
+
 bool
 sticker_find(const char *type, const char *base_uri, const char *name,
+	     const struct sticker_query *query,
 	     void (*func)(const char *uri, const char *value,
 			  gpointer user_data),
 	     gpointer user_data)
 {
-	sqlite3_stmt *const stmt = sticker_stmt[STICKER_SQL_FIND];
+	static const struct sticker_query all = {
+		.compare = STICKER_COMPARE_ANY,
+		.sort = STICKER_SORT_NONE,
+		.start = 0,
+		.end = G_MAXUINT,
+	};
+	sqlite3_stmt *stmt;
 	int ret;
 
 	assert(type != NULL);
@@ -607,31 +1216,24 @@ sticker_find(const char *type, const char *base_uri, const char *name,
 	assert(func != NULL);
 	assert(sticker_enabled());
 
-	sqlite3_reset(stmt);
-
-	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
-	if (ret != SQLITE_OK) {
-		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
-		return false;
-	}
-
 	if (base_uri == NULL)
 		base_uri = "";
 
-	ret = sqlite3_bind_text(stmt, 2, base_uri, -1, NULL);
-	if (ret != SQLITE_OK) {
-		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
-		return false;
-	}
+	if (query == NULL)
+		query = &all;
 
-	ret = sqlite3_bind_text(stmt, 3, name, -1, NULL);
-	if (ret != SQLITE_OK) {
-		g_warning("sqlite3_bind_text() failed: %s",
-			  sqlite3_errmsg(sticker_db));
+	assert(query->compare < G_N_ELEMENTS(sticker_compare_sql));
+	assert(query->sort < G_N_ELEMENTS(sticker_sort_sql));
+	assert(query->compare == STICKER_COMPARE_ANY || query->value != NULL);
+	assert(query->start <= query->end);
+
+	/* applying the pending operations to the search result is
+	   not worth the effort; just commit them first */
+	sticker_flush();
+
+	stmt = sticker_find_prepare(type, base_uri, name, query);
+	if (stmt == NULL)
 		return false;
-	}
 
 	do {
 		ret = sqlite3_step(stmt);
@@ -649,12 +1251,11 @@ sticker_find(const char *type, const char *base_uri, const char *name,
 		default:
 			g_warning("sqlite3_step() failed: %s",
 				  sqlite3_errmsg(sticker_db));
+			sqlite3_finalize(stmt);
 			return false;
 		}
 	} while (ret != SQLITE_DONE);
 
-	sqlite3_reset(stmt);
-	sqlite3_clear_bindings(stmt);
-
+	sqlite3_finalize(stmt);
 	return true;
 }
@@ -79,7 +79,7 @@ sticker_load_value(const char *type, const char *uri, const char *name);
 
 /**
  * Sets a sticker value in the specified object.  Overwrites existing
- * values.
+ * values.  The value is committed to the database asynchronously.
  */
 bool
 sticker_store_value(const char *type, const char *uri,
@@ -99,6 +99,15 @@ sticker_delete(const char *type, const char *uri);
 bool
 sticker_delete_value(const char *type, const char *uri, const char *name);
 
+/**
+ * Waits until all modifications have been committed to the
+ * database.  Modifications are written by a separate thread in
+ * batches, but they are visible to the sticker_load*() functions
+ * right away.
+ */
+void
+sticker_flush(void);
+
 /**
  * Frees resources held by the sticker object.
  *
@@ -140,6 +149,55 @@ sticker_foreach(const struct sticker *sticker,
 struct sticker *
 sticker_load(const char *type, const char *uri);
 
+/**
+ * How sticker_find() compares sticker values with
+ * #sticker_query.value.
+ */
+enum sticker_compare {
+	/** don't compare, find all values */
+	STICKER_COMPARE_ANY,
+
+	/* string comparison */
+	STICKER_COMPARE_EQUALS,
+	STICKER_COMPARE_LESS,
+	STICKER_COMPARE_GREATER,
+
+	/* both values are converted to integers */
+	STICKER_COMPARE_INT_EQUALS,
+	STICKER_COMPARE_INT_LESS,
+	STICKER_COMPARE_INT_GREATER,
+};
+
+enum sticker_sort {
+	STICKER_SORT_NONE,
+	STICKER_SORT_URI,
+	STICKER_SORT_VALUE,
+
+	/** sort by the integer value */
+	STICKER_SORT_VALUE_INT,
+};
+
+/**
+ * Optional filter, sort order and window for sticker_find().
+ */
+struct sticker_query {
+	enum sticker_compare compare;
+
+	/** the operand of #compare */
+	const char *value;
+
+	enum sticker_sort sort;
+
+	/** sort in descending order? */
+	bool descending;
+
+	/**
+	 * Return only this range of results.  #end may be G_MAXUINT
+	 * for "no limit".
+	 */
+	unsigned start, end;
+};
+
 /**
  * Finds stickers with the specified name below the specified URI.
  *
@@ -147,11 +205,14 @@ sticker_load(const char *type, const char *uri);
  * @param base_uri the URI prefix of the resources, or NULL if all
  * resources should be searched
  * @param name the name of the sticker
+ * @param query filter, sort order and window; NULL finds all
+ * stickers in no particular order
  * @return true on success (even if no sticker was found), false on
  * failure
  */
 bool
 sticker_find(const char *type, const char *base_uri, const char *name,
+	     const struct sticker_query *query,
 	     void (*func)(const char *uri, const char *value,
 			  gpointer user_data),
 	     gpointer user_data);
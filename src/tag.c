@@ -103,6 +103,17 @@ static size_t items_size(const struct tag *tag)
 	return tag->num_items * sizeof(struct tag_item *);
 }
 
+/**
+ * Returns the address of the item array which is allocated together
+ * with the #tag object by tag_compact().  For other tags, this is an
+ * address which #tag::items never points to.
+ */
+static inline struct tag_item **
+tag_inline_items(struct tag *tag)
+{
+	return (struct tag_item **)(tag + 1);
+}
+
 void tag_lib_init(void)
 {
 	const char *value;
@@ -159,6 +170,8 @@ struct tag *tag_new(void)
 	ret->items = NULL;
 	ret->time = -1;
 	ret->has_playlist = false;
+	ret->picture_size = 0;
+	ret->picture_offset = 0;
 	ret->num_items = 0;
 	return ret;
 }
@@ -168,16 +181,19 @@ static void tag_delete_item(struct tag *tag, unsigned idx)
 	assert(idx < tag->num_items);
 	tag->num_items--;
 
-	g_mutex_lock(tag_pool_lock);
 	tag_pool_put_item(tag->items[idx]);
-	g_mutex_unlock(tag_pool_lock);
 
 	if (tag->num_items - idx > 0) {
 		memmove(tag->items + idx, tag->items + idx + 1,
 			(tag->num_items - idx) * sizeof(tag->items[0]));
 	}
 
-	if (tag->num_items > 0) {
+	if (tag->items == tag_inline_items(tag)) {
+		/* compact tag: the array is part of the tag
+		   allocation and cannot be shrunk */
+		if (tag->num_items == 0)
+			tag->items = NULL;
+	} else if (tag->num_items > 0) {
 		tag->items = g_realloc(tag->items, items_size(tag));
 	} else {
 		g_free(tag->items);
@@ -202,10 +218,56 @@ void tag_free(struct tag *tag)
 
 	assert(tag != NULL);
 
-	g_mutex_lock(tag_pool_lock);
 	for (i = tag->num_items; --i >= 0; )
 		tag_pool_put_item(tag->items[i]);
-	g_mutex_unlock(tag_pool_lock);
+
+	if (tag->items == bulk.items) {
+#ifndef NDEBUG
+		assert(bulk.busy);
+		bulk.busy = false;
+#endif
+	} else if (tag->items != tag_inline_items(tag))
+		g_free(tag->items);
+
+	g_free(tag);
+}
+
+/**
+ * Allocates a #tag object with room for the specified number of
+ * items right behind it.
+ */
+static struct tag *
+tag_new_compact(unsigned num_items)
+{
+	struct tag *tag = g_malloc(sizeof(*tag) +
+				   num_items * sizeof(tag->items[0]));
+	tag->time = -1;
+	tag->has_playlist = false;
+	tag->picture_size = 0;
+	tag->picture_offset = 0;
+	tag->num_items = num_items;
+	tag->items = num_items > 0 ? tag_inline_items(tag) : NULL;
+	return tag;
+}
+
+struct tag *
+tag_compact(struct tag *tag)
+{
+	assert(tag != NULL);
+
+	if (tag->items == tag_inline_items(tag))
+		/* already compact */
+		return tag;
+
+	struct tag *ret = tag_new_compact(tag->num_items);
+	ret->time = tag->time;
+	ret->has_playlist = tag->has_playlist;
+	ret->picture_size = tag->picture_size;
+	ret->picture_offset = tag->picture_offset;
+
+	/* move the item references over to the new tag */
+	if (tag->num_items > 0)
+		memcpy(ret->items, tag->items, items_size(tag));
 
 	if (tag->items == bulk.items) {
 #ifndef NDEBUG
@@ -216,6 +278,7 @@ void tag_free(struct tag *tag)
 		g_free(tag->items);
 
 	g_free(tag);
+	return ret;
 }
 
 struct tag *tag_dup(const struct tag *tag)
@@ -225,16 +288,14 @@ struct tag *tag_dup(const struct tag *tag)
 	if (!tag)
 		return NULL;
 
-	ret = tag_new();
+	ret = tag_new_compact(tag->num_items);
 	ret->time = tag->time;
 	ret->has_playlist = tag->has_playlist;
-	ret->num_items = tag->num_items;
-	ret->items = ret->num_items > 0 ? g_malloc(items_size(tag)) : NULL;
+	ret->picture_size = tag->picture_size;
+	ret->picture_offset = tag->picture_offset;
 
-	g_mutex_lock(tag_pool_lock);
 	for (unsigned i = 0; i < tag->num_items; i++)
 		ret->items[i] = tag_pool_dup_item(tag->items[i]);
-	g_mutex_unlock(tag_pool_lock);
 
 	return ret;
 }
@@ -255,8 +316,6 @@ tag_merge(const struct tag *base, const struct tag *add)
 	ret->num_items = base->num_items + add->num_items;
 	ret->items = ret->num_items > 0 ? g_malloc(items_size(ret)) : NULL;
 
-	g_mutex_lock(tag_pool_lock);
-
 	/* copy all items from "add" */
 
 	for (unsigned i = 0; i < add->num_items; ++i)
@@ -270,8 +329,6 @@ tag_merge(const struct tag *base, const struct tag *add)
 		if (!tag_has_type(add, base->items[i]->type))
 			ret->items[n++] = tag_pool_dup_item(base->items[i]);
 
-	g_mutex_unlock(tag_pool_lock);
-
 	assert(n <= ret->num_items);
 
 	if (n < ret->num_items) {
@@ -490,7 +547,14 @@ tag_add_item_internal(struct tag *tag, enum tag_type type,
 
 	tag->num_items++;
 
-	if (tag->items != bulk.items)
+	if (tag->items == tag_inline_items(tag)) {
+		/* compact tag: move the items out to a separate
+		   array which can grow */
+		struct tag_item **items = g_malloc(items_size(tag));
+		memcpy(items, tag->items,
+		       items_size(tag) - sizeof(struct tag_item *));
+		tag->items = items;
+	} else if (tag->items != bulk.items)
 		/* bulk mode disabled */
 		tag->items = g_realloc(tag->items, items_size(tag));
 	else if (tag->num_items >= BULK_MAX) {
@@ -502,9 +566,7 @@ tag_add_item_internal(struct tag *tag, enum tag_type type,
 		       items_size(tag) - sizeof(struct tag_item *));
 	}
 
-	g_mutex_lock(tag_pool_lock);
 	tag->items[i] = tag_pool_get_item(type, value, len);
-	g_mutex_unlock(tag_pool_lock);
 
 	g_free(p);
 }
@@ -94,6 +94,18 @@ struct tag {
 	 */
 	bool has_playlist;
 
+	/**
+	 * The size of the picture (cover art) embedded in the song
+	 * file, in bytes.  Zero means there is none.
+	 */
+	uint32_t picture_size;
+
+	/**
+	 * The position of the embedded picture within the song file.
+	 * Only valid if #picture_size is non-zero.
+	 */
+	uint64_t picture_offset;
+
 	/** an array of tag items */
 	struct tag_item **items;
 
@@ -151,6 +163,21 @@ void tag_begin_add(struct tag *tag);
  */
 void tag_end_add(struct tag *tag);
 
+/**
+ * Converts the tag to the compact representation: the item array is
+ * allocated together with the #tag object, which saves an allocation
+ * and a pointer dereference per access.  This is meant for tags which
+ * are kept for a long time, e.g. in the database.  The tag may still
+ * be modified afterwards.
+ *
+ * If the tag is in bulk mode (see tag_begin_add()), this also ends
+ * it.
+ *
+ * @return the compact tag; the old pointer is invalid afterwards
+ */
+struct tag *
+tag_compact(struct tag *tag);
+
 /**
  * Appends a new tag item.
  *
@@ -176,7 +203,7 @@ tag_add_item(struct tag *tag, enum tag_type type, const char *value)
 }
 
 /**
- * Duplicates a #tag object.
+ * Duplicates a #tag object.  The copy is compact, see tag_compact().
  */
 struct tag *tag_dup(const struct tag *tag);
 
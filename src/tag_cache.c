@@ -0,0 +1,661 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h" /* must be first for large file support */
+#include "tag_cache.h"
+#include "tag.h"
+#include "tag_save.h"
+#include "text_file.h"
+#include "string_util.h"
+#include "fd_util.h"
+#include "open.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "tag_cache"
+
+/* format 2 added the "Picture" attribute; older caches are discarded */
+#define TAG_CACHE_FORMAT "format: 2"
+#define TAG_CACHE_BEGIN "begin: "
+#define TAG_CACHE_END "end"
+
+enum {
+	/**
+	 * The number of bytes at the beginning and at the end of a
+	 * file which are hashed.  Tags are usually stored there.
+	 */
+	TAG_CACHE_HASH_SIZE = 64 * 1024,
+};
+
+struct tag_cache_entry {
+	/** must be the first attribute, see tag_cache_add() */
+	struct tag_cache_key key;
+
+	struct tag *tag;
+
+	/**
+	 * Has this entry been looked up, touched or stored during
+	 * the current full update?  See tag_cache_begin_update().
+	 */
+	bool used;
+};
+
+static struct {
+	char *path;
+
+	/** protects the hash tables and #modified */
+	GMutex *mutex;
+
+	/**
+	 * Maps inode/size/mtime to struct tag_cache_entry.  This
+	 * table owns the entries.
+	 */
+	GHashTable *by_stat;
+
+	/**
+	 * Maps size/hash to struct tag_cache_entry.  When several
+	 * files have the same contents, only the most recent one is
+	 * listed here.
+	 */
+	GHashTable *by_content;
+
+	bool modified;
+
+	/**
+	 * If true, tag_cache_lookup() always misses, so all files are
+	 * scanned again.
+	 */
+	bool discard;
+} tag_cache;
+
+static GQuark
+tag_cache_quark(void)
+{
+	return g_quark_from_static_string("tag_cache");
+}
+
+static guint
+tag_cache_stat_hash(gconstpointer p)
+{
+	const struct tag_cache_key *key = p;
+
+	return (guint)(key->inode ^ (key->inode >> 32) ^
+		       key->size ^ key->mtime);
+}
+
+static gboolean
+tag_cache_stat_equal(gconstpointer _a, gconstpointer _b)
+{
+	const struct tag_cache_key *a = _a, *b = _b;
+
+	return a->inode == b->inode && a->size == b->size &&
+		a->mtime == b->mtime;
+}
+
+static guint
+tag_cache_content_hash(gconstpointer p)
+{
+	const struct tag_cache_key *key = p;
+
+	return (guint)(key->hash ^ key->size);
+}
+
+static gboolean
+tag_cache_content_equal(gconstpointer _a, gconstpointer _b)
+{
+	const struct tag_cache_key *a = _a, *b = _b;
+
+	return a->size == b->size && a->hash == b->hash;
+}
+
+static struct tag_cache_entry *
+tag_cache_entry_new(const struct tag_cache_key *key, struct tag *tag)
+{
+	struct tag_cache_entry *entry = g_new(struct tag_cache_entry, 1);
+	entry->key = *key;
+	entry->tag = tag;
+	entry->used = true;
+	return entry;
+}
+
+static void
+tag_cache_entry_free(gpointer data)
+{
+	struct tag_cache_entry *entry = data;
+
+	tag_free(entry->tag);
+	g_free(entry);
+}
+
+/**
+ * Adds an entry to both tables, replacing an existing entry with the
+ * same inode/size/mtime.  The entry is also its own hash table key.
+ * Caller must hold the mutex.
+ */
+static void
+tag_cache_add(struct tag_cache_entry *entry)
+{
+	assert(entry->key.has_hash);
+
+	struct tag_cache_entry *old =
+		g_hash_table_lookup(tag_cache.by_stat, &entry->key);
+	if (old != NULL) {
+		if (g_hash_table_lookup(tag_cache.by_content,
+					&old->key) == old)
+			g_hash_table_remove(tag_cache.by_content, &old->key);
+
+		/* this frees the old entry */
+		g_hash_table_remove(tag_cache.by_stat, &old->key);
+	}
+
+	g_hash_table_insert(tag_cache.by_stat, entry, entry);
+	g_hash_table_replace(tag_cache.by_content, entry, entry);
+}
+
+static void
+tag_cache_clear(void)
+{
+	g_hash_table_remove_all(tag_cache.by_content);
+	g_hash_table_remove_all(tag_cache.by_stat);
+}
+
+/**
+ * Parses the numbers after #TAG_CACHE_BEGIN.
+ */
+static bool
+tag_cache_parse_key(const char *p, struct tag_cache_key *key)
+{
+	char *endptr;
+
+	key->inode = g_ascii_strtoull(p, &endptr, 10);
+	if (endptr == p || *endptr != ' ')
+		return false;
+
+	p = endptr + 1;
+	key->size = g_ascii_strtoull(p, &endptr, 10);
+	if (endptr == p || *endptr != ' ')
+		return false;
+
+	p = endptr + 1;
+	key->mtime = g_ascii_strtoll(p, &endptr, 10);
+	if (endptr == p || *endptr != ' ')
+		return false;
+
+	p = endptr + 1;
+	key->hash = g_ascii_strtoull(p, &endptr, 16);
+	if (endptr == p || *endptr != 0)
+		return false;
+
+	key->has_hash = true;
+	return true;
+}
+
+/**
+ * Parses one line of an entry.
+ */
+static bool
+tag_cache_parse_line(struct tag *tag, char *line)
+{
+	char *colon = strchr(line, ':');
+	if (colon == NULL || colon == line)
+		return false;
+
+	*colon++ = 0;
+	const char *value = strchug_fast_c(colon);
+
+	enum tag_type type = tag_name_parse(line);
+	if (type != TAG_NUM_OF_ITEM_TYPES)
+		tag_add_item(tag, type, value);
+	else if (strcmp(line, "Time") == 0)
+		tag->time = atoi(value);
+	else if (strcmp(line, "Playlist") == 0)
+		tag->has_playlist = strcmp(value, "yes") == 0;
+	else if (strcmp(line, "Picture") == 0) {
+		char *endptr;
+		tag->picture_offset = g_ascii_strtoull(value, &endptr, 10);
+		tag->picture_size = strtoul(endptr, NULL, 10);
+	} else
+		return false;
+
+	return true;
+}
+
+static bool
+tag_cache_load(FILE *fp, GError **error_r)
+{
+	GString *buffer = g_string_sized_new(1024);
+	struct tag_cache_entry *entry = NULL;
+	char *line;
+
+	line = read_text_line(fp, buffer);
+	if (line == NULL || strcmp(line, TAG_CACHE_FORMAT) != 0) {
+		g_string_free(buffer, true);
+		g_set_error(error_r, tag_cache_quark(), 0,
+			    "Unrecognized file format");
+		return false;
+	}
+
+	while ((line = read_text_line(fp, buffer)) != NULL) {
+		if (entry == NULL) {
+			struct tag_cache_key key;
+
+			if (!g_str_has_prefix(line, TAG_CACHE_BEGIN) ||
+			    !tag_cache_parse_key(line +
+						 sizeof(TAG_CACHE_BEGIN) - 1,
+						 &key))
+				break;
+
+			entry = tag_cache_entry_new(&key, tag_new());
+			entry->used = false;
+		} else if (strcmp(line, TAG_CACHE_END) == 0) {
+			entry->tag = tag_compact(entry->tag);
+			tag_cache_add(entry);
+			entry = NULL;
+		} else if (!tag_cache_parse_line(entry->tag, line))
+			break;
+	}
+
+	if (entry != NULL)
+		/* malformed or truncated: ignore the incomplete
+		   entry */
+		tag_cache_entry_free(entry);
+
+	if (line != NULL) {
+		g_set_error(error_r, tag_cache_quark(), 0,
+			    "Malformed line: %s", line);
+		g_string_free(buffer, true);
+		return false;
+	}
+
+	g_string_free(buffer, true);
+	return true;
+}
+
+void
+tag_cache_global_init(const char *path)
+{
+	if (path == NULL)
+		return;
+
+	tag_cache.path = g_strdup(path);
+	tag_cache.mutex = g_mutex_new();
+	tag_cache.by_stat = g_hash_table_new_full(tag_cache_stat_hash,
+						  tag_cache_stat_equal,
+						  NULL, tag_cache_entry_free);
+	tag_cache.by_content = g_hash_table_new(tag_cache_content_hash,
+						tag_cache_content_equal);
+	tag_cache.modified = false;
+	tag_cache.discard = false;
+
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		if (errno != ENOENT)
+			g_warning("Failed to open %s: %s",
+				  path, g_strerror(errno));
+		return;
+	}
+
+	GError *error = NULL;
+	if (!tag_cache_load(fp, &error)) {
+		g_warning("Failed to load %s: %s", path, error->message);
+		g_error_free(error);
+		tag_cache_clear();
+	}
+
+	fclose(fp);
+
+	g_debug("loaded %u entries", g_hash_table_size(tag_cache.by_stat));
+}
+
+void
+tag_cache_global_finish(void)
+{
+	if (!tag_cache_enabled())
+		return;
+
+	/* an update which has not finished must not purge the
+	   cache */
+	GError *error = NULL;
+	if (!tag_cache_save(false, &error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
+
+	g_hash_table_destroy(tag_cache.by_content);
+	g_hash_table_destroy(tag_cache.by_stat);
+	g_mutex_free(tag_cache.mutex);
+	g_free(tag_cache.path);
+	tag_cache.path = NULL;
+}
+
+bool
+tag_cache_enabled(void)
+{
+	return tag_cache.path != NULL;
+}
+
+static void
+tag_cache_entry_unuse(G_GNUC_UNUSED gpointer key, gpointer value,
+		      G_GNUC_UNUSED gpointer user_data)
+{
+	struct tag_cache_entry *entry = value;
+
+	entry->used = false;
+}
+
+void
+tag_cache_begin_update(bool full, bool discard)
+{
+	if (!tag_cache_enabled())
+		return;
+
+	g_mutex_lock(tag_cache.mutex);
+
+	tag_cache.discard = discard;
+	if (full)
+		g_hash_table_foreach(tag_cache.by_stat,
+				     tag_cache_entry_unuse, NULL);
+
+	g_mutex_unlock(tag_cache.mutex);
+}
+
+void
+tag_cache_touch(const struct stat *st)
+{
+	if (!tag_cache_enabled())
+		return;
+
+	struct tag_cache_key key = {
+		.inode = st->st_ino,
+		.size = st->st_size,
+		.mtime = st->st_mtime,
+	};
+
+	g_mutex_lock(tag_cache.mutex);
+
+	struct tag_cache_entry *entry =
+		g_hash_table_lookup(tag_cache.by_stat, &key);
+	if (entry != NULL)
+		entry->used = true;
+
+	g_mutex_unlock(tag_cache.mutex);
+}
+
+static gboolean
+tag_cache_entry_unused(G_GNUC_UNUSED gpointer key, gpointer value,
+		       G_GNUC_UNUSED gpointer user_data)
+{
+	struct tag_cache_entry *entry = value;
+
+	if (entry->used)
+		return false;
+
+	if (g_hash_table_lookup(tag_cache.by_content, &entry->key) == entry)
+		g_hash_table_remove(tag_cache.by_content, &entry->key);
+
+	return true;
+}
+
+static void
+tag_cache_content_restore(G_GNUC_UNUSED gpointer key, gpointer value,
+			  G_GNUC_UNUSED gpointer user_data)
+{
+	struct tag_cache_entry *entry = value;
+
+	if (g_hash_table_lookup(tag_cache.by_content, &entry->key) == NULL)
+		g_hash_table_insert(tag_cache.by_content, entry, entry);
+}
+
+/**
+ * Deletes all entries which were not used by the full update.
+ * Caller must hold the mutex.
+ */
+static void
+tag_cache_purge(void)
+{
+	guint n = g_hash_table_foreach_remove(tag_cache.by_stat,
+					      tag_cache_entry_unused, NULL);
+	if (n == 0)
+		return;
+
+	/* a deleted entry may have shadowed another one with the
+	   same contents */
+	g_hash_table_foreach(tag_cache.by_stat,
+			     tag_cache_content_restore, NULL);
+
+	g_debug("purged %u entries", n);
+	tag_cache.modified = true;
+}
+
+/**
+ * Feeds data into a FNV-1a hash.
+ */
+static uint64_t
+fnv1a_update(uint64_t hash, const unsigned char *p, size_t length)
+{
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Hashes up to #length bytes from the current file position.
+ */
+static bool
+tag_cache_hash_fd(int fd, size_t length, uint64_t *hash)
+{
+	unsigned char buffer[8192];
+
+	while (length > 0) {
+		ssize_t nbytes = read(fd, buffer,
+				      MIN(length, sizeof(buffer)));
+		if (nbytes < 0)
+			return false;
+
+		if (nbytes == 0)
+			break;
+
+		*hash = fnv1a_update(*hash, buffer, nbytes);
+		length -= nbytes;
+	}
+
+	return true;
+}
+
+/**
+ * Calculates the hash of the first and the last
+ * #TAG_CACHE_HASH_SIZE bytes of the file.
+ */
+static bool
+tag_cache_hash_file(const char *path_fs, uint64_t size, uint64_t *hash_r)
+{
+	int fd = open_cloexec(path_fs, O_RDONLY|O_BINARY, 0);
+	if (fd < 0)
+		return false;
+
+	uint64_t hash = 14695981039346656037ULL;
+	bool success = tag_cache_hash_fd(fd, TAG_CACHE_HASH_SIZE, &hash);
+
+	if (success && size > TAG_CACHE_HASH_SIZE) {
+		uint64_t offset = size > 2 * TAG_CACHE_HASH_SIZE
+			? size - TAG_CACHE_HASH_SIZE
+			: TAG_CACHE_HASH_SIZE;
+
+		success = lseek(fd, offset, SEEK_SET) == (off_t)offset &&
+			tag_cache_hash_fd(fd, TAG_CACHE_HASH_SIZE, &hash);
+	}
+
+	close(fd);
+
+	*hash_r = hash;
+	return success;
+}
+
+struct tag *
+tag_cache_lookup(const char *path_fs, const struct stat *st,
+		 struct tag_cache_key *key_r)
+{
+	struct tag_cache_entry *entry;
+	struct tag *tag = NULL;
+
+	key_r->inode = st->st_ino;
+	key_r->size = st->st_size;
+	key_r->mtime = st->st_mtime;
+	key_r->has_hash = false;
+
+	if (!tag_cache_enabled())
+		return NULL;
+
+	g_mutex_lock(tag_cache.mutex);
+	const bool discard = tag_cache.discard;
+	entry = discard
+		? NULL
+		: g_hash_table_lookup(tag_cache.by_stat, key_r);
+	if (entry != NULL) {
+		tag = tag_dup(entry->tag);
+		entry->used = true;
+	}
+	g_mutex_unlock(tag_cache.mutex);
+
+	if (tag != NULL)
+		return tag;
+
+	/* not found by its identity - the file may have been
+	   touched, copied or moved; look for its contents (reading
+	   the file without holding the lock) */
+
+	if (!tag_cache_hash_file(path_fs, key_r->size, &key_r->hash))
+		return NULL;
+
+	key_r->has_hash = true;
+
+	if (discard)
+		/* the caller wants to scan the file again; the hash
+		   is only needed for tag_cache_store() */
+		return NULL;
+
+	g_mutex_lock(tag_cache.mutex);
+	entry = g_hash_table_lookup(tag_cache.by_content, key_r);
+	if (entry != NULL) {
+		tag = tag_dup(entry->tag);
+
+		/* remember the new identity, so the next lookup
+		   doesn't need to read the file */
+		tag_cache_add(tag_cache_entry_new(key_r, tag_dup(tag)));
+		tag_cache.modified = true;
+	}
+	g_mutex_unlock(tag_cache.mutex);
+
+	return tag;
+}
+
+void
+tag_cache_store(const struct tag_cache_key *key, const struct tag *tag)
+{
+	if (!tag_cache_enabled() || !key->has_hash)
+		return;
+
+	struct tag_cache_entry *entry =
+		tag_cache_entry_new(key, tag_dup(tag));
+
+	g_mutex_lock(tag_cache.mutex);
+	tag_cache_add(entry);
+	tag_cache.modified = true;
+	g_mutex_unlock(tag_cache.mutex);
+}
+
+static void
+tag_cache_save_entry(G_GNUC_UNUSED gpointer key, gpointer value,
+		     gpointer user_data)
+{
+	const struct tag_cache_entry *entry = value;
+	FILE *fp = user_data;
+
+	fprintf(fp, TAG_CACHE_BEGIN "%llu %llu %lld %llx\n",
+		(unsigned long long)entry->key.inode,
+		(unsigned long long)entry->key.size,
+		(long long)entry->key.mtime,
+		(unsigned long long)entry->key.hash);
+	tag_save(fp, entry->tag);
+	fprintf(fp, TAG_CACHE_END "\n");
+}
+
+bool
+tag_cache_save(bool purge, GError **error_r)
+{
+	if (!tag_cache_enabled())
+		return true;
+
+	g_mutex_lock(tag_cache.mutex);
+
+	if (purge)
+		tag_cache_purge();
+
+	tag_cache.discard = false;
+
+	if (!tag_cache.modified) {
+		g_mutex_unlock(tag_cache.mutex);
+		return true;
+	}
+
+	/* write to a temporary file first, so a crash doesn't
+	   leave a truncated cache behind */
+	char *tmp = g_strconcat(tag_cache.path, ".tmp", NULL);
+	FILE *fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		g_mutex_unlock(tag_cache.mutex);
+		g_set_error(error_r, tag_cache_quark(), errno,
+			    "Failed to create %s: %s",
+			    tmp, g_strerror(errno));
+		g_free(tmp);
+		return false;
+	}
+
+	fprintf(fp, TAG_CACHE_FORMAT "\n");
+	g_hash_table_foreach(tag_cache.by_stat, tag_cache_save_entry, fp);
+
+	bool success = !ferror(fp);
+	success = fclose(fp) == 0 && success;
+	if (success)
+		success = rename(tmp, tag_cache.path) == 0;
+
+	if (success)
+		tag_cache.modified = false;
+	else {
+		g_set_error(error_r, tag_cache_quark(), errno,
+			    "Failed to write %s: %s",
+			    tag_cache.path, g_strerror(errno));
+		unlink(tmp);
+	}
+
+	g_mutex_unlock(tag_cache.mutex);
+	g_free(tmp);
+	return success;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * The tag cache remembers the tags of files which have been scanned
+ * before.  A file is identified either by its inode, size and
+ * modification time, or (after it has been copied or moved to
+ * another file system) by its size and a hash of its beginning and
+ * its end.  On a hit, the decoder plugins need not be invoked.
+ */
+
+#ifndef MPD_TAG_CACHE_H
+#define MPD_TAG_CACHE_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct stat;
+struct tag;
+
+/**
+ * Identifies a file in the tag cache.
+ */
+struct tag_cache_key {
+	uint64_t inode;
+	uint64_t size;
+	int64_t mtime;
+
+	/** the hash of the beginning and the end of the file */
+	uint64_t hash;
+
+	/** is #hash valid? */
+	bool has_hash;
+};
+
+/**
+ * Loads the tag cache file.  A missing or damaged file is not an
+ * error; the cache then starts empty.
+ *
+ * @param path the path of the cache file; NULL disables the cache
+ */
+void
+tag_cache_global_init(const char *path);
+
+/**
+ * Saves the cache (if it was modified) and frees all resources.
+ */
+void
+tag_cache_global_finish(void);
+
+bool
+tag_cache_enabled(void);
+
+/**
+ * Called by the update thread before walking the music directory.
+ *
+ * @param full true if the whole music directory will be walked; the
+ * entries used by this update are recorded for tag_cache_save()
+ * @param discard true if tag_cache_lookup() shall miss, so all files
+ * are scanned again (new results are still stored)
+ */
+void
+tag_cache_begin_update(bool full, bool discard);
+
+/**
+ * Marks the entry of an unmodified file as used by the current
+ * update, without looking it up.
+ */
+void
+tag_cache_touch(const struct stat *st);
+
+/**
+ * Looks up a file in the cache.  This function may be called from
+ * any thread.
+ *
+ * @param path_fs the path of the file in file system encoding
+ * @param st the result of stat() on the file
+ * @param key_r on a miss, this is filled for tag_cache_store()
+ * @return a copy of the cached tag (to be freed by the caller), or
+ * NULL on a miss
+ */
+struct tag *
+tag_cache_lookup(const char *path_fs, const struct stat *st,
+		 struct tag_cache_key *key_r);
+
+/**
+ * Adds a freshly scanned tag to the cache.
+ *
+ * @param key the key returned by the failed tag_cache_lookup()
+ */
+void
+tag_cache_store(const struct tag_cache_key *key, const struct tag *tag);
+
+/**
+ * Ends the update started by tag_cache_begin_update(), and writes
+ * the cache file if it has been modified since it was last loaded
+ * or saved.
+ *
+ * @param purge delete all entries which were not used by the full
+ * update; this must only be set if the walk has actually read the
+ * music directory, or else an unmounted music directory would wipe
+ * the whole cache
+ */
+bool
+tag_cache_save(bool purge, GError **error_r);
+
+#endif
@@ -52,9 +52,19 @@ full_tag_pair(const char *name, G_GNUC_UNUSED const char *value, void *ctx)
 		tag->has_playlist = true;
 }
 
+static void
+full_tag_picture(uint64_t offset, uint32_t size, void *ctx)
+{
+	struct tag *tag = ctx;
+
+	tag->picture_offset = offset;
+	tag->picture_size = size;
+}
+
 const struct tag_handler full_tag_handler = {
 	.duration = add_tag_duration,
 	.tag = add_tag_tag,
 	.pair = full_tag_pair,
+	.picture = full_tag_picture,
 };
 
@@ -49,6 +49,15 @@ struct tag_handler {
 	 * representation of tags.
 	 */
 	void (*pair)(const char *key, const char *value, void *ctx);
+
+	/**
+	 * An embedded picture (cover art) has been found.
+	 *
+	 * @param offset the position of the image data within the
+	 * file
+	 * @param size the size of the image data in bytes
+	 */
+	void (*picture)(uint64_t offset, uint32_t size, void *ctx);
 };
 
 static inline void
@@ -85,6 +94,17 @@ tag_handler_invoke_pair(const struct tag_handler *handler, void *ctx,
 		handler->pair(name, value, ctx);
 }
 
+static inline void
+tag_handler_invoke_picture(const struct tag_handler *handler, void *ctx,
+			   uint64_t offset, uint32_t size)
+{
+	assert(handler != NULL);
+	assert(size > 0);
+
+	if (handler->picture != NULL)
+		handler->picture(offset, size, ctx);
+}
+
 /**
  * This #tag_handler implementation adds tag values to a #tag object
  * (casted from the context pointer).
@@ -94,7 +114,7 @@ extern const struct tag_handler add_tag_handler;
 /**
  * This #tag_handler implementation adds tag values to a #tag object
  * (casted from the context pointer), and supports the has_playlist
- * attribute.
+ * and picture attributes.
  */
 extern const struct tag_handler full_tag_handler;
 
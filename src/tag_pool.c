@@ -21,18 +21,49 @@
 #include "tag_pool.h"
 
 #include <assert.h>
+#include <string.h>
 
-GMutex *tag_pool_lock = NULL;
+/**
+ * The pool is split into this number of shards, each with its own
+ * lock and hash table, so threads which intern different values
+ * rarely contend.  Must be a power of two.
+ */
+#define NUM_SHARDS 16
 
-#define NUM_SLOTS 4096
+/**
+ * The initial number of buckets in each shard.  Must be a power of
+ * two.
+ */
+#define INITIAL_BUCKETS 256
 
 struct slot {
 	struct slot *next;
-	unsigned char ref;
+
+	/** the hash of type and value, see calc_hash_n() */
+	unsigned hash;
+
+	/**
+	 * The reference counter.  It is modified with the
+	 * g_atomic_int_*() functions.  The last reference is only
+	 * dropped while the shard is locked.
+	 */
+	gint ref;
+
 	struct tag_item item;
-} mpd_packed;
+};
+
+struct shard {
+	GMutex *mutex;
+
+	/** the hash table; #num_buckets is a power of two */
+	struct slot **buckets;
+	unsigned num_buckets;
 
-static struct slot *slots[NUM_SLOTS];
+	/** the number of slots in this shard */
+	unsigned num_slots;
+};
+
+static struct shard shards[NUM_SHARDS];
 
 static inline unsigned
 calc_hash_n(enum tag_type type, const char *p, size_t length)
@@ -44,20 +75,28 @@ calc_hash_n(enum tag_type type, const char *p, size_t length)
 	while (length-- > 0)
 		hash = (hash << 5) + hash + *p++;
 
-	return hash ^ type;
-}
+	hash ^= type;
 
-static inline unsigned
-calc_hash(enum tag_type type, const char *p)
-{
-	unsigned hash = 5381;
+	/* mix the high bits into the low ones, which select the
+	   shard and the bucket */
+	hash ^= hash >> 16;
+	hash *= 0x45d9f3b;
+	hash ^= hash >> 16;
 
-	assert(p != NULL);
+	return hash;
+}
 
-	while (*p != 0)
-		hash = (hash << 5) + hash + *p++;
+static inline struct shard *
+hash_to_shard(unsigned hash)
+{
+	return &shards[hash % NUM_SHARDS];
+}
 
-	return hash ^ type;
+static inline struct slot **
+shard_bucket(struct shard *shard, unsigned hash)
+{
+	return &shard->buckets[(hash / NUM_SHARDS) &
+			       (shard->num_buckets - 1)];
 }
 
 static inline struct slot *
@@ -66,7 +105,7 @@ tag_item_to_slot(struct tag_item *item)
 	return (struct slot*)(((char*)item) - offsetof(struct slot, item));
 }
 
-static struct slot *slot_alloc(struct slot *next,
+static struct slot *slot_alloc(struct slot *next, unsigned hash,
 			       enum tag_type type,
 			       const char *value, int length)
 {
@@ -74,6 +113,7 @@ static struct slot *slot_alloc(struct slot *next,
 
 	slot = g_malloc(sizeof(*slot) - sizeof(slot->item.value) + length + 1);
 	slot->next = next;
+	slot->hash = hash;
 	slot->ref = 1;
 	slot->item.type = type;
 	memcpy(slot->item.value, value, length);
@@ -81,38 +121,92 @@ static struct slot *slot_alloc(struct slot *next,
 	return slot;
 }
 
+/**
+ * Doubles the number of buckets of a shard.  The caller must lock
+ * the shard.
+ */
+static void
+shard_grow(struct shard *shard)
+{
+	struct slot **old_buckets = shard->buckets;
+	unsigned old_num_buckets = shard->num_buckets;
+
+	shard->num_buckets *= 2;
+	shard->buckets = g_new0(struct slot *, shard->num_buckets);
+
+	for (unsigned i = 0; i < old_num_buckets; ++i) {
+		struct slot *slot = old_buckets[i];
+		while (slot != NULL) {
+			struct slot *next = slot->next;
+			struct slot **slot_p = shard_bucket(shard, slot->hash);
+
+			slot->next = *slot_p;
+			*slot_p = slot;
+			slot = next;
+		}
+	}
+
+	g_free(old_buckets);
+}
+
 void tag_pool_init(void)
 {
-	g_assert(tag_pool_lock == NULL);
-	tag_pool_lock = g_mutex_new();
+	for (unsigned i = 0; i < NUM_SHARDS; ++i) {
+		struct shard *shard = &shards[i];
+
+		assert(shard->mutex == NULL);
+
+		shard->mutex = g_mutex_new();
+		shard->num_buckets = INITIAL_BUCKETS;
+		shard->buckets = g_new0(struct slot *, INITIAL_BUCKETS);
+		shard->num_slots = 0;
+	}
 }
 
 void tag_pool_deinit(void)
 {
-	g_assert(tag_pool_lock != NULL);
-	g_mutex_free(tag_pool_lock);
-	tag_pool_lock = NULL;
+	for (unsigned i = 0; i < NUM_SHARDS; ++i) {
+		struct shard *shard = &shards[i];
+
+		assert(shard->mutex != NULL);
+
+		g_mutex_free(shard->mutex);
+		shard->mutex = NULL;
+
+		g_free(shard->buckets);
+		shard->buckets = NULL;
+	}
 }
 
 struct tag_item *
 tag_pool_get_item(enum tag_type type, const char *value, size_t length)
 {
+	unsigned hash = calc_hash_n(type, value, length);
+	struct shard *shard = hash_to_shard(hash);
 	struct slot **slot_p, *slot;
 
-	slot_p = &slots[calc_hash_n(type, value, length) % NUM_SLOTS];
+	g_mutex_lock(shard->mutex);
+
+	slot_p = shard_bucket(shard, hash);
 	for (slot = *slot_p; slot != NULL; slot = slot->next) {
-		if (slot->item.type == type &&
+		if (slot->hash == hash &&
+		    slot->item.type == type &&
 		    length == strlen(slot->item.value) &&
-		    memcmp(value, slot->item.value, length) == 0 &&
-		    slot->ref < 0xff) {
-			assert(slot->ref > 0);
-			++slot->ref;
+		    memcmp(value, slot->item.value, length) == 0) {
+			assert(g_atomic_int_get(&slot->ref) > 0);
+			g_atomic_int_inc(&slot->ref);
+			g_mutex_unlock(shard->mutex);
 			return &slot->item;
 		}
 	}
 
-	slot = slot_alloc(*slot_p, type, value, length);
+	slot = slot_alloc(*slot_p, hash, type, value, length);
 	*slot_p = slot;
+
+	if (++shard->num_slots > shard->num_buckets * 2)
+		shard_grow(shard);
+
+	g_mutex_unlock(shard->mutex);
 	return &slot->item;
 }
 
@@ -120,42 +214,56 @@ struct tag_item *tag_pool_dup_item(struct tag_item *item)
 {
 	struct slot *slot = tag_item_to_slot(item);
 
-	assert(slot->ref > 0);
-
-	if (slot->ref < 0xff) {
-		++slot->ref;
-		return item;
-	} else {
-		/* the reference counter overflows above 0xff;
-		   duplicate the item, and start with 1 */
-		size_t length = strlen(item->value);
-		struct slot **slot_p =
-			&slots[calc_hash_n(item->type, item->value,
-					   length) % NUM_SLOTS];
-		slot = slot_alloc(*slot_p, item->type,
-				  item->value, strlen(item->value));
-		*slot_p = slot;
-		return &slot->item;
-	}
+	/* the caller owns a reference, so the slot cannot vanish
+	   meanwhile, and no lock is needed */
+	assert(g_atomic_int_get(&slot->ref) > 0);
+	g_atomic_int_inc(&slot->ref);
+	return item;
 }
 
 void tag_pool_put_item(struct tag_item *item)
 {
-	struct slot **slot_p, *slot;
+	struct slot *slot = tag_item_to_slot(item);
+
+	/* drop a reference which is not the last one without
+	   locking */
+	while (true) {
+		gint ref = g_atomic_int_get(&slot->ref);
+		assert(ref > 0);
+
+		if (ref == 1)
+			break;
 
-	slot = tag_item_to_slot(item);
-	assert(slot->ref > 0);
-	--slot->ref;
+		if (g_atomic_int_compare_and_exchange(&slot->ref,
+						      ref, ref - 1))
+			return;
+	}
+
+	/* this is probably the last reference: lock the shard, so
+	   tag_pool_get_item() cannot find the slot while it is being
+	   removed */
+
+	struct shard *shard = hash_to_shard(slot->hash);
+	g_mutex_lock(shard->mutex);
 
-	if (slot->ref > 0)
+	if (!g_atomic_int_dec_and_test(&slot->ref)) {
+		/* tag_pool_get_item() has obtained a new reference
+		   meanwhile */
+		g_mutex_unlock(shard->mutex);
 		return;
+	}
 
-	for (slot_p = &slots[calc_hash(item->type, item->value) % NUM_SLOTS];
+	struct slot **slot_p;
+	for (slot_p = shard_bucket(shard, slot->hash);
 	     *slot_p != slot;
 	     slot_p = &(*slot_p)->next) {
 		assert(*slot_p != NULL);
 	}
 
 	*slot_p = slot->next;
+	--shard->num_slots;
+
+	g_mutex_unlock(shard->mutex);
+
 	g_free(slot);
 }
@@ -24,19 +24,30 @@
 
 #include <glib.h>
 
-extern GMutex *tag_pool_lock;
-
 struct tag_item;
 
 void tag_pool_init(void);
 
 void tag_pool_deinit(void);
 
+/**
+ * Obtains a reference to a shared #tag_item with the specified type
+ * and value, creating it if it doesn't exist yet.  This function is
+ * thread-safe; it locks only one shard of the pool.
+ */
 struct tag_item *
 tag_pool_get_item(enum tag_type type, const char *value, size_t length);
 
+/**
+ * Obtains another reference to an item.  This function is
+ * thread-safe and does not lock.
+ */
 struct tag_item *tag_pool_dup_item(struct tag_item *item);
 
+/**
+ * Releases a reference to an item, and frees it when it was the last
+ * one.  This function is thread-safe.
+ */
 void tag_pool_put_item(struct tag_item *item);
 
 #endif
@@ -0,0 +1,1350 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Lightweight scanners which read only the metadata headers of the
+ * most common formats.  They are used by the database update before
+ * the decoder plugins, which may have to open a demuxer or (for MP3)
+ * read the whole file just to determine the duration.
+ */
+
+#include "config.h" /* must be first for large file support */
+#include "tag_quick.h"
+#include "tag_handler.h"
+#include "uri.h"
+#include "fd_util.h"
+#include "open.h"
+#include "decoder/vorbis_comments.h"
+
+#include <glib.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "tag_quick"
+
+enum {
+	/**
+	 * The maximum number of bytes read from one file.  Files
+	 * with more metadata than that are left to the decoder
+	 * plugins.
+	 */
+	QUICK_BUDGET = 256 * 1024,
+
+	/**
+	 * How much of the file is searched for the first MPEG frame
+	 * (after the ID3v2 tag)?
+	 */
+	QUICK_MP3_SYNC = 16 * 1024,
+
+	/**
+	 * How much of the end of an Ogg file is searched for the last
+	 * page?  This is a bit more than the maximum page size.
+	 */
+	QUICK_OGG_TAIL = 66 * 1024,
+
+	/**
+	 * The maximum size of a MP4 metadata item which is loaded.
+	 * This excludes cover art and other binary items.
+	 */
+	QUICK_MP4_MAX_ITEM = 16 * 1024,
+};
+
+struct quick_file {
+	int fd;
+
+	goffset size;
+
+	/**
+	 * The number of bytes which may still be read.  Seeking is
+	 * free.
+	 */
+	size_t budget;
+};
+
+/**
+ * Maps a four-character code to a tag type.
+ */
+struct quick_tag {
+	char id[4];
+
+	enum tag_type type;
+};
+
+static inline uint16_t
+read_be16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t
+read_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline uint64_t
+read_be64(const uint8_t *p)
+{
+	return ((uint64_t)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+static inline uint16_t
+read_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t
+read_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t
+read_le64(const uint8_t *p)
+{
+	return read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+static enum tag_type
+quick_tag_lookup(const struct quick_tag *table, unsigned n, const void *id)
+{
+	for (unsigned i = 0; i < n; ++i)
+		if (memcmp(table[i].id, id, sizeof(table[i].id)) == 0)
+			return table[i].type;
+
+	return TAG_NUM_OF_ITEM_TYPES;
+}
+
+/**
+ * Reads a block from the file, and charges it to the read budget.
+ */
+static bool
+quick_read(struct quick_file *qf, goffset offset, void *buffer, size_t length)
+{
+	if (offset < 0 || offset > qf->size ||
+	    (goffset)length > qf->size - offset || length > qf->budget)
+		return false;
+
+	qf->budget -= length;
+
+	if (lseek(qf->fd, (off_t)offset, SEEK_SET) != (off_t)offset)
+		return false;
+
+	uint8_t *p = buffer;
+	while (length > 0) {
+		ssize_t nbytes = read(qf->fd, p, length);
+		if (nbytes <= 0)
+			return false;
+
+		p += nbytes;
+		length -= nbytes;
+	}
+
+	return true;
+}
+
+/**
+ * Like quick_read(), but allocates the buffer.  Free the return
+ * value with g_free().
+ */
+static uint8_t *
+quick_read_alloc(struct quick_file *qf, goffset offset, size_t length)
+{
+	if (length > qf->budget)
+		return NULL;
+
+	uint8_t *buffer = g_malloc(length);
+	if (!quick_read(qf, offset, buffer, length)) {
+		g_free(buffer);
+		return NULL;
+	}
+
+	return buffer;
+}
+
+static void
+quick_duration(const struct tag_handler *handler, void *handler_ctx,
+	       uint64_t samples, unsigned sample_rate)
+{
+	tag_handler_invoke_duration(handler, handler_ctx,
+				    (samples + sample_rate / 2) / sample_rate);
+}
+
+/**
+ * The embedded picture chosen so far.  The front cover is preferred
+ * over other pictures.
+ */
+struct quick_picture {
+	uint64_t offset;
+
+	uint32_t size;
+
+	bool front_cover;
+};
+
+enum {
+	/** the ID3v2/FLAC picture type for the front cover */
+	PICTURE_TYPE_FRONT_COVER = 3,
+};
+
+static void
+quick_picture_add(struct quick_picture *picture, unsigned type,
+		  uint64_t offset, uint64_t size)
+{
+	if (size == 0 || size > G_MAXUINT32 || picture->front_cover)
+		return;
+
+	if (picture->size == 0 || type == PICTURE_TYPE_FRONT_COVER) {
+		picture->offset = offset;
+		picture->size = size;
+		picture->front_cover = type == PICTURE_TYPE_FRONT_COVER;
+	}
+}
+
+static void
+quick_picture_submit(const struct quick_picture *picture,
+		     const struct tag_handler *handler, void *handler_ctx)
+{
+	if (picture->size > 0)
+		tag_handler_invoke_picture(handler, handler_ctx,
+					   picture->offset, picture->size);
+}
+
+static inline uint32_t
+read_syncsafe32(const uint8_t *p)
+{
+	return (p[0] << 21) | (p[1] << 14) | (p[2] << 7) | p[3];
+}
+
+/**
+ * Returns the size of the ID3v2 tag at the beginning of the file,
+ * or 0 if there is none.
+ */
+static goffset
+quick_id3v2_size(struct quick_file *qf)
+{
+	uint8_t header[10];
+	if (!quick_read(qf, 0, header, sizeof(header)) ||
+	    memcmp(header, "ID3", 3) != 0 ||
+	    ((header[6] | header[7] | header[8] | header[9]) & 0x80) != 0)
+		return 0;
+
+	goffset size = sizeof(header) + read_syncsafe32(header + 6);
+	if ((header[5] & 0x10) != 0)
+		/* footer present */
+		size += 10;
+
+	return size;
+}
+
+/**
+ * Parses a Vorbis comment block, as used by Vorbis and FLAC.
+ */
+static bool
+quick_vorbis_comments(const uint8_t *p, size_t length,
+		      const struct tag_handler *handler, void *handler_ctx)
+{
+	const uint8_t *const end = p + length;
+
+	if (length < 4)
+		return false;
+
+	uint32_t vendor_length = read_le32(p);
+	p += 4;
+	if ((size_t)(end - p) < 4 || vendor_length > (size_t)(end - p) - 4)
+		return false;
+
+	p += vendor_length;
+
+	uint32_t n = read_le32(p);
+	p += 4;
+	if (n > (size_t)(end - p) / 4)
+		return false;
+
+	char **comments = g_new(char *, n + 1);
+	unsigned i;
+	for (i = 0; i < n; ++i) {
+		if (end - p < 4)
+			break;
+
+		uint32_t comment_length = read_le32(p);
+		p += 4;
+		if (comment_length > (size_t)(end - p))
+			break;
+
+		comments[i] = g_strndup((const char *)p, comment_length);
+		p += comment_length;
+	}
+
+	comments[i] = NULL;
+
+	if (i == n)
+		vorbis_comments_scan(comments, handler, handler_ctx);
+
+	g_strfreev(comments);
+	return i == n;
+}
+
+/*
+ * FLAC
+ *
+ */
+
+enum {
+	FLAC_STREAMINFO = 0,
+	FLAC_VORBIS_COMMENT = 4,
+	FLAC_PICTURE = 6,
+};
+
+/**
+ * Parses the header of a PICTURE block, to find out where the image
+ * data is.
+ */
+static void
+flac_scan_picture(struct quick_file *qf, goffset offset, size_t length,
+		  struct quick_picture *picture)
+{
+	const goffset end = offset + length;
+	uint8_t buffer[20];
+
+	/* picture type, MIME type */
+	if (length < 8 || !quick_read(qf, offset, buffer, 8))
+		return;
+
+	const unsigned type = read_be32(buffer);
+	offset += 8 + read_be32(buffer + 4);
+
+	/* description */
+	if (end - offset < 4 || !quick_read(qf, offset, buffer, 4))
+		return;
+
+	offset += 4 + read_be32(buffer);
+
+	/* width, height, depth, number of colors, data length */
+	if (end - offset < 20 || !quick_read(qf, offset, buffer, 20))
+		return;
+
+	offset += 20;
+
+	const uint32_t size = read_be32(buffer + 16);
+	if (size <= end - offset)
+		quick_picture_add(picture, type, offset, size);
+}
+
+static bool
+quick_flac(struct quick_file *qf,
+	   const struct tag_handler *handler, void *handler_ctx)
+{
+	goffset offset = quick_id3v2_size(qf);
+	uint8_t header[4];
+	if (!quick_read(qf, offset, header, sizeof(header)) ||
+	    memcmp(header, "fLaC", 4) != 0)
+		return false;
+
+	offset += sizeof(header);
+
+	unsigned sample_rate = 0;
+	uint64_t total_samples = 0;
+	struct quick_picture picture = { .size = 0, .front_cover = false };
+	bool last;
+
+	do {
+		if (!quick_read(qf, offset, header, sizeof(header)))
+			return false;
+
+		last = (header[0] & 0x80) != 0;
+		const unsigned type = header[0] & 0x7f;
+		const size_t length =
+			(header[1] << 16) | (header[2] << 8) | header[3];
+		offset += sizeof(header);
+
+		if (type == FLAC_STREAMINFO) {
+			uint8_t info[34];
+			if (length < sizeof(info) ||
+			    !quick_read(qf, offset, info, sizeof(info)))
+				return false;
+
+			sample_rate = (info[10] << 12) | (info[11] << 4) |
+				(info[12] >> 4);
+			total_samples = ((uint64_t)(info[13] & 0x0f) << 32) |
+				read_be32(info + 14);
+		} else if (type == FLAC_VORBIS_COMMENT) {
+			uint8_t *block = quick_read_alloc(qf, offset, length);
+			if (block == NULL)
+				return false;
+
+			bool success = quick_vorbis_comments(block, length,
+							     handler,
+							     handler_ctx);
+			g_free(block);
+			if (!success)
+				return false;
+		} else if (type == FLAC_PICTURE)
+			flac_scan_picture(qf, offset, length, &picture);
+
+		/* skip everything else (and the picture data) without
+		   reading it */
+		offset += length;
+	} while (!last);
+
+	if (sample_rate == 0 || total_samples == 0)
+		return false;
+
+	quick_picture_submit(&picture, handler, handler_ctx);
+
+	/* round up, just like flac_duration() */
+	tag_handler_invoke_duration(handler, handler_ctx,
+				    (total_samples + sample_rate - 1) /
+				    sample_rate);
+	return true;
+}
+
+/*
+ * Ogg Vorbis
+ *
+ */
+
+struct quick_ogg {
+	struct quick_file *file;
+
+	/** the offset of the next page */
+	goffset offset;
+
+	/** the serial number of the first logical stream */
+	uint32_t serial;
+
+	bool have_serial;
+
+	/** the segment table of the current page */
+	uint8_t segments[255];
+
+	unsigned n_segments, segment;
+
+	/** the file offset of the current segment */
+	goffset data;
+};
+
+static bool
+quick_ogg_next_page(struct quick_ogg *ogg)
+{
+	uint8_t header[27];
+
+	do {
+		if (!quick_read(ogg->file, ogg->offset,
+				header, sizeof(header)) ||
+		    memcmp(header, "OggS", 4) != 0 || header[4] != 0)
+			return false;
+
+		const unsigned n = header[26];
+		if (!quick_read(ogg->file, ogg->offset + sizeof(header),
+				ogg->segments, n))
+			return false;
+
+		const uint32_t serial = read_le32(header + 14);
+		if (!ogg->have_serial) {
+			ogg->serial = serial;
+			ogg->have_serial = true;
+		}
+
+		ogg->n_segments = n;
+		ogg->segment = 0;
+		ogg->data = ogg->offset + sizeof(header) + n;
+
+		ogg->offset = ogg->data;
+		for (unsigned i = 0; i < n; ++i)
+			ogg->offset += ogg->segments[i];
+
+		/* skip pages of other multiplexed streams */
+	} while (read_le32(header + 14) != ogg->serial);
+
+	return true;
+}
+
+/**
+ * Reads the next packet of the first logical stream.
+ */
+static bool
+quick_ogg_packet(struct quick_ogg *ogg, GByteArray *packet)
+{
+	g_byte_array_set_size(packet, 0);
+
+	while (true) {
+		if (ogg->segment == ogg->n_segments &&
+		    !quick_ogg_next_page(ogg))
+			return false;
+
+		/* the segments of one packet are contiguous within a
+		   page; a segment shorter than 255 bytes terminates
+		   the packet */
+		size_t length = 0;
+		bool complete = false;
+		while (ogg->segment < ogg->n_segments && !complete) {
+			const unsigned size = ogg->segments[ogg->segment++];
+			length += size;
+			complete = size < 255;
+		}
+
+		if (length > 0) {
+			if (length > ogg->file->budget)
+				return false;
+
+			const unsigned old_length = packet->len;
+			g_byte_array_set_size(packet, old_length + length);
+			if (!quick_read(ogg->file, ogg->data,
+					packet->data + old_length, length))
+				return false;
+
+			ogg->data += length;
+		}
+
+		if (complete)
+			return true;
+	}
+}
+
+/**
+ * Finds the granule position of the last page of the specified
+ * logical stream.
+ */
+static bool
+quick_ogg_last_granule(struct quick_file *qf, uint32_t serial,
+		       uint64_t *granule_r)
+{
+	const size_t length = MIN(qf->size, (goffset)QUICK_OGG_TAIL);
+	if (length < 27)
+		return false;
+
+	uint8_t *buffer = quick_read_alloc(qf, qf->size - length, length);
+	if (buffer == NULL)
+		return false;
+
+	bool found = false;
+	for (size_t i = length - 27 + 1; i-- > 0;) {
+		const uint8_t *p = buffer + i;
+		if (memcmp(p, "OggS", 4) == 0 && p[4] == 0 &&
+		    read_le32(p + 14) == serial) {
+			const uint64_t granule = read_le64(p + 6);
+			if (granule != G_MAXUINT64) {
+				*granule_r = granule;
+				found = true;
+				break;
+			}
+		}
+	}
+
+	g_free(buffer);
+	return found;
+}
+
+static bool
+quick_ogg_scan(struct quick_ogg *ogg, GByteArray *packet,
+	       const struct tag_handler *handler, void *handler_ctx)
+{
+	/* the identification header; other codecs (FLAC, Opus) are
+	   left to the decoder plugins, which may not support them */
+
+	if (!quick_ogg_packet(ogg, packet) ||
+	    packet->len < 16 ||
+	    memcmp(packet->data, "\001vorbis", 7) != 0)
+		return false;
+
+	const unsigned sample_rate = read_le32(packet->data + 12);
+	if (sample_rate == 0)
+		return false;
+
+	/* the comment header */
+
+	if (!quick_ogg_packet(ogg, packet) ||
+	    packet->len < 7 ||
+	    memcmp(packet->data, "\003vorbis", 7) != 0 ||
+	    !quick_vorbis_comments(packet->data + 7, packet->len - 7,
+				   handler, handler_ctx))
+		return false;
+
+	/* the duration */
+
+	uint64_t granule;
+	if (!quick_ogg_last_granule(ogg->file, ogg->serial, &granule))
+		return false;
+
+	quick_duration(handler, handler_ctx, granule, sample_rate);
+	return true;
+}
+
+static bool
+quick_ogg(struct quick_file *qf,
+	  const struct tag_handler *handler, void *handler_ctx)
+{
+	struct quick_ogg ogg = {
+		.file = qf,
+		.offset = 0,
+		.have_serial = false,
+		.n_segments = 0,
+		.segment = 0,
+	};
+
+	GByteArray *packet = g_byte_array_new();
+	bool success = quick_ogg_scan(&ogg, packet, handler, handler_ctx);
+	g_byte_array_free(packet, true);
+	return success;
+}
+
+/*
+ * MP3
+ *
+ */
+
+struct mp3_frame {
+	/** MPEG 2 or 2.5 ("low sampling frequency") */
+	bool lsf;
+
+	bool mono;
+
+	unsigned layer;
+
+	/** in bits per second */
+	unsigned bitrate;
+
+	unsigned sample_rate;
+
+	/** the number of samples per channel */
+	unsigned samples;
+
+	/** the size of the frame in bytes */
+	unsigned length;
+};
+
+static bool
+mp3_parse_frame(const uint8_t *p, struct mp3_frame *frame)
+{
+	static const uint16_t bitrates[2][3][15] = {
+		/* MPEG 1 */
+		{
+			{ 0, 32, 64, 96, 128, 160, 192, 224,
+			  256, 288, 320, 352, 384, 416, 448 },
+			{ 0, 32, 48, 56, 64, 80, 96, 112,
+			  128, 160, 192, 224, 256, 320, 384 },
+			{ 0, 32, 40, 48, 56, 64, 80, 96,
+			  112, 128, 160, 192, 224, 256, 320 },
+		},
+		/* MPEG 2 and 2.5 */
+		{
+			{ 0, 32, 48, 56, 64, 80, 96, 112,
+			  128, 144, 160, 176, 192, 224, 256 },
+			{ 0, 8, 16, 24, 32, 40, 48, 56,
+			  64, 80, 96, 112, 128, 144, 160 },
+			{ 0, 8, 16, 24, 32, 40, 48, 56,
+			  64, 80, 96, 112, 128, 144, 160 },
+		},
+	};
+
+	static const unsigned sample_rates[3] = { 44100, 48000, 32000 };
+
+	if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0)
+		return false;
+
+	const unsigned version = (p[1] >> 3) & 0x3;
+	const unsigned layer = (p[1] >> 1) & 0x3;
+	const unsigned bitrate_index = p[2] >> 4;
+	const unsigned sample_rate_index = (p[2] >> 2) & 0x3;
+
+	/* reject reserved values and the "free" bitrate */
+	if (version == 1 || layer == 0 || bitrate_index == 0 ||
+	    bitrate_index == 15 || sample_rate_index == 3)
+		return false;
+
+	frame->lsf = version != 3;
+	frame->mono = (p[3] >> 6) == 3;
+	frame->layer = 4 - layer;
+	frame->bitrate =
+		bitrates[frame->lsf][frame->layer - 1][bitrate_index] * 1000;
+	frame->sample_rate = sample_rates[sample_rate_index] >>
+		(version == 3 ? 0 : (version == 2 ? 1 : 2));
+
+	const unsigned padding = (p[2] >> 1) & 0x1;
+	if (frame->layer == 1) {
+		frame->samples = 384;
+		frame->length = (12 * frame->bitrate / frame->sample_rate +
+				 padding) * 4;
+	} else {
+		frame->samples = frame->layer == 3 && frame->lsf
+			? 576 : 1152;
+		frame->length = frame->samples / 8 * frame->bitrate /
+			frame->sample_rate + padding;
+	}
+
+	return true;
+}
+
+/**
+ * Finds the first MPEG frame in the buffer.  A candidate is only
+ * accepted if it is followed by another frame header, which rules
+ * out most false syncs in garbage data.
+ */
+static const uint8_t *
+mp3_find_frame(const uint8_t *p, size_t length, struct mp3_frame *frame)
+{
+	for (const uint8_t *end = p + length; end - p >= 4; ++p) {
+		if (!mp3_parse_frame(p, frame))
+			continue;
+
+		struct mp3_frame next;
+		if ((size_t)(end - p) < frame->length + 4 ||
+		    (mp3_parse_frame(p + frame->length, &next) &&
+		     next.lsf == frame->lsf &&
+		     next.layer == frame->layer &&
+		     next.sample_rate == frame->sample_rate))
+			return p;
+	}
+
+	return NULL;
+}
+
+/**
+ * Determines the number of samples from a Xing/Info or VBRI header,
+ * minus the encoder delay and padding declared in the LAME tag.
+ */
+static bool
+mp3_vbr_samples(const uint8_t *p, size_t length,
+		const struct mp3_frame *frame, uint64_t *samples_r)
+{
+	if (frame->layer != 3)
+		return false;
+
+	/* the Xing header follows the side information */
+	const size_t xing = 4 + (frame->lsf
+				 ? (frame->mono ? 9 : 17)
+				 : (frame->mono ? 17 : 32));
+	if (length >= xing + 12 &&
+	    (memcmp(p + xing, "Xing", 4) == 0 ||
+	     memcmp(p + xing, "Info", 4) == 0)) {
+		enum {
+			XING_FRAMES = 0x1,
+			XING_BYTES = 0x2,
+			XING_TOC = 0x4,
+			XING_SCALE = 0x8,
+		};
+
+		const uint32_t flags = read_be32(p + xing + 4);
+		if ((flags & XING_FRAMES) == 0)
+			return false;
+
+		const uint32_t frames = read_be32(p + xing + 8);
+		if (frames == 0)
+			return false;
+
+		uint64_t samples = (uint64_t)frames * frame->samples;
+
+		size_t lame = xing + 12;
+		if (flags & XING_BYTES)
+			lame += 4;
+		if (flags & XING_TOC)
+			lame += 100;
+		if (flags & XING_SCALE)
+			lame += 4;
+
+		if (length >= lame + 24 && memcmp(p + lame, "LAME", 4) == 0) {
+			const uint8_t *q = p + lame + 21;
+			const unsigned delay = (q[0] << 4) | (q[1] >> 4);
+			const unsigned padding = ((q[1] & 0xf) << 8) | q[2];
+			if (delay + padding < samples)
+				samples -= delay + padding;
+		}
+
+		*samples_r = samples;
+		return true;
+	}
+
+	/* the VBRI header is always at the same position */
+	if (length >= 36 + 18 && memcmp(p + 36, "VBRI", 4) == 0) {
+		const uint32_t frames = read_be32(p + 36 + 14);
+		if (frames == 0)
+			return false;
+
+		*samples_r = (uint64_t)frames * frame->samples;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Parses the header of an "APIC" frame, to find out where the image
+ * data is.
+ */
+static void
+id3v2_scan_apic(struct quick_file *qf, goffset offset, uint32_t size,
+		struct quick_picture *picture)
+{
+	uint8_t buffer[1024];
+	const size_t length = MIN(size, sizeof(buffer));
+	if (length < 4 || !quick_read(qf, offset, buffer, length))
+		return;
+
+	const uint8_t *const end = buffer + length;
+	const unsigned encoding = buffer[0];
+
+	/* MIME type */
+	const uint8_t *p = memchr(buffer + 1, 0, end - buffer - 1);
+	if (p == NULL || end - p < 2)
+		return;
+
+	const unsigned type = p[1];
+	p += 2;
+
+	/* description */
+	if (encoding == 1 || encoding == 2) {
+		/* UTF-16, terminated by two null bytes */
+		while (true) {
+			if (end - p < 2)
+				return;
+
+			const bool terminator = p[0] == 0 && p[1] == 0;
+			p += 2;
+			if (terminator)
+				break;
+		}
+	} else {
+		p = memchr(p, 0, end - p);
+		if (p == NULL)
+			return;
+
+		++p;
+	}
+
+	const size_t header_length = p - buffer;
+	if (header_length < size)
+		quick_picture_add(picture, type, offset + header_length,
+				  size - header_length);
+}
+
+/**
+ * Finds the pictures in the ID3v2 tag at the beginning of the file.
+ * Only versions 2.3 and 2.4 are supported, and only frames which
+ * are stored verbatim (no unsynchronisation, compression or
+ * encryption), because the image is served straight from the file.
+ */
+static void
+id3v2_scan_pictures(struct quick_file *qf, struct quick_picture *picture)
+{
+	uint8_t header[10];
+	if (!quick_read(qf, 0, header, sizeof(header)) ||
+	    memcmp(header, "ID3", 3) != 0 ||
+	    (header[3] != 3 && header[3] != 4) ||
+	    /* unsynchronisation */
+	    (header[5] & 0x80) != 0)
+		return;
+
+	const bool v4 = header[3] == 4;
+	const goffset end = sizeof(header) + read_syncsafe32(header + 6);
+	goffset offset = sizeof(header);
+
+	if ((header[5] & 0x40) != 0) {
+		/* skip the extended header */
+		if (!quick_read(qf, offset, header, 4))
+			return;
+
+		offset += v4
+			? read_syncsafe32(header)
+			: read_be32(header) + 4;
+	}
+
+	while (end - offset >= 10) {
+		if (!quick_read(qf, offset, header, sizeof(header)) ||
+		    header[0] == 0)
+			/* error or padding */
+			break;
+
+		const uint32_t size = v4
+			? read_syncsafe32(header + 4)
+			: read_be32(header + 4);
+		offset += sizeof(header);
+		if (size > end - offset)
+			break;
+
+		const bool verbatim = v4
+			? (header[9] & 0x0f) == 0
+			: (header[9] & 0xc0) == 0;
+		if (verbatim && memcmp(header, "APIC", 4) == 0)
+			id3v2_scan_apic(qf, offset, size, picture);
+
+		offset += size;
+	}
+}
+
+static bool
+quick_mp3(struct quick_file *qf,
+	  const struct tag_handler *handler, void *handler_ctx)
+{
+	const goffset start = quick_id3v2_size(qf);
+	if (start >= qf->size)
+		return false;
+
+	const size_t length = MIN(qf->size - start, (goffset)QUICK_MP3_SYNC);
+	uint8_t *buffer = quick_read_alloc(qf, start, length);
+	if (buffer == NULL)
+		return false;
+
+	struct mp3_frame frame;
+	const uint8_t *p = mp3_find_frame(buffer, length, &frame);
+	if (p == NULL) {
+		g_free(buffer);
+		return false;
+	}
+
+	uint64_t samples;
+	if (mp3_vbr_samples(p, buffer + length - p, &frame, &samples))
+		quick_duration(handler, handler_ctx,
+			       samples, frame.sample_rate);
+	else {
+		/* no VBR header: assume a constant bitrate, and
+		   estimate the duration from the file size, just like
+		   the "mad" decoder plugin */
+		goffset audio = qf->size - start - (p - buffer);
+
+		uint8_t id3v1[3];
+		if (audio > 128 &&
+		    quick_read(qf, qf->size - 128, id3v1, sizeof(id3v1)) &&
+		    memcmp(id3v1, "TAG", 3) == 0)
+			audio -= 128;
+
+		quick_duration(handler, handler_ctx,
+			       (uint64_t)audio * 8, frame.bitrate);
+	}
+
+	g_free(buffer);
+
+	/* the tags are loaded by the ID3/APE fallback in
+	   song_file_update(), but that doesn't know where the
+	   pictures are */
+	struct quick_picture picture = { .size = 0, .front_cover = false };
+	id3v2_scan_pictures(qf, &picture);
+	quick_picture_submit(&picture, handler, handler_ctx);
+
+	return true;
+}
+
+/*
+ * MP4
+ *
+ */
+
+struct mp4_box {
+	char type[4];
+
+	/** the offset of the box contents */
+	goffset body;
+
+	/** the offset after the end of the box */
+	goffset end;
+};
+
+static bool
+mp4_read_box(struct quick_file *qf, goffset offset, goffset end,
+	     struct mp4_box *box)
+{
+	uint8_t header[16];
+	if (end - offset < 8 || !quick_read(qf, offset, header, 8))
+		return false;
+
+	uint64_t size = read_be32(header);
+	memcpy(box->type, header + 4, sizeof(box->type));
+	box->body = offset + 8;
+
+	if (size == 1) {
+		/* 64 bit size */
+		if (end - offset < 16 ||
+		    !quick_read(qf, offset + 8, header + 8, 8))
+			return false;
+
+		size = read_be64(header + 8);
+		box->body += 8;
+	} else if (size == 0)
+		/* extends to the end of the file */
+		size = end - offset;
+
+	if (size < (uint64_t)(box->body - offset) ||
+	    size > (uint64_t)(end - offset))
+		return false;
+
+	box->end = offset + size;
+	return true;
+}
+
+/**
+ * Finds a child box with the specified type, skipping all others
+ * without reading them.
+ */
+static bool
+mp4_find_box(struct quick_file *qf, goffset offset, goffset end,
+	     const char *type, struct mp4_box *box)
+{
+	while (mp4_read_box(qf, offset, end, box)) {
+		if (memcmp(box->type, type, sizeof(box->type)) == 0)
+			return true;
+
+		offset = box->end;
+	}
+
+	return false;
+}
+
+static const struct quick_tag mp4_tags[] = {
+	{ "\251nam", TAG_TITLE },
+	{ "\251ART", TAG_ARTIST },
+	{ "soar", TAG_ARTIST_SORT },
+	{ "\251alb", TAG_ALBUM },
+	{ "aART", TAG_ALBUM_ARTIST },
+	{ "soaa", TAG_ALBUM_ARTIST_SORT },
+	{ "trkn", TAG_TRACK },
+	{ "disk", TAG_DISC },
+	{ "\251gen", TAG_GENRE },
+	{ "\251day", TAG_DATE },
+	{ "\251wrt", TAG_COMPOSER },
+	{ "\251cmt", TAG_COMMENT },
+};
+
+enum {
+	/** "data" box type for binary values (track/disc numbers) */
+	MP4_DATA_BINARY = 0,
+
+	/** "data" box type for UTF-8 strings */
+	MP4_DATA_UTF8 = 1,
+};
+
+/**
+ * Imports the "data" boxes of one metadata item.
+ */
+static void
+mp4_scan_item(struct quick_file *qf, const struct mp4_box *item,
+	      enum tag_type type,
+	      const struct tag_handler *handler, void *handler_ctx)
+{
+	struct mp4_box data;
+	goffset offset = item->body;
+
+	while (mp4_find_box(qf, offset, item->end, "data", &data)) {
+		offset = data.end;
+
+		const size_t length = data.end - data.body;
+		if (length < 8 || length > QUICK_MP4_MAX_ITEM)
+			continue;
+
+		uint8_t *buffer = quick_read_alloc(qf, data.body, length);
+		if (buffer == NULL)
+			return;
+
+		const uint32_t data_type = read_be32(buffer) & 0xffffff;
+		const uint8_t *value = buffer + 8;
+		const size_t value_length = length - 8;
+
+		if ((type == TAG_TRACK || type == TAG_DISC) &&
+		    data_type == MP4_DATA_BINARY && value_length >= 4) {
+			/* 16 bit padding, number, total */
+			const unsigned number = read_be16(value + 2);
+			if (number > 0) {
+				char buffer2[16];
+				snprintf(buffer2, sizeof(buffer2), "%u", number);
+				tag_handler_invoke_tag(handler, handler_ctx,
+						       type, buffer2);
+			}
+		} else if (data_type == MP4_DATA_UTF8 && value_length > 0) {
+			char *p = g_strndup((const char *)value, value_length);
+			tag_handler_invoke_tag(handler, handler_ctx, type, p);
+			g_free(p);
+		}
+
+		g_free(buffer);
+	}
+}
+
+/**
+ * Reports the first "data" box of the "covr" item as the embedded
+ * picture.  The image itself is not read.
+ */
+static void
+mp4_scan_cover(struct quick_file *qf, const struct mp4_box *item,
+	       const struct tag_handler *handler, void *handler_ctx)
+{
+	struct mp4_box data;
+	if (mp4_find_box(qf, item->body, item->end, "data", &data) &&
+	    data.end - data.body > 8 &&
+	    data.end - data.body - 8 <= G_MAXUINT32)
+		/* skip the type indicator and the locale */
+		tag_handler_invoke_picture(handler, handler_ctx,
+					   data.body + 8,
+					   data.end - data.body - 8);
+}
+
+static void
+mp4_scan_ilst(struct quick_file *qf, const struct mp4_box *ilst,
+	      const struct tag_handler *handler, void *handler_ctx)
+{
+	struct mp4_box item;
+	bool found_cover = false;
+
+	for (goffset offset = ilst->body;
+	     mp4_read_box(qf, offset, ilst->end, &item);
+	     offset = item.end) {
+		if (memcmp(item.type, "covr", 4) == 0 && !found_cover) {
+			mp4_scan_cover(qf, &item, handler, handler_ctx);
+			found_cover = true;
+			continue;
+		}
+
+		/* unknown items (iTunes freeform data) are skipped
+		   without reading them */
+		enum tag_type type = quick_tag_lookup(mp4_tags,
+						      G_N_ELEMENTS(mp4_tags),
+						      item.type);
+		if (type != TAG_NUM_OF_ITEM_TYPES)
+			mp4_scan_item(qf, &item, type, handler, handler_ctx);
+	}
+}
+
+/**
+ * Reads the metadata from "moov/udta/meta/ilst".
+ */
+static void
+mp4_scan_udta(struct quick_file *qf, const struct mp4_box *moov,
+	      const struct tag_handler *handler, void *handler_ctx)
+{
+	struct mp4_box udta, meta, ilst;
+	if (!mp4_find_box(qf, moov->body, moov->end, "udta", &udta) ||
+	    !mp4_find_box(qf, udta.body, udta.end, "meta", &meta))
+		return;
+
+	/* "meta" is a "full box" with version and flags in ISO
+	   files, but not in old QuickTime files */
+	goffset children = meta.body;
+	uint8_t version[4];
+	if (meta.end - meta.body >= 4 &&
+	    quick_read(qf, meta.body, version, sizeof(version)) &&
+	    read_be32(version) == 0)
+		children += sizeof(version);
+
+	if (mp4_find_box(qf, children, meta.end, "ilst", &ilst))
+		mp4_scan_ilst(qf, &ilst, handler, handler_ctx);
+}
+
+static bool
+quick_mp4(struct quick_file *qf,
+	  const struct tag_handler *handler, void *handler_ctx)
+{
+	struct mp4_box ftyp, moov, mvhd;
+	if (!mp4_read_box(qf, 0, qf->size, &ftyp) ||
+	    memcmp(ftyp.type, "ftyp", 4) != 0 ||
+	    /* "moov" may be after "mdat", which is skipped */
+	    !mp4_find_box(qf, ftyp.end, qf->size, "moov", &moov) ||
+	    !mp4_find_box(qf, moov.body, moov.end, "mvhd", &mvhd))
+		return false;
+
+	uint8_t buffer[32];
+	const size_t length = MIN(mvhd.end - mvhd.body,
+				  (goffset)sizeof(buffer));
+	if (length < 20 || !quick_read(qf, mvhd.body, buffer, length))
+		return false;
+
+	uint32_t timescale;
+	uint64_t duration;
+	if (buffer[0] == 0) {
+		timescale = read_be32(buffer + 12);
+		duration = read_be32(buffer + 16);
+	} else if (buffer[0] == 1 && length >= 32) {
+		timescale = read_be32(buffer + 20);
+		duration = read_be64(buffer + 24);
+	} else
+		return false;
+
+	if (timescale == 0)
+		return false;
+
+	quick_duration(handler, handler_ctx, duration, timescale);
+
+	mp4_scan_udta(qf, &moov, handler, handler_ctx);
+	return true;
+}
+
+/*
+ * WAV
+ *
+ */
+
+static const struct quick_tag riff_info_tags[] = {
+	{ "INAM", TAG_TITLE },
+	{ "IART", TAG_ARTIST },
+	{ "IPRD", TAG_ALBUM },
+	{ "ITRK", TAG_TRACK },
+	{ "IPRT", TAG_TRACK },
+	{ "IGNR", TAG_GENRE },
+	{ "ICRD", TAG_DATE },
+	{ "ICMT", TAG_COMMENT },
+};
+
+/**
+ * Imports the sub-chunks of a "LIST" chunk of type "INFO".
+ */
+static void
+wav_scan_info(const uint8_t *p, size_t length,
+	      const struct tag_handler *handler, void *handler_ctx)
+{
+	const uint8_t *const end = p + length;
+
+	while (end - p >= 8) {
+		const uint32_t size = read_le32(p + 4);
+		if (size > (size_t)(end - p) - 8)
+			break;
+
+		enum tag_type type =
+			quick_tag_lookup(riff_info_tags,
+					 G_N_ELEMENTS(riff_info_tags), p);
+		if (type != TAG_NUM_OF_ITEM_TYPES) {
+			/* the value is usually null-terminated */
+			char *value = g_strndup((const char *)p + 8, size);
+			if (*value != 0)
+				tag_handler_invoke_tag(handler, handler_ctx,
+						       type, value);
+			g_free(value);
+		}
+
+		p += 8 + size;
+		if (size % 2 != 0 && p < end)
+			/* pad byte */
+			++p;
+	}
+}
+
+static bool
+quick_wav(struct quick_file *qf,
+	  const struct tag_handler *handler, void *handler_ctx)
+{
+	uint8_t header[12];
+	if (!quick_read(qf, 0, header, sizeof(header)) ||
+	    memcmp(header, "RIFF", 4) != 0 ||
+	    memcmp(header + 8, "WAVE", 4) != 0)
+		return false;
+
+	uint32_t byte_rate = 0;
+	uint64_t data_size = 0;
+	bool found_data = false;
+
+	goffset offset = sizeof(header);
+	while (qf->size - offset >= 8) {
+		uint8_t chunk[8];
+		if (!quick_read(qf, offset, chunk, sizeof(chunk)))
+			return false;
+
+		const uint32_t size = read_le32(chunk + 4);
+		offset += sizeof(chunk);
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			uint8_t format[16];
+			if (size < sizeof(format) ||
+			    !quick_read(qf, offset, format, sizeof(format)))
+				return false;
+
+			byte_rate = read_le32(format + 8);
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			/* the size may be bogus if the file was not
+			   finalized by the writer */
+			data_size = MIN((goffset)size, qf->size - offset);
+			found_data = true;
+		} else if (memcmp(chunk, "LIST", 4) == 0 && size >= 4) {
+			uint8_t *list = quick_read_alloc(qf, offset, size);
+			if (list == NULL)
+				return false;
+
+			if (memcmp(list, "INFO", 4) == 0)
+				wav_scan_info(list + 4, size - 4,
+					      handler, handler_ctx);
+			g_free(list);
+		}
+
+		/* chunks are padded to an even size */
+		offset += size + (size % 2);
+	}
+
+	if (!found_data || byte_rate == 0)
+		return false;
+
+	quick_duration(handler, handler_ctx, data_size, byte_rate);
+	return true;
+}
+
+static const struct {
+	const char *suffix;
+
+	bool (*scan)(struct quick_file *qf,
+		     const struct tag_handler *handler, void *handler_ctx);
+} quick_scanners[] = {
+	{ "flac", quick_flac },
+	{ "ogg", quick_ogg },
+	{ "oga", quick_ogg },
+	{ "mp3", quick_mp3 },
+	{ "mp2", quick_mp3 },
+	{ "m4a", quick_mp4 },
+	{ "m4b", quick_mp4 },
+	{ "mp4", quick_mp4 },
+	{ "wav", quick_wav },
+};
+
+bool
+tag_quick_scan(const char *path_fs,
+	       const struct tag_handler *handler, void *handler_ctx)
+{
+	const char *suffix = uri_get_suffix(path_fs);
+	if (suffix == NULL)
+		return false;
+
+	unsigned i = 0;
+	while (g_ascii_strcasecmp(quick_scanners[i].suffix, suffix) != 0)
+		if (++i == G_N_ELEMENTS(quick_scanners))
+			return false;
+
+	int fd = open_cloexec(path_fs, O_RDONLY|O_BINARY, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return false;
+	}
+
+	struct quick_file qf = {
+		.fd = fd,
+		.size = st.st_size,
+		.budget = QUICK_BUDGET,
+	};
+
+	bool success = quick_scanners[i].scan(&qf, handler, handler_ctx);
+	close(fd);
+
+	if (!success)
+		g_debug("falling back to the decoder plugins for %s",
+			path_fs);
+
+	return success;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_TAG_QUICK_H
+#define MPD_TAG_QUICK_H
+
+#include "check.h"
+
+#include <stdbool.h>
+
+struct tag_handler;
+
+/**
+ * Scans the duration, the tags and the position of the embedded
+ * picture of a song file by parsing only its metadata headers,
+ * without the help of a decoder plugin.  Supported are FLAC, Ogg
+ * Vorbis, MP3 (Xing/VBRI/LAME), MP4 and WAV; at most a few
+ * hundred kilobytes are read from each file.
+ *
+ * @param path_fs the path of the file in filesystem encoding
+ * @return true if the duration was determined; false if the format
+ * is not supported or the file could not be parsed (the handler may
+ * have received some tags already), and the caller should fall back
+ * to the decoder plugins
+ */
+bool
+tag_quick_scan(const char *path_fs,
+	       const struct tag_handler *handler, void *handler_ctx);
+
+#endif
@@ -23,6 +23,8 @@
 #include "tag_internal.h"
 #include "song.h"
 
+#include <glib.h>
+
 void tag_save(FILE *file, const struct tag *tag)
 {
 	if (tag->time >= 0)
@@ -31,6 +33,11 @@ void tag_save(FILE *file, const struct tag *tag)
 	if (tag->has_playlist)
 		fprintf(file, "Playlist: yes\n");
 
+	if (tag->picture_size > 0)
+		fprintf(file, "Picture: %" G_GUINT64_FORMAT " %u\n",
+			(guint64)tag->picture_offset,
+			(unsigned)tag->picture_size);
+
 	for (unsigned i = 0; i < tag->num_items; i++)
 		fprintf(file, "%s: %s\n",
 			tag_item_names[tag->items[i]->type],
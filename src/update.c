@@ -22,6 +22,9 @@
 #include "update_remove.h"
 #include "update.h"
 #include "database.h"
+#include "tag_cache.h"
+#include "directory.h"
+#include "conf.h"
 #include "mapper.h"
 #include "playlist.h"
 #include "event_pipe.h"
@@ -67,7 +70,11 @@ static void * update_task(void *_path)
 	else
 		g_debug("starting");
 
-	modified = update_walk(path, discard);
+	const bool full = path == NULL || isRootDirectory(path);
+	tag_cache_begin_update(full, discard);
+
+	bool walked_root;
+	modified = update_walk(path, discard, &walked_root);
 
 	if (modified || !db_exists()) {
 		GError *error = NULL;
@@ -78,6 +85,12 @@ static void * update_task(void *_path)
 		}
 	}
 
+	GError *error = NULL;
+	if (!tag_cache_save(full && walked_root, &error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
+
 	if (path != NULL && *path != 0)
 		g_debug("finished: %s", path);
 	else
@@ -170,10 +183,19 @@ void update_global_init(void)
 
 	update_remove_global_init();
 	update_walk_global_init();
+
+	GError *error = NULL;
+	char *tag_cache_file = config_dup_path(CONF_TAG_CACHE_FILE, &error);
+	if (tag_cache_file == NULL && error != NULL)
+		MPD_ERROR("%s", error->message);
+
+	tag_cache_global_init(tag_cache_file);
+	g_free(tag_cache_file);
 }
 
 void update_global_finish(void)
 {
+	tag_cache_global_finish();
 	update_walk_global_finish();
 	update_remove_global_finish();
 }
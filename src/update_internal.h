@@ -43,8 +43,11 @@ update_walk_global_finish(void);
 
 /**
  * Returns true if the database was modified.
+ *
+ * @param walked_root_r set to true if the music directory itself
+ * has been read, i.e. a full update has seen all files
  */
 bool
-update_walk(const char *path, bool discard);
+update_walk(const char *path, bool discard, bool *walked_root_r);
 
 #endif
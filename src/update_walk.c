@@ -36,6 +36,7 @@
 #include "conf.h"
 #include "tag.h"
 #include "tag_handler.h"
+#include "tag_cache.h"
 
 #ifdef ENABLE_ARCHIVE
 #include "archive_list.h"
@@ -446,7 +447,9 @@ update_song_file(struct directory *directory,
 		}
 
 		modified = true;
-	}
+	} else
+		/* unmodified: keep its tag cache entry */
+		tag_cache_touch(st);
 }
 
 static void
@@ -737,10 +740,11 @@ updatePath(const char *path)
 }
 
 bool
-update_walk(const char *path, bool discard)
+update_walk(const char *path, bool discard, bool *walked_root_r)
 {
 	walk_discard = discard;
 	modified = false;
+	*walked_root_r = false;
 
 	if (path != NULL && !isRootDirectory(path)) {
 		updatePath(path);
@@ -749,7 +753,7 @@ update_walk(const char *path, bool discard)
 		struct stat st;
 
 		if (stat_directory(directory, &st) == 0)
-			updateDirectory(directory, &st);
+			*walked_root_r = updateDirectory(directory, &st);
 	}
 
 	return modified;
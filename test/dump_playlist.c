@@ -83,6 +83,17 @@ decoder_read(G_GNUC_UNUSED struct decoder *decoder,
 	return input_stream_lock_read(is, buffer, length, NULL);
 }
 
+const void *
+decoder_read_direct(G_GNUC_UNUSED struct decoder *decoder,
+		    struct input_stream *is,
+		    size_t length, size_t *length_r)
+{
+	input_stream_lock(is);
+	const void *data = input_stream_read_direct(is, length, length_r);
+	input_stream_unlock(is);
+	return data;
+}
+
 void
 decoder_timestamp(G_GNUC_UNUSED struct decoder *decoder,
 		  G_GNUC_UNUSED double t)
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * This program connects many listeners to a stream provided by the
+ * "httpd" output plugin, and reports the throughput.  If the process
+ * id of MPD is given, it also reports MPD's CPU usage per listener.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct listener {
+	int fd;
+
+	/** bytes received since the last report */
+	size_t bytes;
+};
+
+static int
+listener_connect(const struct addrinfo *ai)
+{
+	static const char request[] = "GET / HTTP/1.0\r\n\r\n";
+
+	int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0 ||
+	    write(fd, request, sizeof(request) - 1) !=
+	    (ssize_t)sizeof(request) - 1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Returns the CPU time (user + system) consumed by the specified
+ * process in clock ticks, or -1 on error.
+ */
+static long
+process_cpu_ticks(long pid)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
+
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+
+	char buffer[1024];
+	size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+	fclose(file);
+	buffer[length] = 0;
+
+	/* skip "pid (comm)", which may contain spaces */
+	const char *p = strrchr(buffer, ')');
+	unsigned long utime, stime;
+	if (p == NULL ||
+	    sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+		   &utime, &stime) != 2)
+		return -1;
+
+	return (long)(utime + stime);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 4 || argc > 6) {
+		g_printerr("Usage: run_httpd_load HOST PORT N [SECONDS] [PID]\n");
+		return EXIT_FAILURE;
+	}
+
+	const char *host = argv[1], *port = argv[2];
+	unsigned n = strtoul(argv[3], NULL, 10);
+	unsigned duration = argc > 4 ? strtoul(argv[4], NULL, 10) : 10;
+	long pid = argc > 5 ? strtol(argv[5], NULL, 10) : 0;
+
+	if (n == 0 || duration == 0) {
+		g_printerr("Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	struct addrinfo *ai;
+	int ret = getaddrinfo(host, port, &hints, &ai);
+	if (ret != 0) {
+		g_printerr("Failed to resolve %s: %s\n",
+			   host, gai_strerror(ret));
+		return EXIT_FAILURE;
+	}
+
+	struct listener *listeners = g_new(struct listener, n);
+	struct pollfd *pfds = g_new(struct pollfd, n);
+
+	for (unsigned i = 0; i < n; ++i) {
+		listeners[i].fd = listener_connect(ai);
+		listeners[i].bytes = 0;
+		if (listeners[i].fd < 0) {
+			g_printerr("Failed to connect listener %u\n", i);
+			freeaddrinfo(ai);
+			return EXIT_FAILURE;
+		}
+
+		pfds[i].fd = listeners[i].fd;
+		pfds[i].events = POLLIN;
+	}
+
+	freeaddrinfo(ai);
+
+	const long ticks_per_second = sysconf(_SC_CLK_TCK);
+	long last_ticks = pid > 0 ? process_cpu_ticks(pid) : -1;
+	GTimer *timer = g_timer_new();
+	double last_report = 0;
+	unsigned alive = n;
+
+	while (alive > 0 && last_report < duration) {
+		if (poll(pfds, n, 1000) < 0)
+			break;
+
+		for (unsigned i = 0; i < n; ++i) {
+			if (pfds[i].revents == 0)
+				continue;
+
+			char buffer[16384];
+			ssize_t nbytes = read(pfds[i].fd, buffer,
+					      sizeof(buffer));
+			if (nbytes <= 0) {
+				g_printerr("listener %u disconnected\n", i);
+				close(pfds[i].fd);
+				pfds[i].fd = -1;
+				--alive;
+				continue;
+			}
+
+			listeners[i].bytes += nbytes;
+		}
+
+		const double now = g_timer_elapsed(timer, NULL);
+		if (now - last_report < 1.0)
+			continue;
+
+		size_t total = 0, min = (size_t)-1;
+		for (unsigned i = 0; i < n; ++i) {
+			if (pfds[i].fd < 0)
+				continue;
+
+			total += listeners[i].bytes;
+			if (listeners[i].bytes < min)
+				min = listeners[i].bytes;
+			listeners[i].bytes = 0;
+		}
+
+		const double elapsed = now - last_report;
+		g_print("listeners=%u total=%.0f kB/s min=%.1f kB/s",
+			alive, total / elapsed / 1024,
+			alive > 0 ? min / elapsed / 1024 : 0.);
+
+		if (last_ticks >= 0) {
+			long ticks = process_cpu_ticks(pid);
+			double cpu = (double)(ticks - last_ticks) /
+				ticks_per_second / elapsed;
+			g_print(" cpu=%.1f%% cpu_per_listener=%.3f%%",
+				cpu * 100, alive > 0 ? cpu * 100 / alive : 0.);
+			last_ticks = ticks;
+		}
+
+		g_print("\n");
+		last_report = now;
+	}
+
+	for (unsigned i = 0; i < n; ++i)
+		if (pfds[i].fd >= 0)
+			close(pfds[i].fd);
+
+	g_timer_destroy(timer);
+	g_free(pfds);
+	g_free(listeners);
+	return EXIT_SUCCESS;
+}
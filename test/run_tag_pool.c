@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * This program measures the throughput of the tag pool: each thread
+ * interns, duplicates and releases tag values in a loop, like the
+ * database update and the playlist do.  Most values are drawn from a
+ * small set of popular ones (genres, "Various Artists"), the rest
+ * are unique.
+ */
+
+#include "config.h"
+#include "tag_pool.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** the number of distinct "popular" values */
+static const unsigned NUM_POPULAR = 64;
+
+/** how many items does each thread hold at a time? */
+#define WINDOW 256
+
+static unsigned num_iterations;
+
+static gpointer
+bench_thread(gpointer data)
+{
+	const unsigned id = GPOINTER_TO_UINT(data);
+	struct tag_item *window[WINDOW] = { NULL };
+	GRand *rand = g_rand_new_with_seed(id);
+	char value[64];
+
+	for (unsigned i = 0; i < num_iterations; ++i) {
+		unsigned n = g_rand_int_range(rand, 0, 4) == 0
+			? (unsigned)snprintf(value, sizeof(value),
+					     "unique %u/%u", id, i)
+			: (unsigned)snprintf(value, sizeof(value),
+					     "popular %u",
+					     g_rand_int_range(rand, 0,
+							      NUM_POPULAR));
+
+		struct tag_item *item =
+			tag_pool_get_item(TAG_GENRE, value, n);
+		struct tag_item *dup = tag_pool_dup_item(item);
+		tag_pool_put_item(item);
+
+		struct tag_item **slot = &window[i % WINDOW];
+		if (*slot != NULL)
+			tag_pool_put_item(*slot);
+		*slot = dup;
+	}
+
+	for (unsigned i = 0; i < WINDOW; ++i)
+		if (window[i] != NULL)
+			tag_pool_put_item(window[i]);
+
+	g_rand_free(rand);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 3) {
+		g_printerr("Usage: run_tag_pool [THREADS [ITERATIONS]]\n");
+		return EXIT_FAILURE;
+	}
+
+	const unsigned num_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : 4;
+	num_iterations = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+	if (num_threads == 0 || num_threads > 256) {
+		g_printerr("Invalid number of threads\n");
+		return EXIT_FAILURE;
+	}
+
+	g_thread_init(NULL);
+	tag_pool_init();
+
+	GThread *threads[num_threads];
+	GTimer *timer = g_timer_new();
+
+	for (unsigned i = 0; i < num_threads; ++i) {
+		GError *error = NULL;
+		threads[i] = g_thread_create(bench_thread,
+					     GUINT_TO_POINTER(i), true,
+					     &error);
+		if (threads[i] == NULL) {
+			g_printerr("Failed to create thread: %s\n",
+				   error->message);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (unsigned i = 0; i < num_threads; ++i)
+		g_thread_join(threads[i]);
+
+	const double elapsed = g_timer_elapsed(timer, NULL);
+	const double total = (double)num_threads * num_iterations;
+	g_print("threads=%u iterations=%u time=%.3fs %.0f intern/s\n",
+		num_threads, num_iterations, elapsed, total / elapsed);
+
+	g_timer_destroy(timer);
+	tag_pool_deinit();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Round-trips PCM data through the parallel mode of the FLAC
+ * encoder and verifies the samples decoded by libFLAC.
+ */
+
+#include "config.h"
+#include "encoder_list.h"
+#include "encoder_plugin.h"
+#include "audio_format.h"
+#include "conf.h"
+
+#include <FLAC/stream_decoder.h>
+
+#include <glib.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Enough frames for several jobs per worker thread, plus a short
+ * last job.
+ */
+#define NUM_FRAMES (6 * 4096 * 16 + 1234)
+
+struct decode_state {
+	const GByteArray *input;
+	size_t position;
+
+	const int32_t *expected;
+	unsigned channels, bits;
+
+	unsigned num_frames;
+};
+
+/**
+ * Generates a deterministic, not too compressible signal.
+ */
+static int32_t
+generate_sample(unsigned i, unsigned channel, unsigned bits)
+{
+	uint32_t x = (i * 2654435761u) ^ (channel * 40503u);
+	x ^= x >> 13;
+
+	/* mix a ramp with noise, so both the LPC and the verbatim
+	   subframe paths are exercised */
+	int32_t value = (int32_t)((i % 512) << 6) - 16384
+		+ (int32_t)(x & 0xff) - 128;
+
+	/* scale the 16 bit value to the sample format */
+	if (bits > 16)
+		value *= 1 << (bits - 16);
+	else if (bits < 16)
+		value /= 1 << (16 - bits);
+
+	return value;
+}
+
+static FLAC__StreamDecoderReadStatus
+decode_read(G_GNUC_UNUSED const FLAC__StreamDecoder *decoder,
+	    FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	struct decode_state *state = client_data;
+	size_t remaining = state->input->len - state->position;
+
+	if (remaining == 0) {
+		*bytes = 0;
+		return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+	}
+
+	if (*bytes > remaining)
+		*bytes = remaining;
+
+	memcpy(buffer, state->input->data + state->position, *bytes);
+	state->position += *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+static FLAC__StreamDecoderWriteStatus
+decode_write(G_GNUC_UNUSED const FLAC__StreamDecoder *decoder,
+	     const FLAC__Frame *frame, const FLAC__int32 *const buffer[],
+	     void *client_data)
+{
+	struct decode_state *state = client_data;
+
+	assert(frame->header.channels == state->channels);
+	assert(frame->header.bits_per_sample == state->bits);
+	assert(frame->header.number_type ==
+	       FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
+	assert(frame->header.number.sample_number == state->num_frames);
+	assert(state->num_frames + frame->header.blocksize <= NUM_FRAMES);
+
+	for (unsigned i = 0; i < frame->header.blocksize; ++i) {
+		const unsigned n = state->num_frames + i;
+
+		for (unsigned c = 0; c < state->channels; ++c)
+			assert(buffer[c][i] ==
+			       state->expected[n * state->channels + c]);
+	}
+
+	state->num_frames += frame->header.blocksize;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void
+decode_metadata(G_GNUC_UNUSED const FLAC__StreamDecoder *decoder,
+		const FLAC__StreamMetadata *metadata, void *client_data)
+{
+	const struct decode_state *state = client_data;
+
+	if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO)
+		return;
+
+	assert(metadata->data.stream_info.channels == state->channels);
+	assert(metadata->data.stream_info.bits_per_sample == state->bits);
+	assert(metadata->data.stream_info.sample_rate == 44100);
+}
+
+static void
+decode_error(G_GNUC_UNUSED const FLAC__StreamDecoder *decoder,
+	     FLAC__StreamDecoderErrorStatus status,
+	     G_GNUC_UNUSED void *client_data)
+{
+	g_printerr("FLAC decoder error: %s\n",
+		   FLAC__StreamDecoderErrorStatusString[status]);
+	assert(false);
+}
+
+static void
+read_output(struct encoder *encoder, GByteArray *output)
+{
+	static char buffer[16384];
+	size_t length;
+
+	while ((length = encoder_read(encoder, buffer, sizeof(buffer))) > 0)
+		g_byte_array_append(output, (const guint8 *)buffer, length);
+}
+
+static void
+test_round_trip(const struct encoder_plugin *plugin,
+		enum sample_format format, unsigned bits, unsigned channels)
+{
+	struct config_param *param = config_new_param(NULL, -1);
+	config_add_block_param(param, "threads", "3", -1);
+
+	GError *error = NULL;
+	struct encoder *encoder = encoder_init(plugin, param, &error);
+	if (encoder == NULL) {
+		/* libFLAC is too old for the parallel mode: skip */
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		exit(77);
+	}
+
+	struct audio_format audio_format;
+	audio_format_init(&audio_format, 44100, format, channels);
+
+	bool success = encoder_open(encoder, &audio_format, &error);
+	assert(success);
+	assert(audio_format.format == format);
+
+	/* generate the input in MPD's sample format, and the expected
+	   output in libFLAC's format */
+
+	const unsigned num_samples = NUM_FRAMES * channels;
+	int32_t *expected = g_new(int32_t, num_samples);
+	const size_t sample_size = audio_format_sample_size(&audio_format);
+	guint8 *input = g_malloc(num_samples * sample_size);
+
+	for (unsigned i = 0; i < NUM_FRAMES; ++i) {
+		for (unsigned c = 0; c < channels; ++c) {
+			const unsigned n = i * channels + c;
+			const int32_t value = generate_sample(i, c, bits);
+
+			expected[n] = value;
+
+			if (sample_size == 1)
+				((int8_t *)input)[n] = value;
+			else if (sample_size == 2)
+				((int16_t *)input)[n] = value;
+			else
+				((int32_t *)input)[n] = value;
+		}
+	}
+
+	/* feed odd-sized chunks, so jobs are filled across several
+	   write() calls */
+
+	GByteArray *output = g_byte_array_new();
+	const size_t frame_size = audio_format_frame_size(&audio_format);
+	const size_t total = NUM_FRAMES * frame_size;
+
+	for (size_t position = 0; position < total;) {
+		size_t length = 1021 * frame_size;
+		if (length > total - position)
+			length = total - position;
+
+		success = encoder_write(encoder, input + position, length,
+					&error);
+		assert(success);
+		position += length;
+
+		read_output(encoder, output);
+	}
+
+	success = encoder_flush(encoder, &error);
+	assert(success);
+	read_output(encoder, output);
+
+	encoder_close(encoder);
+	encoder_finish(encoder);
+	config_param_free(param);
+
+	/* decode and compare */
+
+	struct decode_state state = {
+		.input = output,
+		.position = 0,
+		.expected = expected,
+		.channels = channels,
+		.bits = bits,
+		.num_frames = 0,
+	};
+
+	FLAC__StreamDecoder *decoder = FLAC__stream_decoder_new();
+	assert(decoder != NULL);
+
+	FLAC__StreamDecoderInitStatus init_status =
+		FLAC__stream_decoder_init_stream(decoder, decode_read,
+						 NULL, NULL, NULL, NULL,
+						 decode_write,
+						 decode_metadata,
+						 decode_error, &state);
+	assert(init_status == FLAC__STREAM_DECODER_INIT_STATUS_OK);
+
+	success = FLAC__stream_decoder_process_until_end_of_stream(decoder);
+	assert(success);
+	assert(state.num_frames == NUM_FRAMES);
+
+	FLAC__stream_decoder_finish(decoder);
+	FLAC__stream_decoder_delete(decoder);
+
+	g_byte_array_free(output, true);
+	g_free(input);
+	g_free(expected);
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	g_thread_init(NULL);
+
+	const struct encoder_plugin *plugin = encoder_plugin_get("flac");
+	assert(plugin != NULL);
+
+	test_round_trip(plugin, SAMPLE_FORMAT_S16, 16, 1);
+	test_round_trip(plugin, SAMPLE_FORMAT_S24_P32, 24, 2);
+	test_round_trip(plugin, SAMPLE_FORMAT_S24_P32, 24, 1);
+	test_round_trip(plugin, SAMPLE_FORMAT_S8, 8, 2);
+
+	return 0;
+}
@@ -0,0 +1,15 @@
+#!/bin/sh -e
+
+DST="$(pwd)/test/tmp/silence.opus"
+
+mkdir -p test/tmp
+rm -f "$DST"
+
+# one second of stereo silence, 20 ms frames
+head -c 192000 /dev/zero |./test/run_encoder opus 48000:16:2 >"$DST"
+
+# the first page must contain only the "OpusHead" packet, the second
+# one must begin with "OpusTags"
+test "$(dd if="$DST" bs=1 skip=28 count=8 2>/dev/null)" = OpusHead
+test "$(dd if="$DST" bs=1 skip=47 count=4 2>/dev/null)" = OggS
+test "$(dd if="$DST" bs=1 skip=75 count=8 2>/dev/null)" = OpusTags
@@ -0,0 +1,128 @@
+#include "queue.h"
+#include "song.h"
+
+void
+song_free(G_GNUC_UNUSED struct song *song)
+{
+}
+
+char *
+song_get_uri(const struct song *song)
+{
+	return g_strdup_printf("%p", (const void *)song);
+}
+
+/**
+ * Verify that the change history finds exactly the same items as a
+ * full scan of the queue.
+ */
+static void
+check_changes(const struct queue *queue, uint32_t version)
+{
+	struct queue_change ranges[QUEUE_HISTORY_LENGTH];
+	int n = queue_get_changes(queue, version, ranges);
+	if (n < 0)
+		/* history too short; the caller falls back to a full
+		   scan */
+		return;
+
+	unsigned found = 0;
+	for (int r = 0; r < n; ++r) {
+		assert(ranges[r].start < ranges[r].end);
+		assert(ranges[r].end <= queue_length(queue));
+		assert(r == 0 || ranges[r - 1].end < ranges[r].start);
+
+		for (unsigned i = ranges[r].start; i < ranges[r].end; ++i)
+			if (queue_song_newer(queue, i, version))
+				++found;
+	}
+
+	unsigned expected = 0;
+	for (unsigned i = 0; i < queue_length(queue); ++i)
+		if (queue_song_newer(queue, i, version))
+			++expected;
+
+	assert(found == expected);
+	(void)found;
+	(void)expected;
+}
+
+static void
+check_all_changes(const struct queue *queue)
+{
+	for (uint32_t version = 0; version <= queue->version; ++version)
+		check_changes(queue, version);
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	static struct song songs[16];
+
+	struct queue queue;
+	queue_init(&queue, 32);
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(songs); ++i) {
+		queue_append(&queue, &songs[i]);
+		queue_increment_version(&queue);
+	}
+
+	check_all_changes(&queue);
+
+	/* nothing has changed since the current version */
+
+	struct queue_change ranges[QUEUE_HISTORY_LENGTH];
+	assert(queue_get_changes(&queue, queue.version, ranges) == 0);
+
+	queue_move(&queue, 2, 5);
+	queue_increment_version(&queue);
+	check_all_changes(&queue);
+
+	queue_move_range(&queue, 8, 11, 1);
+	queue_increment_version(&queue);
+	check_all_changes(&queue);
+
+	queue_move_range(&queue, 0, 2, 10);
+	queue_increment_version(&queue);
+	check_all_changes(&queue);
+
+	queue_swap(&queue, 3, 12);
+	queue_increment_version(&queue);
+	check_all_changes(&queue);
+
+	queue_delete(&queue, 14);
+	queue_delete(&queue, 6);
+	queue_increment_version(&queue);
+	check_all_changes(&queue);
+
+	queue_set_priority(&queue, 7, 10, -1);
+	queue_increment_version(&queue);
+	check_all_changes(&queue);
+
+	queue_shuffle_range(&queue, 2, 9);
+	queue_increment_version(&queue);
+	check_all_changes(&queue);
+
+	/* overflow the history ring; old versions must be rejected */
+
+	for (unsigned i = 0; i < QUEUE_HISTORY_LENGTH * 2; ++i)
+		queue_modify(&queue, i % queue_length(&queue));
+
+	assert(queue_get_changes(&queue, 1, ranges) < 0);
+	check_all_changes(&queue);
+
+	/* after "clear", the history is complete again */
+
+	queue_clear(&queue);
+	queue_increment_version(&queue);
+
+	for (unsigned i = 0; i < 4; ++i)
+		queue_append(&queue, &songs[i]);
+	queue_increment_version(&queue);
+
+	assert(queue_get_changes(&queue, 1, ranges) == 1);
+	assert(ranges[0].start == 0 && ranges[0].end == 4);
+	check_all_changes(&queue);
+
+	queue_finish(&queue);
+}
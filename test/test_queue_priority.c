@@ -6,6 +6,12 @@ song_free(G_GNUC_UNUSED struct song *song)
 {
 }
 
+char *
+song_get_uri(const struct song *song)
+{
+	return g_strdup_printf("%p", (const void *)song);
+}
+
 G_GNUC_UNUSED
 static void
 dump_order(const struct queue *queue)
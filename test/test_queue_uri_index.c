@@ -0,0 +1,98 @@
+#include "queue.h"
+#include "song.h"
+
+#include <string.h>
+
+static struct song songs[16];
+
+void
+song_free(G_GNUC_UNUSED struct song *song)
+{
+}
+
+/**
+ * Songs with the same index modulo 4 share the same URI.
+ */
+char *
+song_get_uri(const struct song *song)
+{
+	return g_strdup_printf("%u", (unsigned)(song - songs) % 4);
+}
+
+/**
+ * Verify that the URI index lists exactly the items which a full
+ * scan of the queue finds.
+ */
+static void
+check_uri(const struct queue *queue, const char *uri)
+{
+	const GSList *ids = queue_lookup_uri(queue, uri);
+	unsigned n = 0;
+
+	for (unsigned i = 0; i < queue_length(queue); ++i) {
+		char *p = song_get_uri(queue_get(queue, i));
+		if (strcmp(p, uri) == 0) {
+			const unsigned id = queue_position_to_id(queue, i);
+			assert(g_slist_find((GSList *)ids,
+					    GUINT_TO_POINTER(id)) != NULL);
+			++n;
+		}
+
+		g_free(p);
+	}
+
+	assert(g_slist_length((GSList *)ids) == n);
+}
+
+static void
+check_all_uris(const struct queue *queue)
+{
+	check_uri(queue, "0");
+	check_uri(queue, "1");
+	check_uri(queue, "2");
+	check_uri(queue, "3");
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	struct queue queue;
+	queue_init(&queue, 32);
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(songs); ++i)
+		queue_append(&queue, &songs[i]);
+
+	assert(g_slist_length((GSList *)queue_lookup_uri(&queue, "1")) == 4);
+	assert(queue_lookup_uri(&queue, "4") == NULL);
+	check_all_uris(&queue);
+
+	/* moving songs does not affect the index */
+
+	queue_move(&queue, 1, 10);
+	queue_move_range(&queue, 2, 5, 8);
+	queue_swap(&queue, 0, 15);
+	check_all_uris(&queue);
+
+	/* delete all songs with URI "2" */
+
+	for (unsigned i = queue_length(&queue); i-- > 0;) {
+		char *uri = song_get_uri(queue_get(&queue, i));
+		if (strcmp(uri, "2") == 0)
+			queue_delete(&queue, i);
+		g_free(uri);
+	}
+
+	assert(queue_lookup_uri(&queue, "2") == NULL);
+	check_all_uris(&queue);
+
+	queue_delete(&queue, 0);
+	check_all_uris(&queue);
+
+	queue_clear(&queue);
+	assert(queue_lookup_uri(&queue, "0") == NULL);
+
+	queue_append(&queue, &songs[3]);
+	check_all_uris(&queue);
+
+	queue_finish(&queue);
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Parses filter expressions and evaluates them against a few
+ * hand-made songs.
+ */
+
+#include "config.h"
+#include "song_filter.h"
+#include "locate.h"
+#include "song.h"
+#include "tag.h"
+#include "tag_pool.h"
+#include "ack.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+int
+locate_parse_type(const char *str)
+{
+	if (g_ascii_strcasecmp(str, "file") == 0)
+		return LOCATE_TAG_FILE_TYPE;
+
+	if (g_ascii_strcasecmp(str, "any") == 0)
+		return LOCATE_TAG_ANY_TYPE;
+
+	enum tag_type type = tag_name_parse_i(str);
+	return type != TAG_NUM_OF_ITEM_TYPES ? (int)type : -1;
+}
+
+#ifdef ENABLE_SQLITE
+GHashTable *
+locate_load_stickers(G_GNUC_UNUSED const char *name)
+{
+	/* no sticker database */
+	return NULL;
+}
+#endif
+
+char *
+song_get_uri(const struct song *song)
+{
+	return g_strdup(song->uri);
+}
+
+static struct song *
+make_song(const char *uri, const char *artist, const char *album,
+	  const char *title)
+{
+	struct song *song = g_malloc0(sizeof(*song) + strlen(uri));
+	strcpy(song->uri, uri);
+
+	if (artist != NULL) {
+		song->tag = tag_new();
+		tag_add_item(song->tag, TAG_ARTIST, artist);
+		tag_add_item(song->tag, TAG_ALBUM, album);
+		tag_add_item(song->tag, TAG_TITLE, title);
+	}
+
+	return song;
+}
+
+static void
+free_song(struct song *song)
+{
+	if (song->tag != NULL)
+		tag_free(song->tag);
+	g_free(song);
+}
+
+static struct song *miles, *purple, *untagged;
+
+/**
+ * Parses the expression and checks the result for each of the three
+ * songs.
+ */
+static void
+check_match(const char *expression, bool fold_case,
+	    bool expect_miles, bool expect_purple, bool expect_untagged)
+{
+	GError *error = NULL;
+	struct song_filter *filter = song_filter_parse(expression, &error);
+	if (filter == NULL) {
+		g_printerr("%s: %s\n", expression, error->message);
+		g_error_free(error);
+	}
+	g_assert(filter != NULL);
+
+	bool result = song_filter_match(filter, miles, fold_case);
+	g_assert(result == expect_miles);
+	result = song_filter_match(filter, purple, fold_case);
+	g_assert(result == expect_purple);
+	result = song_filter_match(filter, untagged, fold_case);
+	g_assert(result == expect_untagged);
+
+	song_filter_unref(filter);
+}
+
+/**
+ * Verifies that the expression is rejected with #ACK_ERROR_ARG, and
+ * that the message starts with the given prefix.
+ */
+static void
+check_error(const char *expression, const char *prefix)
+{
+	GError *error = NULL;
+	struct song_filter *filter = song_filter_parse(expression, &error);
+	g_assert(filter == NULL);
+	g_assert(error != NULL);
+	g_assert(error->domain == ack_quark());
+	g_assert(error->code == ACK_ERROR_ARG);
+
+	if (!g_str_has_prefix(error->message, prefix)) {
+		g_printerr("%s: '%s' does not start with '%s'\n",
+			   expression, error->message, prefix);
+		g_assert(false);
+	}
+
+	g_error_free(error);
+}
+
+static void
+test_leaf(void)
+{
+	check_match("(artist == 'Miles Davis')", false, true, false, false);
+	check_match("  ( Artist=='Miles Davis' )  ", false, true, false, false);
+
+	/* a missing tag is an empty value */
+	check_match("(artist != 'Miles Davis')", false, false, true, true);
+	check_match("(artist == '')", false, false, false, true);
+
+	check_match("(album contains 'of')", false, true, false, false);
+	check_match("(title starts_with 'Smoke')", false, false, true, false);
+	check_match("(file starts_with 'jazz/')", false, true, false, false);
+	check_match("(any contains 'Purple')", false, false, true, false);
+	check_match("(any contains 'misc')", false, false, false, true);
+
+	check_match("(artist == 'miles davis')", false, false, false, false);
+	check_match("(artist == 'miles davis')", true, true, false, false);
+	check_match("(album contains 'BLUE')", true, true, false, false);
+}
+
+static void
+test_quoting(void)
+{
+	check_match("(title == \"So What\")", false, true, false, false);
+	check_match("(title == 'Smoke on the \"Water\"')", false,
+		    false, true, false);
+	check_match("(title == \"Smoke on the \\\"Water\\\"\")", false,
+		    false, true, false);
+	check_match("(album == 'Live \\'n\\' Loud')", false,
+		    false, true, false);
+	check_match("(file == 'misc\\\\untagged.mp3')", false,
+		    false, false, true);
+
+	/* operators and AND/OR are literal inside quotes */
+	check_match("(title contains ') AND (')", false, false, false, false);
+
+	check_error("(artist == Miles)", "Quoted value expected");
+	check_error("(artist == 'Miles)", "Closing quote not found");
+	check_error("(artist == 'Miles\\", "Closing quote not found");
+}
+
+static void
+test_boolean(void)
+{
+	check_match("((artist == 'Miles Davis') AND (album == 'Kind of Blue'))",
+		    false, true, false, false);
+	check_match("((artist == 'Miles Davis') AND (album == 'Nope'))",
+		    false, false, false, false);
+	check_match("((artist == 'Miles Davis') OR (artist == 'Deep Purple'))",
+		    false, true, true, false);
+	check_match("((artist == 'x') OR (artist == 'y') OR (file contains 'u'))",
+		    false, false, false, true);
+	check_match("((artist != '') AND (album != '') AND (title contains 'So'))",
+		    false, true, false, false);
+
+	/* explicit precedence */
+	check_match("(((artist == 'Deep Purple') AND (album == 'Nope'))"
+		    " OR (title == 'So What'))",
+		    false, true, false, false);
+	check_match("((artist == 'Deep Purple') AND"
+		    " ((album == 'Nope') OR (title starts_with 'Smoke')))",
+		    false, false, true, false);
+
+	/* redundant parentheses */
+	check_match("(((artist == 'Miles Davis')))", false, true, false, false);
+	check_match("(((artist == 'Miles Davis')) OR ((file contains 'misc')))",
+		    false, true, false, true);
+
+	/* there is no implicit precedence: mixing AND and OR without
+	   parentheses is an error */
+	check_error("((artist == 'x') AND (album == 'y') OR (title == 'z'))",
+		    "'AND' or ')' expected");
+	check_error("((artist == 'x') OR (album == 'y') AND (title == 'z'))",
+		    "'OR' or ')' expected");
+	check_error("((artist == 'x') XOR (album == 'y'))",
+		    "'AND' or 'OR' expected");
+	check_error("((artist == 'x') and (album == 'y'))",
+		    "'AND' or 'OR' expected");
+	check_error("((artist == 'x') AND)", "'(' expected");
+}
+
+static void
+test_not(void)
+{
+	check_match("(!(artist == 'Miles Davis'))", false, false, true, true);
+	check_match("( ! (artist == 'Miles Davis') )", false, false, true, true);
+	check_match("(!(!(artist == 'Miles Davis')))", false, true, false, false);
+	check_match("(!((artist == 'Miles Davis') OR (artist == 'Deep Purple')))",
+		    false, false, false, true);
+	check_match("((!(artist == 'Miles Davis')) AND (file contains 'rock'))",
+		    false, false, true, false);
+
+	/* "!=" is an operator, not a negated expression */
+	check_match("(!(artist != 'Miles Davis'))", false, true, false, false);
+
+	check_error("(!)", "'(' expected");
+	check_error("(!artist == 'x')", "'(' expected");
+	check_error("(!(artist == 'x') AND (album == 'y'))", "')' expected");
+}
+
+static void
+test_regex(void)
+{
+#if GLIB_CHECK_VERSION(2,14,0)
+	check_match("(title =~ '^So ')", false, true, false, false);
+	check_match("(title =~ '^so ')", false, false, false, false);
+	check_match("(title =~ '^so ')", true, true, false, false);
+	check_match("(title !~ '^So ')", false, false, true, true);
+	check_match("(file =~ '\\\\.(flac|ogg)$')", false, true, true, false);
+
+	check_error("(title =~ '(')", "Invalid regular expression: ");
+	check_error("(title !~ '[a-')", "Invalid regular expression: ");
+#else
+	check_error("(title =~ 'x')", "Regular expressions not supported");
+#endif
+}
+
+static void
+test_syntax_errors(void)
+{
+	check_error("", "'(' expected");
+	check_error("artist == 'x'", "'(' expected");
+	check_error("()", "Tag name expected");
+	check_error("(artist)", "Operator expected");
+	check_error("(artist == 'x'", "')' expected");
+	check_error("(artist == 'x' 'y')", "')' expected");
+	check_error("(artist == 'x'))", "Unparsed garbage");
+	check_error("(artist == 'x') (album == 'y')", "Unparsed garbage");
+	check_error("(nosuchtag == 'x')", "Unknown tag: nosuchtag");
+	check_error("(artist ~= 'x')", "Operator expected");
+	check_error("(artist equals 'x')", "Unknown operator: equals");
+	check_error("(sticker:rating == '5')", "Sticker database not available");
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	g_thread_init(NULL);
+	tag_pool_init();
+
+	miles = make_song("jazz/so_what.flac", "Miles Davis", "Kind of Blue",
+			  "So What");
+	purple = make_song("rock/smoke.ogg", "Deep Purple", "Live 'n' Loud",
+			   "Smoke on the \"Water\"");
+	untagged = make_song("misc\\untagged.mp3", NULL, NULL, NULL);
+
+	test_leaf();
+	test_quoting();
+	test_boolean();
+	test_not();
+	test_regex();
+	test_syntax_errors();
+
+	free_song(miles);
+	free_song(purple);
+	free_song(untagged);
+
+	tag_pool_deinit();
+
+	return 0;
+}
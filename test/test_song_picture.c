@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Reads pictures embedded in a fake song file in "readpicture"
+ * chunks, with and without the picture cache.
+ */
+
+#include "config.h"
+#include "song_picture.h"
+#include "song.h"
+#include "tag.h"
+#include "mapper.h"
+#include "ack.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+/** the size of a "readpicture" chunk */
+#define CHUNK_SIZE 8192
+
+/** the number of bytes before the picture within the song file */
+#define PICTURE_OFFSET 1000
+
+#define PICTURE_SIZE (3 * CHUNK_SIZE + 123)
+
+static char *test_directory;
+
+char *
+song_get_uri(const struct song *song)
+{
+	return g_strdup(song->uri);
+}
+
+char *
+map_song_fs(const struct song *song)
+{
+	return g_build_filename(test_directory, song->uri, NULL);
+}
+
+static uint8_t
+picture_byte(size_t i)
+{
+	return (uint8_t)(i * 7 + (i >> 8));
+}
+
+/**
+ * Creates a song file with an embedded picture, and a song object
+ * which describes it like the database update would.
+ *
+ * @param magic the first bytes of the picture (the image format)
+ */
+static struct song *
+make_song(const char *name, const char *magic)
+{
+	uint8_t *data = g_malloc(PICTURE_OFFSET + PICTURE_SIZE + 100);
+	memset(data, 0xaa, PICTURE_OFFSET + PICTURE_SIZE + 100);
+
+	for (size_t i = 0; i < PICTURE_SIZE; ++i)
+		data[PICTURE_OFFSET + i] = picture_byte(i);
+	memcpy(data + PICTURE_OFFSET, magic, strlen(magic));
+
+	char *path = g_build_filename(test_directory, name, NULL);
+	FILE *file = fopen(path, "wb");
+	g_assert(file != NULL);
+	size_t nbytes = fwrite(data, 1, PICTURE_OFFSET + PICTURE_SIZE + 100,
+			       file);
+	g_assert(nbytes == PICTURE_OFFSET + PICTURE_SIZE + 100);
+	fclose(file);
+	g_free(data);
+
+	struct stat st;
+	int ret = stat(path, &st);
+	g_assert(ret == 0);
+	g_free(path);
+
+	struct song *song = g_malloc0(sizeof(*song) + strlen(name));
+	strcpy(song->uri, name);
+	song->mtime = st.st_mtime;
+	song->tag = g_new0(struct tag, 1);
+	song->tag->picture_offset = PICTURE_OFFSET;
+	song->tag->picture_size = PICTURE_SIZE;
+	return song;
+}
+
+static void
+free_song(struct song *song)
+{
+	char *path = map_song_fs(song);
+	unlink(path);
+	g_free(path);
+
+	g_free(song->tag);
+	g_free(song);
+}
+
+/**
+ * Sets the modification time of the song file to a different value,
+ * as if it had been edited after the database update.
+ */
+static void
+touch_song(const struct song *song)
+{
+	char *path = map_song_fs(song);
+	struct utimbuf times = {
+		.actime = song->mtime + 60,
+		.modtime = song->mtime + 60,
+	};
+	int ret = utime(path, &times);
+	g_assert(ret == 0);
+	g_free(path);
+}
+
+/**
+ * Reads the chunk at the specified offset and compares it with the
+ * picture.
+ */
+static void
+check_chunk(const struct song *song, size_t offset, const char *magic)
+{
+	uint8_t buffer[CHUNK_SIZE];
+	GError *error = NULL;
+	gssize nbytes = song_picture_read_chunk(song, offset, buffer,
+						sizeof(buffer), &error);
+	if (nbytes < 0) {
+		g_printerr("%s: %s\n", song->uri, error->message);
+		g_error_free(error);
+	}
+
+	g_assert(nbytes == (gssize)MIN(PICTURE_SIZE - offset, CHUNK_SIZE));
+
+	const size_t magic_length = strlen(magic);
+	for (size_t i = 0; i < (size_t)nbytes; ++i) {
+		const size_t n = offset + i;
+		const uint8_t expected = n < magic_length
+			? (uint8_t)magic[n]
+			: picture_byte(n);
+		g_assert(buffer[i] == expected);
+	}
+}
+
+/**
+ * Reads the whole picture chunk by chunk, like a client would.
+ */
+static void
+check_picture(const struct song *song, const char *magic)
+{
+	for (size_t offset = 0; offset < PICTURE_SIZE; offset += CHUNK_SIZE)
+		check_chunk(song, offset, magic);
+}
+
+static void
+check_error(const struct song *song, size_t offset, enum ack code)
+{
+	uint8_t buffer[CHUNK_SIZE];
+	GError *error = NULL;
+	gssize nbytes = song_picture_read_chunk(song, offset, buffer,
+						sizeof(buffer), &error);
+	g_assert(nbytes < 0);
+	g_assert(error != NULL);
+	g_assert(error->domain == ack_quark());
+	g_assert(error->code == (int)code);
+	g_error_free(error);
+}
+
+static unsigned
+count_cached_pictures(const char *cache_directory)
+{
+	GDir *dir = g_dir_open(cache_directory, 0, NULL);
+	g_assert(dir != NULL);
+
+	unsigned n = 0;
+	const char *name;
+	while ((name = g_dir_read_name(dir)) != NULL)
+		if (g_str_has_suffix(name, ".img"))
+			++n;
+
+	g_dir_close(dir);
+	return n;
+}
+
+static void
+clear_cache(const char *cache_directory)
+{
+	GDir *dir = g_dir_open(cache_directory, 0, NULL);
+	g_assert(dir != NULL);
+
+	const char *name;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		char *path = g_build_filename(cache_directory, name, NULL);
+		unlink(path);
+		g_free(path);
+	}
+
+	g_dir_close(dir);
+	rmdir(cache_directory);
+}
+
+static void
+test_read(void)
+{
+	struct song *song = make_song("a.flac", "\x89PNG\r\n\x1a\n");
+
+	/* offset 0, a middle offset, the last chunk */
+	check_chunk(song, 0, "\x89PNG\r\n\x1a\n");
+	check_chunk(song, 12345, "\x89PNG\r\n\x1a\n");
+	check_chunk(song, PICTURE_SIZE - 1, "\x89PNG\r\n\x1a\n");
+	check_picture(song, "\x89PNG\r\n\x1a\n");
+
+	/* offset == size: end of picture */
+	uint8_t buffer[CHUNK_SIZE];
+	GError *error = NULL;
+	gssize nbytes = song_picture_read_chunk(song, PICTURE_SIZE, buffer,
+						sizeof(buffer), &error);
+	g_assert(nbytes == 0);
+
+	check_error(song, PICTURE_SIZE + 1, ACK_ERROR_ARG);
+
+	/* the file has been modified after the database update */
+	touch_song(song);
+	check_error(song, 0, ACK_ERROR_NO_EXIST);
+
+	free_song(song);
+}
+
+static void
+test_no_picture(void)
+{
+	struct song *song = make_song("c.flac", "");
+	uint8_t buffer[CHUNK_SIZE];
+	GError *error = NULL;
+
+	song->tag->picture_size = 0;
+	gssize nbytes = song_picture_read_chunk(song, 0, buffer,
+						sizeof(buffer), &error);
+	g_assert(nbytes == 0);
+
+	g_free(song->tag);
+	song->tag = NULL;
+	nbytes = song_picture_read_chunk(song, 0, buffer, sizeof(buffer),
+					 &error);
+	g_assert(nbytes == 0);
+
+	free_song(song);
+}
+
+static void
+test_cache(void)
+{
+	char *cache_directory = g_build_filename(test_directory, "cache",
+						 NULL);
+	bool success = song_picture_global_init(cache_directory, 1024 * 1024,
+						NULL);
+	g_assert(success);
+
+	struct song *png = make_song("png.flac", "\x89PNG\r\n\x1a\n");
+	struct song *unknown = make_song("unknown.flac", "<svg");
+
+	/* the first chunk copies the picture to the cache, the
+	   following chunks are read from there, even after the song
+	   file is gone */
+	check_chunk(png, 0, "\x89PNG\r\n\x1a\n");
+	check_chunk(unknown, 0, "<svg");
+	g_assert(count_cached_pictures(cache_directory) == 2);
+
+	char *path = map_song_fs(png);
+	unlink(path);
+	g_free(path);
+	path = map_song_fs(unknown);
+	unlink(path);
+	g_free(path);
+
+	check_picture(png, "\x89PNG\r\n\x1a\n");
+	check_picture(unknown, "<svg");
+
+	/* the cache index is reloaded from the directory */
+	song_picture_global_finish();
+	success = song_picture_global_init(cache_directory, 1024 * 1024,
+					   NULL);
+	g_assert(success);
+
+	check_picture(png, "\x89PNG\r\n\x1a\n");
+
+	free_song(png);
+	free_song(unknown);
+
+	/* a file modified after the database update is not cached */
+	struct song *song = make_song("modified.flac", "GIF89a");
+	touch_song(song);
+	check_error(song, 0, ACK_ERROR_NO_EXIST);
+	g_assert(count_cached_pictures(cache_directory) == 2);
+	free_song(song);
+
+	song_picture_global_finish();
+	clear_cache(cache_directory);
+	g_free(cache_directory);
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	test_directory = g_strdup_printf("%s/test_song_picture.%d",
+					 g_get_tmp_dir(), (int)getpid());
+	if (mkdir(test_directory, 0700) < 0) {
+		perror(test_directory);
+		return 1;
+	}
+
+	test_read();
+	test_no_picture();
+	test_cache();
+
+	rmdir(test_directory);
+	g_free(test_directory);
+	return 0;
+}
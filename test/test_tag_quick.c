@@ -0,0 +1,844 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Feeds small crafted files to the header-only tag scanners, and
+ * verifies the reported duration, tags and picture position.
+ * Malformed files must be rejected, so the caller falls back to the
+ * decoder plugins.
+ */
+
+#include "config.h"
+#include "tag_quick.h"
+#include "tag_handler.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char *test_directory;
+
+struct scan_result {
+	bool has_duration;
+	unsigned duration;
+
+	char *tags[TAG_NUM_OF_ITEM_TYPES];
+
+	uint64_t picture_offset;
+	uint32_t picture_size;
+};
+
+static void
+result_duration(unsigned seconds, void *ctx)
+{
+	struct scan_result *result = ctx;
+
+	result->has_duration = true;
+	result->duration = seconds;
+}
+
+static void
+result_tag(enum tag_type type, const char *value, void *ctx)
+{
+	struct scan_result *result = ctx;
+
+	/* remember only the first value of each type */
+	if (result->tags[type] == NULL)
+		result->tags[type] = g_strdup(value);
+}
+
+static void
+result_picture(uint64_t offset, uint32_t size, void *ctx)
+{
+	struct scan_result *result = ctx;
+
+	result->picture_offset = offset;
+	result->picture_size = size;
+}
+
+static const struct tag_handler result_handler = {
+	.duration = result_duration,
+	.tag = result_tag,
+	.picture = result_picture,
+};
+
+static void
+result_clear(struct scan_result *result)
+{
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+		g_free(result->tags[i]);
+
+	memset(result, 0, sizeof(*result));
+}
+
+static bool
+tag_equals(const struct scan_result *result, enum tag_type type,
+	   const char *expected)
+{
+	return result->tags[type] != NULL &&
+		strcmp(result->tags[type], expected) == 0;
+}
+
+/**
+ * Writes the buffer to a file in the test directory, and scans it.
+ */
+static bool
+scan(const char *name, const GByteArray *data, struct scan_result *result)
+{
+	char *path = g_build_filename(test_directory, name, NULL);
+	FILE *file = fopen(path, "wb");
+	g_assert(file != NULL);
+	size_t nbytes = fwrite(data->data, 1, data->len, file);
+	g_assert(nbytes == data->len);
+	fclose(file);
+
+	memset(result, 0, sizeof(*result));
+	bool success = tag_quick_scan(path, &result_handler, result);
+
+	unlink(path);
+	g_free(path);
+
+	return success;
+}
+
+/*
+ * Helpers for building files
+ *
+ */
+
+static void
+put(GByteArray *b, const void *data, size_t length)
+{
+	g_byte_array_append(b, data, length);
+}
+
+static void
+put_string(GByteArray *b, const char *s)
+{
+	put(b, s, strlen(s));
+}
+
+static void
+put_zero(GByteArray *b, size_t length)
+{
+	const guint old_length = b->len;
+	g_byte_array_set_size(b, old_length + length);
+	memset(b->data + old_length, 0, length);
+}
+
+static void
+put_byte(GByteArray *b, unsigned value)
+{
+	const guint8 byte = value;
+	put(b, &byte, 1);
+}
+
+static void
+put_be16(GByteArray *b, unsigned value)
+{
+	put_byte(b, value >> 8);
+	put_byte(b, value);
+}
+
+static void
+put_be24(GByteArray *b, uint32_t value)
+{
+	put_byte(b, value >> 16);
+	put_be16(b, value);
+}
+
+static void
+put_be32(GByteArray *b, uint32_t value)
+{
+	put_be16(b, value >> 16);
+	put_be16(b, value);
+}
+
+static void
+put_be64(GByteArray *b, uint64_t value)
+{
+	put_be32(b, value >> 32);
+	put_be32(b, value);
+}
+
+static void
+put_le16(GByteArray *b, unsigned value)
+{
+	put_byte(b, value);
+	put_byte(b, value >> 8);
+}
+
+static void
+put_le32(GByteArray *b, uint32_t value)
+{
+	put_le16(b, value);
+	put_le16(b, value >> 16);
+}
+
+static void
+put_le64(GByteArray *b, uint64_t value)
+{
+	put_le32(b, value);
+	put_le32(b, value >> 32);
+}
+
+static void
+set_be32(GByteArray *b, guint offset, uint32_t value)
+{
+	b->data[offset] = value >> 24;
+	b->data[offset + 1] = value >> 16;
+	b->data[offset + 2] = value >> 8;
+	b->data[offset + 3] = value;
+}
+
+/**
+ * Appends a Vorbis comment block (without framing).
+ */
+static void
+put_vorbis_comments(GByteArray *b, const char *const*comments)
+{
+	unsigned n = 0;
+	while (comments[n] != NULL)
+		++n;
+
+	put_le32(b, 4);
+	put_string(b, "test");
+	put_le32(b, n);
+
+	for (unsigned i = 0; i < n; ++i) {
+		put_le32(b, strlen(comments[i]));
+		put_string(b, comments[i]);
+	}
+}
+
+/*
+ * FLAC
+ *
+ */
+
+static void
+put_flac_streaminfo(GByteArray *b, unsigned sample_rate,
+		    uint64_t total_samples)
+{
+	/* block header */
+	put_byte(b, 0);
+	put_be24(b, 34);
+
+	/* block sizes, frame sizes */
+	put_be16(b, 4096);
+	put_be16(b, 4096);
+	put_be24(b, 0);
+	put_be24(b, 0);
+
+	/* 20 bits sample rate, 3 bits channels-1, 5 bits bits-1, 36
+	   bits total samples */
+	put_byte(b, sample_rate >> 12);
+	put_byte(b, sample_rate >> 4);
+	put_byte(b, ((sample_rate & 0xf) << 4) | (1 << 1) | 0);
+	put_byte(b, (15 << 4) | ((total_samples >> 32) & 0xf));
+	put_be32(b, total_samples);
+
+	/* MD5 */
+	put_zero(b, 16);
+}
+
+/**
+ * Appends a PICTURE block.
+ *
+ * @return the offset of the image data
+ */
+static guint
+put_flac_picture(GByteArray *b, unsigned type, const char *mime,
+		 const char *description, uint32_t size, bool last)
+{
+	put_byte(b, 6 | (last ? 0x80 : 0));
+	put_be24(b, 4 + 4 + strlen(mime) + 4 + strlen(description) +
+		 16 + 4 + size);
+
+	put_be32(b, type);
+	put_be32(b, strlen(mime));
+	put_string(b, mime);
+	put_be32(b, strlen(description));
+	put_string(b, description);
+
+	/* width, height, depth, number of colors */
+	put_zero(b, 16);
+
+	put_be32(b, size);
+	const guint offset = b->len;
+	put_zero(b, size);
+	return offset;
+}
+
+static void
+test_flac(void)
+{
+	static const char *const comments[] = {
+		"TITLE=Flac Song", "ARTIST=Someone", "TRACKNUMBER=3", NULL,
+	};
+
+	GByteArray *b = g_byte_array_new();
+	struct scan_result result;
+
+	put_string(b, "fLaC");
+	put_flac_streaminfo(b, 44100, 441000);
+
+	/* the back cover comes first, but the front cover is
+	   preferred */
+	put_flac_picture(b, 4, "image/png", "", 100, false);
+	const guint front = put_flac_picture(b, 3, "image/jpeg", "front",
+					     200, false);
+
+	const guint comment_header = b->len;
+	put_byte(b, 4 | 0x80);
+	put_be24(b, 0);
+	put_vorbis_comments(b, comments);
+	b->data[comment_header + 1] = (b->len - comment_header - 4) >> 16;
+	b->data[comment_header + 2] = (b->len - comment_header - 4) >> 8;
+	b->data[comment_header + 3] = b->len - comment_header - 4;
+
+	/* a few bytes of audio frames */
+	put_zero(b, 1000);
+
+	g_assert(scan("test.flac", b, &result));
+	g_assert(result.has_duration && result.duration == 10);
+	g_assert(tag_equals(&result, TAG_TITLE, "Flac Song"));
+	g_assert(tag_equals(&result, TAG_ARTIST, "Someone"));
+	g_assert(tag_equals(&result, TAG_TRACK, "3"));
+	g_assert(result.picture_offset == front);
+	g_assert(result.picture_size == 200);
+	result_clear(&result);
+
+	/* truncated in the middle of the comment block */
+
+	g_byte_array_set_size(b, comment_header + 20);
+	g_assert(!scan("test.flac", b, &result));
+	result_clear(&result);
+
+	/* no "fLaC" marker */
+
+	g_byte_array_set_size(b, 0);
+	put_string(b, "fLaX");
+	put_flac_streaminfo(b, 44100, 441000);
+	g_assert(!scan("test.flac", b, &result));
+	result_clear(&result);
+
+	g_byte_array_free(b, true);
+}
+
+/*
+ * Ogg Vorbis
+ *
+ */
+
+static void
+put_ogg_page(GByteArray *b, unsigned flags, uint64_t granule,
+	     uint32_t serial, uint32_t sequence, const GByteArray *packet)
+{
+	put_string(b, "OggS");
+	put_byte(b, 0);
+	put_byte(b, flags);
+	put_le64(b, granule);
+	put_le32(b, serial);
+	put_le32(b, sequence);
+
+	/* the checksum is not verified */
+	put_le32(b, 0);
+
+	unsigned n_segments = packet->len / 255 + 1;
+	g_assert(n_segments <= 255);
+	put_byte(b, n_segments);
+	for (unsigned i = 0; i + 1 < n_segments; ++i)
+		put_byte(b, 255);
+	put_byte(b, packet->len % 255);
+
+	put(b, packet->data, packet->len);
+}
+
+static void
+put_ogg_vorbis(GByteArray *b, const char *const*comments,
+	       const char *identification, uint64_t granule)
+{
+	GByteArray *packet = g_byte_array_new();
+
+	put(packet, identification, 7);
+	put_le32(packet, 0);
+	put_byte(packet, 2);
+	put_le32(packet, 48000);
+	put_zero(packet, 14);
+	put_ogg_page(b, 0x02, 0, 7, 0, packet);
+
+	/* a multiplexed stream, which must be ignored */
+	g_byte_array_set_size(packet, 0);
+	put_string(packet, "junk");
+	put_ogg_page(b, 0x02, 0, 9, 0, packet);
+
+	/* the comment header spans more than one segment */
+	g_byte_array_set_size(packet, 0);
+	put_string(packet, "\003vorbis");
+	put_vorbis_comments(packet, comments);
+	put_zero(packet, 300);
+	put_ogg_page(b, 0, 0, 7, 1, packet);
+
+	g_byte_array_set_size(packet, 0);
+	put_zero(packet, 1000);
+	put_ogg_page(b, 0, 48000 * 5, 7, 2, packet);
+	put_ogg_page(b, 0x04, granule, 7, 3, packet);
+
+	g_byte_array_free(packet, true);
+}
+
+static void
+test_ogg(void)
+{
+	static const char *const comments[] = {
+		"TITLE=Ogg Song", "ALBUM=Ogg Album", NULL,
+	};
+
+	GByteArray *b = g_byte_array_new();
+	struct scan_result result;
+
+	put_ogg_vorbis(b, comments, "\001vorbis", 48000 * 125 + 20000);
+	g_assert(scan("test.ogg", b, &result));
+	g_assert(result.has_duration && result.duration == 125);
+	g_assert(tag_equals(&result, TAG_TITLE, "Ogg Song"));
+	g_assert(tag_equals(&result, TAG_ALBUM, "Ogg Album"));
+	result_clear(&result);
+
+	/* truncated in the middle of the comment page */
+
+	g_byte_array_set_size(b, 0);
+	put_ogg_vorbis(b, comments, "\001vorbis", 48000 * 125);
+	g_byte_array_set_size(b, 160);
+	g_assert(!scan("test.ogg", b, &result));
+	result_clear(&result);
+
+	/* other codecs are left to the decoder plugins */
+
+	g_byte_array_set_size(b, 0);
+	put_ogg_vorbis(b, comments, "\177FLAC\001", 48000 * 125);
+	g_assert(!scan("test.oga", b, &result));
+	result_clear(&result);
+
+	g_byte_array_free(b, true);
+}
+
+/*
+ * MP3
+ *
+ */
+
+enum {
+	/** MPEG 1 layer 3, 128 kbit/s, 44.1 kHz, stereo */
+	MP3_FRAME_LENGTH = 417,
+};
+
+static void
+put_mp3_frame_header(GByteArray *b)
+{
+	put_byte(b, 0xff);
+	put_byte(b, 0xfb);
+	put_byte(b, 0x90);
+	put_byte(b, 0x00);
+}
+
+/**
+ * Appends an ID3v2.3 tag with one APIC frame.
+ *
+ * @return the offset of the image data
+ */
+static guint
+put_id3v2_apic(GByteArray *b, uint32_t size)
+{
+	static const char apic_header[] = "\000image/jpeg\000\003cover";
+
+	put_string(b, "ID3");
+	put_byte(b, 3);
+	put_byte(b, 0);
+	put_byte(b, 0);
+
+	/* the tag size, syncsafe; plus some padding */
+	const uint32_t tag_size = 10 + sizeof(apic_header) + size + 64;
+	put_byte(b, (tag_size >> 21) & 0x7f);
+	put_byte(b, (tag_size >> 14) & 0x7f);
+	put_byte(b, (tag_size >> 7) & 0x7f);
+	put_byte(b, tag_size & 0x7f);
+
+	put_string(b, "APIC");
+	put_be32(b, sizeof(apic_header) + size);
+	put_be16(b, 0);
+
+	/* including the null terminator of the description */
+	put(b, apic_header, sizeof(apic_header));
+
+	const guint offset = b->len;
+	put_zero(b, size);
+	put_zero(b, 64);
+	return offset;
+}
+
+static void
+test_mp3_xing(void)
+{
+	GByteArray *b = g_byte_array_new();
+	struct scan_result result;
+
+	const guint picture = put_id3v2_apic(b, 300);
+
+	/* the Xing frame with a LAME tag */
+	const guint frame = b->len;
+	put_mp3_frame_header(b);
+	put_zero(b, 32);
+	put_string(b, "Xing");
+	/* frames, bytes, TOC, scale */
+	put_be32(b, 0xf);
+	put_be32(b, 3849);
+	put_be32(b, 3849 * MP3_FRAME_LENGTH);
+	put_zero(b, 100);
+	put_be32(b, 0);
+	put_string(b, "LAME3.99r");
+	put_zero(b, 12);
+	/* encoder delay and padding: 4095 samples each */
+	put_byte(b, 0xff);
+	put_byte(b, 0xff);
+	put_byte(b, 0xff);
+	put_zero(b, frame + MP3_FRAME_LENGTH - b->len);
+
+	for (unsigned i = 0; i < 4; ++i) {
+		put_mp3_frame_header(b);
+		put_zero(b, MP3_FRAME_LENGTH - 4);
+	}
+
+	/* 3849 * 1152 samples would be 100.545 seconds; minus the
+	   delay and the padding, it's 100.36 */
+	g_assert(scan("test.mp3", b, &result));
+	g_assert(result.has_duration && result.duration == 100);
+	g_assert(result.picture_offset == picture);
+	g_assert(result.picture_size == 300);
+	result_clear(&result);
+
+	g_byte_array_free(b, true);
+}
+
+static void
+test_mp3_vbri(void)
+{
+	GByteArray *b = g_byte_array_new();
+	struct scan_result result;
+
+	put_mp3_frame_header(b);
+	put_zero(b, 32);
+	put_string(b, "VBRI");
+	/* version, delay, quality, bytes */
+	put_be16(b, 1);
+	put_be16(b, 0);
+	put_be16(b, 75);
+	put_be32(b, 3849 * MP3_FRAME_LENGTH);
+	put_be32(b, 3849);
+	put_zero(b, MP3_FRAME_LENGTH - b->len);
+
+	for (unsigned i = 0; i < 4; ++i) {
+		put_mp3_frame_header(b);
+		put_zero(b, MP3_FRAME_LENGTH - 4);
+	}
+
+	g_assert(scan("test.mp3", b, &result));
+	g_assert(result.has_duration && result.duration == 101);
+	g_assert(result.picture_size == 0);
+	result_clear(&result);
+
+	g_byte_array_free(b, true);
+}
+
+static void
+test_mp3_malformed(void)
+{
+	GByteArray *b = g_byte_array_new();
+	struct scan_result result;
+
+	/* no frame sync at all */
+
+	for (unsigned i = 0; i < 4096; ++i)
+		put_byte(b, i * 7);
+	g_assert(!scan("test.mp3", b, &result));
+	result_clear(&result);
+
+	/* the ID3v2 tag claims to be larger than the file */
+
+	g_byte_array_set_size(b, 0);
+	put_id3v2_apic(b, 300);
+	g_byte_array_set_size(b, 200);
+	g_assert(!scan("test.mp3", b, &result));
+	result_clear(&result);
+
+	g_byte_array_free(b, true);
+}
+
+/*
+ * MP4
+ *
+ */
+
+/**
+ * Begins a box with a 64 bit size.  The size is filled in by
+ * end_box64().
+ */
+static guint
+begin_box64(GByteArray *b, const char *type)
+{
+	const guint offset = b->len;
+	put_be32(b, 1);
+	put_string(b, type);
+	put_be64(b, 0);
+	return offset;
+}
+
+static void
+end_box64(GByteArray *b, guint offset)
+{
+	const uint64_t size = b->len - offset;
+	set_be32(b, offset + 8, size >> 32);
+	set_be32(b, offset + 12, size);
+}
+
+static guint
+begin_box(GByteArray *b, const char *type)
+{
+	const guint offset = b->len;
+	put_be32(b, 0);
+	put_string(b, type);
+	return offset;
+}
+
+static void
+end_box(GByteArray *b, guint offset)
+{
+	set_be32(b, offset, b->len - offset);
+}
+
+static void
+put_mp4_item(GByteArray *b, const char *type, uint32_t data_type,
+	     const void *value, size_t length)
+{
+	const guint item = begin_box(b, type);
+	const guint data = begin_box(b, "data");
+	put_be32(b, data_type);
+	put_be32(b, 0);
+	put(b, value, length);
+	end_box(b, data);
+	end_box(b, item);
+}
+
+static void
+test_mp4(void)
+{
+	static const uint8_t trkn[] = { 0, 0, 0, 5, 0, 12, 0, 0 };
+
+	GByteArray *b = g_byte_array_new();
+	struct scan_result result;
+
+	guint box = begin_box(b, "ftyp");
+	put_string(b, "M4A ");
+	put_be32(b, 0);
+	end_box(b, box);
+
+	/* "mdat" before "moov", with a 64 bit size */
+	box = begin_box64(b, "mdat");
+	put_zero(b, 1000);
+	end_box64(b, box);
+
+	const guint moov = begin_box64(b, "moov");
+
+	/* version 1: 64 bit times and duration */
+	box = begin_box(b, "mvhd");
+	put_byte(b, 1);
+	put_be24(b, 0);
+	put_be64(b, 0);
+	put_be64(b, 0);
+	put_be32(b, 1000);
+	put_be64(b, 183500);
+	put_zero(b, 80);
+	end_box(b, box);
+
+	box = begin_box(b, "trak");
+	put_zero(b, 300);
+	end_box(b, box);
+
+	const guint udta = begin_box(b, "udta");
+	const guint meta = begin_box(b, "meta");
+	put_be32(b, 0);
+	box = begin_box(b, "hdlr");
+	put_zero(b, 25);
+	end_box(b, box);
+
+	const guint ilst = begin_box(b, "ilst");
+	put_mp4_item(b, "\251nam", 1, "Mp4 Song", 8);
+
+	box = begin_box(b, "covr");
+	const guint data = begin_box(b, "data");
+	put_be32(b, 13);
+	put_be32(b, 0);
+	const guint cover = b->len;
+	put_zero(b, 500);
+	end_box(b, data);
+	end_box(b, box);
+
+	put_mp4_item(b, "trkn", 0, trkn, sizeof(trkn));
+	put_mp4_item(b, "\251ART", 1, "Mp4 Artist", 10);
+	end_box(b, ilst);
+
+	end_box(b, meta);
+	end_box(b, udta);
+	end_box64(b, moov);
+
+	/* 183.5 seconds, rounded */
+	g_assert(scan("test.m4a", b, &result));
+	g_assert(result.has_duration && result.duration == 184);
+	g_assert(tag_equals(&result, TAG_TITLE, "Mp4 Song"));
+	g_assert(tag_equals(&result, TAG_ARTIST, "Mp4 Artist"));
+	g_assert(tag_equals(&result, TAG_TRACK, "5"));
+	g_assert(result.picture_offset == cover);
+	g_assert(result.picture_size == 500);
+	result_clear(&result);
+
+	/* the "moov" box claims to be larger than the file */
+
+	g_byte_array_set_size(b, b->len - 1);
+	g_assert(!scan("test.m4a", b, &result));
+	result_clear(&result);
+
+	g_byte_array_free(b, true);
+}
+
+/*
+ * WAV
+ *
+ */
+
+static void
+put_wav(GByteArray *b, bool with_data)
+{
+	put_string(b, "RIFF");
+	put_le32(b, 0);
+	put_string(b, "WAVE");
+
+	/* 8 kHz, mono, 8 bit */
+	put_string(b, "fmt ");
+	put_le32(b, 16);
+	put_le16(b, 1);
+	put_le16(b, 1);
+	put_le32(b, 8000);
+	put_le32(b, 8000);
+	put_le16(b, 1);
+	put_le16(b, 8);
+
+	/* an odd-sized LIST chunk with an odd-sized item, followed
+	   by pad bytes */
+	put_string(b, "LIST");
+	put_le32(b, 4 + 8 + 6 + 8 + 3);
+	put_string(b, "INFO");
+	put_string(b, "INAM");
+	put_le32(b, 6);
+	put(b, "Hello", 6);
+	put_string(b, "IART");
+	put_le32(b, 3);
+	put_string(b, "Bob");
+	put_byte(b, 0);
+
+	if (with_data) {
+		put_string(b, "data");
+		put_le32(b, 24000);
+		put_zero(b, 24000);
+	}
+
+	b->data[4] = b->len - 8;
+	b->data[5] = (b->len - 8) >> 8;
+	b->data[6] = (b->len - 8) >> 16;
+}
+
+static void
+test_wav(void)
+{
+	GByteArray *b = g_byte_array_new();
+	struct scan_result result;
+
+	put_wav(b, true);
+	g_assert(scan("test.wav", b, &result));
+	g_assert(result.has_duration && result.duration == 3);
+	g_assert(tag_equals(&result, TAG_TITLE, "Hello"));
+	g_assert(tag_equals(&result, TAG_ARTIST, "Bob"));
+	result_clear(&result);
+
+	/* no "data" chunk */
+
+	g_byte_array_set_size(b, 0);
+	put_wav(b, false);
+	g_assert(!scan("test.wav", b, &result));
+	result_clear(&result);
+
+	g_byte_array_free(b, true);
+}
+
+static void
+test_unsupported(void)
+{
+	GByteArray *b = g_byte_array_new();
+	struct scan_result result;
+
+	put_string(b, "fLaC");
+	put_flac_streaminfo(b, 44100, 441000);
+	b->data[4] |= 0x80;
+
+	g_assert(scan("test.flac", b, &result));
+	result_clear(&result);
+
+	/* the suffix selects the scanner */
+	g_assert(!scan("test.xyz", b, &result));
+	g_assert(!scan("test.mp3", b, &result));
+	result_clear(&result);
+
+	g_byte_array_free(b, true);
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	test_directory = g_strdup_printf("%s/test_tag_quick.%d",
+					 g_get_tmp_dir(), (int)getpid());
+	if (mkdir(test_directory, 0700) < 0) {
+		perror(test_directory);
+		return 1;
+	}
+
+	test_flac();
+	test_ogg();
+	test_mp3_xing();
+	test_mp3_vbri();
+	test_mp3_malformed();
+	test_mp4();
+	test_wav();
+	test_unsupported();
+
+	rmdir(test_directory);
+	g_free(test_directory);
+	return 0;
+}